@@ -0,0 +1,82 @@
+#ifndef LIDARVALUE_H
+#define LIDARVALUE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define VALUE_INT                 0                 // Value is a plain int, as every message was before typed values
+#define VALUE_FIXED               1                 // Value is fixed point with VALUE_FRACTION_BITS fractional bits
+#define VALUE_FLOAT               2                 // Value holds the bits of an IEEE 754 float
+#define VALUE_FRACTION_BITS       8                 // Q23.8: 1/256 mm resolution over +/-8 km
+#define VALUE_TYPE_SHIFT          16                // Value type sits in the Descriptor, above the descriptor itself
+#define DESCRIPTOR_MASK           0xFFFF
+#define CAP_TYPED_VALUES          0x01              // Capability: understands typed values
+
+/**
+ * Optional trailer after the 20 byte message. Older clients only read the first MESSAGE_SIZE bytes, so they
+ * never see it.
+ */
+struct __attribute__((packed)) MessageExtension {
+    uint16_t Signal;        // Sensor signal strength (return count), 0 if unknown
+    uint16_t Ambient;       // Sensor ambient light (count), 0 if unknown
+};
+
+/**
+ * Trailer after a MSG_ID, saying what the sender can decode. Older clients send none, so have no capabilities.
+ */
+struct __attribute__((packed)) IdExtension {
+    uint32_t Capabilities;  // CAP_* flags
+};
+
+/**
+ * Descriptor as sent: the descriptor in the low 16 bits and the value's type above it.
+ * Untyped messages are unchanged. Older clients don't recognise a typed descriptor, so only send one to clients
+ * that advertised CAP_TYPED_VALUES.
+ */
+inline int packDescriptor(int descriptor, int valueType)
+{
+    return (descriptor & DESCRIPTOR_MASK) | (valueType << VALUE_TYPE_SHIFT);
+}
+
+inline int unpackDescriptor(int packed)
+{
+    return packed & DESCRIPTOR_MASK;
+}
+
+inline int unpackValueType(int packed)
+{
+    return (packed >> VALUE_TYPE_SHIFT) & 0xFF;
+}
+
+/**
+ * Turn a value into the 32 bits sent in Value. A multiply and a round for fixed point, a copy for float.
+ */
+inline int encodeValue(float value, int valueType)
+{
+    int encoded;
+    switch (valueType) {
+        case VALUE_FIXED:
+            return (int)(value * (1 << VALUE_FRACTION_BITS) + (value < 0 ? -0.5f : 0.5f));
+
+        case VALUE_FLOAT:
+            memcpy(&encoded, &value, sizeof encoded);
+            return encoded;
+    }
+    return (int)(value + (value < 0 ? -0.5f : 0.5f));
+}
+
+inline float decodeValue(int encoded, int valueType)
+{
+    float value;
+    switch (valueType) {
+        case VALUE_FIXED:
+            return encoded * (1.0f / (1 << VALUE_FRACTION_BITS));
+
+        case VALUE_FLOAT:
+            memcpy(&value, &encoded, sizeof value);
+            return value;
+    }
+    return encoded;
+}
+
+#endif
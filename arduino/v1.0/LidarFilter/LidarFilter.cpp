@@ -0,0 +1,62 @@
+#include "LidarFilter.h"
+#include <math.h>
+
+/**
+ * Mean of the values left after dropping trimPercent of them from each end. The values are sorted in place.
+ */
+float trimmedMean(float *values, int count, int trimPercent)
+{
+    if (count <= 0)
+        return 0;
+
+    insertionSort(values, count);
+
+    int trim = count * trimPercent / 100;
+    if (trim * 2 >= count)
+        trim = (count - 1) / 2;
+
+    float total = 0;
+    for (int i = trim; i < count - trim; i++)
+        total += values[i];
+    return total / (count - trim * 2);
+}
+
+/**
+ * Median of each value's distance from the median. Robust where a standard deviation is thrown by a single
+ * bad reading. The values are left untouched.
+ */
+float medianAbsoluteDeviation(float *values, int count, float median)
+{
+    float deviations[FILTER_MAX_VALUES];
+    if (count > FILTER_MAX_VALUES)
+        count = FILTER_MAX_VALUES;
+
+    for (int i = 0; i < count; i++)
+        deviations[i] = fabsf(values[i] - median);
+    return smallMedian(deviations, count);
+}
+
+/**
+ * Mean of the values within threshold scaled MADs of their median. Falls back to the median itself when
+ * the values are too tightly grouped for the MAD to mean anything. The values are reordered.
+ */
+float rejectOutliersMean(float *values, int count, float threshold)
+{
+    if (count <= 0)
+        return 0;
+
+    float median = smallMedian(values, count);
+    float limit = threshold * FILTER_MAD_SCALE * medianAbsoluteDeviation(values, count, median);
+    if (limit <= 0)
+        return median;
+
+    float total = 0;
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (fabsf(values[i] - median) <= limit) {
+            total += values[i];
+            kept++;
+        }
+    }
+    return kept > 0 ? total / kept : median;
+}
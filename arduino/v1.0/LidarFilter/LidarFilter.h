@@ -0,0 +1,266 @@
+#ifndef LIDARFILTER_H
+#define LIDARFILTER_H
+
+#define FILTER_MAD_SCALE          1.4826f           // Scales MAD to a standard deviation for normally distributed noise
+#define FILTER_MAD_THRESHOLD      3.0f              // Default: readings more than this many scaled MADs from the median are outliers
+#define FILTER_MAX_VALUES         64                // Most values the MAD helpers look at
+
+/**
+ * Compare-exchange used by the sorting networks: leaves the smaller value in a
+ */
+template <typename T>
+inline void filterSort2(T &a, T &b)
+{
+    // Written as two selects so the compiler can use conditional moves rather than a branch
+    T low = b < a ? b : a;
+    T high = b < a ? a : b;
+    a = low;
+    b = high;
+}
+
+/**
+ * Median of 3, 5, 7 or 9 values with a fixed sorting network: no branches on the data beyond the
+ * compare-exchanges, no copies beyond the swaps. The values are reordered.
+ */
+template <typename T>
+inline T median3(T *p)
+{
+    filterSort2(p[0], p[1]); filterSort2(p[1], p[2]); filterSort2(p[0], p[1]);
+    return p[1];
+}
+
+template <typename T>
+inline T median5(T *p)
+{
+    filterSort2(p[0], p[1]); filterSort2(p[3], p[4]); filterSort2(p[0], p[3]);
+    filterSort2(p[1], p[4]); filterSort2(p[1], p[2]); filterSort2(p[2], p[3]);
+    filterSort2(p[1], p[2]);
+    return p[2];
+}
+
+template <typename T>
+inline T median7(T *p)
+{
+    filterSort2(p[0], p[5]); filterSort2(p[0], p[3]); filterSort2(p[1], p[6]);
+    filterSort2(p[2], p[4]); filterSort2(p[0], p[1]); filterSort2(p[3], p[5]);
+    filterSort2(p[2], p[6]); filterSort2(p[2], p[3]); filterSort2(p[3], p[6]);
+    filterSort2(p[4], p[5]); filterSort2(p[1], p[4]); filterSort2(p[1], p[3]);
+    filterSort2(p[3], p[4]);
+    return p[3];
+}
+
+template <typename T>
+inline T median9(T *p)
+{
+    filterSort2(p[1], p[2]); filterSort2(p[4], p[5]); filterSort2(p[7], p[8]);
+    filterSort2(p[0], p[1]); filterSort2(p[3], p[4]); filterSort2(p[6], p[7]);
+    filterSort2(p[1], p[2]); filterSort2(p[4], p[5]); filterSort2(p[7], p[8]);
+    filterSort2(p[0], p[3]); filterSort2(p[5], p[8]); filterSort2(p[4], p[7]);
+    filterSort2(p[3], p[6]); filterSort2(p[1], p[4]); filterSort2(p[2], p[5]);
+    filterSort2(p[4], p[7]); filterSort2(p[4], p[2]); filterSort2(p[6], p[4]);
+    filterSort2(p[4], p[2]);
+    return p[4];
+}
+
+/**
+ * Sort a handful of values in place. Insertion sort beats anything cleverer at these sizes.
+ */
+template <typename T>
+void insertionSort(T *values, int count)
+{
+    for (int i = 1; i < count; i++) {
+        T value = values[i];
+        int j = i - 1;
+        for (; j >= 0 && value < values[j]; j--)
+            values[j + 1] = values[j];
+        values[j + 1] = value;
+    }
+}
+
+/**
+ * Median of a small set of values, using a sorting network where there is one. Even counts give the
+ * mean of the middle two. The values are reordered.
+ */
+template <typename T>
+T smallMedian(T *values, int count)
+{
+    switch (count) {
+        case 0: return T();
+        case 1: return values[0];
+        case 3: return median3(values);
+        case 5: return median5(values);
+        case 7: return median7(values);
+        case 9: return median9(values);
+    }
+
+    insertionSort(values, count);
+    if (count & 1)
+        return values[count / 2];
+    return (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * Median of the last N values, updated in O(log N) per value with O(1) reads.
+ *
+ * The window is held as two heaps sharing one array around the median: a max-heap of the lower half at
+ * negative indices and a min-heap of the upper half at positive ones, with the median at index 0. Each new
+ * value overwrites the oldest in place and is sifted through whichever heap it landed in, so nothing is
+ * ever allocated or searched for.
+ */
+template <typename T, int N>
+class SlidingMedian {
+    static_assert(N >= 1, "SlidingMedian window must hold at least one value");
+
+    private:
+        T values[N];            // Ring of the window's values, oldest at next
+        int positions[N];       // Heap index of each value
+        int storage[N];         // Value index at each heap position
+        int *heap;              // storage, re-centred so the median is heap[0]
+        int next;
+        int count;
+
+        int minCount() { return (count - 1) / 2; }
+        int maxCount() { return count / 2; }
+
+        bool isLess(int i, int j) { return values[heap[i]] < values[heap[j]]; }
+
+        /**
+         * Swap heap positions i and j if i holds the smaller value. Returns whether they were swapped.
+         */
+        bool exchangeIfLess(int i, int j)
+        {
+            if (!isLess(i, j))
+                return false;
+
+            int swap = heap[i];
+            heap[i] = heap[j];
+            heap[j] = swap;
+            positions[heap[i]] = i;
+            positions[heap[j]] = j;
+            return true;
+        }
+
+        void minSortDown(int i)
+        {
+            for (; i <= minCount(); i *= 2) {
+                if (i > 1 && i < minCount() && isLess(i + 1, i))
+                    ++i;
+                if (!exchangeIfLess(i, i / 2))
+                    break;
+            }
+        }
+
+        void maxSortDown(int i)
+        {
+            for (; i >= -maxCount(); i *= 2) {
+                if (i < -1 && i > -maxCount() && isLess(i, i - 1))
+                    --i;
+                if (!exchangeIfLess(i / 2, i))
+                    break;
+            }
+        }
+
+        /**
+         * Sift up towards the median. Returns true if the value became the median.
+         */
+        bool minSortUp(int i)
+        {
+            while (i > 0 && exchangeIfLess(i, i / 2))
+                i /= 2;
+            return i == 0;
+        }
+
+        bool maxSortUp(int i)
+        {
+            while (i < 0 && exchangeIfLess(i / 2, i))
+                i /= 2;
+            return i == 0;
+        }
+
+    public:
+        SlidingMedian()
+        {
+            heap = storage + N / 2;
+            reset();
+        }
+
+        /**
+         * Empty the window, e.g. when the sensor moves to a new step
+         */
+        void reset()
+        {
+            next = 0;
+            count = 0;
+            // Slots alternate between the two heaps as the window first fills
+            for (int i = N - 1; i >= 0; i--) {
+                positions[i] = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+                heap[positions[i]] = i;
+                values[i] = T();
+            }
+        }
+
+        /**
+         * Add a value, dropping the oldest once the window is full
+         */
+        void add(T value)
+        {
+            bool isNew = count < N;
+            int position = positions[next];
+            T old = values[next];
+            values[next] = value;
+            next = (next + 1) % N;
+            if (isNew)
+                count++;
+
+            if (position > 0) {
+                if (!isNew && old < value)
+                    minSortDown(position * 2);
+                else if (minSortUp(position))
+                    maxSortDown(-1);
+            } else if (position < 0) {
+                if (!isNew && value < old)
+                    maxSortDown(position * 2);
+                else if (maxSortUp(position))
+                    minSortDown(1);
+            } else {
+                if (maxCount())
+                    maxSortDown(-1);
+                if (minCount())
+                    minSortDown(1);
+            }
+        }
+
+        /**
+         * Median of the window; the mean of the middle two when it holds an even number of values
+         */
+        T median()
+        {
+            if (count == 0)
+                return T();
+
+            T value = values[heap[0]];
+            if ((count & 1) == 0)
+                value = (value + values[heap[-1]]) / 2;
+            return value;
+        }
+
+        int size() { return count; }
+        int capacity() { return N; }
+        bool isFull() { return count == N; }
+
+        /**
+         * Copy the window's values, in no particular order, for statistics the heaps can't answer
+         */
+        int copyTo(T *out)
+        {
+            for (int i = 0; i < count; i++)
+                out[i] = values[i];
+            return count;
+        }
+};
+
+float trimmedMean(float *values, int count, int trimPercent);
+float medianAbsoluteDeviation(float *values, int count, float median);
+float rejectOutliersMean(float *values, int count, float threshold = FILTER_MAD_THRESHOLD);
+
+#endif
@@ -0,0 +1,92 @@
+#include "StepRamp.h"
+#include <math.h>
+
+/**
+ * Default ramp: no acceleration, 100 steps/s. Call build() before use.
+ */
+StepRamp::StepRamp()
+{
+    intervals[0] = 10000;
+    length = 1;
+}
+
+/**
+ * Time (s) from rest to `steps` steps at constant acceleration
+ */
+float StepRamp::trapezoidTime(int steps, float acceleration)
+{
+    return sqrtf(2.0f * steps / acceleration);
+}
+
+/**
+ * Time (s) from rest to `steps` steps when speed follows a smoothstep up to maxSpeed over rampTime. Position
+ * is maxSpeed * rampTime * (x^3 - x^4 / 2) for x = t / rampTime, which has no neat inverse, so bisect.
+ */
+float StepRamp::sCurveTime(int steps, float maxSpeed, float rampTime)
+{
+    float low = 0, high = 1;
+    for (int i = 0; i < MOTION_SCURVE_SEARCHES; i++) {
+        float x = (low + high) / 2;
+        float position = maxSpeed * rampTime * x * x * x * (1 - x / 2);
+        if (position < steps)
+            low = x;
+        else
+            high = x;
+    }
+    return high * rampTime;
+}
+
+/**
+ * Work out the ramp for a profile. Speeds are in steps/s and acceleration in steps/s^2; for the S-curve,
+ * acceleration is the peak reached halfway up the ramp. Steps slower than startSpeed (the speed the motor
+ * can start at from rest) are brought up to it. Returns false, leaving the ramp as it was, if the
+ * parameters make no sense.
+ */
+bool StepRamp::build(int profile, float maxSpeed, float acceleration, float startSpeed)
+{
+    if (maxSpeed <= 0 || acceleration <= 0 || startSpeed < 0)
+        return false;
+
+    float cruise = 1000000.0f / maxSpeed;
+    if (cruise < MOTION_MIN_INTERVAL)
+        cruise = MOTION_MIN_INTERVAL;
+    float slowest = startSpeed > 0 ? 1000000.0f / startSpeed : 0;
+
+    // Smoothstep's steepest slope is 1.5x its average, so this ramp time peaks at the acceleration asked for
+    float rampTime = 1.5f * maxSpeed / acceleration;
+    float rampSteps = maxSpeed * rampTime / 2;
+
+    float previous = 0;
+    length = 0;
+    while (length < MOTION_RAMP_SIZE) {
+        int steps = length + 1;
+        if (profile == MOTION_SCURVE && steps > rampSteps)
+            break;
+
+        float time = profile == MOTION_SCURVE ? sCurveTime(steps, maxSpeed, rampTime) : trapezoidTime(steps, acceleration);
+        float interval = (time - previous) * 1000000.0f;
+        previous = time;
+        if (interval <= cruise)
+            break;
+
+        if (slowest > 0 && interval > slowest)
+            interval = slowest;
+        intervals[length++] = (uint32_t)(interval + 0.5f);
+    }
+
+    // Cruise at the speed asked for, or wherever a ramp too long for the table got to
+    if (length < MOTION_RAMP_SIZE)
+        intervals[length++] = (uint32_t)(cruise + 0.5f);
+    return true;
+}
+
+/**
+ * Total time (us) a move of `steps` takes from rest to rest
+ */
+uint32_t StepRamp::getMoveTime(int steps) const
+{
+    uint32_t total = 0;
+    for (int i = 0; i < steps; i++)
+        total += getInterval(i, steps);
+    return total;
+}
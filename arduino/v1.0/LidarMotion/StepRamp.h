@@ -0,0 +1,44 @@
+#ifndef STEPRAMP_H
+#define STEPRAMP_H
+
+#include <stdint.h>
+
+#define MOTION_TRAPEZOID          0                 // Constant acceleration up to speed
+#define MOTION_SCURVE             1                 // Acceleration eases in and out, so jerk is limited
+#define MOTION_RAMP_SIZE          512               // Most steps a ramp can take to reach speed; beyond that it cruises early
+#define MOTION_MIN_INTERVAL       20                // Shortest interval (us) the ramp will give, whatever the speed asked for
+#define MOTION_SCURVE_SEARCHES    24                // Bisection rounds to place each S-curve step in time
+
+/**
+ * Step intervals for accelerating from rest to a cruise speed, worked out once so that the step timer only has
+ * to look them up. Deceleration is the same ramp read backwards, so moves are symmetric and every step
+ * interval is a table read: nothing in the timer interrupt needs floating point.
+ */
+class StepRamp {
+    private:
+        uint32_t intervals[MOTION_RAMP_SIZE];   // Wait (us) before each step of the ramp, the last being the cruise
+        int length;
+
+        float trapezoidTime(int steps, float acceleration);
+        float sCurveTime(int steps, float maxSpeed, float rampTime);
+
+    public:
+        StepRamp();
+        bool build(int profile, float maxSpeed, float acceleration, float startSpeed = 0);
+
+        /**
+         * Wait (us) before step `step` of a move `steps` long
+         */
+        uint32_t getInterval(int step, int steps) const
+        {
+            int fromEnd = steps - 1 - step;
+            int index = step < fromEnd ? step : fromEnd;
+            return intervals[index < length ? index : length - 1];
+        }
+
+        uint32_t getCruiseInterval() const { return intervals[length - 1]; }
+        int getLength() const { return length; }
+        uint32_t getMoveTime(int steps) const;
+};
+
+#endif
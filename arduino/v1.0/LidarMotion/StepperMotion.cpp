@@ -0,0 +1,78 @@
+#include "StepperMotion.h"
+
+StepperMotion::StepperMotion() : head(0), tail(0), position(0), target(0), moving(false)
+{
+    direction = 1;
+    step = 0;
+    steps = 0;
+}
+
+/**
+ * Set the speed profile. Only while stopped: the timer reads the ramp without locking.
+ */
+bool StepperMotion::configure(int profile, float maxSpeed, float acceleration, float startSpeed)
+{
+    if (isMoving())
+        return false;
+    return ramp.build(profile, maxSpeed, acceleration, startSpeed);
+}
+
+/**
+ * Queue a move to an absolute step. Returns false if the queue is full.
+ */
+bool StepperMotion::moveTo(int target)
+{
+    uint32_t writeAt = head.load(std::memory_order_relaxed);
+    if (writeAt - tail.load(std::memory_order_acquire) >= MOTION_QUEUE_SIZE)
+        return false;
+
+    targets[writeAt & (MOTION_QUEUE_SIZE - 1)] = target;
+    this->target.store(target, std::memory_order_relaxed);
+    head.store(writeAt + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Say where the motor is, e.g. from a saved step. Only while stopped.
+ */
+void StepperMotion::setPosition(int position)
+{
+    if (isMoving())
+        return;
+    this->position.store(position, std::memory_order_release);
+    target.store(position, std::memory_order_relaxed);
+}
+
+/**
+ * Called by the step timer. Takes the next step if one is due and returns the wait (us) until the next call.
+ */
+MOTION_ISR_ATTR uint32_t StepperMotion::tick()
+{
+    if (steps > 0) {
+        position.store(position.load(std::memory_order_relaxed) + direction, std::memory_order_release);
+        if (++step < steps)
+            return ramp.getInterval(step, steps);
+        steps = 0;
+    }
+
+    // Start the next queued move, skipping any that go nowhere
+    uint32_t readAt = tail.load(std::memory_order_relaxed);
+    while (readAt != head.load(std::memory_order_acquire)) {
+        // Moving before the queue empties, so isMoving() never sees a gap between the two
+        moving.store(true, std::memory_order_release);
+        int next = targets[readAt & (MOTION_QUEUE_SIZE - 1)];
+        tail.store(++readAt, std::memory_order_release);
+
+        int distance = next - position.load(std::memory_order_relaxed);
+        if (distance == 0)
+            continue;
+
+        direction = distance > 0 ? 1 : -1;
+        steps = distance * direction;
+        step = 0;
+        return ramp.getInterval(0, steps);
+    }
+
+    moving.store(false, std::memory_order_release);
+    return MOTION_IDLE_INTERVAL;
+}
@@ -0,0 +1,61 @@
+#ifndef STEPPERMOTION_H
+#define STEPPERMOTION_H
+
+#include <stdint.h>
+#include <atomic>
+#include "StepRamp.h"
+
+#define MOTION_QUEUE_SIZE         8                 // Targets that can be waiting behind the current move (power of two)
+#define MOTION_IDLE_INTERVAL      1000              // Interval (us) between looks at the queue while stopped
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <esp_attr.h>
+#define MOTION_ISR_ATTR           IRAM_ATTR
+#else
+#define MOTION_ISR_ATTR
+#endif
+
+/**
+ * Step generator for a timer interrupt. The comms side queues targets with moveTo() and reads back where the
+ * motor is with getPosition(); the timer calls tick(), which takes at most one step and returns how long
+ * until it wants calling again. Moves run from rest to rest along the StepRamp, one queued target after
+ * another.
+ *
+ * One task may call moveTo() and one interrupt (or thread) may call tick(). Everything else may be read from
+ * anywhere.
+ */
+class StepperMotion {
+    private:
+        StepRamp ramp;
+        int targets[MOTION_QUEUE_SIZE];
+        std::atomic<uint32_t> head;         // Next target slot to write, owned by moveTo()
+        std::atomic<uint32_t> tail;         // Next target slot to read, owned by tick()
+        std::atomic<int> position;
+        std::atomic<int> target;            // Last target queued
+        std::atomic<bool> moving;
+        int direction;
+        int step;                           // Steps taken in the current move
+        int steps;                          // Length of the current move
+
+    public:
+        StepperMotion();
+        bool configure(int profile, float maxSpeed, float acceleration, float startSpeed = 0);
+        bool moveTo(int target);
+        void setPosition(int position);
+        MOTION_ISR_ATTR uint32_t tick();
+
+        int getPosition() const { return position.load(std::memory_order_acquire); }
+        int getTarget() const { return target.load(std::memory_order_relaxed); }
+        const StepRamp &getRamp() const { return ramp; }
+
+        /**
+         * Whether the motor is moving or has moves waiting
+         */
+        bool isMoving() const
+        {
+            return moving.load(std::memory_order_acquire)
+                || head.load(std::memory_order_acquire) != tail.load(std::memory_order_acquire);
+        }
+};
+
+#endif
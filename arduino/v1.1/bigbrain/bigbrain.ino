@@ -1,270 +1,826 @@
-/**
- * Bigbrain v1.1
- * -------------
- * Bigbrain sets up a Wifi AP to allow comms, and feeds data back to the PC via serial.
- */
-
-#define CLIENT                      1                 // Client number (permanent)
-#define CLIENT_NAME                 "Bigbrain"        // Client name, only really used for display
-
-// -------------------------------
-// DO NOT edit below here
-// -------------------------------
-
-#include "LidarComms.h"
-#include "LidarState.h"
-
-#define STATE_STARTUP               1
-#define STATE_AWAIT_CLIENT          2
-#define STATE_SEND_POLL_CMD         3
-#define STATE_RECV_POLL_DATA        4
-#define STATE_NEW_BC_ID             5
-#define STATE_RECOVERABLE_FAILURE   77
-#define STATE_SYSTEM_FAILURE        99
-
-LidarComms lidarComms = LidarComms(CLIENT, (CLIENT == 1), false);
-LidarState lidarState = LidarState();
-
-bool clientConnected;
-bool pollCommandConfirmed;
-int clientDistance;
-int clientStep;
-bool systemFailureLedState;
-bool systemFailed;
-bool broadcastIdReceived;
-hw_timer_t* systemFailureTimer = NULL;
-
-/**
- * Timer interrupt to flash red LED in case of system failure
- */ 
-void IRAM_ATTR systemFailureIsr()
-{
-  systemFailureLedState = !systemFailureLedState;
-  lidarState.setLedState(systemFailureLedState, false, false);
-}
-
-void setup()
-{
-  // Run BOOT state
-  Serial.begin(115200);
-  Serial.printf("Starting %s...\n", CLIENT_NAME);
-  WiFi.onEvent(WiFiEvent);
-  lidarState.setStateChangeHandler(handleStateChange);
-  lidarComms.setMessageHandler(handleMessage);
-  lidarComms.setConnectionHandler(handleConnection);
-  Serial.println("Boot complete, beginning startup...");
-  lidarState.transitionTo(STATE_STARTUP);
-
-
-}
-
-void loop()
-{
-  if (systemFailed) {
-    Serial.println("**************************");
-    Serial.println("**************************");
-    Serial.println("SYSTEM FAILED");
-    Serial.println("**************************");
-    Serial.println("**************************");
-    delay(10000);
-  }
-  lidarComms.checkUdpPacket();
-  doStateActions();
-  
-  // Should be minimal artificial delay eventually
-  delay(1);
-}
-
-/**
- * Message displayed in the event a recoverable failure is encountered
- */
-void recoverFailureMessage(int stateFrom = -1)
-{
-  Serial.println("**************************");
-  Serial.println("**************************");
-  Serial.println("RECOVERABLE FAILURE");
-  if (stateFrom != -1) {
-    Serial.printf("State: %d\n", stateFrom);
-  }
-  Serial.println("This means something didn't happen (probably within a certain timeframe).");
-  Serial.println("It's not fatal, but we'll head back to startup regardless.");
-  Serial.println("**************************");
-  Serial.println("**************************");
-}
-
-
-/**
- * Startup state entry instructions refactored into method
- */
-void stateStartupEntry()
-{
-    Serial.println("Beginning startup...");
-
-    clientConnected = false;
-    
-    lidarState.setLedState(false, false, true);
-
-    WiFi.softAPdisconnect();
-    delay(5000);
-
-    // Set up WiFi Access Point
-    WiFi.softAP(WIFI_SSID, WIFI_PASSWORD);
-    Serial.printf("AP: %s\nIP: ", WIFI_SSID);
-    
-    Serial.println(WiFi.softAPIP());
-
-    lidarComms.startUdp();
-}
-
-/**
- * Handle when we move in/out of a state
- */
-void handleStateChange(int stateTo, int stateFrom)
-{
-    
-  // State entry
-  switch (stateTo) {
-    
-    case STATE_STARTUP:
-      stateStartupEntry();
-    break;
-
-    case STATE_AWAIT_CLIENT:
-      lidarComms.messageBroadcastSystemRestartCommand();
-      lidarState.setLedState(false, true, true);
-      broadcastIdReceived = false;
-      clientConnected = false;
-    break;
-
-    case STATE_SEND_POLL_CMD:
-      pollCommandConfirmed = false;
-      lidarState.setLedState(true, false, true);
-      lidarComms.messageBroadcastPollCommand();
-    break;
-
-    case STATE_RECV_POLL_DATA:
-      broadcastIdReceived = false;
-      clientStep = -1;
-      clientDistance = -1;
-      lidarState.setLedState(false, true, false);
-    break;
-
-    case STATE_RECOVERABLE_FAILURE:
-      lidarComms.messageBroadcastSystemRestartCommand();
-    break;
-
-    case STATE_SYSTEM_FAILURE:
-      lidarComms.messageBroadcastSystemFailure();
-      systemFailureTimer = timerBegin(0, 40, true);
-      timerAttachInterrupt(systemFailureTimer, &systemFailureIsr, true);
-      timerAlarmWrite(systemFailureTimer, 1000000, true);
-      timerAlarmEnable(systemFailureTimer);
-    break;
-
-  }
-
-  // State exit
-  switch (stateFrom) {
-
-  }
-}
-
-/**
- * Perform actions in the current state
- */
-void doStateActions()
-{
-
-  switch (lidarState.getCurrentState()) {
-    case STATE_STARTUP:
-        lidarState.transitionTo(STATE_AWAIT_CLIENT);
-    break;
-
-    case STATE_AWAIT_CLIENT:
-      if (clientConnected)
-        lidarState.transitionTo(STATE_SEND_POLL_CMD);
-
-    break;
-
-    case STATE_SEND_POLL_CMD:
-      if (pollCommandConfirmed)
-        lidarState.transitionTo(STATE_RECV_POLL_DATA);
-
-      if (systemFailed)
-        lidarState.transitionTo(STATE_SYSTEM_FAILURE);
-
-      if (lidarState.isTimedOut())
-        lidarState.transitionTo(STATE_RECOVERABLE_FAILURE);
-
-    break;
-    
-    case STATE_RECV_POLL_DATA:
-      if (broadcastIdReceived)
-        lidarState.transitionTo(STATE_NEW_BC_ID);
-    break;
-
-    case STATE_NEW_BC_ID:
-      lidarState.transitionTo(STATE_STARTUP);
-    break;
-
-    case STATE_RECOVERABLE_FAILURE:
-      lidarState.transitionTo(STATE_STARTUP);
-    break;
-    
-    case STATE_SYSTEM_FAILURE:
-      // Not much to do here
-      delay(5000);
-    break;
-  }
-}
-
-
-/**
- * Broadcast ID message on network. Intended to be periodic for bookkeeping.
- */
-void broadcastId()
-{
-    lidarComms.messageBroadcastId();
-}
-
-/**
- * Handle connections from LidarComms
- */
-void handleConnection(int clientId)
-{
-  clientConnected = true;
-}
-
-/**
- *  Handle incoming messages
- */
-void handleMessage(int msgFrom, int msgTo, int msgDescriptor, int msgMetaData, int msgValue)
-{
-
-  // Should we listen to this message?
-  if (msgTo != 0 && msgTo != CLIENT)
-    return;
-  
-  // Decide what to do
-  switch (msgDescriptor) {
-    case MSG_ID:
-      broadcastIdReceived = true;
-    break;
-
-    case MSG_POLL_CONFIRM:
-      pollCommandConfirmed = true;
-    break;
-
-    case MSG_POLL_RESULT:
-      Serial.printf("[POLL:%d,%d]", msgMetaData, msgValue);
-    break;
-  }
-}
-
-/**
- * Event handler for WiFi events
- */ 
-void WiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
-{
-  lidarComms.wifiEvent(event, info);
-}
+/**
+ * Bigbrain v1.1
+ * -------------
+ * Bigbrain sets up a Wifi AP to allow comms, and feeds data back to the PC via serial.
+ */
+
+#define CLIENT                      1                 // Client number (permanent)
+#define CLIENT_NAME                 "Bigbrain"        // Client name, only really used for display
+#define SERIAL_BINARY_OUTPUT        false             // Start with binary framed output to the PC instead of text
+#define SERIAL_FRAME_TIMEOUT        50                // Max time (ms) samples wait before a partial frame is sent
+#define MAX_HEADS                   4                 // Sensor heads polled at once
+#define HEAD_RING_SIZE              256               // Samples buffered per head between UDP receive and serial output (power of 2)
+#define POLL_CONFIRM_TIMEOUT        2000              // Time (ms) before a head that hasn't confirmed polling is sent the command again
+#define REPORT_QUEUE_SIZE           8                 // Reports asked for by the PC and waiting on loop()
+#define PROFILE_RETRIES             3                 // Times a scan profile a head hasn't accepted is sent again, POLL_CONFIRM_TIMEOUT apart
+#define SERIAL_TASK_CORE            0                 // Core for the serial output task; loop() runs on the other
+#define SERIAL_LOG_SIZE             2048              // Status text (bytes) held for the serial output task; more is dropped
+#define SERIAL_PROFILE_SIZE         128               // Longest scan profile line (chars) taken from the PC; longer ones are turned down
+#define SCAN_START_ANGLE            0                 // Scan profile sent to each head before polling: start of the arc (degrees)
+#define SCAN_END_ANGLE              180               // End of the arc (degrees)
+#define SCAN_STEP                   1                 // Step (degrees) outside the region of interest
+#define SCAN_DWELL                  0                 // Extra time (ms) at each step once the servo has settled
+#define SCAN_OVERSAMPLE             1                 // Readings averaged into each sample
+#define SCAN_REGION_START           0                 // Region of interest, scanned at SCAN_REGION_STEP...
+#define SCAN_REGION_END             0                 // ...set start and end equal for none
+#define SCAN_REGION_STEP            1                 // Step (degrees) inside the region of interest
+#define CLOCK_SYNC_INTERVAL         1000              // Time (ms) between clock pings to each head
+#define CLOCK_SYNC_FAST_INTERVAL    100               // Time (ms) between pings until the clock sync window is full
+
+// -------------------------------
+// DO NOT edit below here
+// -------------------------------
+
+#include "LidarComms.h"
+#include "LidarState.h"
+#include "SerialFrame.h"
+#include "SampleMerger.h"
+#include "freertos/ringbuf.h"
+
+#define STATE_STARTUP               1
+#define STATE_AWAIT_CLIENT          2
+#define STATE_RECV_POLL_DATA        4
+#define STATE_RECOVERABLE_FAILURE   77
+#define STATE_SYSTEM_FAILURE        99
+
+#define HEAD_FREE                   0
+#define HEAD_SEND_POLL_CMD          1
+#define HEAD_POLLING                2
+
+/**
+ * A sensor head being polled, each going through its own states so heads can join and leave without
+ * disturbing the others
+ */
+struct SensorHead {
+  int id;                           // Client ID, 0 for a free slot
+  int state;                        // HEAD_*
+  unsigned long stateTime;          // When it entered its state (ms)
+  unsigned long lastClockPingTime;
+  int profileId;                    // Scan profile it has accepted, -1 for none
+  int profileSends;                 // Times the current profile has been sent to it
+  unsigned long profileTime;        // When it was last sent (ms)
+};
+
+/**
+ * A sample as it goes to the PC, tagged with the head it came from
+ */
+struct HeadSample {
+  PollSample sample;
+  int head;
+};
+
+/**
+ * Status text, from loop(), the libraries or WiFi events, held for serialOutputTask() to write between frames,
+ * so only that task ever writes to Serial. Each write goes in whole or not at all.
+ */
+class SerialLog : public Print {
+  public:
+    RingbufHandle_t buffer = NULL;
+
+    size_t write(uint8_t value) override
+    {
+      return write(&value, 1);
+    }
+
+    size_t write(const uint8_t *text, size_t length) override
+    {
+      if (!buffer || xRingbufferSend(buffer, text, length, 0) != pdTRUE)
+        return 0;
+      return length;
+    }
+};
+
+SerialLog serialLog;
+LidarComms lidarComms = LidarComms(CLIENT, (CLIENT == 1), false);
+LidarState lidarState = LidarState();
+
+// Owned by loop()
+SensorHead heads[MAX_HEADS];
+bool systemFailureLedState;
+bool systemFailed;
+hw_timer_t* systemFailureTimer = NULL;
+ScanProfile scanProfile;
+int scanProfileId;
+bool headSlotFreed;                 // A head left, so one turned away for want of a slot may now fit
+
+// Filled by serialOutputTask() when the PC asks for a new profile, emptied by loop(); holds one at a time
+QueueHandle_t scanProfileQueue;
+
+// Reports the PC has asked for on heads and clients, queued by serialOutputTask() for loop(), which owns them
+QueueHandle_t reportQueue;
+
+// Filled by loop() as poll results arrive, one stream per head slot, emptied fairly by serialOutputTask()
+SampleMerger<HeadSample, HEAD_RING_SIZE, MAX_HEADS> sampleMerger;
+
+// Owned by serialOutputTask()
+bool serialBinaryOutput = SERIAL_BINARY_OUTPUT;
+HeadSample outputSamples[FRAME_MAX_SAMPLES];
+PollSample frameSamples[FRAME_MAX_SAMPLES];
+uint16_t frameSequence = 0;
+uint8_t frameBuffer[FRAME_MAX_SIZE];
+char profileLine[SERIAL_PROFILE_SIZE];
+int profileLineLength = -1;         // -1 when no 'S' command is being read
+
+/**
+ * Timer interrupt to flash red LED in case of system failure
+ */ 
+void IRAM_ATTR systemFailureIsr()
+{
+  systemFailureLedState = !systemFailureLedState;
+  lidarState.setLedState(systemFailureLedState, false, false);
+}
+
+void setup()
+{
+  // Run BOOT state
+  Serial.begin(115200);
+  serialLog.buffer = xRingbufferCreate(SERIAL_LOG_SIZE, RINGBUF_TYPE_BYTEBUF);
+  scanProfileQueue = xQueueCreate(1, sizeof(ScanProfile));
+  reportQueue = xQueueCreate(REPORT_QUEUE_SIZE, sizeof(int));
+  lidarComms.setLog(&serialLog);
+  lidarState.setLog(&serialLog);
+  serialLog.printf("Starting %s...\n", CLIENT_NAME);
+  WiFi.onEvent(WiFiEvent);
+  lidarState.setStateChangeHandler(handleStateChange);
+  lidarComms.setDescriptorHandler(MSG_POLL_CONFIRM, handlePollConfirm);
+  lidarComms.setDescriptorHandler(MSG_SCAN_PROFILE_CONFIRM, handleScanProfileConfirm);
+  lidarComms.setConnectionHandler(handleConnection);
+  lidarComms.setDisconnectionHandler(handleDisconnection);
+  lidarComms.setPollSampleHandler(handlePollSample);
+
+  scanProfile = ScanProfile(SCAN_START_ANGLE, SCAN_END_ANGLE, SCAN_STEP);
+  scanProfile.dwell = SCAN_DWELL;
+  scanProfile.oversample = SCAN_OVERSAMPLE;
+  if (SCAN_REGION_START != SCAN_REGION_END)
+    scanProfile.addRegion(SCAN_REGION_START, SCAN_REGION_END, SCAN_REGION_STEP);
+
+  xTaskCreatePinnedToCore(serialOutputTask, "serialOutput", 4096, NULL, 1, NULL, SERIAL_TASK_CORE);
+  serialLog.println("Boot complete, beginning startup...");
+  lidarState.transitionTo(STATE_STARTUP);
+
+
+}
+
+void loop()
+{
+  if (systemFailed) {
+    serialLog.println("**************************");
+    serialLog.println("**************************");
+    serialLog.println("SYSTEM FAILED");
+    serialLog.println("**************************");
+    serialLog.println("**************************");
+    delay(10000);
+  }
+  int packetsHandled = lidarComms.drainUdpPackets();
+  doStateActions();
+  lidarComms.checkPollStreams();
+  lidarComms.checkClients();
+
+  if (xQueueReceive(scanProfileQueue, &scanProfile, 0) == pdTRUE) {
+    ++scanProfileId;
+    for (int i = 0; i < MAX_HEADS; i++) {
+      heads[i].profileSends = 0;
+      if (heads[i].state != HEAD_FREE)
+        offerScanProfile(heads[i]);
+    }
+  }
+
+  int report;
+  while (xQueueReceive(reportQueue, &report, 0) == pdTRUE)
+    printReport(report);
+  
+  // Only idle when the UDP stack was empty, so bursts don't back up
+  if (packetsHandled == 0)
+    delay(1);
+}
+
+/**
+ * Message displayed in the event a recoverable failure is encountered
+ */
+void recoverFailureMessage(int stateFrom = -1)
+{
+  serialLog.println("**************************");
+  serialLog.println("**************************");
+  serialLog.println("RECOVERABLE FAILURE");
+  if (stateFrom != -1) {
+    serialLog.printf("State: %d\n", stateFrom);
+  }
+  serialLog.println("This means something didn't happen (probably within a certain timeframe).");
+  serialLog.println("It's not fatal, but we'll head back to startup regardless.");
+  serialLog.println("**************************");
+  serialLog.println("**************************");
+}
+
+
+/**
+ * Startup state entry instructions refactored into method
+ */
+void stateStartupEntry()
+{
+    serialLog.println("Beginning startup...");
+
+    freeHeads();
+    
+    lidarState.setLedState(false, false, true);
+
+    WiFi.softAPdisconnect();
+    delay(5000);
+
+    // Set up WiFi Access Point
+    WiFi.softAP(WIFI_SSID, WIFI_PASSWORD);
+    serialLog.printf("AP: %s\nIP: ", WIFI_SSID);
+    
+    serialLog.println(WiFi.softAPIP());
+
+    lidarComms.startUdp();
+}
+
+/**
+ * Handle when we move in/out of a state
+ */
+void handleStateChange(int stateTo, int stateFrom)
+{
+    
+  // State entry
+  switch (stateTo) {
+    
+    case STATE_STARTUP:
+      stateStartupEntry();
+    break;
+
+    case STATE_AWAIT_CLIENT:
+      lidarComms.messageBroadcastSystemRestartCommand();
+      // Everyone restarts, so addresses are learnt again as they say hello
+      lidarComms.forgetClients();
+      lidarState.setLedState(false, true, true);
+      freeHeads();
+    break;
+
+    case STATE_RECV_POLL_DATA:
+      lidarState.setLedState(false, true, false);
+    break;
+
+    case STATE_RECOVERABLE_FAILURE:
+      lidarComms.messageBroadcastSystemRestartCommand();
+    break;
+
+    case STATE_SYSTEM_FAILURE:
+      lidarComms.messageBroadcastSystemFailure();
+      systemFailureTimer = timerBegin(0, 40, true);
+      timerAttachInterrupt(systemFailureTimer, &systemFailureIsr, true);
+      timerAlarmWrite(systemFailureTimer, 1000000, true);
+      timerAlarmEnable(systemFailureTimer);
+    break;
+
+  }
+
+  // State exit
+  switch (stateFrom) {
+
+  }
+}
+
+/**
+ * Perform actions in the current state
+ */
+void doStateActions()
+{
+
+  switch (lidarState.getCurrentState()) {
+    case STATE_STARTUP:
+        lidarState.transitionTo(STATE_AWAIT_CLIENT);
+    break;
+
+    case STATE_AWAIT_CLIENT:
+      doHeadActions();
+      if (countHeads() > 0)
+        lidarState.transitionTo(STATE_RECV_POLL_DATA);
+
+      if (systemFailed)
+        lidarState.transitionTo(STATE_SYSTEM_FAILURE);
+    break;
+
+    case STATE_RECV_POLL_DATA:
+      // With every head gone, carry on here with the AP up; they join again through handleConnection()
+      doHeadActions();
+
+      if (systemFailed)
+        lidarState.transitionTo(STATE_SYSTEM_FAILURE);
+    break;
+
+    case STATE_RECOVERABLE_FAILURE:
+      lidarState.transitionTo(STATE_STARTUP);
+    break;
+    
+    case STATE_SYSTEM_FAILURE:
+      // Not much to do here
+      delay(5000);
+    break;
+  }
+}
+
+
+/**
+ * Move a head to a new state
+ */
+void setHeadState(SensorHead &head, int state)
+{
+  head.state = state;
+  head.stateTime = millis();
+}
+
+/**
+ * The slot a head is in, or -1 if it isn't one of ours
+ */
+int findHead(int clientId)
+{
+  for (int i = 0; i < MAX_HEADS; i++) {
+    if (heads[i].state != HEAD_FREE && heads[i].id == clientId)
+      return i;
+  }
+  return -1;
+}
+
+/**
+ * Take a slot for a head, or return the one it already has. Returns -1 if every slot is taken.
+ */
+int addHead(int clientId)
+{
+  int slot = findHead(clientId);
+  if (slot >= 0)
+    return slot;
+
+  for (int i = 0; i < MAX_HEADS; i++) {
+    if (heads[i].state != HEAD_FREE)
+      continue;
+
+    heads[i].id = clientId;
+    heads[i].lastClockPingTime = 0;
+    heads[i].profileId = -1;
+    heads[i].profileSends = 0;
+    setHeadState(heads[i], HEAD_SEND_POLL_CMD);
+    return i;
+  }
+  return -1;
+}
+
+/**
+ * Let every head go, e.g. when everyone is told to restart
+ */
+void freeHeads()
+{
+  for (int i = 0; i < MAX_HEADS; i++) {
+    heads[i].id = 0;
+    heads[i].state = HEAD_FREE;
+  }
+}
+
+/**
+ * Heads currently taking a slot
+ */
+int countHeads()
+{
+  int count = 0;
+  for (int i = 0; i < MAX_HEADS; i++)
+    count += heads[i].state != HEAD_FREE;
+  return count;
+}
+
+/**
+ * Send a head the current scan profile unless it has already accepted it. One it hasn't answered, or has
+ * turned down while still taking up the last, is sent again at most PROFILE_RETRIES times.
+ */
+void offerScanProfile(SensorHead &head)
+{
+  if (head.profileId == scanProfileId || head.profileSends > PROFILE_RETRIES)
+    return;
+
+  head.profileSends++;
+  head.profileTime = millis();
+  lidarComms.messageScanProfile(head.id, scanProfileId, scanProfile);
+}
+
+/**
+ * Set a head polling: send it the scan profile if it needs it, and the command to start
+ */
+void startHead(SensorHead &head)
+{
+  setHeadState(head, HEAD_SEND_POLL_CMD);
+  offerScanProfile(head);
+  lidarComms.messagePollCommand(head.id);
+}
+
+/**
+ * Per-head actions: give any freed slot to a head waiting for one, chase heads that haven't confirmed polling or
+ * the scan profile, and keep every head's clock synced
+ */
+void doHeadActions()
+{
+  if (headSlotFreed) {
+    headSlotFreed = false;
+    joinWaitingHeads();
+  }
+
+  for (int i = 0; i < MAX_HEADS; i++) {
+    SensorHead &head = heads[i];
+    if (head.state == HEAD_SEND_POLL_CMD && millis() - head.stateTime >= POLL_CONFIRM_TIMEOUT)
+      startHead(head);
+    else if (head.state == HEAD_POLLING && millis() - head.profileTime >= POLL_CONFIRM_TIMEOUT)
+      offerScanProfile(head);
+
+    if (head.state != HEAD_FREE)
+      syncHeadClock(head);
+  }
+}
+
+/**
+ * A client identified itself for the first time since it was registered: a new head joining, one of ours
+ * that restarted and was dropped meanwhile, or one still running after we restarted. Either way it gets a slot
+ * and is set polling, without disturbing the other heads.
+ */
+void handleConnection(int clientId)
+{
+  joinHead(clientId);
+}
+
+/**
+ * Give a client a slot and set it polling. Returns false if every slot is taken; it waits, heartbeating, for
+ * joinWaitingHeads() to find it when one frees up.
+ */
+bool joinHead(int clientId)
+{
+  int slot = addHead(clientId);
+  if (slot < 0) {
+    serialLog.printf("No room for head %d, already polling %d\n", clientId, MAX_HEADS);
+    return false;
+  }
+
+  // A head connecting may have restarted, so its clock starts over and it needs the scan profile again
+  ClockSync *clockSync = lidarComms.getClockSync(clientId);
+  if (clockSync)
+    clockSync->reset();
+  heads[slot].profileId = -1;
+  heads[slot].profileSends = 0;
+
+  serialLog.printf("Head %d joined in slot %d\n", clientId, slot);
+  startHead(heads[slot]);
+  return true;
+}
+
+/**
+ * Give freed slots to heads that identified themselves while every slot was taken. Their connection has
+ * already been handled, so they have to be found among the clients still registered.
+ */
+void joinWaitingHeads()
+{
+  for (int i = 0; i < REGISTRY_SIZE && countHeads() < MAX_HEADS; i++) {
+    const ClientInfo *client = lidarComms.getClientSlot(i);
+    if (!client || !client->identified || !(client->capabilities & CAP_HEARTBEAT) || findHead(client->id) >= 0)
+      continue;
+    joinHead(client->id);
+  }
+}
+
+/**
+ * Handle clients timing out or being forgotten by LidarComms: the head's slot is free for another
+ */
+void handleDisconnection(int clientId)
+{
+  int slot = findHead(clientId);
+  if (slot < 0)
+    return;
+
+  serialLog.printf("Head %d left slot %d\n", clientId, slot);
+  heads[slot].id = 0;
+  heads[slot].state = HEAD_FREE;
+  headSlotFreed = true;
+}
+
+/**
+ * Ping a head's clock, quickly until there are enough exchanges to fit its skew, then every
+ * CLOCK_SYNC_INTERVAL to follow its drift
+ */
+void syncHeadClock(SensorHead &head)
+{
+  if (!lidarComms.clientHasCapability(head.id, CAP_CLOCK_SYNC))
+    return;
+
+  ClockSync *clockSync = lidarComms.getClockSync(head.id);
+  unsigned long interval = clockSync->getExchangeCount() < CLOCK_SYNC_WINDOW ? CLOCK_SYNC_FAST_INTERVAL : CLOCK_SYNC_INTERVAL;
+  if (millis() - head.lastClockPingTime < interval)
+    return;
+
+  head.lastClockPingTime = millis();
+  lidarComms.messageClockPing(head.id);
+}
+
+/**
+ * A head has started polling
+ */
+void handlePollConfirm(void *context, const MessageView &message)
+{
+  int slot = findHead(message.from());
+  if (slot >= 0)
+    setHeadState(heads[slot], HEAD_POLLING);
+}
+
+/**
+ * Note a head taking up a scan profile, so it isn't sent again, and pass its answer on to the PC
+ */
+void handleScanProfileConfirm(void *context, const MessageView &message)
+{
+  int slot = findHead(message.from());
+  if (slot >= 0 && message.value())
+    heads[slot].profileId = message.metaData();
+
+  serialLog.printf("[PROFILE:%d,%d,%d]", message.metaData(), message.value(), message.from());
+}
+
+/**
+ * Handle poll results, timestamped on our clock (us) by LidarComms. A head already polling when we started,
+ * e.g. because we restarted and it didn't, is taken on as it is.
+ */
+void handlePollSample(void *, int from, const PollSample &sample)
+{
+  int slot = findHead(from);
+  if (slot < 0) {
+    slot = addHead(from);
+    if (slot < 0)
+      return;
+  }
+  if (heads[slot].state != HEAD_POLLING)
+    setHeadState(heads[slot], HEAD_POLLING);
+
+  // Hand over to the serial task; if it has fallen behind on this head, its ring counts the overflow
+  HeadSample headSample = { sample, from };
+  sampleMerger.push(slot, headSample);
+}
+
+/**
+ * Serial output task. Runs on its own core so a slow serial write never holds up UDP intake in loop().
+ * Takes the heads in turn, a frame's worth at a time, so a fast head can't crowd out the others, and
+ * sends a head's samples once a frame is full or they have waited SERIAL_FRAME_TIMEOUT.
+ */
+void serialOutputTask(void *parameters)
+{
+  for (;;) {
+    checkSerialCommand();
+    flushSerialLog();
+
+    int stream;
+    int count = sampleMerger.pop(outputSamples, FRAME_MAX_SAMPLES, stream, millis(), SERIAL_FRAME_TIMEOUT);
+    if (count > 0)
+      outputHeadSamples(count);
+    else
+      vTaskDelay(1);
+  }
+}
+
+/**
+ * Write out the status text other tasks have left, between frames
+ */
+void flushSerialLog()
+{
+  size_t length;
+  uint8_t *text;
+  while ((text = (uint8_t *)xRingbufferReceiveUpTo(serialLog.buffer, &length, 0, SERIAL_LOG_SIZE)) != NULL) {
+    Serial.write(text, length);
+    vRingbufferReturnItem(serialLog.buffer, text);
+  }
+}
+
+/**
+ * Send samples to the PC, either as "[POLL:angle,distance,head]" text or as binary frames tagged by head.
+ * A head's slot can change hands while its samples wait, so frames are split wherever the head changes.
+ */
+void outputHeadSamples(int count)
+{
+  if (!serialBinaryOutput) {
+    for (int i = 0; i < count; i++)
+      Serial.printf("[POLL:%d,%d,%d]", outputSamples[i].sample.angle, outputSamples[i].sample.distance, outputSamples[i].head);
+    return;
+  }
+
+  int start = 0;
+  while (start < count) {
+    int head = outputSamples[start].head;
+    int frameCount = 0;
+    while (start + frameCount < count && outputSamples[start + frameCount].head == head) {
+      frameSamples[frameCount] = outputSamples[start + frameCount].sample;
+      frameCount++;
+    }
+
+    int length = encodeSampleFrame(frameBuffer, sizeof(frameBuffer), frameSequence++, frameSamples, frameCount, head);
+    Serial.write(frameBuffer, length);
+    start += frameCount;
+  }
+}
+
+/**
+ * The PC can switch output mode at any time: 'B' for binary frames, 'T' for text.
+ * 'R' reports the sample rings' combined high-water mark and overflow count as "[RING:hwm,overflows]".
+ * 'C' reports each head's clock sync, see printClockSync().
+ * 'L' reports poll sample loss from each head, see printPollLoss().
+ * 'P' lists every registered client, see printClients().
+ * These three read state owned by loop(), so are passed to it to answer.
+ * 'S' sends every head a new scan profile, see parseScanProfile(); each head's answer comes back as
+ * "[PROFILE:id,accepted,head]", and a line that can't be taken as "[PROFILE:0,0,0]". The line is taken as it
+ * arrives, over as many calls as it takes, so output never waits on the PC.
+ * Status text still goes out in binary mode, between frames; the PC's decoder skips it while hunting for the
+ * sync word.
+ */
+void checkSerialCommand()
+{
+  while (Serial.available() > 0) {
+    int command = Serial.read();
+    if (profileLineLength >= 0) {
+      readProfileLine(command);
+      continue;
+    }
+
+    switch (command) {
+      case 'B':
+      case 'T':
+        serialBinaryOutput = (command == 'B');
+      break;
+
+      case 'R':
+        printRings();
+      break;
+
+      case 'C':
+      case 'L':
+      case 'P':
+        xQueueSend(reportQueue, &command, 0);
+      break;
+
+      case 'S':
+        profileLineLength = 0;
+      break;
+    }
+  }
+}
+
+/**
+ * Take the next character of an 'S' command's line, and pass the profile on to loop() once the line is done
+ */
+void readProfileLine(int character)
+{
+  if (character == '\r')
+    return;
+
+  if (character != '\n') {
+    // Past the end, keep going to the newline, then turn the line down
+    if (profileLineLength < SERIAL_PROFILE_SIZE)
+      profileLine[profileLineLength++] = character;
+    return;
+  }
+
+  ScanProfile profile;
+  bool overflowed = profileLineLength == SERIAL_PROFILE_SIZE;
+  profileLine[overflowed ? 0 : profileLineLength] = '\0';
+  profileLineLength = -1;
+  if (overflowed || !parseScanProfile(profileLine, profile) || xQueueSend(scanProfileQueue, &profile, 0) != pdTRUE)
+    Serial.print("[PROFILE:0,0,0]");
+}
+
+/**
+ * Report the high-water mark of the fullest head ring and the overflows of all of them as "[RING:hwm,overflows]"
+ */
+void printRings()
+{
+  uint32_t highWaterMark = 0;
+  uint32_t overflows = 0;
+  for (int i = 0; i < MAX_HEADS; i++) {
+    highWaterMark = max(highWaterMark, sampleMerger.getRing(i).getHighWaterMark());
+    overflows += sampleMerger.getRing(i).getOverflows();
+  }
+  Serial.printf("[RING:%u,%u]", highWaterMark, overflows);
+}
+
+/**
+ * Answer a report the PC asked for, in loop()
+ */
+void printReport(int report)
+{
+  switch (report) {
+    case 'C':
+      printClockSync();
+    break;
+
+    case 'L':
+      printPollLoss();
+    break;
+
+    case 'P':
+      printClients();
+    break;
+  }
+}
+
+/**
+ * Report each head's clock as "[CLOCK:client,offset,skew,roundTrip,exchanges]": its offset from ours (us),
+ * drift (ppm) and best round trip (us), one entry per head, or a single one of zeros without any heads.
+ */
+void printClockSync()
+{
+  bool printed = false;
+  for (int i = 0; i < MAX_HEADS; i++) {
+    int id = heads[i].id;
+    ClockSync *clockSync = id ? lidarComms.getClockSync(id) : NULL;
+    if (!clockSync)
+      continue;
+
+    serialLog.printf("[CLOCK:%d,%d,%.2f,%u,%d]", id, clockSync->getOffset(micros()), clockSync->getSkewPpm(),
+      clockSync->getRoundTrip(), clockSync->getExchangeCount());
+    printed = true;
+  }
+
+  if (!printed)
+    serialLog.print("[CLOCK:0,0,0,0,0]");
+}
+
+/**
+ * Report poll sample loss from each head as "[LOSS:client,samples,lost,recovered,reordered,duplicates,nacks,
+ * missing]", where missing is what is still waiting on a NACK.
+ */
+void printPollLoss()
+{
+  bool printed = false;
+  for (int i = 0; i < MAX_HEADS; i++) {
+    int id = heads[i].id;
+    const PollStreamStats *stats = id ? lidarComms.getReceiveStats(id) : NULL;
+    if (!stats)
+      continue;
+
+    serialLog.printf("[LOSS:%d,%u,%u,%u,%u,%u,%u,%u]", id, stats->samples, stats->lost, stats->recovered,
+      stats->reordered, stats->duplicates, stats->nacks, lidarComms.getMissingSamples(id));
+    printed = true;
+  }
+
+  if (!printed)
+    serialLog.print("[LOSS:0,0,0,0,0,0,0,0]");
+}
+
+/**
+ * List registered clients as "[CLIENTS:id,rx,tx,lastHeard,roundTrip,lost;...]": messages each way, how long ago
+ * (ms) we last heard from it, best clock sync round trip (us) and poll samples lost.
+ */
+void printClients()
+{
+  serialLog.print("[CLIENTS:");
+  bool first = true;
+  uint32_t now = millis();
+  for (int slot = 0; slot < REGISTRY_SIZE; slot++) {
+    const ClientInfo *client = lidarComms.getClientSlot(slot);
+    if (!client)
+      continue;
+
+    serialLog.printf("%s%d,%u,%u,%u,%u,%u", first ? "" : ";", client->id, client->received, client->sent,
+      now - client->lastReceived, client->clockSync.getRoundTrip(), client->streamTracker.getStats().lost);
+    first = false;
+  }
+  serialLog.print("]");
+}
+
+/**
+ * Parse "start,end,step,dwell,oversample" followed by up to SCAN_MAX_REGIONS ",regionStart,regionEnd,regionStep".
+ * Anything else on the line turns it down.
+ */
+bool parseScanProfile(const char *text, ScanProfile &profile)
+{
+  int values[5 + SCAN_MAX_REGIONS * 3];
+  int count = 0;
+
+  while (count < (int)(sizeof(values) / sizeof(values[0]))) {
+    char *end;
+    values[count] = strtol(text, &end, 10);
+    if (end == text)
+      return false;
+
+    count++;
+    text = end;
+    if (*text != ',')
+      break;
+    text++;
+  }
+
+  if (*text != '\0' || count < 5 || (count - 5) % 3 != 0)
+    return false;
+
+  profile = ScanProfile(values[0], values[1], values[2]);
+  profile.dwell = values[3];
+  profile.oversample = values[4];
+  for (int i = 5; i < count; i += 3)
+    profile.addRegion(values[i], values[i + 1], values[i + 2]);
+
+  return profile.isValid();
+}
+
+/**
+ * Event handler for WiFi events
+ */ 
+void WiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+  lidarComms.wifiEvent(event, info);
+}
@@ -0,0 +1,120 @@
+#include "ClientRegistry.h"
+
+static_assert(REGISTRY_SIZE < 256, "Registry slots must fit the uint8_t lookups");
+
+ClientRegistry::ClientRegistry()
+{
+    memset(slotById, 0, sizeof(slotById));
+    memset(slotByHost, 0, sizeof(slotByHost));
+    for (int i = 0; i < REGISTRY_SIZE; i++)
+        clearSlot(i);
+    count = 0;
+}
+
+void ClientRegistry::clearSlot(int slot)
+{
+    ClientInfo &client = clients[slot];
+    client.id = 0;
+    client.address = IPAddress();
+    client.capabilities = 0;
+    client.identified = false;
+    client.lastReceived = 0;
+    client.lastSent = 0;
+    client.received = 0;
+    client.sent = 0;
+    client.clockSync.reset();
+    client.streamTracker = StreamTracker();
+}
+
+/**
+ * A client by ID, or NULL if it isn't registered
+ */
+ClientInfo *ClientRegistry::find(int clientId)
+{
+    if (clientId <= 0 || clientId > MAX_CLIENT_ID || !slotById[clientId])
+        return NULL;
+    return &clients[slotById[clientId] - 1];
+}
+
+/**
+ * A client by address, or NULL if none is registered there
+ */
+ClientInfo *ClientRegistry::findByAddress(IPAddress address)
+{
+    int slot = slotByHost[address[3]];
+    if (!slot || clients[slot - 1].address != address)
+        return NULL;
+    return &clients[slot - 1];
+}
+
+/**
+ * Register a client, or return it if it already is. Returns NULL if the ID is out of range or the registry
+ * is full.
+ */
+ClientInfo *ClientRegistry::add(int clientId, uint32_t now)
+{
+    ClientInfo *client = find(clientId);
+    if (client || clientId <= 0 || clientId > MAX_CLIENT_ID)
+        return client;
+
+    for (int slot = 0; slot < REGISTRY_SIZE; slot++) {
+        if (clients[slot].id != 0)
+            continue;
+
+        client = &clients[slot];
+        client->id = clientId;
+        client->lastReceived = now;
+        client->lastSent = now;
+        slotById[clientId] = slot + 1;
+        count++;
+        return client;
+    }
+    return NULL;
+}
+
+/**
+ * Set where a client is. Anyone else registered at that address has moved on, and loses it.
+ */
+void ClientRegistry::setAddress(ClientInfo *client, IPAddress address)
+{
+    if (client->address == address)
+        return;
+
+    int slot = client - clients;
+    if (client->address && slotByHost[client->address[3]] == slot + 1)
+        slotByHost[client->address[3]] = 0;
+
+    ClientInfo *previous = address ? findByAddress(address) : NULL;
+    if (previous)
+        previous->address = IPAddress();
+
+    client->address = address;
+    if (address)
+        slotByHost[address[3]] = slot + 1;
+}
+
+/**
+ * Forget a client. Returns false if it wasn't registered.
+ */
+bool ClientRegistry::remove(int clientId)
+{
+    ClientInfo *client = find(clientId);
+    if (!client)
+        return false;
+
+    setAddress(client, IPAddress());
+    slotById[clientId] = 0;
+    clearSlot(client - clients);
+    count--;
+    return true;
+}
+
+/**
+ * The client in a slot, for walking the registry: NULL for free slots and past the end
+ */
+ClientInfo *ClientRegistry::getSlot(int slot)
+{
+    if (slot < 0 || slot >= REGISTRY_SIZE || clients[slot].id == 0)
+        return NULL;
+    return &clients[slot];
+}
@@ -0,0 +1,56 @@
+#ifndef CLIENTREGISTRY_H
+#define CLIENTREGISTRY_H
+
+#include <Arduino.h>
+#include "ClockSync.h"
+#include "StreamTracker.h"
+
+#define REGISTRY_SIZE             16                // Clients tracked at once
+#define MAX_CLIENT_ID             255               // Highest client ID accepted; 0 is broadcast
+#define HEARTBEAT_INTERVAL        100               // Time (ms) without sending to a client before it is sent a heartbeat
+#define CLIENT_TIMEOUT            350               // Time (ms) without hearing from a heartbeating client before it is dropped
+#define QUIET_CLIENT_TIMEOUT      5000              // Time (ms) without hearing from any other client before it is dropped
+
+/**
+ * Everything known about one remote client
+ */
+struct ClientInfo {
+    int id;                     // 0 for a free slot
+    IPAddress address;          // 0 until known
+    int capabilities;           // From the flags of its MSG_ID
+    bool identified;            // Has sent a MSG_ID since it was registered
+    uint32_t lastReceived;      // When it was last heard from (ms)
+    uint32_t lastSent;          // When it was last sent to (ms)
+    uint32_t received;          // Messages received from it
+    uint32_t sent;              // Messages sent to it
+    ClockSync clockSync;        // Its clock against ours (brain only)
+    StreamTracker streamTracker; // Its poll stream (brain only)
+};
+
+/**
+ * Fixed-size table of remote clients, looked up in O(1) by ID or by address. Clients all sit on the
+ * brain's /24, so the last segment of an address is enough to find one.
+ */
+class ClientRegistry {
+    private:
+        ClientInfo clients[REGISTRY_SIZE];
+        uint8_t slotById[MAX_CLIENT_ID + 1];    // Slot + 1, 0 for none
+        uint8_t slotByHost[256];                // Slot + 1 by last address segment, 0 for none
+        int count;
+
+        void clearSlot(int slot);
+
+    public:
+        ClientRegistry();
+
+        ClientInfo *find(int clientId);
+        ClientInfo *findByAddress(IPAddress address);
+        ClientInfo *add(int clientId, uint32_t now);
+        void setAddress(ClientInfo *client, IPAddress address);
+        bool remove(int clientId);
+
+        ClientInfo *getSlot(int slot);
+        int getCount() { return count; }
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "ClockSync.h"
+
+ClockSync::ClockSync()
+{
+    reset();
+}
+
+/**
+ * Forget everything, e.g. when the remote node restarts
+ */
+void ClockSync::reset()
+{
+    count = 0;
+    next = 0;
+    rejected = 0;
+    referenceTime = 0;
+    referenceOffset = 0;
+    skew = 0;
+}
+
+/**
+ * Add an exchange: we sent a ping at `sent`, the remote received it at `received` and replied at `replied`
+ * (its clock), and the reply got back to us at `returned`. Returns false if the round trip was too long to
+ * be worth using.
+ */
+bool ClockSync::addExchange(uint32_t sent, uint32_t received, uint32_t replied, uint32_t returned)
+{
+    int32_t roundTrip = (int32_t)(returned - sent);
+    int32_t remoteTime = (int32_t)(replied - received);
+    int32_t delay = roundTrip - remoteTime;
+    if (roundTrip < 0 || remoteTime < 0 || delay < 0 || delay > CLOCK_SYNC_MAX_DELAY) {
+        rejected++;
+        return false;
+    }
+
+    // Assume the network took as long each way; the error is at most half the delay
+    ClockExchange &exchange = exchanges[next];
+    exchange.localTime = sent + (uint32_t)roundTrip / 2;
+    uint32_t outbound = received - sent;
+    uint32_t inbound = replied - returned;
+    exchange.offset = (int32_t)(outbound + (uint32_t)((int32_t)(inbound - outbound) / 2));
+    exchange.delay = delay;
+
+    next = (next + 1) % CLOCK_SYNC_WINDOW;
+    if (count < CLOCK_SYNC_WINDOW)
+        count++;
+
+    fit();
+    return true;
+}
+
+/**
+ * Least squares line through the offsets of the exchanges with the best round trips. Everything is taken
+ * relative to the newest exchange, so the sums only ever hold small numbers. Doubles are slow on the ESP32,
+ * but this only runs once per ping.
+ */
+void ClockSync::fit()
+{
+    const ClockExchange &newest = exchanges[(next + CLOCK_SYNC_WINDOW - 1) % CLOCK_SYNC_WINDOW];
+
+    uint32_t bestDelay = newest.delay;
+    for (int i = 0; i < count; i++)
+        if (exchanges[i].delay < bestDelay)
+            bestDelay = exchanges[i].delay;
+
+    int used = 0;
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    double oldest = 0;
+    for (int i = 0; i < count; i++) {
+        if (exchanges[i].delay > bestDelay + CLOCK_SYNC_DELAY_SLACK)
+            continue;
+
+        double x = (int32_t)(exchanges[i].localTime - newest.localTime);
+        if (x < oldest)
+            oldest = x;
+        double y = (int32_t)(exchanges[i].offset - newest.offset);
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+        used++;
+    }
+
+    // Exchanges close together say little about drift, so the last estimate stands until there is a baseline
+    double spread = used * sumXX - sumX * sumX;
+    if (used >= 3 && -oldest >= CLOCK_SYNC_MIN_SPAN && spread > 0) {
+        float fitted = (used * sumXY - sumX * sumY) / spread;
+        if (fitted <= CLOCK_SYNC_MAX_SKEW && fitted >= -CLOCK_SYNC_MAX_SKEW)
+            skew = fitted;
+    }
+
+    referenceTime = newest.localTime;
+    referenceOffset = newest.offset + (int32_t)((sumY - skew * sumX) / used);
+}
+
+/**
+ * Remote clock minus ours at a given time of ours
+ */
+int32_t ClockSync::getOffset(uint32_t localTime)
+{
+    return referenceOffset + (int32_t)(skew * (int32_t)(localTime - referenceTime));
+}
+
+/**
+ * Put a remote timestamp on our timeline
+ */
+uint32_t ClockSync::toLocal(uint32_t remoteTime)
+{
+    // The offset depends on our time, which is what we're after; one correction is plenty at these skews
+    uint32_t estimate = remoteTime - referenceOffset;
+    return remoteTime - getOffset(estimate);
+}
+
+/**
+ * Our time on the remote clock
+ */
+uint32_t ClockSync::toRemote(uint32_t localTime)
+{
+    return localTime + getOffset(localTime);
+}
+
+float ClockSync::getSkewPpm()
+{
+    return skew * 1000000.0f;
+}
+
+/**
+ * Best round trip (us) among the exchanges held
+ */
+uint32_t ClockSync::getRoundTrip() const
+{
+    uint32_t best = 0;
+    for (int i = 0; i < count; i++)
+        if (i == 0 || exchanges[i].delay < best)
+            best = exchanges[i].delay;
+    return best;
+}
+
+int ClockSync::getExchangeCount()
+{
+    return count;
+}
+
+uint32_t ClockSync::getRejectedCount()
+{
+    return rejected;
+}
+
+bool ClockSync::isSynced()
+{
+    return count > 0;
+}
@@ -0,0 +1,59 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <stdint.h>
+
+#define CLOCK_SYNC_WINDOW         16                // Exchanges kept for the offset and skew estimate
+#define CLOCK_SYNC_MAX_DELAY      50000             // Exchanges with a longer round trip (us) are ignored
+#define CLOCK_SYNC_DELAY_SLACK    1000              // Exchanges within this (us) of the best round trip are used in the fit
+#define CLOCK_SYNC_MAX_SKEW       0.0002f           // Largest believable drift between two clocks (200 ppm)
+#define CLOCK_SYNC_MIN_SPAN       2000000           // Fitted exchanges must span this long (us) before skew is re-estimated
+
+/**
+ * One NTP-style exchange, as seen from our side: when it happened, the remote clock's offset from ours
+ * and the round trip it was measured over
+ */
+struct ClockExchange {
+    uint32_t localTime;
+    int32_t offset;
+    uint32_t delay;
+};
+
+/**
+ * Tracks a remote node's clock against ours from ping exchanges, so remote timestamps can be put on our
+ * timeline. All times are microsecond counters that wrap every 71 minutes; only differences are ever used.
+ *
+ * Each exchange gives an offset good to half its round trip. The offset is fitted against time over the
+ * exchanges with the shortest round trips, so the skew between the two crystals is tracked as well and
+ * timestamps between pings are corrected for drift.
+ */
+class ClockSync {
+    private:
+        ClockExchange exchanges[CLOCK_SYNC_WINDOW];
+        int count;
+        int next;
+        uint32_t rejected;
+
+        uint32_t referenceTime;     // Our time the fit is anchored at
+        int32_t referenceOffset;    // Remote clock minus ours at referenceTime
+        float skew;                 // Remote drift against us, in us per us
+
+        void fit();
+
+    public:
+        ClockSync();
+
+        bool addExchange(uint32_t sent, uint32_t received, uint32_t replied, uint32_t returned);
+        void reset();
+
+        uint32_t toLocal(uint32_t remoteTime);
+        uint32_t toRemote(uint32_t localTime);
+        int32_t getOffset(uint32_t localTime);
+        float getSkewPpm();
+        uint32_t getRoundTrip() const;
+        int getExchangeCount();
+        uint32_t getRejectedCount();
+        bool isSynced();
+};
+
+#endif
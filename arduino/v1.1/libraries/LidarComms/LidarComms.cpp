@@ -1,457 +1,1216 @@
-#include "LidarComms.h"
-
-struct Message {
-    int From;
-    int To;
-    int Descriptor;
-    int MetaData;
-    int Value;
-};
-
-LidarComms::LidarComms(int clientId, bool isBrain = false, bool debugMode = false)
-{
-    this->clientId = clientId;
-    this->brain = isBrain; 
-    this->debugMode = debugMode;
-}
-
-/**
- * Check if a packet exists on the UDP stack and if so, handle it
- */
-void LidarComms::checkUdpPacket()
-{
-    // My assumption here is that parsePacket() essentially parses a single message, i.e. one message handled per call
-    int packetSize = udp.parsePacket();
-    if (packetSize <= 0) {
-        return;
-    }
-
-    IPAddress remoteIp = udp.remoteIP();
-    if (debugMode) {
-        Serial.printf("Packet received: %d bytes from ", packetSize);
-        Serial.println(remoteIp);
-    }
-    char packetBuffer[BUFFER_SIZE];
-    int readLen = udp.read(packetBuffer, BUFFER_SIZE);
-    if (!localIp) {
-        if (brain) 
-            localIp = WiFi.softAPIP();
-    }
-    handleMessage(remoteIp, packetBuffer, readLen);
-    
-}
-
-/**
- * Send messages to all clients (broadcast)
- */
-bool LidarComms::sendMessageBroadcast(int descriptor, int metaData, int value)
-{
-    sendMessage(0, descriptor, metaData, value);
-}
-
-/**
- * Send message to a specific client
- */
-bool LidarComms::sendMessage(int to, int descriptor, int metaData, int value)
-{
-    if (to != 0) {
-        IPAddress dest = getClientIp(to);
-        if (debugMode) {
-            Serial.printf("Client ID %d resolved to IP ", to);
-            Serial.println(dest);
-        }
-        if (dest) {
-            return sendMessageToIp(dest, to, descriptor, metaData, value);
-        }
-        
-    }
-    // Otherwise, broadcast
-    return sendMessageToIp(IPAddress {255,255,255,255}, to, descriptor, metaData, value);
-
-}
-
-/**
- * Send a message to a specific IP address 
- */ 
-bool LidarComms::sendMessageToIp(IPAddress ipTo, int to, int descriptor, int metaData, int value)
-{
-    Message message = { .From = clientId , .To = to, .Descriptor = descriptor , .MetaData = metaData , .Value = value };
-    if (debugMode) {
-        Serial.printf("Sending %d message to (%d) => ", descriptor, to);
-        Serial.println(ipTo);
-    }
-    udp.beginPacket(ipTo, PORT);
-    udp.write((byte*)&message, sizeof message);
-    udp.endPacket();
-    return true;
-}
-
-/**
- *  Handle incoming messages
- */
-void LidarComms::handleMessage(IPAddress remoteIp, char *message, int length) {
-    if (length < MESSAGE_SIZE) {
-        if (debugMode)
-            Serial.printf("Message discarded for being undersized: %d\n", length);
-        return;
-    }
-
-    lastMessageTime = millis();
-
-    // TODO: Tidy this up
-    int msgFrom = decompileMessage(message,0);
-    int msgTo = decompileMessage(message,4);
-    int msgDescriptor = decompileMessage(message,8);
-    int msgMetaData = decompileMessage(message,12);
-    int msgValue = decompileMessage(message,16);
-
-    if (debugMode)
-        Serial.printf("(Lib) Message received:\n\tFrom: %d\n\tTo: %d\n\tDescriptor: %d\n\tMetaData: %d\n\tValue: %d\n\n", msgFrom, msgTo, msgDescriptor, msgMetaData, msgValue);
-
-    if (msgTo != clientId && msgTo != 0)
-        return;
-
-    switch (msgDescriptor) {
-        // Identification message
-        case MSG_ID:
-            addClientInfo(msgFrom, remoteIp[3]);
-            if (msgMetaData == 1) {
-                // Saying hello, so say hello back
-                sayHelloBack(msgFrom);
-            }
-        break;
-        // Client information message
-        case MSG_CLIENT_INFO:
-            addClientInfo(msgValue, msgMetaData);
-        break;
-    }
-
-    // Hand over to client
-    if (messageHandler) {
-        messageHandler(msgFrom, msgTo, msgDescriptor, msgMetaData, msgValue);
-    }
-}
-
-/**
- * Broadcast ID on network (say "Hello")
- */ 
-bool LidarComms::sayHello()
-{
-    if (!connected)
-        return false;
-    
-    Serial.printf("-> Hello, I am client %d\n", clientId);
-    return sendMessageBroadcast(MSG_ID, 1, clientId);
-}
-
-/**
- * Respond to a hello request
- */ 
-bool LidarComms::sayHelloBack(int to)
-{
-    if (!brain && !connected)
-        return false;
-    
-    Serial.printf("-> Hello back %d! I am client %d\n", to, clientId);
-
-    if (connectionHandler) {
-        if (debugMode) {
-            Serial.println("Firing connection handler");
-        }
-        connectionHandler(to);
-    }
-
-    return sendMessage(to, MSG_ID, 2, clientId);
-}
-
-/**
- * Add info about a remote client
- */ 
-void LidarComms::addClientInfo(int clientId, int ipSegment)
-{
-    // Don't track ourselves
-    if (clientId == this->clientId)
-        return;
-    
-    if (debugMode)
-        Serial.printf("Received info on client %d, IP segment %d\n", clientId, ipSegment);
-
-    clientIps[clientId] = ipSegment;
-}
-
-
-
-/**
- * This should be called by parent when event raised.
- */ 
-void LidarComms::wifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
-{
-    if (debugMode)
-        Serial.printf("WiFi event %d raised\n", event);
-
-    switch(event) {
-        case SYSTEM_EVENT_STA_GOT_IP:
-            wifiConnectedEvent();
-        break;
-
-        case SYSTEM_EVENT_STA_DISCONNECTED:
-            wifiDisconnectedEvent();
-        break;
-
-        default: break;
-    }
-    
-}
-
-void LidarComms::wifiConnectedEvent()
-{
-    if (brain) {
-        Serial.println("Client connected.");
-        return;
-    }
-
-    connected = true;
-
-    if (AUTO_DESTINATION)
-        destination = WiFi.gatewayIP();
-
-    localIp = WiFi.localIP();
-    udp.begin(localIp,PORT);
-    if (debugMode) {
-        Serial.print("WiFi connected! IP address: ");
-        Serial.println(localIp);  
-        Serial.print("Attaching to destination: ");
-        Serial.println(destination);
-    }
-    
-    sayHello();
-}
-
-/**
- * This should be called by parent when event raised.
- */ 
-void LidarComms::wifiDisconnectedEvent()
-{
-    if (brain) {
-        Serial.println("Client lost connection.");
-        return;
-    }
-
-    connected = false;
-    Serial.println("WiFi lost connection.");
-}
-
-/**
- * Construct an IP address from our local IP and the last segment of the client if stored
- */
-IPAddress LidarComms::getClientIp(int clientId)
-{
-    if (debugMode) {
-        Serial.printf("Getting client IP for %d with base ", clientId);
-        Serial.println(localIp);
-    }
-    if (localIp && clientIps[clientId] != NULL && clientIps[clientId] != 0) {
-        IPAddress clientIp = {localIp[0], localIp[1], localIp[2], clientIps[clientId]};
-        return clientIp;
-    }
-    return (0,0,0,0);
-}
-
-/**
- * Establish a WiFi connection
- */ 
-bool LidarComms::connectWifi()
-{
-    if (connected || brain) {
-        return true;
-    }
-
-
-    long currentTime = millis();
-    if ((currentTime - lastConnectionTime) < RECONNECT_INTERVAL) {
-        return false;
-    }
-    
-    lastConnectionTime = currentTime;
-    
-    disconnectWifi();
-
-    Serial.print("Connecting to Wifi on ");
-    Serial.println(WIFI_SSID);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-
-    return true;
-}
-
-/**
- * Disconnect from Wifi.
- * @TODO: Should we raise an event here?
- */
-bool LidarComms::disconnectWifi()
-{
-    WiFi.disconnect();
-    return true;
-}
-
-/**
- * Listen for UDP messages
- */ 
-void LidarComms::startUdp()
-{
-    udp.begin(PORT);
-    Serial.printf("Ready for UDP messages on port %d.\n\n", PORT);
-}
-
-/**
- * Set IP address. Should only be used by Brain
- */ 
-void LidarComms::setLocalIp(IPAddress localIp)
-{
-    this->localIp = localIp;
-}
-
-/**
- * Set callback to handle messages
- */ 
-void LidarComms::setMessageHandler(handleMessageCallback messageHandler)
-{
-    this->messageHandler = messageHandler;
-}
-
-/**
- * Set callback to handle connections
- */
-void LidarComms::setConnectionHandler(handleClientConnection connectionHandler)
-{
-    this->connectionHandler = connectionHandler;
-} 
-
-/**
- * Set callback to handle disconnections
- */
-void LidarComms::setDisconnectionHandler(handleClientConnection disconnectionHandler)
-{
-    this->disconnectionHandler = connectionHandler;
-} 
-
-/**
- * 
- */
-char *LidarComms::getWifiSsid()
-{
-    return WIFI_SSID;
-}
-
-/**
- * 
- */
-bool LidarComms::isConnected()
-{
-    return connected;
-}
-
-/**
- * 
- */
-int LidarComms::getClientId()
-{
-    return clientId;
-}
-
-long LidarComms::getLastMessageTime()
-{
-    return lastMessageTime;
-}
-
-/**
- * Send ID to specific client
- */
-bool LidarComms::messageId(int to)
-{
-    return sendMessage(to, MSG_ID, 0, clientId);
-}
-
-/**
- * Broadcast ID to network
- */
-bool LidarComms::messageBroadcastId()
-{
-    return sendMessageBroadcast(MSG_ID, 0, clientId);
-}
-
-/**
- * Message info about all known clients
- */
-bool LidarComms::messageClientInfo(int to)
-{
-    for (int i = 0; i < sizeof(clientIps)/sizeof(clientIps[0]); i++) {
-        int ipSegment = clientIps[i];
-        if (ipSegment != 0)
-            sendMessage(to, MSG_CLIENT_INFO, ipSegment, i);
-    }
-    return true;
-}
-
-/**
- * Send a client a command to start polling
- */ 
-bool LidarComms::messageBroadcastPollCommand()
-{
-    return sendMessage(0, MSG_POLL_CMD, 0, 0);
-}
-
-/**
- * Confirm a command to start polling
- */ 
-bool LidarComms::messageBroadcastPollConfirm()
-{
-    return sendMessage(0, MSG_POLL_CONFIRM, 0, 0);
-}
-
-/**
- * Broadcast a polling result
- */ 
-bool LidarComms::messageBroadcastPollResult(int position, int distance)
-{
-    return sendMessage(0, MSG_POLL_RESULT, position, distance);
-}
-
-/**
- * Broadcast a stop command
- */ 
-bool LidarComms::messageBroadcastStopCommand()
-{
-    return sendMessage(0, MSG_STOP_CMD, 0, 0);
-}
-
-/**
- * Broadcast system restart command (brain only)
- */
-bool LidarComms::messageBroadcastSystemRestartCommand(int reason)
-{
-    if (!brain) {
-        return false;
-    }
-    return sendMessageBroadcast(MSG_SYSTEM_RESTART_CMD, 0, reason);
-}
-
-/**
- * Broadcast unrecoverable system failure
- */ 
-bool LidarComms::messageBroadcastSystemFailure(int reason)
-{
-    return sendMessageBroadcast(MSG_SYSTEM_FAILURE, 0, reason);
-}
-
-/**
- * Decompile message bytes
- */
-int LidarComms::decompileMessage(char *message, int msgStart) {
-    byte b[4];
-    for (int i = msgStart; i < (msgStart + 4); i++) {
-        b[(i - msgStart)] = message[i];
-    }
-    
-    return (b[3] << 24) | (b[2] << 16) | (b[1] << 8) | b[0];
-}
-
+#include "LidarComms.h"
+
+static_assert(sizeof(WireHeader) == MESSAGE_SIZE, "WireHeader must match MESSAGE_SIZE");
+static_assert(sizeof(WireSample) == POLL_SAMPLE_SIZE, "WireSample must match POLL_SAMPLE_SIZE");
+
+LidarComms::LidarComms(int clientId, bool isBrain = false, bool debugMode = false)
+{
+    this->clientId = clientId;
+    this->brain = isBrain; 
+    this->debugMode = debugMode;
+    this->connected = false;
+    this->lastConnectionTime = 0;
+    this->lastMessageTime = 0;
+    this->messageHandler = NULL;
+    this->connectionHandler = NULL;
+    this->disconnectionHandler = NULL;
+    this->scanProfileHandler = NULL;
+    this->pollSampleHandler = NULL;
+    this->pollSampleContext = NULL;
+    this->receiveTime = 0;
+    this->receiveClient = NULL;
+    this->batchCount = 0;
+    this->pollSequence = 0;
+    memset(&sendStats, 0, sizeof(sendStats));
+    this->compactPollResults = COMPACT_POLL_RESULTS;
+    this->drainBudgetExhausted = false;
+    this->udp = &wifiUdp;
+    this->log = &Serial;
+
+    for (int i = 0; i <= MAX_DESCRIPTOR; i++) {
+        descriptorTable[i].builtIn = NULL;
+        descriptorTable[i].handler = NULL;
+        descriptorTable[i].context = NULL;
+    }
+    setBuiltInHandler(MSG_ID, &LidarComms::handleId);
+    setBuiltInHandler(MSG_CLIENT_INFO, &LidarComms::handleClientInfo);
+    setBuiltInHandler(MSG_HEARTBEAT, &LidarComms::handleHeartbeat);
+    setBuiltInHandler(MSG_POLL_RESULT, &LidarComms::handlePollResult);
+    setBuiltInHandler(MSG_POLL_RESULT_BATCH, &LidarComms::handlePollResultBatch);
+    setBuiltInHandler(MSG_POLL_RESULT_COMPACT, &LidarComms::handleCompactPollResult);
+    setBuiltInHandler(MSG_POLL_NACK, &LidarComms::handlePollNack);
+    setBuiltInHandler(MSG_SCAN_PROFILE, &LidarComms::handleScanProfile);
+    setBuiltInHandler(MSG_CLOCK_PING, &LidarComms::handleClockPing);
+    setBuiltInHandler(MSG_CLOCK_PONG, &LidarComms::handleClockPong);
+}
+
+void LidarComms::setBuiltInHandler(int descriptor, bool (LidarComms::*builtIn)(const MessageView &message))
+{
+    descriptorTable[descriptor].builtIn = builtIn;
+}
+
+/**
+ * Check if a packet exists on the UDP stack and if so, handle it. Returns whether a packet was handled.
+ */
+bool LidarComms::checkUdpPacket()
+{
+    // parsePacket() pulls a single datagram off the stack, i.e. one message handled per call
+    int packetSize = udp->parsePacket();
+    if (packetSize <= 0) {
+        return false;
+    }
+
+    IPAddress remoteIp = udp->remoteIP();
+    if (debugMode) {
+        log->printf("Packet received: %d bytes from ", packetSize);
+        log->println(remoteIp);
+    }
+    int readLen = udp->read(packetBuffer, BUFFER_SIZE);
+    if (!localIp) {
+        if (brain) 
+            localIp = WiFi.softAPIP();
+    }
+    handleMessage(remoteIp, packetBuffer, readLen);
+    return true;
+}
+
+/**
+ * Handle every packet waiting on the UDP stack, up to budget. Returns how many were handled.
+ * If the budget ran out there may be more waiting; see isDrainBudgetExhausted().
+ */
+int LidarComms::drainUdpPackets(int budget)
+{
+    int handled = 0;
+    while (handled < budget && checkUdpPacket()) {
+        handled++;
+    }
+
+    drainBudgetExhausted = (handled >= budget);
+    if (debugMode && drainBudgetExhausted)
+        log->printf("Drain budget of %d packets exhausted\n", budget);
+
+    return handled;
+}
+
+/**
+ * Whether the last drainUdpPackets() call stopped on its budget rather than an empty stack
+ */
+bool LidarComms::isDrainBudgetExhausted()
+{
+    return drainBudgetExhausted;
+}
+
+/**
+ * Send messages to all clients (broadcast)
+ */
+bool LidarComms::sendMessageBroadcast(int descriptor, int metaData, int value)
+{
+    return sendMessage(0, descriptor, metaData, value);
+}
+
+/**
+ * Where to send a message for a client: its cached address, or broadcast if it is 0 or we don't know it yet.
+ * Unicast goes at the link's negotiated rate and is acknowledged; broadcast goes at the lowest basic rate
+ * and is not, so broadcast is kept for discovery.
+ */
+IPAddress LidarComms::resolveClient(int clientId)
+{
+    IPAddress address = getClientIp(clientId);
+    if (!address)
+        return IPAddress {255,255,255,255};
+    return address;
+}
+
+/**
+ * Send message to a specific client
+ */
+bool LidarComms::sendMessage(int to, int descriptor, int metaData, int value)
+{
+    return sendMessageToIp(resolveClient(to), to, descriptor, metaData, value);
+}
+
+/**
+ * Send a message to a specific IP address 
+ */ 
+bool LidarComms::sendMessageToIp(IPAddress ipTo, int to, int descriptor, int metaData, int value)
+{
+    byte message[MESSAGE_SIZE];
+    // Identification messages advertise what we can decode
+    encodeHeader(message, clientId, to, descriptor, metaData, value, descriptor == MSG_ID ? LOCAL_CAPABILITIES : 0);
+    if (debugMode) {
+        log->printf("Sending %d message to (%d) => ", descriptor, to);
+        log->println(ipTo);
+    }
+    return sendPacketToIp(ipTo, to, descriptor, (char*)message, sizeof message);
+}
+
+/**
+ * Send a pre-built packet (header included) to a specific IP address
+ */
+bool LidarComms::sendPacketToIp(IPAddress ipTo, int to, int descriptor, const char *packet, int length)
+{
+    if (debugMode) {
+        log->printf("Sending %d packet of %d bytes to (%d) => ", descriptor, length, to);
+        log->println(ipTo);
+    }
+
+    // The stack can refuse a packet at any stage, e.g. when out of buffers
+    bool sent = udp->beginPacket(ipTo, PORT)
+        && udp->write((const byte*)packet, length) == (size_t)length
+        && udp->endPacket();
+    if (!sent) {
+        sendStats.sendFailures++;
+        if (debugMode)
+            log->printf("Sending %d packet failed\n", descriptor);
+        return false;
+    }
+
+    ClientInfo *client = clients.find(to);
+    if (client) {
+        client->sent++;
+        client->lastSent = millis();
+    }
+    return true;
+}
+
+/**
+ *  Handle incoming messages
+ */
+void LidarComms::handleMessage(IPAddress remoteIp, char *message, int length) {
+    // Taken first, as clock sync pings depend on it
+    receiveTime = micros();
+
+    MessageView view(message, length);
+    if (!view.isComplete()) {
+        if (debugMode)
+            log->printf("Message discarded for being undersized: %d\n", length);
+        return;
+    }
+
+    if (!view.isSupported()) {
+        if (debugMode)
+            log->printf("Message discarded for unsupported version: %d\n", view.version());
+        return;
+    }
+
+    uint32_t now = millis();
+    lastMessageTime = now;
+
+    int msgFrom = view.from();
+    int msgTo = view.to();
+    int msgDescriptor = view.descriptor();
+
+    if (debugMode)
+        log->printf("(Lib) Message received:\n\tFrom: %d\n\tTo: %d\n\tDescriptor: %d\n\tMetaData: %d\n\tValue: %d\n\n", msgFrom, msgTo, msgDescriptor, view.metaData(), view.value());
+
+    // Clients only ever see messages meant for them, so they needn't check again
+    if (msgTo != clientId && msgTo != 0)
+        return;
+
+    if (msgDescriptor > MAX_DESCRIPTOR) {
+        if (debugMode)
+            log->printf("Message discarded for unknown descriptor: %d\n", msgDescriptor);
+        return;
+    }
+
+    // Anyone we hear from is registered, so their stream and clock are tracked before they say hello
+    receiveClient = msgFrom != clientId ? clients.add(msgFrom, now) : NULL;
+    if (receiveClient) {
+        receiveClient->lastReceived = now;
+        receiveClient->received++;
+        if (!receiveClient->address)
+            clients.setAddress(receiveClient, remoteIp);
+    } else if (debugMode && msgFrom != clientId) {
+        log->printf("Client %d not registered, %d of %d slots in use\n", msgFrom, clients.getCount(), REGISTRY_SIZE);
+    }
+
+    const DescriptorEntry &entry = descriptorTable[msgDescriptor];
+    receiveAddress = remoteIp;
+    if (entry.builtIn && !(this->*entry.builtIn)(view))
+        return;
+
+    // Hand over to client
+    if (entry.handler)
+        entry.handler(entry.context, view);
+    else if (messageHandler)
+        messageHandler(view.from(), msgTo, msgDescriptor, view.metaData(), view.value());
+}
+
+/**
+ * Identification message: remember where the client is and what it can decode, and say hello back if asked.
+ * A client saying hello may have restarted its poll stream from sequence 0, so tracking it starts over, gaps
+ * waiting on NACKs and all. The connection handler only fires the first time a client identifies itself after
+ * being registered, so one saying hello again, e.g. after a brief dropout, isn't taken for a new connection;
+ * one that restarted has been silent long enough to be dropped.
+ */
+bool LidarComms::handleId(const MessageView &message)
+{
+    int from = message.from();
+    addClientAddress(from, receiveAddress);
+    bool connecting = receiveClient && !receiveClient->identified;
+    if (receiveClient) {
+        receiveClient->capabilities = message.flags();
+        receiveClient->identified = true;
+    }
+
+    if (connecting && connectionHandler) {
+        if (debugMode)
+            log->println("Firing connection handler");
+        connectionHandler(from);
+    }
+
+    // Saying hello, so say hello back
+    if (message.metaData() == 1) {
+        if (receiveClient)
+            receiveClient->streamTracker.reset();
+        sayHelloBack(from);
+    }
+    return true;
+}
+
+/**
+ * Client information message
+ */
+bool LidarComms::handleClientInfo(const MessageView &message)
+{
+    addClientInfo(message.value(), message.metaData());
+    return true;
+}
+
+/**
+ * Heartbeats only need to arrive, which handleMessage has already noted. One from a client that hasn't
+ * identified itself, e.g. because we restarted, asks it to, so we learn what it can do.
+ */
+bool LidarComms::handleHeartbeat(const MessageView &message)
+{
+    if (receiveClient && !receiveClient->identified)
+        sendMessage(message.from(), MSG_ID, 1, clientId);
+    return false;
+}
+
+/**
+ * Single results carry no timestamp, so they are stamped on arrival. Without a sample handler they go to the
+ * client as they are.
+ */
+bool LidarComms::handlePollResult(const MessageView &message)
+{
+    if (!pollSampleHandler)
+        return true;
+
+    PollSample sample;
+    sample.angle = message.metaData();
+    sample.distance = message.value();
+    sample.timestamp = receiveTime;
+    handlePollSample(message.from(), message.to(), sample, false);
+    return false;
+}
+
+/**
+ * Unpack a batched poll result, handing each sample to the client as a MSG_POLL_RESULT
+ */
+bool LidarComms::handlePollResultBatch(const MessageView &message)
+{
+    int count = message.metaData();
+    if (count < 0 || count > BATCH_MAX_SAMPLES || message.payloadLength() < (count * POLL_SAMPLE_SIZE)) {
+        if (debugMode)
+            log->printf("Batch discarded, %d samples do not fit in %d bytes\n", count, message.size());
+        return false;
+    }
+
+    if (!messageHandler && !pollSampleHandler)
+        return false;
+
+    int from = message.from();
+    int to = message.to();
+    uint32_t sequence = message.value();
+    bool retransmit = message.flags() & FLAG_RETRANSMIT;
+    const uint8_t *data = message.payload();
+    PollSample sample;
+    for (int i = 0; i < count; i++, data += POLL_SAMPLE_SIZE) {
+        if (!trackPollSample(from, sequence + i, retransmit))
+            continue;
+        sample.angle = (int32_t)wireLoad32(data + offsetof(WireSample, Angle));
+        sample.distance = (int32_t)wireLoad32(data + offsetof(WireSample, Distance));
+        sample.timestamp = wireLoad32(data + offsetof(WireSample, Timestamp));
+        handlePollSample(from, to, sample, true);
+    }
+    return false;
+}
+
+/**
+ * Unpack a compact poll result stream, handing each sample to the client as a MSG_POLL_RESULT
+ */
+bool LidarComms::handleCompactPollResult(const MessageView &message)
+{
+    if (!messageHandler && !pollSampleHandler)
+        return false;
+
+    int from = message.from();
+    int to = message.to();
+    int count = message.metaData();
+    uint32_t sequence = message.value();
+    bool retransmit = message.flags() & FLAG_RETRANSMIT;
+    CompactStreamReader reader(message.payload(), message.payloadLength());
+    PollSample sample;
+    for (int i = 0; i < count && reader.next(sample); i++) {
+        if (trackPollSample(from, sequence + i, retransmit))
+            handlePollSample(from, to, sample, true);
+    }
+
+    if (debugMode && !reader.isValid())
+        log->printf("Compact poll result truncated, expected %d samples in %d bytes\n", count, message.size());
+    return false;
+}
+
+/**
+ * Check a received sample against its sender's stream. Returns false if it is a duplicate to be dropped.
+ */
+bool LidarComms::trackPollSample(int from, uint32_t sequence, bool retransmit)
+{
+    if (!receiveClient || receiveClient->id != from)
+        return true;
+    return receiveClient->streamTracker.accept(sequence, retransmit, millis());
+}
+
+/**
+ * Resend the samples a NACK asks for, as far as the retransmit buffer still holds them
+ */
+bool LidarComms::handlePollNack(const MessageView &message)
+{
+    uint32_t first = message.metaData();
+    uint32_t end = first + (uint32_t)message.value();
+    uint32_t held = pollSequence < RETRANSMIT_BUFFER_SIZE ? pollSequence : RETRANSMIT_BUFFER_SIZE;
+    uint32_t oldest = pollSequence - held;
+
+    // Clip to what was sent and is still held
+    if ((int32_t)(first - oldest) < 0)
+        first = oldest;
+    if ((int32_t)(end - pollSequence) > 0)
+        end = pollSequence;
+    if ((int32_t)(end - first) <= 0) {
+        if (debugMode)
+            log->printf("NACK for %d samples from %d no longer held\n", message.value(), message.metaData());
+        return false;
+    }
+
+    sendStats.nacks++;
+    while (first != end) {
+        // In runs that neither wrap the buffer nor overfill a datagram
+        uint32_t index = first & (RETRANSMIT_BUFFER_SIZE - 1);
+        uint32_t count = end - first;
+        if (count > RETRANSMIT_BUFFER_SIZE - index)
+            count = RETRANSMIT_BUFFER_SIZE - index;
+        if (count > BATCH_MAX_SAMPLES)
+            count = BATCH_MAX_SAMPLES;
+
+        sendPollResults(retransmitBuffer + index, count, first, FLAG_RETRANSMIT);
+        sendStats.retransmitted += count;
+        first += count;
+    }
+    return false;
+}
+
+/**
+ * Hand a received sample to the client: whole to the sample handler if there is one, otherwise as a
+ * MSG_POLL_RESULT. Timestamps taken on a synced sender's clock are moved onto ours; anything else gets the
+ * time it arrived.
+ */
+void LidarComms::handlePollSample(int from, int to, PollSample &sample, bool remoteClock)
+{
+    if (!pollSampleHandler) {
+        messageHandler(from, to, MSG_POLL_RESULT, sample.angle, sample.distance);
+        return;
+    }
+
+    if (remoteClock) {
+        ClockSync *clockSync = getClockSync(from);
+        if (clockSync && clockSync->isSynced() && clientHasCapability(from, CAP_CLOCK_SYNC))
+            sample.timestamp = clockSync->toLocal(sample.timestamp);
+        else
+            sample.timestamp = receiveTime;
+    }
+
+    pollSampleHandler(pollSampleContext, from, sample);
+}
+
+/**
+ * Answer a clock ping with when it arrived and when the answer left, both on our clock. The ping's own
+ * send time comes back in Value so the pinger needs to keep nothing.
+ */
+bool LidarComms::handleClockPing(const MessageView &message)
+{
+    int from = message.from();
+    uint8_t packet[MESSAGE_SIZE + CLOCK_PONG_SIZE];
+    encodeHeader(packet, clientId, from, MSG_CLOCK_PONG, message.metaData(), message.value());
+    wireStore32(packet + MESSAGE_SIZE, receiveTime);
+
+    IPAddress dest = resolveClient(from);
+
+    // As late as possible, so the time spent sending counts as network delay rather than ours
+    wireStore32(packet + MESSAGE_SIZE + 4, micros());
+    sendPacketToIp(dest, from, MSG_CLOCK_PONG, (char*)packet, sizeof packet);
+    return false;
+}
+
+/**
+ * Feed a clock pong into the sender's clock sync
+ */
+bool LidarComms::handleClockPong(const MessageView &message)
+{
+    ClockSync *clockSync = getClockSync(message.from());
+    if (!clockSync || message.payloadLength() < CLOCK_PONG_SIZE)
+        return false;
+
+    uint32_t received = wireLoad32(message.payload());
+    uint32_t replied = wireLoad32(message.payload() + 4);
+    bool accepted = clockSync->addExchange(message.value(), received, replied, receiveTime);
+    if (debugMode)
+        log->printf("Clock pong from %d: %s, offset %d us, skew %.2f ppm, round trip %u us\n", message.from(),
+            accepted ? "accepted" : "rejected", clockSync->getOffset(receiveTime), clockSync->getSkewPpm(), clockSync->getRoundTrip());
+    return false;
+}
+
+/**
+ * Decode a scan profile and hand it to the client. Profiles that don't decode are rejected here.
+ */
+bool LidarComms::handleScanProfile(const MessageView &message)
+{
+    int profileId = message.metaData();
+    ScanProfile profile;
+    if (!decodeScanProfile(message.payload(), message.payloadLength(), profile)) {
+        if (debugMode)
+            log->printf("Scan profile %d discarded as invalid\n", profileId);
+        messageScanProfileConfirm(message.from(), profileId, false);
+        return false;
+    }
+
+    if (scanProfileHandler)
+        scanProfileHandler(message.from(), profileId, profile);
+    return false;
+}
+
+/**
+ * Broadcast ID on network (say "Hello")
+ */ 
+bool LidarComms::sayHello()
+{
+    if (!connected)
+        return false;
+    
+    log->printf("-> Hello, I am client %d\n", clientId);
+    return sendMessageBroadcast(MSG_ID, 1, clientId);
+}
+
+/**
+ * Respond to a hello request
+ */ 
+bool LidarComms::sayHelloBack(int to)
+{
+    if (!brain && !connected)
+        return false;
+    
+    log->printf("-> Hello back %d! I am client %d\n", to, clientId);
+    return sendMessage(to, MSG_ID, 2, clientId);
+}
+
+/**
+ * Add info about a remote client from the last segment of its IP, as passed on in MSG_CLIENT_INFO.
+ * Ignored until we know our own IP to complete it with.
+ */ 
+void LidarComms::addClientInfo(int clientId, int ipSegment)
+{
+    if (debugMode)
+        log->printf("Received info on client %d, IP segment %d\n", clientId, ipSegment);
+
+    if (!localIp || ipSegment <= 0 || ipSegment > 255)
+        return;
+
+    addClientAddress(clientId, IPAddress {localIp[0], localIp[1], localIp[2], (uint8_t)ipSegment});
+}
+
+/**
+ * Register a remote client at an address. Resolved once when it says hello and used for everything sent to it.
+ */
+void LidarComms::addClientAddress(int clientId, IPAddress address)
+{
+    // Don't track ourselves
+    if (clientId == this->clientId)
+        return;
+
+    ClientInfo *client = clients.add(clientId, millis());
+    if (!client) {
+        if (debugMode)
+            log->printf("No room to register client %d\n", clientId);
+        return;
+    }
+
+    if (debugMode && client->address != address) {
+        log->printf("Client %d is at ", clientId);
+        log->println(address);
+    }
+    clients.setAddress(client, address);
+}
+
+/**
+ * Drop a client, e.g. when it disconnects, firing the disconnection handler. Messages for it are broadcast
+ * until it is heard from again.
+ */
+void LidarComms::forgetClient(int clientId)
+{
+    if (!clients.remove(clientId))
+        return;
+
+    if (debugMode)
+        log->printf("Client %d dropped\n", clientId);
+    if (disconnectionHandler)
+        disconnectionHandler(clientId);
+}
+
+/**
+ * Drop every client
+ */
+void LidarComms::forgetClients()
+{
+    for (int slot = 0; slot < REGISTRY_SIZE; slot++) {
+        ClientInfo *client = clients.getSlot(slot);
+        if (client)
+            forgetClient(client->id);
+    }
+}
+
+/**
+ * Drop clients that haven't been heard from for CLIENT_TIMEOUT if they heartbeat, or QUIET_CLIENT_TIMEOUT if
+ * they don't, so anyone who only passed by doesn't hold a slot for good. Heartbeat those we haven't sent
+ * anything to for HEARTBEAT_INTERVAL. Returns how many were dropped. Call regularly.
+ */
+int LidarComms::checkClients()
+{
+    uint32_t now = millis();
+    int dropped = 0;
+    for (int slot = 0; slot < REGISTRY_SIZE; slot++) {
+        ClientInfo *client = clients.getSlot(slot);
+        if (!client)
+            continue;
+
+        bool heartbeats = client->capabilities & CAP_HEARTBEAT;
+        if (now - client->lastReceived > (uint32_t)(heartbeats ? CLIENT_TIMEOUT : QUIET_CLIENT_TIMEOUT)) {
+            forgetClient(client->id);
+            dropped++;
+        } else if (heartbeats && now - client->lastSent >= HEARTBEAT_INTERVAL) {
+            messageHeartbeat(client->id);
+        }
+    }
+    return dropped;
+}
+
+
+
+/**
+ * This should be called by parent when event raised.
+ */ 
+void LidarComms::wifiEvent(WiFiEvent_t event, WiFiEventInfo_t)
+{
+    if (debugMode)
+        log->printf("WiFi event %d raised\n", event);
+
+    switch(event) {
+        case SYSTEM_EVENT_STA_GOT_IP:
+            wifiConnectedEvent();
+        break;
+
+        case SYSTEM_EVENT_STA_DISCONNECTED:
+            wifiDisconnectedEvent();
+        break;
+
+        default: break;
+    }
+    
+}
+
+void LidarComms::wifiConnectedEvent()
+{
+    if (brain) {
+        log->println("Client connected.");
+        return;
+    }
+
+    connected = true;
+
+    if (AUTO_DESTINATION)
+        destination = WiFi.gatewayIP();
+
+    // The brain is the AP, so it can be sent to directly before it has said hello
+    localIp = WiFi.localIP();
+    if (destination)
+        addClientAddress(BRAIN_CLIENT, destination);
+    // Bound to the station IP, as before transports could be swapped; the UDP interface only has the port
+    if (udp == &wifiUdp)
+        wifiUdp.begin(localIp, PORT);
+    else
+        udp->begin(PORT);
+    if (debugMode) {
+        log->print("WiFi connected! IP address: ");
+        log->println(localIp);  
+        log->print("Attaching to destination: ");
+        log->println(destination);
+    }
+    
+    sayHello();
+}
+
+/**
+ * This should be called by parent when event raised.
+ */ 
+void LidarComms::wifiDisconnectedEvent()
+{
+    if (brain) {
+        log->println("Client lost connection.");
+        return;
+    }
+
+    connected = false;
+    forgetClients();
+    log->println("WiFi lost connection.");
+}
+
+/**
+ * A client's address, or 0 if we don't know it
+ */
+IPAddress LidarComms::getClientIp(int clientId)
+{
+    ClientInfo *client = clients.find(clientId);
+    if (!client)
+        return IPAddress();
+    return client->address;
+}
+
+/**
+ * Establish a WiFi connection
+ */ 
+bool LidarComms::connectWifi()
+{
+    if (connected || brain) {
+        return true;
+    }
+
+
+    long currentTime = millis();
+    if ((currentTime - lastConnectionTime) < RECONNECT_INTERVAL) {
+        return false;
+    }
+    
+    lastConnectionTime = currentTime;
+    
+    disconnectWifi();
+
+    log->print("Connecting to Wifi on ");
+    log->println(WIFI_SSID);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+
+    return true;
+}
+
+/**
+ * Disconnect from Wifi.
+ * @TODO: Should we raise an event here?
+ */
+bool LidarComms::disconnectWifi()
+{
+    WiFi.disconnect();
+    return true;
+}
+
+/**
+ * Listen for UDP messages
+ */ 
+void LidarComms::startUdp()
+{
+    udp->begin(PORT);
+    log->printf("Ready for UDP messages on port %d.\n\n", PORT);
+}
+
+/**
+ * Use a different UDP transport in place of WiFi, e.g. for running on a host. Call before startUdp().
+ */
+void LidarComms::setTransport(UDP *transport)
+{
+    this->udp = transport;
+}
+
+/**
+ * Print status and debug text somewhere other than Serial, e.g. so it can't land in the middle of binary output
+ * written by another task
+ */
+void LidarComms::setLog(Print *log)
+{
+    this->log = log;
+}
+
+/**
+ * Choose whether poll results are sent compact (when the brain supports it) or as plain batches
+ */
+void LidarComms::setCompactPollResults(bool compactPollResults)
+{
+    this->compactPollResults = compactPollResults;
+}
+
+/**
+ * Set IP address. Should only be used by Brain
+ */ 
+void LidarComms::setLocalIp(IPAddress localIp)
+{
+    this->localIp = localIp;
+}
+
+/**
+ * Set callback to handle messages
+ */ 
+void LidarComms::setMessageHandler(handleMessageCallback messageHandler)
+{
+    this->messageHandler = messageHandler;
+}
+
+/**
+ * Set callback to handle connections
+ */
+void LidarComms::setConnectionHandler(handleClientConnection connectionHandler)
+{
+    this->connectionHandler = connectionHandler;
+} 
+
+/**
+ * Set callback to handle disconnections
+ */
+void LidarComms::setDisconnectionHandler(handleClientConnection disconnectionHandler)
+{
+    this->disconnectionHandler = disconnectionHandler;
+} 
+
+/**
+ * Set callback to handle scan profiles. Whoever handles them should reply with messageScanProfileConfirm().
+ */
+void LidarComms::setScanProfileHandler(handleScanProfileCallback scanProfileHandler)
+{
+    this->scanProfileHandler = scanProfileHandler;
+}
+
+/**
+ * Set callback to take poll results whole, timestamp included, along with context. Without one, they go to
+ * the message handler as MSG_POLL_RESULT.
+ */
+void LidarComms::setPollSampleHandler(handlePollSampleCallback pollSampleHandler, void *context)
+{
+    this->pollSampleHandler = pollSampleHandler;
+    this->pollSampleContext = context;
+}
+
+/**
+ * Set callback to handle one message descriptor, in place of the message handler. It is given the message
+ * as received, payload included, along with context. Returns false if the descriptor is out of range.
+ */
+bool LidarComms::setDescriptorHandler(int descriptor, handleDescriptorCallback handler, void *context)
+{
+    if (descriptor < 0 || descriptor > MAX_DESCRIPTOR)
+        return false;
+
+    descriptorTable[descriptor].handler = handler;
+    descriptorTable[descriptor].context = context;
+    return true;
+}
+
+/**
+ * 
+ */
+char *LidarComms::getWifiSsid()
+{
+    return WIFI_SSID;
+}
+
+/**
+ * 
+ */
+bool LidarComms::isConnected()
+{
+    return connected;
+}
+
+/**
+ * 
+ */
+int LidarComms::getClientId()
+{
+    return clientId;
+}
+
+long LidarComms::getLastMessageTime()
+{
+    return lastMessageTime;
+}
+
+/**
+ * Whether a client is registered: heard from, and not since timed out or forgotten
+ */
+bool LidarComms::isClientConnected(int clientId)
+{
+    return clients.find(clientId) != NULL;
+}
+
+/**
+ * Whether a client advertised a capability in its MSG_ID
+ */
+bool LidarComms::clientHasCapability(int clientId, int capability)
+{
+    ClientInfo *client = clients.find(clientId);
+    return client && (client->capabilities & capability) != 0;
+}
+
+/**
+ * Loss, reorder and duplicate counts for the poll stream received from a client, or NULL if it isn't registered
+ */
+const PollStreamStats *LidarComms::getReceiveStats(int clientId)
+{
+    ClientInfo *client = clients.find(clientId);
+    if (!client)
+        return NULL;
+    return &client->streamTracker.getStats();
+}
+
+/**
+ * Samples missing from a client's poll stream that may still be recovered
+ */
+uint32_t LidarComms::getMissingSamples(int clientId)
+{
+    ClientInfo *client = clients.find(clientId);
+    if (!client)
+        return 0;
+    return client->streamTracker.getMissing();
+}
+
+/**
+ * Counts for the poll stream we send: samples, NACKs answered, samples retransmitted and send failures
+ */
+const PollStreamStats &LidarComms::getSendStats()
+{
+    return sendStats;
+}
+
+/**
+ * Clock sync state for a client, or NULL if it isn't registered. Only the brain's ever gets fed.
+ */
+ClockSync *LidarComms::getClockSync(int clientId)
+{
+    ClientInfo *client = clients.find(clientId);
+    if (!client)
+        return NULL;
+    return &client->clockSync;
+}
+
+/**
+ * Everything known about a client, counters included, or NULL if it isn't registered
+ */
+const ClientInfo *LidarComms::getClient(int clientId)
+{
+    return clients.find(clientId);
+}
+
+/**
+ * The client in a registry slot, or NULL if it is free. For walking every client, 0 to REGISTRY_SIZE - 1.
+ */
+const ClientInfo *LidarComms::getClientSlot(int slot)
+{
+    return clients.getSlot(slot);
+}
+
+/**
+ * Send ID to specific client
+ */
+bool LidarComms::messageId(int to)
+{
+    return sendMessage(to, MSG_ID, 0, clientId);
+}
+
+/**
+ * Broadcast ID to network
+ */
+bool LidarComms::messageBroadcastId()
+{
+    return sendMessageBroadcast(MSG_ID, 0, clientId);
+}
+
+/**
+ * Message info about all known clients
+ */
+bool LidarComms::messageClientInfo(int to)
+{
+    for (int slot = 0; slot < REGISTRY_SIZE; slot++) {
+        ClientInfo *client = clients.getSlot(slot);
+        if (client && client->address)
+            sendMessage(to, MSG_CLIENT_INFO, client->address[3], client->id);
+    }
+    return true;
+}
+
+/**
+ * Tell a client we are still here
+ */
+bool LidarComms::messageHeartbeat(int to)
+{
+    return sendMessage(to, MSG_HEARTBEAT, 0, 0);
+}
+
+/**
+ * Send a client a command to start polling
+ */ 
+bool LidarComms::messageBroadcastPollCommand()
+{
+    return sendMessage(0, MSG_POLL_CMD, 0, 0);
+}
+
+/**
+ * Send one client a command to start polling, leaving the others as they are
+ */ 
+bool LidarComms::messagePollCommand(int to)
+{
+    return sendMessage(to, MSG_POLL_CMD, 0, 0);
+}
+
+/**
+ * Confirm a command to start polling. Goes straight to the brain once we know where it is.
+ */ 
+bool LidarComms::messageBroadcastPollConfirm()
+{
+    return sendMessage(BRAIN_CLIENT, MSG_POLL_CONFIRM, 0, 0);
+}
+
+/**
+ * Send a polling result. Goes straight to the brain once we know where it is.
+ */ 
+bool LidarComms::messageBroadcastPollResult(int position, int distance)
+{
+    return sendMessage(BRAIN_CLIENT, MSG_POLL_RESULT, position, distance);
+}
+
+/**
+ * Queue a polling result, taken now, to be broadcast as part of a batch. The batch is sent once full.
+ */
+bool LidarComms::queuePollResult(int position, int distance)
+{
+    PollSample sample;
+    sample.angle = position;
+    sample.distance = distance;
+    sample.timestamp = micros();
+    return queuePollResult(sample);
+}
+
+/**
+ * Queue a polling result that was taken earlier, e.g. on another task
+ */
+bool LidarComms::queuePollResult(const PollSample &sample)
+{
+    // A brain that hasn't told us it can unpack batches gets results one at a time
+    if (getPollResultFormat() == MSG_POLL_RESULT)
+        return messageBroadcastPollResult(sample.angle, sample.distance);
+
+    if (batchCount == 0)
+        batchStartTime = millis();
+
+    pendingSamples[batchCount++] = sample;
+
+    if (batchCount >= BATCH_MAX_SAMPLES)
+        return flushPollResults();
+
+    return true;
+}
+
+/**
+ * Send the pending batch if it has been held longer than BATCH_TIMEOUT. Should be called every loop.
+ */
+bool LidarComms::checkPollResultBatch()
+{
+    if (batchCount == 0 || (millis() - batchStartTime) < BATCH_TIMEOUT)
+        return false;
+
+    return flushPollResults();
+}
+
+/**
+ * Broadcast all queued polling results, in the best format the brain supports
+ */
+bool LidarComms::flushPollResults()
+{
+    if (batchCount == 0)
+        return false;
+
+    // Kept by sequence number in case the brain NACKs them
+    for (int i = 0; i < batchCount; i++)
+        retransmitBuffer[(pollSequence + i) & (RETRANSMIT_BUFFER_SIZE - 1)] = pendingSamples[i];
+
+    bool sent = sendPollResults(pendingSamples, batchCount, pollSequence, 0);
+    sendStats.samples += batchCount;
+    pollSequence += batchCount;
+    batchCount = 0;
+    return sent;
+}
+
+/**
+ * Send samples, numbered from sequence, in the best format the brain supports
+ */
+bool LidarComms::sendPollResults(const PollSample *samples, int count, unsigned int sequence, uint8_t flags)
+{
+    bool sent;
+    switch (getPollResultFormat()) {
+        case MSG_POLL_RESULT_COMPACT:
+            sent = sendCompactPollResults(samples, count, sequence, flags);
+        break;
+        case MSG_POLL_RESULT_BATCH:
+            sent = sendBatchPollResults(samples, count, sequence, flags);
+        break;
+        default:
+            sent = true;
+            for (int i = 0; i < count; i++)
+                sent &= messageBroadcastPollResult(samples[i].angle, samples[i].distance);
+        break;
+    }
+    return sent;
+}
+
+/**
+ * NACK any gaps in the poll streams we receive that are due one, giving up on those that have had all
+ * their retries. Returns the number of NACKs sent. Call regularly (brain only).
+ */
+int LidarComms::checkPollStreams()
+{
+    int sent = 0;
+    uint32_t now = millis();
+    for (int slot = 0; slot < REGISTRY_SIZE; slot++) {
+        ClientInfo *client = clients.getSlot(slot);
+        if (!client)
+            continue;
+
+        int retries = (client->capabilities & CAP_RETRANSMIT) ? STREAM_NACK_RETRIES : 0;
+        uint32_t first, count;
+        while (client->streamTracker.nextNack(now, first, count, retries)) {
+            messagePollNack(client->id, first, count);
+            sent++;
+        }
+    }
+    return sent;
+}
+
+/**
+ * Which message type poll results should go out as, based on what the brain advertised
+ */
+int LidarComms::getPollResultFormat()
+{
+    ClientInfo *brainClient = clients.find(BRAIN_CLIENT);
+    int capabilities = brainClient ? brainClient->capabilities : 0;
+    if (compactPollResults && (capabilities & CAP_COMPACT))
+        return MSG_POLL_RESULT_COMPACT;
+
+    if (capabilities & CAP_BATCH)
+        return MSG_POLL_RESULT_BATCH;
+
+    return MSG_POLL_RESULT;
+}
+
+/**
+ * Send samples as a fixed-size batch, at most BATCH_MAX_SAMPLES. Value carries the sequence number of the first sample.
+ */
+bool LidarComms::sendBatchPollResults(const PollSample *samples, int count, unsigned int sequence, uint8_t flags)
+{
+    byte *sample = (byte*)batchBuffer + MESSAGE_SIZE;
+    for (int i = 0; i < count; i++, sample += POLL_SAMPLE_SIZE) {
+        wireStore32(sample + offsetof(WireSample, Angle), samples[i].angle);
+        wireStore32(sample + offsetof(WireSample, Distance), samples[i].distance);
+        wireStore32(sample + offsetof(WireSample, Timestamp), samples[i].timestamp);
+    }
+    encodeHeader((byte*)batchBuffer, clientId, BRAIN_CLIENT, MSG_POLL_RESULT_BATCH, count, sequence, flags);
+
+    int length = MESSAGE_SIZE + (count * POLL_SAMPLE_SIZE);
+    return sendPacketToIp(resolveClient(BRAIN_CLIENT), BRAIN_CLIENT, MSG_POLL_RESULT_BATCH, batchBuffer, length);
+}
+
+/**
+ * Send samples as compact streams, splitting across datagrams in the unlikely case they don't fit in one
+ */
+bool LidarComms::sendCompactPollResults(const PollSample *samples, int count, unsigned int sequence, uint8_t flags)
+{
+    IPAddress dest = resolveClient(BRAIN_CLIENT);
+    bool sent = true;
+    int first = 0;
+    while (first < count) {
+        CompactStreamWriter writer((byte*)batchBuffer + MESSAGE_SIZE, BUFFER_SIZE - MESSAGE_SIZE, samples[first].timestamp);
+        while (first + writer.getCount() < count && writer.add(samples[first + writer.getCount()])) {}
+
+        encodeHeader((byte*)batchBuffer, clientId, BRAIN_CLIENT, MSG_POLL_RESULT_COMPACT, writer.getCount(), sequence + first, flags);
+        sent &= sendPacketToIp(dest, BRAIN_CLIENT, MSG_POLL_RESULT_COMPACT, batchBuffer, MESSAGE_SIZE + writer.length());
+        first += writer.getCount();
+    }
+    return sent;
+}
+
+/**
+ * Broadcast a stop command
+ */ 
+bool LidarComms::messageBroadcastStopCommand()
+{
+    return sendMessage(0, MSG_STOP_CMD, 0, 0);
+}
+
+/**
+ * Send a client a scan profile to follow, tagged with an ID it will confirm
+ */
+bool LidarComms::messageScanProfile(int to, int profileId, const ScanProfile &profile)
+{
+    uint8_t packet[MESSAGE_SIZE + SCAN_PROFILE_MAX_SIZE];
+    int length = encodeScanProfile(packet + MESSAGE_SIZE, SCAN_PROFILE_MAX_SIZE, profile);
+    if (length == 0)
+        return false;
+
+    encodeHeader(packet, clientId, to, MSG_SCAN_PROFILE, profileId, 0);
+
+    return sendPacketToIp(resolveClient(to), to, MSG_SCAN_PROFILE, (char*)packet, MESSAGE_SIZE + length);
+}
+
+/**
+ * Ask a client to resend the poll samples numbered first to first + count - 1 (brain only)
+ */
+bool LidarComms::messagePollNack(int to, uint32_t first, uint32_t count)
+{
+    return sendMessage(to, MSG_POLL_NACK, first, count);
+}
+
+/**
+ * Ping a client's clock (brain only). Our send time goes in Value and comes back in the pong.
+ */
+bool LidarComms::messageClockPing(int to)
+{
+    return sendMessage(to, MSG_CLOCK_PING, 0, micros());
+}
+
+/**
+ * Tell the brain whether a scan profile was taken on
+ */
+bool LidarComms::messageScanProfileConfirm(int to, int profileId, bool accepted)
+{
+    return sendMessage(to, MSG_SCAN_PROFILE_CONFIRM, profileId, accepted);
+}
+
+/**
+ * Broadcast system restart command (brain only)
+ */
+bool LidarComms::messageBroadcastSystemRestartCommand(int reason)
+{
+    if (!brain) {
+        return false;
+    }
+    return sendMessageBroadcast(MSG_SYSTEM_RESTART_CMD, 0, reason);
+}
+
+/**
+ * Broadcast unrecoverable system failure
+ */ 
+bool LidarComms::messageBroadcastSystemFailure(int reason)
+{
+    return sendMessageBroadcast(MSG_SYSTEM_FAILURE, 0, reason);
+}
@@ -1,107 +1,221 @@
-#ifndef LIDARCOMMS_H
-#define LIDARCOMMS_H
-
-#define WIFI_SSID                 "LIDAR319"        // AP SSID
-#define WIFI_PASSWORD             "ItsBigBrainTime" // AP Password
-#define AUTO_DESTINATION          true              // Auto attach to gateway
-#define MESSAGE_SIZE              20                // Size of messages to be expected
-#define PORT                      21337             // UDP Port
-#define BUFFER_SIZE               255               // Size of buffer to read at a time from UDP stack
-#define BROADCAST_ID              false             // Whether to broadcast ID on network
-#define BROADCAST_INTERVAL        10000             // Interval between broadcasting ID
-#define RECONNECT_INTERVAL         1000              // Interval between reconnection attempts
-
-#define MSG_ID                    1           
-#define MSG_CLIENT_INFO           5
-#define MSG_POLL_CMD              10
-#define MSG_POLL_CONFIRM          20
-#define MSG_POLL_RESULT           30
-#define MSG_STOP_CMD              40
-#define MSG_SYSTEM_RESTART_CMD    77
-#define MSG_SYSTEM_FAILURE        99
-
-#include <Arduino.h>
-#include <WiFi.h>
-#include <WiFiClient.h>
-#include <WiFiUdp.h>
-
-
-class LidarComms {
-    typedef void (*handleMessageCallback)(int from, int to, int descriptor, int metaData, int value);
-    typedef void (*handleClientConnection)(int clientId);
-    
-    private:
-        int clientId;
-        bool brain;
-        bool debugMode;
-        bool connected;
-
-        int clientIps[10];
-
-        char *clientName;
-
-        long lastConnectionTime;
-        long lastMessageTime;
-
-        IPAddress localIp;
-        IPAddress destination; // Defaults to client 1 (Bigbrain)
-
-        int decompileMessage(char *message, int msgStart);
-
-        WiFiUDP udp;
-
-        handleMessageCallback messageHandler;
-        handleClientConnection connectionHandler;
-        handleClientConnection disconnectionHandler;
-
-        bool sendMessageBroadcast(int descriptor, int metaData, int value);
-        bool sendMessage(int to, int descriptor, int metaData, int value);
-        bool sendMessageToIp(IPAddress ipTo, int to, int descriptor, int metaData, int value);
-
-        void wifiConnectedEvent();
-        void wifiDisconnectedEvent();
-
-    public:
-        LidarComms(int clientId, bool isBrain, bool debugMode);
-
-        void checkUdpPacket();
-
-        void handleMessage(IPAddress remoteIp, char *message, int length);
-        bool sayHello();
-        bool sayHelloBack(int to);
-
-        void addClientInfo(int clientId, int ipSegment);
-
-        void wifiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
-
-        void broadcastId();
-        IPAddress getClientIp(int clientId);
-        bool connectWifi();
-        bool disconnectWifi();
-        void startUdp();
-
-        void setLocalIp(IPAddress localIp);
-
-        void setMessageHandler(handleMessageCallback messageHandler);
-        void setConnectionHandler(handleClientConnection connectionHandler);
-        void setDisconnectionHandler(handleClientConnection disconnectionHandler);
-
-        char *getWifiSsid();
-        bool isConnected();
-        int getClientId();
-        bool isClientConnected(int clientId);
-        long getLastMessageTime();
-
-        bool messageId(int to);
-        bool messageBroadcastId();
-        bool messageClientInfo(int to);
-        bool messageBroadcastPollCommand();
-        bool messageBroadcastPollConfirm();
-        bool messageBroadcastPollResult(int position, int distance);
-        bool messageBroadcastStopCommand();
-        bool messageBroadcastSystemRestartCommand(int reason = 0);
-        bool messageBroadcastSystemFailure(int reason = 0);
-
-};
-
+#ifndef LIDARCOMMS_H
+#define LIDARCOMMS_H
+
+#define WIFI_SSID                 "LIDAR319"        // AP SSID
+#define WIFI_PASSWORD             "ItsBigBrainTime" // AP Password
+#define AUTO_DESTINATION          true              // Auto attach to gateway
+#define MESSAGE_SIZE              20                // Size of messages to be expected
+#define PORT                      21337             // UDP Port
+#define BUFFER_SIZE               1472              // Size of buffer to read at a time from UDP stack (one full datagram)
+#define BROADCAST_ID              false             // Whether to broadcast ID on network
+#define BROADCAST_INTERVAL        10000             // Interval between broadcasting ID
+#define RECONNECT_INTERVAL         1000              // Interval between reconnection attempts
+#define POLL_SAMPLE_SIZE          12                // Size of a single sample within a batched poll result
+#define BATCH_MAX_SAMPLES         ((BUFFER_SIZE - MESSAGE_SIZE) / POLL_SAMPLE_SIZE) // Samples that fit in one datagram
+#define BATCH_TIMEOUT             500               // Max time (ms) a partial batch is held before being sent
+#define DRAIN_BUDGET              32                // Max packets handled per drainUdpPackets() call
+#define COMPACT_POLL_RESULTS      true              // Send compact poll results when the brain supports them
+#define BRAIN_CLIENT              1                 // Client ID of the brain, which poll results are meant for
+#define RETRANSMIT_BUFFER_SIZE    256               // Sent samples kept for answering NACKs (power of two)
+#define MAX_DESCRIPTOR            99                // Highest message descriptor dispatched; anything above is discarded
+
+#define CAP_BATCH                 0x01              // Capability flag: understands MSG_POLL_RESULT_BATCH
+#define CAP_COMPACT               0x02              // Capability flag: understands MSG_POLL_RESULT_COMPACT
+#define CAP_CLOCK_SYNC            0x04              // Capability flag: answers MSG_CLOCK_PING, and stamps samples in us
+#define CAP_RETRANSMIT            0x08              // Capability flag: answers MSG_POLL_NACK from its retransmit buffer
+#define CAP_HEARTBEAT             0x10              // Capability flag: heartbeats every HEARTBEAT_INTERVAL, so can be timed out
+#define LOCAL_CAPABILITIES        (CAP_BATCH | CAP_COMPACT | CAP_CLOCK_SYNC | CAP_RETRANSMIT | CAP_HEARTBEAT) // Advertised in the flags of our MSG_ID messages
+#define FLAG_RETRANSMIT           0x01              // Header flag on poll results: these samples were asked for again
+#define CLOCK_PONG_SIZE           8                 // Payload of a MSG_CLOCK_PONG: when the ping arrived and when the pong left
+
+#define MSG_ID                    1           
+#define MSG_HEARTBEAT             2
+#define MSG_CLIENT_INFO           5
+#define MSG_POLL_CMD              10
+#define MSG_POLL_CONFIRM          20
+#define MSG_POLL_RESULT           30
+#define MSG_POLL_RESULT_BATCH     31
+#define MSG_POLL_RESULT_COMPACT   32
+#define MSG_POLL_NACK             33
+#define MSG_STOP_CMD              40
+#define MSG_SCAN_PROFILE          50
+#define MSG_SCAN_PROFILE_CONFIRM  51
+#define MSG_CLOCK_PING            60
+#define MSG_CLOCK_PONG            61
+#define MSG_SYSTEM_RESTART_CMD    77
+#define MSG_SYSTEM_FAILURE        99
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiUdp.h>
+#include <Udp.h>
+#include "LidarMessage.h"
+#include "PollStream.h"
+#include "ScanProfile.h"
+#include "ClockSync.h"
+#include "StreamTracker.h"
+#include "ClientRegistry.h"
+
+
+class LidarComms {
+    typedef void (*handleMessageCallback)(int from, int to, int descriptor, int metaData, int value);
+    typedef void (*handleClientConnection)(int clientId);
+    typedef void (*handleScanProfileCallback)(int from, int profileId, const ScanProfile &profile);
+    typedef void (*handlePollSampleCallback)(void *context, int from, const PollSample &sample);
+    typedef void (*handleDescriptorCallback)(void *context, const MessageView &message);
+
+    /**
+     * Dispatch table entry for one descriptor. Protocol messages are handled in here first; what they
+     * leave, and everything else, goes to the client's handler for the descriptor, or messageHandler.
+     */
+    struct DescriptorEntry {
+        bool (LidarComms::*builtIn)(const MessageView &message);  // Returns whether the message goes on to the client
+        handleDescriptorCallback handler;
+        void *context;
+    };
+    
+    private:
+        int clientId;
+        bool brain;
+        bool debugMode;
+        bool connected;
+        bool drainBudgetExhausted;
+
+        ClientRegistry clients;
+        uint32_t receiveTime;       // When the message being handled arrived (us)
+        IPAddress receiveAddress;   // Where the message being handled came from
+        ClientInfo *receiveClient;  // Who it came from, NULL if they aren't registered
+
+        char packetBuffer[BUFFER_SIZE];
+        char batchBuffer[BUFFER_SIZE];
+        PollSample pendingSamples[BATCH_MAX_SAMPLES];
+        int batchCount;
+        long batchStartTime;
+        unsigned int pollSequence;
+        PollSample retransmitBuffer[RETRANSMIT_BUFFER_SIZE];   // Sample with sequence n is at n % RETRANSMIT_BUFFER_SIZE
+        PollStreamStats sendStats;
+        bool compactPollResults;
+
+        char *clientName;
+
+        long lastConnectionTime;
+        long lastMessageTime;
+
+        IPAddress localIp;
+        IPAddress destination; // Defaults to client 1 (Bigbrain)
+
+        WiFiUDP wifiUdp;
+        UDP *udp;           // Transport in use, WiFi unless overridden
+        Print *log;         // Where status and debug text goes, Serial unless overridden
+
+        handleMessageCallback messageHandler;
+        handleClientConnection connectionHandler;
+        handleClientConnection disconnectionHandler;
+        handleScanProfileCallback scanProfileHandler;
+        handlePollSampleCallback pollSampleHandler;
+        void *pollSampleContext;
+        DescriptorEntry descriptorTable[MAX_DESCRIPTOR + 1];
+
+        IPAddress resolveClient(int clientId);
+        bool sendMessageBroadcast(int descriptor, int metaData, int value);
+        bool sendMessage(int to, int descriptor, int metaData, int value);
+        bool sendMessageToIp(IPAddress ipTo, int to, int descriptor, int metaData, int value);
+        bool sendPacketToIp(IPAddress ipTo, int to, int descriptor, const char *packet, int length);
+
+        void setBuiltInHandler(int descriptor, bool (LidarComms::*builtIn)(const MessageView &message));
+        bool handleId(const MessageView &message);
+        bool handleClientInfo(const MessageView &message);
+        bool handleHeartbeat(const MessageView &message);
+        bool handlePollResult(const MessageView &message);
+        bool handlePollResultBatch(const MessageView &message);
+        bool handleCompactPollResult(const MessageView &message);
+        bool handleScanProfile(const MessageView &message);
+        bool handleClockPing(const MessageView &message);
+        bool handleClockPong(const MessageView &message);
+        bool handlePollNack(const MessageView &message);
+        bool trackPollSample(int from, uint32_t sequence, bool retransmit);
+        void handlePollSample(int from, int to, PollSample &sample, bool remoteClock);
+
+        int getPollResultFormat();
+        bool sendPollResults(const PollSample *samples, int count, unsigned int sequence, uint8_t flags);
+        bool sendBatchPollResults(const PollSample *samples, int count, unsigned int sequence, uint8_t flags);
+        bool sendCompactPollResults(const PollSample *samples, int count, unsigned int sequence, uint8_t flags);
+
+        void wifiConnectedEvent();
+        void wifiDisconnectedEvent();
+
+    public:
+        LidarComms(int clientId, bool isBrain, bool debugMode);
+
+        bool checkUdpPacket();
+        int drainUdpPackets(int budget = DRAIN_BUDGET);
+        bool isDrainBudgetExhausted();
+
+        void handleMessage(IPAddress remoteIp, char *message, int length);
+        bool sayHello();
+        bool sayHelloBack(int to);
+
+        void addClientInfo(int clientId, int ipSegment);
+        void addClientAddress(int clientId, IPAddress address);
+        void forgetClient(int clientId);
+        void forgetClients();
+        int checkClients();
+
+        void wifiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+
+        void broadcastId();
+        IPAddress getClientIp(int clientId);
+        bool connectWifi();
+        bool disconnectWifi();
+        void startUdp();
+
+        void setLocalIp(IPAddress localIp);
+        void setTransport(UDP *transport);
+        void setLog(Print *log);
+        void setCompactPollResults(bool compactPollResults);
+
+        void setMessageHandler(handleMessageCallback messageHandler);
+        void setConnectionHandler(handleClientConnection connectionHandler);
+        void setDisconnectionHandler(handleClientConnection disconnectionHandler);
+        void setScanProfileHandler(handleScanProfileCallback scanProfileHandler);
+        void setPollSampleHandler(handlePollSampleCallback pollSampleHandler, void *context = NULL);
+        bool setDescriptorHandler(int descriptor, handleDescriptorCallback handler, void *context = NULL);
+
+        char *getWifiSsid();
+        bool isConnected();
+        int getClientId();
+        bool isClientConnected(int clientId);
+        const ClientInfo *getClient(int clientId);
+        const ClientInfo *getClientSlot(int slot);
+        long getLastMessageTime();
+        bool clientHasCapability(int clientId, int capability);
+        ClockSync *getClockSync(int clientId);
+
+        bool messageId(int to);
+        bool messageBroadcastId();
+        bool messageClientInfo(int to);
+        bool messageHeartbeat(int to);
+        bool messageBroadcastPollCommand();
+        bool messagePollCommand(int to);
+        bool messageBroadcastPollConfirm();
+        bool messageBroadcastPollResult(int position, int distance);
+        bool queuePollResult(int position, int distance);
+        bool queuePollResult(const PollSample &sample);
+        bool checkPollResultBatch();
+        bool flushPollResults();
+        int checkPollStreams();
+        bool messagePollNack(int to, uint32_t first, uint32_t count);
+        const PollStreamStats *getReceiveStats(int clientId);
+        const PollStreamStats &getSendStats();
+        uint32_t getMissingSamples(int clientId);
+        bool messageBroadcastStopCommand();
+        bool messageScanProfile(int to, int profileId, const ScanProfile &profile);
+        bool messageScanProfileConfirm(int to, int profileId, bool accepted);
+        bool messageClockPing(int to);
+        bool messageBroadcastSystemRestartCommand(int reason = 0);
+        bool messageBroadcastSystemFailure(int reason = 0);
+
+};
+
 #endif
\ No newline at end of file
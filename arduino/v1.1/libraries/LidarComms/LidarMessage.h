@@ -0,0 +1,118 @@
+#ifndef LIDARMESSAGE_H
+#define LIDARMESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define WIRE_VERSION              0                 // Wire format version we speak (0 = original 20 byte layout)
+
+/**
+ * Message header as it appears on the wire. All fields are little-endian.
+ * Descriptor was originally a full int; its top two bytes now carry flags and a version,
+ * which are always zero from older clients, so they decode as before.
+ */
+struct __attribute__((packed)) WireHeader {
+    int32_t From;
+    int32_t To;
+    uint16_t Descriptor;
+    uint8_t Flags;
+    uint8_t Version;
+    int32_t MetaData;
+    int32_t Value;
+};
+
+/**
+ * A single sample within a batched poll result
+ */
+struct __attribute__((packed)) WireSample {
+    int32_t Angle;
+    int32_t Distance;
+    uint32_t Timestamp;
+};
+
+static_assert(sizeof(WireHeader) == 20, "WireHeader must be 20 bytes");
+static_assert(sizeof(WireSample) == 12, "WireSample must be 12 bytes");
+
+/**
+ * Unaligned little-endian loads/stores. memcpy compiles to a single load on the ESP32 and x86.
+ */
+inline uint32_t wireLoad32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof value);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+inline uint16_t wireLoad16(const uint8_t *data)
+{
+    uint16_t value;
+    memcpy(&value, data, sizeof value);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap16(value);
+#endif
+    return value;
+}
+
+inline void wireStore32(uint8_t *data, uint32_t value)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    memcpy(data, &value, sizeof value);
+}
+
+inline void wireStore16(uint8_t *data, uint16_t value)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap16(value);
+#endif
+    memcpy(data, &value, sizeof value);
+}
+
+/**
+ * Write a header into the start of a packet buffer
+ */
+inline void encodeHeader(uint8_t *data, int from, int to, int descriptor, int metaData, int value, uint8_t flags = 0)
+{
+    wireStore32(data + offsetof(WireHeader, From), from);
+    wireStore32(data + offsetof(WireHeader, To), to);
+    wireStore16(data + offsetof(WireHeader, Descriptor), descriptor);
+    data[offsetof(WireHeader, Flags)] = flags;
+    data[offsetof(WireHeader, Version)] = WIRE_VERSION;
+    wireStore32(data + offsetof(WireHeader, MetaData), metaData);
+    wireStore32(data + offsetof(WireHeader, Value), value);
+}
+
+/**
+ * Read-only view of a received packet. Fields are read in place from the receive buffer;
+ * nothing is copied, so the view is only valid until the buffer is next written.
+ */
+class MessageView {
+    private:
+        const uint8_t *data;
+        int length;
+
+    public:
+        MessageView(const char *data, int length) : data((const uint8_t *)data), length(length) {}
+
+        bool isComplete() const { return data && length >= (int)sizeof(WireHeader); }
+        bool isSupported() const { return version() <= WIRE_VERSION; }
+
+        int from() const { return (int32_t)wireLoad32(data + offsetof(WireHeader, From)); }
+        int to() const { return (int32_t)wireLoad32(data + offsetof(WireHeader, To)); }
+        int descriptor() const { return wireLoad16(data + offsetof(WireHeader, Descriptor)); }
+        uint8_t flags() const { return data[offsetof(WireHeader, Flags)]; }
+        uint8_t version() const { return data[offsetof(WireHeader, Version)]; }
+        int metaData() const { return (int32_t)wireLoad32(data + offsetof(WireHeader, MetaData)); }
+        int value() const { return (int32_t)wireLoad32(data + offsetof(WireHeader, Value)); }
+
+        const uint8_t *payload() const { return data + sizeof(WireHeader); }
+        int payloadLength() const { return length - (int)sizeof(WireHeader); }
+        int size() const { return length; }
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "PollStream.h"
+
+/**
+ * Write an unsigned LEB128 varint, returning the number of bytes written
+ */
+int writeVarint(uint8_t *data, uint32_t value)
+{
+    int length = 0;
+    while (value >= 0x80) {
+        data[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    data[length++] = (uint8_t)value;
+    return length;
+}
+
+/**
+ * Read an unsigned LEB128 varint, returning the number of bytes consumed (0 if truncated or overlong)
+ */
+int readVarint(const uint8_t *data, int size, uint32_t *value)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < size && i < VARINT_MAX_SIZE; i++) {
+        result |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+CompactStreamWriter::CompactStreamWriter(uint8_t *data, int size, uint32_t baseTimestamp)
+{
+    this->data = data;
+    this->size = size;
+    this->count = 0;
+    this->prevAngle = 0;
+    this->prevDistance = 0;
+    this->prevTimestamp = baseTimestamp;
+    this->position = (size >= VARINT_MAX_SIZE) ? writeVarint(data, baseTimestamp) : size;
+}
+
+/**
+ * Append a sample. Returns false, writing nothing, if the buffer may not have room for it.
+ */
+bool CompactStreamWriter::add(const PollSample &sample)
+{
+    if (size - position < COMPACT_SAMPLE_MAX_SIZE)
+        return false;
+
+    position += writeVarint(data + position, zigzagDelta(prevAngle, sample.angle));
+    position += writeVarint(data + position, zigzagDelta(prevDistance, sample.distance));
+    position += writeVarint(data + position, sample.timestamp - prevTimestamp);
+
+    prevAngle = sample.angle;
+    prevDistance = sample.distance;
+    prevTimestamp = sample.timestamp;
+    count++;
+    return true;
+}
+
+/**
+ * Bytes written so far
+ */
+int CompactStreamWriter::length()
+{
+    return position;
+}
+
+int CompactStreamWriter::getCount()
+{
+    return count;
+}
+
+CompactStreamReader::CompactStreamReader(const uint8_t *data, int size)
+{
+    this->data = data;
+    this->size = size;
+    this->prevAngle = 0;
+    this->prevDistance = 0;
+    this->position = readVarint(data, size, &prevTimestamp);
+    this->valid = position > 0;
+}
+
+/**
+ * Decode the next sample. Returns false at the end of the data, or if it is malformed.
+ */
+bool CompactStreamReader::next(PollSample &sample)
+{
+    uint32_t angleDelta, distanceDelta, timestampDelta;
+
+    if (!valid || !readField(&angleDelta) || !readField(&distanceDelta) || !readField(&timestampDelta)) {
+        valid = false;
+        return false;
+    }
+
+    prevAngle = addDelta(prevAngle, angleDelta);
+    prevDistance = addDelta(prevDistance, distanceDelta);
+    prevTimestamp += timestampDelta;
+
+    sample.angle = prevAngle;
+    sample.distance = prevDistance;
+    sample.timestamp = prevTimestamp;
+    return true;
+}
+
+/**
+ * Read one varint field, advancing past it
+ */
+bool CompactStreamReader::readField(uint32_t *value)
+{
+    int read = readVarint(data + position, size - position, value);
+    position += read;
+    return read > 0;
+}
+
+bool CompactStreamReader::isValid()
+{
+    return valid;
+}
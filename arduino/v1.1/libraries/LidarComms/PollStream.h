@@ -0,0 +1,98 @@
+#ifndef POLLSTREAM_H
+#define POLLSTREAM_H
+
+#include <stdint.h>
+
+#define VARINT_MAX_SIZE           5                 // Largest encoding of a 32 bit varint
+#define COMPACT_SAMPLE_MAX_SIZE   (3 * VARINT_MAX_SIZE) // Worst case encoding of one compact sample
+
+/**
+ * A single poll result as produced by the sensor node
+ */
+struct PollSample {
+    int angle;
+    int distance;
+    uint32_t timestamp;
+};
+
+/**
+ * Zigzag mapping, so small negative deltas encode as small varints
+ */
+inline uint32_t zigzagEncode(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * Zigzag of to - from, subtracted as uint32_t so that values further apart than INT_MAX wrap instead of
+ * overflowing; adding the decoded delta back as uint32_t wraps round to to again
+ */
+inline uint32_t zigzagDelta(int32_t from, int32_t to)
+{
+    uint32_t delta = (uint32_t)to - (uint32_t)from;
+    return (delta << 1) ^ (0 - (delta >> 31));
+}
+
+inline int32_t addDelta(int32_t value, uint32_t zigzag)
+{
+    return (int32_t)((uint32_t)value + (uint32_t)zigzagDecode(zigzag));
+}
+
+int writeVarint(uint8_t *data, uint32_t value);
+int readVarint(const uint8_t *data, int size, uint32_t *value);
+
+/**
+ * Writes a compact poll sample stream:
+ *    varint      base timestamp (us)
+ * then per sample, each relative to the previous sample (the first to angle 0, distance 0, base timestamp):
+ *    zigzag      angle delta
+ *    zigzag      distance delta
+ *    varint      timestamp delta
+ * A sweep stepping 1 degree at a time typically costs 4 or 5 bytes per sample, mostly the timestamp.
+ */
+class CompactStreamWriter {
+    private:
+        uint8_t *data;
+        int size;
+        int position;
+        int count;
+        int prevAngle;
+        int prevDistance;
+        uint32_t prevTimestamp;
+
+    public:
+        CompactStreamWriter(uint8_t *data, int size, uint32_t baseTimestamp);
+
+        bool add(const PollSample &sample);
+        int length();
+        int getCount();
+};
+
+/**
+ * Reads back a stream written by CompactStreamWriter, never reading past size
+ */
+class CompactStreamReader {
+    private:
+        const uint8_t *data;
+        int size;
+        int position;
+        bool valid;
+        int prevAngle;
+        int prevDistance;
+        uint32_t prevTimestamp;
+
+        bool readField(uint32_t *value);
+
+    public:
+        CompactStreamReader(const uint8_t *data, int size);
+
+        bool next(PollSample &sample);
+        bool isValid();
+};
+
+#endif
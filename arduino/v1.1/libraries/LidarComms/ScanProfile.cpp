@@ -0,0 +1,105 @@
+#include "ScanProfile.h"
+#include "LidarMessage.h"
+
+/**
+ * Add a region of interest. Returns false if the profile already has SCAN_MAX_REGIONS.
+ */
+bool ScanProfile::addRegion(int startAngle, int endAngle, int step)
+{
+    if (regionCount >= SCAN_MAX_REGIONS)
+        return false;
+
+    regions[regionCount].startAngle = startAngle;
+    regions[regionCount].endAngle = endAngle;
+    regions[regionCount].step = step;
+    regionCount++;
+    return true;
+}
+
+/**
+ * Whether the profile is something swol can follow: a forward arc, steps of at least a degree that fit
+ * in the wire format, and regions that sit inside the arc without overlapping.
+ */
+bool ScanProfile::isValid() const
+{
+    if (startAngle < INT16_MIN || endAngle > INT16_MAX || startAngle >= endAngle)
+        return false;
+
+    if (step < 1 || step > UINT8_MAX || dwell < 0 || dwell > SCAN_MAX_DWELL)
+        return false;
+
+    if (oversample < 1 || oversample > SCAN_MAX_OVERSAMPLE || regionCount < 0 || regionCount > SCAN_MAX_REGIONS)
+        return false;
+
+    for (int i = 0; i < regionCount; i++) {
+        const ScanRegion &region = regions[i];
+        if (region.startAngle < startAngle || region.endAngle > endAngle || region.startAngle >= region.endAngle)
+            return false;
+        if (region.step < 1 || region.step > UINT8_MAX)
+            return false;
+
+        for (int j = 0; j < i; j++) {
+            if (region.startAngle < regions[j].endAngle && regions[j].startAngle < region.endAngle)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Write a profile into a message payload. Returns the bytes written, or 0 if it is invalid or doesn't fit.
+ */
+int encodeScanProfile(uint8_t *data, int size, const ScanProfile &profile)
+{
+    int length = SCAN_PROFILE_HEADER_SIZE + profile.regionCount * SCAN_REGION_SIZE;
+    if (!profile.isValid() || size < length)
+        return 0;
+
+    wireStore16(data + offsetof(WireScanProfile, StartAngle), profile.startAngle);
+    wireStore16(data + offsetof(WireScanProfile, EndAngle), profile.endAngle);
+    data[offsetof(WireScanProfile, Step)] = profile.step;
+    data[offsetof(WireScanProfile, Oversample)] = profile.oversample;
+    wireStore16(data + offsetof(WireScanProfile, Dwell), profile.dwell);
+    data[offsetof(WireScanProfile, RegionCount)] = profile.regionCount;
+    data[offsetof(WireScanProfile, Reserved)] = 0;
+
+    uint8_t *region = data + SCAN_PROFILE_HEADER_SIZE;
+    for (int i = 0; i < profile.regionCount; i++, region += SCAN_REGION_SIZE) {
+        wireStore16(region + offsetof(WireScanRegion, StartAngle), profile.regions[i].startAngle);
+        wireStore16(region + offsetof(WireScanRegion, EndAngle), profile.regions[i].endAngle);
+        region[offsetof(WireScanRegion, Step)] = profile.regions[i].step;
+        region[offsetof(WireScanRegion, Reserved)] = 0;
+    }
+
+    return length;
+}
+
+/**
+ * Read a profile from a message payload. Returns false, leaving profile in an unknown state,
+ * if the payload is truncated or the profile invalid.
+ */
+bool decodeScanProfile(const uint8_t *data, int length, ScanProfile &profile)
+{
+    if (length < SCAN_PROFILE_HEADER_SIZE)
+        return false;
+
+    profile.startAngle = (int16_t)wireLoad16(data + offsetof(WireScanProfile, StartAngle));
+    profile.endAngle = (int16_t)wireLoad16(data + offsetof(WireScanProfile, EndAngle));
+    profile.step = data[offsetof(WireScanProfile, Step)];
+    profile.oversample = data[offsetof(WireScanProfile, Oversample)];
+    profile.dwell = wireLoad16(data + offsetof(WireScanProfile, Dwell));
+    profile.regionCount = data[offsetof(WireScanProfile, RegionCount)];
+
+    if (profile.regionCount > SCAN_MAX_REGIONS || length < SCAN_PROFILE_HEADER_SIZE + profile.regionCount * SCAN_REGION_SIZE)
+        return false;
+
+    const uint8_t *region = data + SCAN_PROFILE_HEADER_SIZE;
+    for (int i = 0; i < profile.regionCount; i++, region += SCAN_REGION_SIZE) {
+        profile.regions[i].startAngle = (int16_t)wireLoad16(region + offsetof(WireScanRegion, StartAngle));
+        profile.regions[i].endAngle = (int16_t)wireLoad16(region + offsetof(WireScanRegion, EndAngle));
+        profile.regions[i].step = region[offsetof(WireScanRegion, Step)];
+    }
+
+    return profile.isValid();
+}
@@ -0,0 +1,71 @@
+#ifndef SCANPROFILE_H
+#define SCANPROFILE_H
+
+#include <stdint.h>
+
+#define SCAN_DEFAULT_START        0                 // Default profile: the full 0-180 degree sweep...
+#define SCAN_DEFAULT_END          180
+#define SCAN_DEFAULT_STEP         1                 // ...at 1 degree steps, as swol always used to
+#define SCAN_MAX_REGIONS          4                 // Regions of interest per profile
+#define SCAN_MAX_OVERSAMPLE       16                // Most readings averaged into one sample
+#define SCAN_MAX_DWELL            1000              // Longest extra wait (ms) at each sample point
+#define SCAN_PROFILE_HEADER_SIZE  10                // Size of WireScanProfile
+#define SCAN_REGION_SIZE          6                 // Size of WireScanRegion
+#define SCAN_PROFILE_MAX_SIZE     (SCAN_PROFILE_HEADER_SIZE + SCAN_MAX_REGIONS * SCAN_REGION_SIZE)
+
+/**
+ * Part of the sweep scanned at its own, usually finer, step
+ */
+struct ScanRegion {
+    int startAngle;
+    int endAngle;
+    int step;
+};
+
+/**
+ * How swol sweeps: the arc to cover, the step between samples outside any region, how long to dwell
+ * after settling, and how many readings are averaged into each sample.
+ */
+struct ScanProfile {
+    int startAngle;
+    int endAngle;
+    int step;
+    int dwell;
+    int oversample;
+    int regionCount;
+    ScanRegion regions[SCAN_MAX_REGIONS];
+
+    ScanProfile(int startAngle = SCAN_DEFAULT_START, int endAngle = SCAN_DEFAULT_END, int step = SCAN_DEFAULT_STEP)
+        : startAngle(startAngle), endAngle(endAngle), step(step), dwell(0), oversample(1), regionCount(0), regions() {}
+
+    bool addRegion(int startAngle, int endAngle, int step);
+    bool isValid() const;
+};
+
+/**
+ * Profile as it appears after the message header. Regions follow it. All fields are little-endian.
+ */
+struct __attribute__((packed)) WireScanProfile {
+    int16_t StartAngle;
+    int16_t EndAngle;
+    uint8_t Step;
+    uint8_t Oversample;
+    uint16_t Dwell;
+    uint8_t RegionCount;
+    uint8_t Reserved;
+};
+
+struct __attribute__((packed)) WireScanRegion {
+    int16_t StartAngle;
+    int16_t EndAngle;
+    uint8_t Step;
+    uint8_t Reserved;
+};
+
+static_assert(sizeof(WireScanProfile) == SCAN_PROFILE_HEADER_SIZE, "WireScanProfile must match SCAN_PROFILE_HEADER_SIZE");
+static_assert(sizeof(WireScanRegion) == SCAN_REGION_SIZE, "WireScanRegion must match SCAN_REGION_SIZE");
+
+int encodeScanProfile(uint8_t *data, int size, const ScanProfile &profile);
+bool decodeScanProfile(const uint8_t *data, int length, ScanProfile &profile);
+
+#endif
@@ -0,0 +1,159 @@
+#include "StreamTracker.h"
+#include <string.h>
+
+StreamTracker::StreamTracker()
+{
+    memset(&stats, 0, sizeof stats);
+    reset();
+}
+
+/**
+ * Start tracking afresh, keeping the counters
+ */
+void StreamTracker::reset()
+{
+    started = false;
+    expected = 0;
+    gapCount = 0;
+}
+
+/**
+ * Check a received sample's sequence number. Returns whether it should be delivered: false only for
+ * duplicates.
+ */
+bool StreamTracker::accept(uint32_t sequence, bool retransmit, uint32_t now)
+{
+    int32_t distance = (int32_t)(sequence - expected);
+    if (!started || distance > STREAM_RESYNC_DISTANCE || distance < -STREAM_RESYNC_DISTANCE) {
+        if (started)
+            stats.resyncs++;
+        reset();
+        started = true;
+        distance = 0;
+        expected = sequence;
+    }
+
+    if (distance >= 0) {
+        if (distance > 0)
+            addGap(expected, distance, now);
+        expected = sequence + 1;
+        stats.samples++;
+        return true;
+    }
+
+    if (!fillGap(sequence)) {
+        stats.duplicates++;
+        return false;
+    }
+
+    if (retransmit)
+        stats.recovered++;
+    else
+        stats.reordered++;
+    stats.samples++;
+    return true;
+}
+
+/**
+ * Remember a missing range. When all STREAM_MAX_GAPS are in use the oldest is given up on.
+ */
+void StreamTracker::addGap(uint32_t first, uint32_t count, uint32_t now)
+{
+    if (gapCount == STREAM_MAX_GAPS)
+        removeGap(0, true);
+
+    Gap &gap = gaps[gapCount++];
+    gap.first = first;
+    gap.count = count;
+    gap.nackTime = now + STREAM_NACK_DELAY;
+    gap.nacks = 0;
+}
+
+/**
+ * Forget a gap, counting what was left of it as lost if it was given up on
+ */
+void StreamTracker::removeGap(int index, bool lost)
+{
+    if (lost)
+        stats.lost += gaps[index].count;
+
+    for (int i = index; i < gapCount - 1; i++)
+        gaps[i] = gaps[i + 1];
+    gapCount--;
+}
+
+/**
+ * Take a late sample out of whichever gap it falls in. Returns false if it wasn't missing.
+ */
+bool StreamTracker::fillGap(uint32_t sequence)
+{
+    for (int i = 0; i < gapCount; i++) {
+        Gap &gap = gaps[i];
+        uint32_t offset = sequence - gap.first;
+        if (offset >= gap.count)
+            continue;
+
+        if (gap.count == 1) {
+            removeGap(i, false);
+        } else if (offset == 0) {
+            gap.first++;
+            gap.count--;
+        } else if (offset == gap.count - 1) {
+            gap.count--;
+        } else {
+            // Split in two; with no room for the second half, give up on it
+            Gap tail = gap;
+            tail.first = sequence + 1;
+            tail.count = gap.count - offset - 1;
+            gap.count = offset;
+            if (gapCount == STREAM_MAX_GAPS) {
+                stats.lost += tail.count;
+            } else {
+                for (int j = gapCount; j > i + 1; j--)
+                    gaps[j] = gaps[j - 1];
+                gaps[i + 1] = tail;
+                gapCount++;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Find a gap due a NACK, returning its range. Gaps that have had all their retries are counted lost here;
+ * with no retries, e.g. for a sender that can't retransmit, gaps are given up once they are due.
+ * Call until it returns false.
+ */
+bool StreamTracker::nextNack(uint32_t now, uint32_t &first, uint32_t &count, int retries)
+{
+    for (int i = 0; i < gapCount; i++) {
+        Gap &gap = gaps[i];
+        if ((int32_t)(now - gap.nackTime) < 0)
+            continue;
+
+        if (gap.nacks >= retries) {
+            removeGap(i--, true);
+            continue;
+        }
+
+        gap.nacks++;
+        gap.nackTime = now + STREAM_NACK_INTERVAL;
+        first = gap.first;
+        count = gap.count;
+        stats.nacks++;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Samples currently missing and not yet given up on
+ */
+uint32_t StreamTracker::getMissing()
+{
+    uint32_t missing = 0;
+    for (int i = 0; i < gapCount; i++)
+        missing += gaps[i].count;
+    return missing;
+}
@@ -0,0 +1,63 @@
+#ifndef STREAMTRACKER_H
+#define STREAMTRACKER_H
+
+#include <stdint.h>
+
+#define STREAM_MAX_GAPS           8                 // Missing ranges tracked at once; the oldest is given up when full
+#define STREAM_NACK_DELAY         20                // Time (ms) a gap may be reordering before it is NACKed
+#define STREAM_NACK_INTERVAL      100               // Time (ms) between NACKs for the same gap
+#define STREAM_NACK_RETRIES       3                 // NACKs sent for a gap before it is counted lost
+#define STREAM_RESYNC_DISTANCE    4096              // A sequence this far from expected means the sender restarted
+
+/**
+ * Counters for one poll stream. A receiver fills in everything but retransmitted and sendFailures; a
+ * sender fills in only those, nacks and samples.
+ */
+struct PollStreamStats {
+    uint32_t samples;           // Delivered (receiver) or sent (sender)
+    uint32_t lost;              // Given up on after STREAM_NACK_RETRIES
+    uint32_t recovered;         // Filled in by a retransmit
+    uint32_t reordered;         // Filled in late without being asked for
+    uint32_t duplicates;        // Dropped as already delivered
+    uint32_t nacks;             // NACKs sent (receiver) or answered (sender)
+    uint32_t retransmitted;     // Samples sent again in answer to NACKs
+    uint32_t sendFailures;      // Packets the transport refused
+    uint32_t resyncs;           // Times the sender's sequence jumped and tracking started over
+};
+
+/**
+ * Receive side of a sequenced poll stream. Every sample carries a sequence number; samples are checked one
+ * at a time, so duplicates are dropped, gaps are remembered until they are filled, NACKed or given up on,
+ * and everything that arrives is delivered as soon as it does. Sequence numbers wrap.
+ */
+class StreamTracker {
+    struct Gap {
+        uint32_t first;
+        uint32_t count;
+        uint32_t nackTime;      // When the gap is next due a NACK (ms)
+        uint8_t nacks;
+    };
+
+    private:
+        bool started;
+        uint32_t expected;
+        Gap gaps[STREAM_MAX_GAPS];
+        int gapCount;
+        PollStreamStats stats;
+
+        void addGap(uint32_t first, uint32_t count, uint32_t now);
+        void removeGap(int index, bool lost);
+        bool fillGap(uint32_t sequence);
+
+    public:
+        StreamTracker();
+
+        bool accept(uint32_t sequence, bool retransmit, uint32_t now);
+        bool nextNack(uint32_t now, uint32_t &first, uint32_t &count, int retries = STREAM_NACK_RETRIES);
+        void reset();
+
+        uint32_t getMissing();
+        const PollStreamStats &getStats() const { return stats; }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SAMPLEMERGER_H
+#define SAMPLEMERGER_H
+
+#include <stdint.h>
+#include "SampleRing.h"
+
+/**
+ * Fair merge of several sample streams, e.g. one per sensor head, into one output. Each stream has its own
+ * SampleRing, so a stream that floods overflows only itself. The consumer takes the streams in turn, up to
+ * a quantum at a time, and only once a stream has a full quantum waiting or has kept its oldest sample
+ * waiting for the timeout. Output is batched, every stream gets an equal share when the output is what
+ * limits, and no sample waits longer than the timeout plus a quantum from each other stream.
+ * As for SampleRing, one task may push (to any stream) and one other may pop.
+ */
+template <typename T, uint32_t Capacity, int Streams>
+class SampleMerger {
+    private:
+        SampleRing<T, Capacity> rings[Streams];
+        bool waiting[Streams];              // Consumer only: whether the stream had samples at the last look
+        uint32_t waitingSince[Streams];     // Consumer only: when the stream was first seen with samples (ms)
+        int nextStream;                     // Consumer only: where the next turn starts
+
+    public:
+        SampleMerger() : nextStream(0)
+        {
+            for (int i = 0; i < Streams; i++)
+                waiting[i] = false;
+        }
+
+        /**
+         * Producer only. Returns false, counting an overflow on the stream's ring, if it is full.
+         */
+        bool push(int stream, const T &item)
+        {
+            return rings[stream].push(item);
+        }
+
+        /**
+         * Consumer only. Take up to quantum items from the next stream that is ready at now (ms). Returns
+         * how many, with the stream they came from, or 0 if no stream is ready. A timeout of 0 flushes.
+         */
+        int pop(T *items, int quantum, int &stream, uint32_t now, uint32_t timeout)
+        {
+            for (int i = 0; i < Streams; i++) {
+                int candidate = (nextStream + i) % Streams;
+                uint32_t size = rings[candidate].size();
+                if (size == 0) {
+                    waiting[candidate] = false;
+                    continue;
+                }
+
+                if (!waiting[candidate]) {
+                    waiting[candidate] = true;
+                    waitingSince[candidate] = now;
+                }
+                if (size < (uint32_t)quantum && now - waitingSince[candidate] < timeout)
+                    continue;
+
+                int count = 0;
+                while (count < quantum && rings[candidate].pop(items[count]))
+                    count++;
+
+                // Anything left has been waiting at least as long, so keeps its place in time
+                if (rings[candidate].size() == 0)
+                    waiting[candidate] = false;
+                nextStream = (candidate + 1) % Streams;
+                stream = candidate;
+                return count;
+            }
+            return 0;
+        }
+
+        SampleRing<T, Capacity> &getRing(int stream) { return rings[stream]; }
+        int streams() const { return Streams; }
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <stdint.h>
+#include <atomic>
+
+#define RING_CACHE_LINE           64                // Keeps producer and consumer indices off each other's cache line
+
+/**
+ * Fixed-capacity, lock-free single-producer/single-consumer ring.
+ * One task (or core) may push and one other may pop, with no locks and no allocation.
+ * Capacity must be a power of two. The producer tracks the high-water mark and overflow count.
+ */
+template <typename T, uint32_t Capacity>
+class SampleRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SampleRing capacity must be a power of two");
+
+    private:
+        alignas(RING_CACHE_LINE) std::atomic<uint32_t> head;    // Next slot to write, owned by the producer
+        std::atomic<uint32_t> highWaterMark;
+        std::atomic<uint32_t> overflows;
+        alignas(RING_CACHE_LINE) std::atomic<uint32_t> tail;    // Next slot to read, owned by the consumer
+        alignas(RING_CACHE_LINE) T slots[Capacity];
+
+    public:
+        SampleRing() : head(0), highWaterMark(0), overflows(0), tail(0) {}
+
+        /**
+         * Producer only. Returns false, counting an overflow, if the ring is full.
+         */
+        bool push(const T &item)
+        {
+            uint32_t writeAt = head.load(std::memory_order_relaxed);
+            uint32_t used = writeAt - tail.load(std::memory_order_acquire);
+            if (used >= Capacity) {
+                overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            slots[writeAt & (Capacity - 1)] = item;
+            head.store(writeAt + 1, std::memory_order_release);
+
+            if (used + 1 > highWaterMark.load(std::memory_order_relaxed))
+                highWaterMark.store(used + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /**
+         * Consumer only. Returns false if the ring is empty.
+         */
+        bool pop(T &item)
+        {
+            uint32_t readAt = tail.load(std::memory_order_relaxed);
+            if (readAt == head.load(std::memory_order_acquire))
+                return false;
+
+            item = slots[readAt & (Capacity - 1)];
+            tail.store(readAt + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Items waiting. Only a snapshot when called while the other side is running.
+         */
+        uint32_t size() const
+        {
+            return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+        }
+
+        uint32_t capacity() const { return Capacity; }
+        uint32_t getHighWaterMark() const { return highWaterMark.load(std::memory_order_relaxed); }
+        uint32_t getOverflows() const { return overflows.load(std::memory_order_relaxed); }
+};
+
+#endif
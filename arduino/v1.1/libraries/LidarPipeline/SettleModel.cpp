@@ -0,0 +1,151 @@
+#include "SettleModel.h"
+#include <math.h>
+#include <stdlib.h>
+
+SettleModel::SettleModel(int baseTime, int perDegree)
+{
+    reset(baseTime, perDegree);
+}
+
+/**
+ * Go back to a linear model: baseTime plus perDegree for each degree moved
+ */
+void SettleModel::reset(int baseTime, int perDegree)
+{
+    for (int reverse = 0; reverse < 2; reverse++) {
+        settleTimes[reverse][0] = 0;
+        for (int step = 1; step <= SETTLE_MAX_STEP; step++)
+            settleTimes[reverse][step] = baseTime + perDegree * step;
+    }
+}
+
+/**
+ * Time (ms) to wait after moving the servo from one angle to another
+ */
+int SettleModel::getSettleTime(int from, int to) const
+{
+    int step = abs(to - from);
+    bool reverse = to < from;
+
+    if (step <= SETTLE_MAX_STEP)
+        return settleTimes[reverse][step];
+
+    // Past the table the servo is slewing at full speed, so scale the largest entry
+    return (int)settleTimes[reverse][SETTLE_MAX_STEP] * step / SETTLE_MAX_STEP;
+}
+
+void SettleModel::setSettleTime(int step, bool reverse, int settleTime)
+{
+    if (step < 1 || step > SETTLE_MAX_STEP)
+        return;
+
+    settleTimes[reverse][step] = settleTime < 0 ? 0 : settleTime;
+}
+
+/**
+ * Where the servo should be, elapsed ms after being sent from one angle to another.
+ * Treats the move as linear over its settle time.
+ */
+float SettleModel::interpolateAngle(float from, int to, uint32_t elapsed) const
+{
+    int step = (int)lroundf(fabsf(to - from));
+    int settleTime = step == 0 ? 0 : getSettleTime(0, to < from ? -step : step);
+
+    if (elapsed >= (uint32_t)settleTime)
+        return to;
+
+    return from + (to - from) * elapsed / settleTime;
+}
+
+/**
+ * Measure one move: time from sending the servo until readings match the settled distance at the target, once
+ * one has shown it away from there. SETTLE_UNOBSERVED if none does, e.g. because the step is too small to
+ * change the distance by more than SETTLE_TOLERANCE or over before the first read is done, and -1 if readings
+ * never settle.
+ */
+int SettleModel::measureSettle(SweepHardware &hardware, int from, int to, int settledDistance)
+{
+    hardware.moveTo(from);
+    hardware.wait(SETTLE_CALIBRATION_REST);
+
+    uint32_t start = hardware.now();
+    hardware.moveTo(to);
+
+    bool departed = false;
+    int stableCount = 0;
+    uint32_t stableSince = start;
+
+    while (hardware.now() - start < SETTLE_CALIBRATION_TIMEOUT) {
+        uint32_t readStart = hardware.now();
+        int distance = hardware.readDistance();
+
+        if (abs(distance - settledDistance) > SETTLE_TOLERANCE) {
+            departed = true;
+            stableCount = 0;
+            continue;
+        }
+
+        if (stableCount++ == 0)
+            stableSince = readStart;
+
+        if (stableCount >= SETTLE_STABLE_READINGS) {
+            if (!departed)
+                return SETTLE_UNOBSERVED;
+            return stableSince - start > 0 ? stableSince - start : 1;
+        }
+    }
+
+    return departed ? -1 : SETTLE_UNOBSERVED;
+}
+
+/**
+ * Calibrate every step size in both directions by moving onto the centre angle and timing how long
+ * readings take to match the distance seen there at rest. Point the sensor across an edge or a slope,
+ * so that small angle changes show up as distance changes. Entries that never settle keep their old value,
+ * as do steps whose movement never shows in the readings; returns false if any never settled, or no step
+ * could be seen at all.
+ */
+bool SettleModel::calibrate(SweepHardware &hardware, int centre, int trials)
+{
+    bool complete = true;
+    bool observed = false;
+
+    hardware.moveTo(centre);
+    hardware.wait(SETTLE_CALIBRATION_REST);
+
+    long total = 0;
+    for (int i = 0; i < SETTLE_STABLE_READINGS; i++)
+        total += hardware.readDistance();
+    int settledDistance = total / SETTLE_STABLE_READINGS;
+
+    for (int reverse = 0; reverse < 2; reverse++) {
+        for (int step = 1; step <= SETTLE_MAX_STEP; step++) {
+            int from = reverse ? centre + step : centre - step;
+            int slowest = -1;
+            bool failed = false;
+            bool unobserved = false;
+
+            for (int trial = 0; trial < trials; trial++) {
+                int settleTime = measureSettle(hardware, from, centre, settledDistance);
+                if (settleTime == SETTLE_UNOBSERVED)
+                    unobserved = true;
+                else if (settleTime < 0)
+                    failed = true;
+                else if (settleTime > slowest)
+                    slowest = settleTime;
+            }
+
+            // A step that any trial couldn't see keeps its default rather than trusting the trials that could
+            if (unobserved && !failed)
+                continue;
+            if (failed || slowest < 0) {
+                complete = false;
+                continue;
+            }
+            observed = true;
+            settleTimes[reverse][step] = slowest;
+        }
+    }
+
+    return complete && observed;
+}
@@ -0,0 +1,37 @@
+#ifndef SETTLEMODEL_H
+#define SETTLEMODEL_H
+
+#include <stdint.h>
+#include "SweepHardware.h"
+
+#define SETTLE_MAX_STEP           16                // Largest step (degrees) with its own table entry; bigger steps scale from it
+#define SETTLE_BASE_TIME          8                 // Default settle time (ms) before calibration...
+#define SETTLE_PER_DEGREE         2                 // ...plus this much per degree, so a 1 degree step is the old 10 ms
+#define SETTLE_TOLERANCE          5                 // Readings (mm) within this of the resting distance count as settled
+#define SETTLE_STABLE_READINGS    3                 // Settled readings in a row before the servo counts as settled
+#define SETTLE_CALIBRATION_REST   300               // Time (ms) to rest at the start angle before each calibration move
+#define SETTLE_CALIBRATION_TIMEOUT 500              // Give up on a calibration move after this long (ms)
+#define SETTLE_CALIBRATION_TRIALS 3                 // Moves per step size and direction; the slowest one is kept
+#define SETTLE_UNOBSERVED         -2                // measureSettle(): no reading showed the servo away from the target
+
+/**
+ * How long the servo takes to settle after a move, looked up by step size and direction.
+ * Starts from a simple linear model and can be calibrated against the real servo and sensor.
+ */
+class SettleModel {
+    private:
+        uint16_t settleTimes[2][SETTLE_MAX_STEP + 1];     // [reverse][step in degrees]
+
+        int measureSettle(SweepHardware &hardware, int from, int to, int settledDistance);
+
+    public:
+        SettleModel(int baseTime = SETTLE_BASE_TIME, int perDegree = SETTLE_PER_DEGREE);
+
+        void reset(int baseTime, int perDegree);
+        int getSettleTime(int from, int to) const;
+        void setSettleTime(int step, bool reverse, int settleTime);
+        float interpolateAngle(float from, int to, uint32_t elapsed) const;
+        bool calibrate(SweepHardware &hardware, int centre, int trials = SETTLE_CALIBRATION_TRIALS);
+};
+
+#endif
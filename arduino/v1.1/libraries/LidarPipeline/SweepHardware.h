@@ -0,0 +1,21 @@
+#ifndef SWEEPHARDWARE_H
+#define SWEEPHARDWARE_H
+
+#include <stdint.h>
+
+/**
+ * What the sweep code needs from the outside world. Swol backs this with the servo, ToF sensor and FreeRTOS;
+ * the host backs it with sleeps or a simulated servo so the pipeline can be exercised off the board.
+ */
+class SweepHardware {
+    public:
+        virtual ~SweepHardware() {}
+
+        virtual void moveTo(int angle) = 0;
+        virtual int readDistance() = 0;
+        virtual uint32_t now() = 0;
+        virtual uint32_t nowMicros() = 0;   // Same clock in us, for sample timestamps
+        virtual void wait(int ms) = 0;
+};
+
+#endif
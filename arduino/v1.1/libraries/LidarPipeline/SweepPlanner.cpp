@@ -0,0 +1,104 @@
+#include "SweepPlanner.h"
+
+SweepPlanner::SweepPlanner(int minAngle, int maxAngle, int step)
+{
+    this->minAngle = minAngle;
+    this->maxAngle = maxAngle;
+    this->step = step > 0 ? step : 1;
+    this->regionCount = 0;
+    reset();
+}
+
+/**
+ * Go back to the start of the sweep
+ */
+void SweepPlanner::reset()
+{
+    position = minAngle;
+    reverse = false;
+}
+
+/**
+ * Follow a scan profile's arc, step and regions from the start of the sweep. Invalid profiles are ignored.
+ */
+void SweepPlanner::setProfile(const ScanProfile &profile)
+{
+    if (!profile.isValid())
+        return;
+
+    minAngle = profile.startAngle;
+    maxAngle = profile.endAngle;
+    step = profile.step;
+    regionCount = profile.regionCount;
+    for (int i = 0; i < regionCount; i++)
+        regions[i] = profile.regions[i];
+
+    reset();
+}
+
+/**
+ * Angle the servo should currently be at
+ */
+int SweepPlanner::current()
+{
+    return position;
+}
+
+/**
+ * Step to take from an angle in the current direction: the region's if we're heading into one, else the sweep's
+ */
+int SweepPlanner::stepAt(int angle)
+{
+    for (int i = 0; i < regionCount; i++) {
+        const ScanRegion &region = regions[i];
+        if (reverse ? (angle > region.startAngle && angle <= region.endAngle) : (angle >= region.startAngle && angle < region.endAngle))
+            return region.step;
+    }
+
+    return step;
+}
+
+/**
+ * Stop short at the first region edge between two angles, so coarse steps don't jump into or past a region
+ */
+int SweepPlanner::clampToEdges(int from, int to)
+{
+    for (int i = 0; i < regionCount; i++) {
+        int edges[2] = { regions[i].startAngle, regions[i].endAngle };
+        for (int j = 0; j < 2; j++) {
+            if (from < edges[j] && edges[j] < to)
+                to = edges[j];
+            else if (to < edges[j] && edges[j] < from)
+                to = edges[j];
+        }
+    }
+
+    return to;
+}
+
+/**
+ * Move on to the next angle, turning around at either end. Returns the new angle.
+ */
+int SweepPlanner::advance()
+{
+    if (!reverse && position >= maxAngle) {
+        reverse = true;
+    } else if (reverse && position <= minAngle) {
+        reverse = false;
+    }
+
+    int next = position + (reverse ? -stepAt(position) : stepAt(position));
+
+    if (next > maxAngle)
+        next = maxAngle;
+    if (next < minAngle)
+        next = minAngle;
+
+    position = clampToEdges(position, next);
+    return position;
+}
+
+bool SweepPlanner::isReversing()
+{
+    return reverse;
+}
@@ -0,0 +1,38 @@
+#ifndef SWEEPPLANNER_H
+#define SWEEPPLANNER_H
+
+#include "ScanProfile.h"
+
+#define SWEEP_MIN_ANGLE           0                 // Default start of the sweep (degrees)
+#define SWEEP_MAX_ANGLE           180               // Default end of the sweep (degrees)
+#define SWEEP_STEP                1                 // Default step between samples (degrees)
+
+/**
+ * Works out where the servo goes next, bouncing back and forth between the ends of the sweep.
+ * Each end is visited once per bounce. Regions of interest are stepped through at their own step,
+ * and both edges of a region are always sampled.
+ */
+class SweepPlanner {
+    private:
+        int minAngle;
+        int maxAngle;
+        int step;
+        int position;
+        bool reverse;
+        int regionCount;
+        ScanRegion regions[SCAN_MAX_REGIONS];
+
+        int stepAt(int angle);
+        int clampToEdges(int from, int to);
+
+    public:
+        SweepPlanner(int minAngle = SWEEP_MIN_ANGLE, int maxAngle = SWEEP_MAX_ANGLE, int step = SWEEP_STEP);
+
+        int current();
+        int advance();
+        bool isReversing();
+        void reset();
+        void setProfile(const ScanProfile &profile);
+};
+
+#endif
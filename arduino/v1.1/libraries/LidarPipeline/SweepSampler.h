@@ -0,0 +1,171 @@
+#ifndef SWEEPSAMPLER_H
+#define SWEEPSAMPLER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <atomic>
+#include "SweepPlanner.h"
+#include "SweepHardware.h"
+#include "SettleModel.h"
+#include "PollStream.h"
+
+#define SWEEP_RESTART_SWING       180               // Assume the servo may be this far off (degrees) after a restart
+#define SWEEP_CONTINUOUS_LEAD     2                 // In continuous mode, keep the servo target at most this many degrees ahead
+
+/**
+ * Sensor side of the sweep pipeline. Each step takes a reading and hands it to the comms side through a
+ * SampleRing; sending, batching and UDP receive all happen elsewhere while the servo moves.
+ *
+ * Stop-and-go (the default) starts the servo toward the next angle straight after each reading, then waits
+ * for the SettleModel's time for that move. Continuous mode never waits: it reads back to back while the servo
+ * moves, and tags each reading with the angle the model says the servo was at halfway through the read.
+ *
+ * A scan profile sets the arc, steps, dwell and oversampling. It can be requested from another task at any
+ * time and is picked up at the start of the next step.
+ */
+template <typename Ring>
+class SweepSampler {
+    private:
+        SweepPlanner &planner;
+        Ring &ring;
+        SweepHardware &hardware;
+        SettleModel &settleModel;
+        bool continuous;
+        bool started;
+        int dwell;
+        int oversample;
+        ScanProfile pendingProfile;
+        std::atomic<bool> profilePending;
+        float moveFrom;
+        int moveTarget;
+        uint32_t moveStart;
+
+        /**
+         * Where the servo should be at the given time, from the move in progress
+         */
+        float estimateAngle(uint32_t time)
+        {
+            return settleModel.interpolateAngle(moveFrom, moveTarget, time - moveStart);
+        }
+
+        /**
+         * Average of the profile's oversample count of readings
+         */
+        int readDistance()
+        {
+            if (oversample <= 1)
+                return hardware.readDistance();
+
+            long total = 0;
+            for (int i = 0; i < oversample; i++)
+                total += hardware.readDistance();
+            return total / oversample;
+        }
+
+        void applyProfile()
+        {
+            planner.setProfile(pendingProfile);
+            dwell = pendingProfile.dwell;
+            oversample = pendingProfile.oversample;
+            started = false;
+            profilePending.store(false, std::memory_order_release);
+        }
+
+        void startMove(int angle)
+        {
+            uint32_t time = hardware.now();
+            moveFrom = estimateAngle(time);
+            moveTarget = angle;
+            moveStart = time;
+            hardware.moveTo(angle);
+        }
+
+        bool stepStopAndGo()
+        {
+            PollSample sample;
+            uint32_t readStart = hardware.nowMicros();
+            sample.angle = planner.current();
+            sample.distance = readDistance();
+            sample.timestamp = readStart + (hardware.nowMicros() - readStart) / 2;
+
+            int from = planner.current();
+            int to = planner.advance();
+            startMove(to);
+            bool queued = ring.push(sample);
+            hardware.wait(settleModel.getSettleTime(from, to) + dwell);
+            return queued;
+        }
+
+        bool stepContinuous()
+        {
+            uint32_t readStart = hardware.now();
+            uint32_t readStartMicros = hardware.nowMicros();
+            int distance = readDistance();
+            uint32_t readEnd = hardware.now();
+
+            // Stamped at the middle of the read, which is also where the angle is estimated
+            PollSample sample;
+            sample.timestamp = readStartMicros + (hardware.nowMicros() - readStartMicros) / 2;
+            sample.angle = (int)lroundf(estimateAngle(readStart + (readEnd - readStart) / 2));
+            sample.distance = distance;
+
+            // Keep the target just ahead of the servo, so it keeps moving but still turns at the ends
+            if (fabsf(moveTarget - estimateAngle(readEnd)) <= SWEEP_CONTINUOUS_LEAD)
+                startMove(planner.advance());
+
+            return ring.push(sample);
+        }
+
+    public:
+        SweepSampler(SweepPlanner &planner, Ring &ring, SweepHardware &hardware, SettleModel &settleModel, bool continuous = false)
+            : planner(planner), ring(ring), hardware(hardware), settleModel(settleModel), continuous(continuous),
+              started(false), dwell(0), oversample(1), profilePending(false), moveFrom(0), moveTarget(0), moveStart(0) {}
+
+        /**
+         * Take one sample. Returns false if the ring was full and the sample dropped.
+         */
+        bool step()
+        {
+            if (profilePending.load(std::memory_order_acquire))
+                applyProfile();
+
+            if (!started) {
+                hardware.moveTo(planner.current());
+                hardware.wait(settleModel.getSettleTime(0, SWEEP_RESTART_SWING));
+                moveFrom = moveTarget = planner.current();
+                moveStart = hardware.now();
+                started = true;
+            }
+
+            return continuous ? stepContinuous() : stepStopAndGo();
+        }
+
+        /**
+         * Next step() moves to the current angle and settles before reading, e.g. after a pause
+         */
+        void restart()
+        {
+            started = false;
+        }
+
+        /**
+         * Hand over a profile for the sampling task to pick up. Returns false if the profile is invalid,
+         * or the last one requested hasn't been picked up yet.
+         */
+        bool requestProfile(const ScanProfile &profile)
+        {
+            if (!profile.isValid() || profilePending.load(std::memory_order_acquire))
+                return false;
+
+            pendingProfile = profile;
+            profilePending.store(true, std::memory_order_release);
+            return true;
+        }
+
+        void setContinuous(bool continuous)
+        {
+            this->continuous = continuous;
+        }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include "SerialFrame.h"
+#include <string.h>
+
+/**
+ * CRC-16/CCITT-FALSE, a nibble at a time so the table stays small on the ESP32
+ */
+uint16_t frameCrc(const uint8_t *data, int length, uint16_t crc)
+{
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+
+    for (int i = 0; i < length; i++) {
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
+
+/**
+ * Build a sample frame, tagged with the sensor head the samples came from if it isn't 0. Returns the frame
+ * length, or 0 if it doesn't fit in size.
+ */
+int encodeSampleFrame(uint8_t *frame, int size, uint16_t sequence, const PollSample *samples, int count, int head)
+{
+    if (count <= 0 || count > FRAME_MAX_SAMPLES || size < FRAME_MAX_SIZE || head < 0 || head > 255)
+        return 0;
+
+    int headLength = head != 0 ? 1 : 0;
+    frame[FRAME_HEADER_SIZE] = head;
+
+    CompactStreamWriter writer(frame + FRAME_HEADER_SIZE + headLength, FRAME_MAX_PAYLOAD - headLength, samples[0].timestamp);
+    for (int i = 0; i < count; i++) {
+        writer.add(samples[i]);
+    }
+
+    int payloadLength = headLength + writer.length();
+    frame[0] = FRAME_SYNC_1;
+    frame[1] = FRAME_SYNC_2;
+    frame[2] = payloadLength & 0xFF;
+    frame[3] = payloadLength >> 8;
+    frame[4] = sequence & 0xFF;
+    frame[5] = sequence >> 8;
+    frame[6] = head != 0 ? FRAME_HEAD_SAMPLES : FRAME_SAMPLES;
+    frame[7] = count;
+
+    int length = FRAME_HEADER_SIZE + payloadLength;
+    uint16_t crc = frameCrc(frame + 2, length - 2);
+    frame[length] = crc & 0xFF;
+    frame[length + 1] = crc >> 8;
+    return length + FRAME_CRC_SIZE;
+}
+
+SerialFrameDecoder::SerialFrameDecoder(handleSample sampleHandler, void *context)
+{
+    this->sampleHandler = sampleHandler;
+    this->context = context;
+    reset();
+}
+
+void SerialFrameDecoder::reset()
+{
+    buffered = 0;
+    sequenceKnown = false;
+    nextSequence = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+const FrameStats &SerialFrameDecoder::getStats()
+{
+    return stats;
+}
+
+/**
+ * Consume received bytes, decoding every frame they complete
+ */
+void SerialFrameDecoder::feed(const uint8_t *data, int length)
+{
+    while (length > 0) {
+        int take = FRAME_MAX_SIZE - buffered;
+        if (take > length)
+            take = length;
+
+        memcpy(buffer + buffered, data, take);
+        buffered += take;
+        data += take;
+        length -= take;
+
+        process();
+    }
+}
+
+/**
+ * Decode whatever complete frames are buffered, skipping anything that isn't one.
+ * A partial frame is kept at the start of the buffer for the next feed().
+ */
+void SerialFrameDecoder::process()
+{
+    int start = 0;
+    while (start < buffered) {
+        // Hunt for the sync word; a lone first byte at the end may be the start of one
+        if (buffer[start] != FRAME_SYNC_1 || (start + 1 < buffered && buffer[start + 1] != FRAME_SYNC_2)) {
+            start++;
+            stats.skippedBytes++;
+            continue;
+        }
+
+        int available = buffered - start;
+        if (available < FRAME_HEADER_SIZE)
+            break;
+
+        const uint8_t *frame = buffer + start;
+        int payloadLength = frame[2] | (frame[3] << 8);
+        if (payloadLength > FRAME_MAX_PAYLOAD || frame[7] > FRAME_MAX_SAMPLES) {
+            stats.malformed++;
+            start++;
+            stats.skippedBytes++;
+            continue;
+        }
+
+        int length = FRAME_HEADER_SIZE + payloadLength + FRAME_CRC_SIZE;
+        if (available < length)
+            break;
+
+        uint16_t crc = frame[length - 2] | (frame[length - 1] << 8);
+        if (frameCrc(frame + 2, length - FRAME_CRC_SIZE - 2) != crc) {
+            stats.crcErrors++;
+            start++;
+            stats.skippedBytes++;
+            continue;
+        }
+
+        handleFrame(frame, length);
+        start += length;
+    }
+
+    buffered -= start;
+    memmove(buffer, buffer + start, buffered);
+}
+
+/**
+ * Unpack a frame that has passed its CRC
+ */
+void SerialFrameDecoder::handleFrame(const uint8_t *frame, int length)
+{
+    uint16_t sequence = frame[4] | (frame[5] << 8);
+    if (sequenceKnown && sequence != nextSequence)
+        stats.lostFrames += (uint16_t)(sequence - nextSequence);
+    sequenceKnown = true;
+    nextSequence = sequence + 1;
+    stats.frames++;
+
+    const uint8_t *payload = frame + FRAME_HEADER_SIZE;
+    int payloadLength = length - FRAME_HEADER_SIZE - FRAME_CRC_SIZE;
+    int head = 0;
+    if (frame[6] == FRAME_HEAD_SAMPLES && payloadLength > 0) {
+        head = *payload++;
+        payloadLength--;
+    } else if (frame[6] != FRAME_SAMPLES) {
+        return;
+    }
+
+    int count = frame[7];
+    CompactStreamReader reader(payload, payloadLength);
+    PollSample sample;
+    for (int i = 0; i < count && reader.next(sample); i++) {
+        stats.samples++;
+        if (sampleHandler)
+            sampleHandler(context, head, sample);
+    }
+
+    if (!reader.isValid())
+        stats.malformed++;
+}
@@ -0,0 +1,73 @@
+#ifndef SERIALFRAME_H
+#define SERIALFRAME_H
+
+#include <stdint.h>
+#include "PollStream.h"
+
+#define FRAME_SYNC_1              0xA5              // First sync byte
+#define FRAME_SYNC_2              0x5A              // Second sync byte
+#define FRAME_HEADER_SIZE         8                 // Sync (2), length (2), sequence (2), type (1), count (1)
+#define FRAME_CRC_SIZE            2                 // CRC-16/CCITT-FALSE over everything after the sync word
+#define FRAME_MAX_SAMPLES         32                // Samples batched into one frame
+#define FRAME_MAX_PAYLOAD         (1 + FRAME_MAX_SAMPLES * COMPACT_SAMPLE_MAX_SIZE + VARINT_MAX_SIZE)
+#define FRAME_MAX_SIZE            (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE)
+
+#define FRAME_SAMPLES             1                 // Payload is a compact poll sample stream (see PollStream.h)
+#define FRAME_HEAD_SAMPLES        2                 // Payload is the ID of the sensor head (1 byte), then its compact poll sample stream
+
+/**
+ * Binary serial frame, little-endian:
+ *    0xA5 0x5A   sync word
+ *    uint16      payload length
+ *    uint16      sequence number, incremented per frame
+ *    uint8       frame type
+ *    uint8       sample count
+ *    ...         payload
+ *    uint16      CRC over length..payload
+ */
+
+uint16_t frameCrc(const uint8_t *data, int length, uint16_t crc = 0xFFFF);
+
+int encodeSampleFrame(uint8_t *frame, int size, uint16_t sequence, const PollSample *samples, int count, int head = 0);
+
+/**
+ * Stats kept by the decoder, for spotting a noisy or overrun link
+ */
+struct FrameStats {
+    unsigned long frames;
+    unsigned long samples;
+    unsigned long crcErrors;
+    unsigned long malformed;
+    unsigned long skippedBytes;
+    unsigned long lostFrames;
+};
+
+/**
+ * Incremental frame decoder. Feed it bytes as they arrive, in any sized chunks; it resynchronises on the
+ * sync word after garbage or a bad CRC, and hands each decoded sample to the handler along with the
+ * sensor head it came from (0 from frames that don't say).
+ */
+class SerialFrameDecoder {
+    typedef void (*handleSample)(void *context, int head, const PollSample &sample);
+
+    private:
+        uint8_t buffer[FRAME_MAX_SIZE];
+        int buffered;
+        bool sequenceKnown;
+        uint16_t nextSequence;
+        handleSample sampleHandler;
+        void *context;
+        FrameStats stats;
+
+        void process();
+        void handleFrame(const uint8_t *frame, int length);
+
+    public:
+        SerialFrameDecoder(handleSample sampleHandler, void *context = 0);
+
+        void feed(const uint8_t *data, int length);
+        const FrameStats &getStats();
+        void reset();
+};
+
+#endif
@@ -1,247 +1,342 @@
-/**
- * Swol v1.1
- * ---------
- * Swol drives the motor and polls the TOF sensor.
- */
-
-#define CLIENT                      2         // Client ID (permanent)
-#define CLIENT_NAME                 "Swol"    // Client name, only really used for display
-#define SERVO_PIN                   14        // Pin for Servo signal
-
-// -------------------------------
-// DO NOT edit below here
-// -------------------------------
-
-#define STATE_STARTUP               1
-#define STATE_AWAIT_POLL_CMD        2
-#define STATE_POLL                  3
-#define STATE_SYSTEM_RESTART        55
-#define STATE_WIFI_DISCONNECTED     88
-#define STATE_SYSTEM_FAILURE        99
-
-#include "LidarComms.h"
-#include "LidarState.h"
-#include "DFRobot_VL53L0X.h"
-#include <ESP32Servo.h>
-
-LidarComms lidarComms = LidarComms(CLIENT, (CLIENT == 1), false);
-LidarState lidarState = LidarState();
-Servo servo;
-DFRobotVL53L0X tofSensor;
-hw_timer_t* systemFailureTimer = NULL;
-int servoPosition;
-bool servoReverse;
-bool pollCommandReceived;
-bool systemFailure;
-bool systemFailureLedState;
-bool systemRestartCommandReceived;
-
-/**
- * Timer interrupt to flash red LED in case of system failure
- */ 
-void IRAM_ATTR systemFailureIsr()
-{
-  systemFailureLedState = !systemFailureLedState;
-  lidarState.setLedState(systemFailureLedState, false, false);
-}
-
-void setup()
-{
-  Serial.begin(115200);
-  Serial.printf("Starting %s...\nTarget AP: %s\n", CLIENT_NAME, lidarComms.getWifiSsid());
-
-  WiFi.onEvent(WiFiEvent);
-  lidarState.setStateChangeHandler(handleStateChange);
-  lidarComms.setMessageHandler(handleMessage);
-
-  Serial.println("Boot complete, entering startup...");
-  
-  lidarState.transitionTo(STATE_STARTUP);
-  
-}
-
-void loop()
-{
-  lidarComms.checkUdpPacket();
-  doStateActions();
-  delay(1);
-}
-
-/**
- * Handle when we move in/out of a state
- */
-void handleStateChange(int stateTo, int stateFrom)
-{
-  // State entry
-  switch (stateTo) {
-    case STATE_STARTUP:
-      systemRestartCommandReceived = false;
-      lidarState.setLedState(false, false, true);
-      lidarComms.connectWifi();
-      Wire.begin();
-      tofSensor.begin(0x50);
-      tofSensor.setMode(Continuous, High);
-      tofSensor.start();
-      ESP32PWM::allocateTimer(0);
-      ESP32PWM::allocateTimer(1);
-      ESP32PWM::allocateTimer(2);
-      ESP32PWM::allocateTimer(3);
-      servo.setPeriodHertz(50);
-      servo.attach(SERVO_PIN, 800, 2200); // MG995
-    break;
-
-    case STATE_AWAIT_POLL_CMD:
-      pollCommandReceived = false;
-      lidarComms.messageBroadcastId();
-      lidarState.setLedState(false, true, true);
-    break;
-
-    case STATE_POLL:
-    break;
-
-    case STATE_SYSTEM_RESTART:
-      lidarState.setLedState(true, true, true);
-    break;
-
-    case STATE_WIFI_DISCONNECTED:
-      lidarState.setLedState(true, false, false);
-      lidarComms.disconnectWifi();
-      delay(5000);
-      lidarState.transitionTo(STATE_STARTUP);
-    break;
-
-    case STATE_SYSTEM_FAILURE:
-      lidarComms.messageBroadcastSystemFailure();
-      systemFailureTimer = timerBegin(0, 40, true);
-      timerAttachInterrupt(systemFailureTimer, &systemFailureIsr, true);
-      timerAlarmWrite(systemFailureTimer, 1000000, true);
-      timerAlarmEnable(systemFailureTimer);
-    break;
-  }
-
-  // State exit
-  switch (stateFrom) {
-      case STATE_AWAIT_POLL_CMD:
-        lidarState.setLedState(false, true, false);
-        lidarComms.messageBroadcastPollConfirm();
-      break;
-  }
-}
-
-/**
- * Perform actions in the current state
- */
-void doStateActions()
-{
-  switch (lidarState.getCurrentState()) {
-    case STATE_STARTUP:
-      // @TODO: Put the hardware check back in!
-      if (lidarComms.isConnected() && tofSensor.getDistance() < 16000) {
-        lidarState.transitionTo(STATE_AWAIT_POLL_CMD);
-        return;
-      }
-      
-      if (lidarState.isTimedOut()) {
-        if (tofSensor.getDistance() > 16000) {
-          lidarState.transitionTo(STATE_SYSTEM_FAILURE);
-          return;
-        }
-        lidarState.transitionTo(STATE_WIFI_DISCONNECTED);
-      }
-    break;
-    case STATE_AWAIT_POLL_CMD:
-      if (pollCommandReceived) {
-        lidarState.transitionTo(STATE_POLL);
-        return;
-      }
-
-      commonStateChecks();
-    break;
-
-    case STATE_POLL:
-      doPolling();
-      commonStateChecks();
-    break;
-  }
-}
-
-
-/**
- * Common checks performed in different states
- */ 
-void commonStateChecks()
-{
-  if (systemRestartCommandReceived)
-    lidarState.transitionTo(STATE_SYSTEM_RESTART);
-
-  if (systemFailure)
-    lidarState.transitionTo(STATE_SYSTEM_FAILURE);
-
-  if (!lidarComms.isConnected())
-    lidarState.transitionTo(STATE_WIFI_DISCONNECTED);
-}
-
-
-/**
- * Step the servo and take polling data
- */ 
-void doPolling()
-{
-  if (servoPosition > 180) {
-    servoPosition = 180;
-    servoReverse = true;
-  }
-
-  if (servoPosition < 0) {
-    servoPosition = 0;
-    servoReverse = false;
-  }
-
-  servo.write(servoPosition);
-
-  delay(10);
-
-  
-  int distance = (int)tofSensor.getDistance();
-
-  lidarComms.messageBroadcastPollResult(servoPosition, distance);
-
-    if (servoReverse) {
-    servoPosition--;
-  } else {
-    servoPosition++;
-  }
-
-}
-
-/**
- *  Handle incoming messages. This will be called from LidarComms class.
- */
-void handleMessage(int msgFrom, int msgTo, int msgDescriptor, int msgMetaData, int msgValue)
-{
-
-  // if (DEBUG == true)
-  //   Serial.printf("Client message received:\n\tFrom: %d\n\tTo: %d\n\tDescriptor: %d\n\tMetaData: %d\n\tValue: %d\n\n", msgFrom, msgTo, msgDescriptor, msgMetaData, msgValue);
-
-  if (msgTo != 0 && msgTo != lidarComms.getClientId())
-    return;
-    
-  switch (msgDescriptor) {
-    case MSG_POLL_CMD:
-      pollCommandReceived = true;
-    break;
-
-    case MSG_SYSTEM_RESTART_CMD:
-      systemRestartCommandReceived = true;
-    break;
-  }
-
-}
-
-/**
- * Event handler for WiFi events
- */ 
-void WiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
-{
-  lidarComms.wifiEvent(event, info);
-}
+/**
+ * Swol v1.1
+ * ---------
+ * Swol drives the motor and polls the TOF sensor.
+ */
+
+#define CLIENT                      2         // Client ID (permanent)
+#define CLIENT_NAME                 "Swol"    // Client name, only really used for display
+#define SERVO_PIN                   14        // Pin for Servo signal
+#define CONTINUOUS_SWEEP            false     // Read while the servo moves, interpolating angle, instead of stopping at each step
+#define SETTLE_CALIBRATION          false     // Calibrate servo settle times once at startup; point the sensor across an edge
+#define SETTLE_CALIBRATION_ANGLE    90        // Angle the calibration moves settle onto
+#define PIPELINED_POLLING           true      // Sample on a separate core, leaving loop() to batch and send
+#define SENSOR_TASK_CORE            0         // Core for the sensor task; loop() runs on the other
+#define SAMPLE_RING_SIZE            256       // Samples buffered between the sensor task and loop() (power of 2)
+
+// -------------------------------
+// DO NOT edit below here
+// -------------------------------
+
+#define STATE_STARTUP               1
+#define STATE_AWAIT_POLL_CMD        2
+#define STATE_POLL                  3
+#define STATE_SYSTEM_RESTART        55
+#define STATE_WIFI_DISCONNECTED     88
+#define STATE_SYSTEM_FAILURE        99
+
+#define SAMPLING_OFF                0
+#define SAMPLING_ON                 1
+#define SAMPLING_STOPPING           2
+
+#include "LidarComms.h"
+#include "LidarState.h"
+#include "DFRobot_VL53L0X.h"
+#include <ESP32Servo.h>
+#include "SampleRing.h"
+#include "SweepPlanner.h"
+#include "SweepSampler.h"
+#include "SettleModel.h"
+#include <atomic>
+
+typedef SampleRing<PollSample, SAMPLE_RING_SIZE> SwolSampleRing;
+
+LidarComms lidarComms = LidarComms(CLIENT, (CLIENT == 1), false);
+LidarState lidarState = LidarState();
+Servo servo;
+DFRobotVL53L0X tofSensor;
+hw_timer_t* systemFailureTimer = NULL;
+bool pollCommandReceived;
+bool systemFailure;
+bool systemFailureLedState;
+bool systemRestartCommandReceived;
+bool settleCalibrated;
+
+/**
+ * The servo and ToF sensor, as driven by the sensor task
+ */
+class SwolHardware : public SweepHardware {
+  public:
+    void moveTo(int angle) { servo.write(angle); }
+    int readDistance() { return (int)tofSensor.getDistance(); }
+    uint32_t now() { return millis(); }
+    uint32_t nowMicros() { return micros(); }
+    void wait(int ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+};
+
+SweepPlanner sweepPlanner;
+SwolSampleRing sampleRing;
+SwolHardware swolHardware;
+SettleModel settleModel;
+SweepSampler<SwolSampleRing> sweepSampler(sweepPlanner, sampleRing, swolHardware, settleModel, CONTINUOUS_SWEEP);
+std::atomic<int> samplingState(SAMPLING_OFF);  // Turned on and told to stop by loop(), turned off by the sensor task
+
+/**
+ * Timer interrupt to flash red LED in case of system failure
+ */ 
+void IRAM_ATTR systemFailureIsr()
+{
+  systemFailureLedState = !systemFailureLedState;
+  lidarState.setLedState(systemFailureLedState, false, false);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.printf("Starting %s...\nTarget AP: %s\n", CLIENT_NAME, lidarComms.getWifiSsid());
+
+  WiFi.onEvent(WiFiEvent);
+  lidarState.setStateChangeHandler(handleStateChange);
+  lidarComms.setDescriptorHandler(MSG_POLL_CMD, handlePollCommand);
+  lidarComms.setDescriptorHandler(MSG_SYSTEM_RESTART_CMD, handleSystemRestartCommand);
+  lidarComms.setScanProfileHandler(handleScanProfile);
+  if (PIPELINED_POLLING)
+    xTaskCreatePinnedToCore(sensorTask, "sensor", 4096, NULL, 1, NULL, SENSOR_TASK_CORE);
+
+  Serial.println("Boot complete, entering startup...");
+  
+  lidarState.transitionTo(STATE_STARTUP);
+  
+}
+
+void loop()
+{
+  int packetsHandled = lidarComms.drainUdpPackets();
+  doStateActions();
+  lidarComms.checkPollResultBatch();
+  lidarComms.checkClients();
+  if (packetsHandled == 0)
+    delay(1);
+}
+
+/**
+ * Handle when we move in/out of a state
+ */
+void handleStateChange(int stateTo, int stateFrom)
+{
+  // State entry
+  switch (stateTo) {
+    case STATE_STARTUP:
+      systemRestartCommandReceived = false;
+      lidarState.setLedState(false, false, true);
+      lidarComms.connectWifi();
+      Wire.begin();
+      tofSensor.begin(0x50);
+      tofSensor.setMode(Continuous, High);
+      tofSensor.start();
+      ESP32PWM::allocateTimer(0);
+      ESP32PWM::allocateTimer(1);
+      ESP32PWM::allocateTimer(2);
+      ESP32PWM::allocateTimer(3);
+      servo.setPeriodHertz(50);
+      servo.attach(SERVO_PIN, 800, 2200); // MG995
+    break;
+
+    case STATE_AWAIT_POLL_CMD:
+      pollCommandReceived = false;
+      lidarComms.messageBroadcastId();
+      lidarState.setLedState(false, true, true);
+    break;
+
+    case STATE_POLL:
+      sweepSampler.restart();
+      samplingState = PIPELINED_POLLING ? SAMPLING_ON : SAMPLING_OFF;
+    break;
+
+    case STATE_SYSTEM_RESTART:
+      lidarState.setLedState(true, true, true);
+    break;
+
+    case STATE_WIFI_DISCONNECTED:
+      lidarState.setLedState(true, false, false);
+      lidarComms.disconnectWifi();
+      delay(5000);
+      lidarState.transitionTo(STATE_STARTUP);
+    break;
+
+    case STATE_SYSTEM_FAILURE:
+      lidarComms.messageBroadcastSystemFailure();
+      systemFailureTimer = timerBegin(0, 40, true);
+      timerAttachInterrupt(systemFailureTimer, &systemFailureIsr, true);
+      timerAlarmWrite(systemFailureTimer, 1000000, true);
+      timerAlarmEnable(systemFailureTimer);
+    break;
+  }
+
+  // State exit
+  switch (stateFrom) {
+      case STATE_AWAIT_POLL_CMD:
+        lidarState.setLedState(false, true, false);
+        lidarComms.messageBroadcastPollConfirm();
+      break;
+
+      case STATE_POLL:
+        // Don't leave a partial batch behind, nor samples the sensor task was still taking
+        stopSampling();
+        forwardSamples();
+        lidarComms.flushPollResults();
+      break;
+  }
+}
+
+/**
+ * Perform actions in the current state
+ */
+void doStateActions()
+{
+  switch (lidarState.getCurrentState()) {
+    case STATE_STARTUP:
+      // @TODO: Put the hardware check back in!
+      if (lidarComms.isConnected() && tofSensor.getDistance() < 16000) {
+        if (SETTLE_CALIBRATION && !settleCalibrated)
+          calibrateSettleTimes();
+        lidarState.transitionTo(STATE_AWAIT_POLL_CMD);
+        return;
+      }
+      
+      if (lidarState.isTimedOut()) {
+        if (tofSensor.getDistance() > 16000) {
+          lidarState.transitionTo(STATE_SYSTEM_FAILURE);
+          return;
+        }
+        lidarState.transitionTo(STATE_WIFI_DISCONNECTED);
+      }
+    break;
+    case STATE_AWAIT_POLL_CMD:
+      if (pollCommandReceived) {
+        lidarState.transitionTo(STATE_POLL);
+        return;
+      }
+
+      commonStateChecks();
+    break;
+
+    case STATE_POLL:
+      doPolling();
+      commonStateChecks();
+    break;
+  }
+}
+
+
+/**
+ * Common checks performed in different states
+ */ 
+void commonStateChecks()
+{
+  if (systemRestartCommandReceived)
+    lidarState.transitionTo(STATE_SYSTEM_RESTART);
+
+  if (systemFailure)
+    lidarState.transitionTo(STATE_SYSTEM_FAILURE);
+
+  if (!lidarComms.isConnected())
+    lidarState.transitionTo(STATE_WIFI_DISCONNECTED);
+}
+
+
+/**
+ * Step the servo and take polling data. When pipelined, the sensor task does the sampling and we just pass it on.
+ */ 
+void doPolling()
+{
+  if (!PIPELINED_POLLING)
+    sweepSampler.step();
+
+  forwardSamples();
+}
+
+/**
+ * Measure how long the servo takes to settle for each step size and direction, replacing the default model
+ */
+void calibrateSettleTimes()
+{
+  Serial.println("Calibrating servo settle times...");
+  if (!settleModel.calibrate(swolHardware, SETTLE_CALIBRATION_ANGLE))
+    Serial.println("Some settle times did not stabilise, keeping defaults for those");
+
+  for (int step = 1; step <= SETTLE_MAX_STEP; step++)
+    Serial.printf("\t%d deg: %d ms / %d ms\n", step,
+      settleModel.getSettleTime(0, step), settleModel.getSettleTime(step, 0));
+
+  settleCalibrated = true;
+}
+
+/**
+ * Pass samples from the sensor task on to LidarComms for batching
+ */
+void forwardSamples()
+{
+  PollSample sample;
+  while (sampleRing.pop(sample))
+    lidarComms.queuePollResult(sample);
+}
+
+/**
+ * Stop the sensor task, returning once it has finished the step it was in, so it pushes nothing more
+ */
+void stopSampling()
+{
+  int expected = SAMPLING_ON;
+  if (!samplingState.compare_exchange_strong(expected, SAMPLING_STOPPING))
+    return;
+
+  while (samplingState != SAMPLING_OFF)
+    vTaskDelay(1);
+}
+
+/**
+ * Sensor task, pinned to SENSOR_TASK_CORE. Moves the servo and takes readings while polling,
+ * so servo settling and sensor reads overlap with sending on the other core. Only steps while sampling is on,
+ * and says it has stopped between steps.
+ */
+void sensorTask(void *parameters)
+{
+  for (;;) {
+    int state = samplingState;
+    if (state == SAMPLING_STOPPING)
+      samplingState = SAMPLING_OFF;
+    if (state != SAMPLING_ON) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+
+    sweepSampler.step();
+  }
+}
+
+/**
+ * Start polling when bigbrain says so. This and the below are called from LidarComms class.
+ */
+void handlePollCommand(void *context, const MessageView &message)
+{
+  pollCommandReceived = true;
+}
+
+/**
+ * Restart when bigbrain says so
+ */
+void handleSystemRestartCommand(void *context, const MessageView &message)
+{
+  systemRestartCommandReceived = true;
+}
+
+/**
+ * Handle a scan profile pushed by bigbrain. The sampler picks it up at its next step.
+ */
+void handleScanProfile(int from, int profileId, const ScanProfile &profile)
+{
+  // Anything outside the servo's travel is refused rather than clipped
+  bool accepted = profile.startAngle >= SWEEP_MIN_ANGLE && profile.endAngle <= SWEEP_MAX_ANGLE
+    && sweepSampler.requestProfile(profile);
+
+  lidarComms.messageScanProfileConfirm(from, profileId, accepted);
+}
+
+/**
+ * Event handler for WiFi events
+ */ 
+void WiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+  lidarComms.wifiEvent(event, info);
+}
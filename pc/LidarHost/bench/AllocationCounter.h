@@ -0,0 +1,50 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+/**
+ * Counts every allocation a bench makes, by replacing the global operator new and delete, single and array,
+ * plain and sized. A bench reads allocations either side of a run to check it allocated nothing. The
+ * operators are defined here, so include this from only one file of each bench. The new and delete the rest
+ * forward to are kept out of line, so the compiler never sees malloc() and free() meet a new or a delete.
+ */
+static std::atomic<unsigned long> allocations(0);
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocations++;
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * Client registry benchmark
+ * -------------------------
+ * Joins more sensor heads to a brain than the old fixed client table could hold, runs them all with
+ * heartbeats over the in-memory channel, then silences one and times how long the brain takes to drop it.
+ * Every other head must stay registered throughout, and identifying itself again mustn't count as a new
+ * connection. A stranger that sends one heartbeat and never says hello must not keep its slot past
+ * QUIET_CLIENT_TIMEOUT. Also reports the cost of looking a client up.
+ *
+ * Usage: ClientRegistryBench [heads]
+ */
+
+#include <LidarComms.h>
+#include <MemoryUdp.h>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#define BENCH_HEADS               12                // Default sensor heads joined to the brain
+#define BENCH_RUN_TIME            1000              // Time (ms) all heads run before one is silenced
+#define BENCH_LOOKUPS             10000000          // Lookups timed
+#define BENCH_STRANGER            40                // Client that never says hello
+
+static int droppedClient = 0;
+static unsigned long droppedTime = 0;
+static int unexpectedDrops = 0;
+static int connections = 0;
+
+void handleConnection(int)
+{
+    connections++;
+}
+
+void handleDisconnection(int clientId)
+{
+    if (clientId == BENCH_STRANGER)
+        return;
+    if (droppedClient == 0) {
+        droppedClient = clientId;
+        droppedTime = millis();
+    } else {
+        unexpectedDrops++;
+    }
+}
+
+struct Head {
+    std::unique_ptr<MemoryUdp> transport;
+    std::unique_ptr<LidarComms> comms;
+    bool alive;
+};
+
+int main(int argc, char **argv)
+{
+    int heads = argc > 1 ? atoi(argv[1]) : BENCH_HEADS;
+    if (heads <= 0 || heads > REGISTRY_SIZE)
+        heads = BENCH_HEADS;
+
+    Serial.setQuiet(true);
+    WiFi.config(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1));
+    MemoryNetwork network;
+    MemoryUdp brainTransport(network, IPAddress(192, 168, 4, 1), 256);
+    LidarComms brain(BRAIN_CLIENT, true, false);
+    brain.setTransport(&brainTransport);
+    brain.setConnectionHandler(handleConnection);
+    brain.setDisconnectionHandler(handleDisconnection);
+    brain.startUdp();
+
+    // Heads take IDs from 2 up, past the 9 the old table had room for
+    std::vector<Head> fleet(heads);
+    for (int i = 0; i < heads; i++) {
+        int id = 2 + i;
+        fleet[i].transport.reset(new MemoryUdp(network, IPAddress(192, 168, 4, 10 + i)));
+        fleet[i].comms.reset(new LidarComms(id, false, false));
+        fleet[i].comms->setTransport(fleet[i].transport.get());
+        fleet[i].comms->startUdp();
+        fleet[i].alive = true;
+        fleet[i].comms->messageId(BRAIN_CLIENT);
+        brain.drainUdpPackets();
+        brain.messageId(id);
+        fleet[i].comms->drainUdpPackets();
+    }
+
+    for (int i = 0; i < heads; i++)
+        fleet[i].comms->messageId(BRAIN_CLIENT);
+    brain.drainUdpPackets();
+
+    int registered = 0;
+    for (int i = 0; i < heads; i++)
+        registered += brain.isClientConnected(2 + i);
+    printf("%d heads joined, %d registered (IDs 2-%d), %d connections after identifying twice\n", heads,
+        registered, heads + 1, connections);
+
+    // Never drained, so never answers the brain asking it to say hello
+    MemoryUdp strangerTransport(network, IPAddress(192, 168, 4, 99));
+    LidarComms stranger(BENCH_STRANGER, false, false);
+    stranger.setTransport(&strangerTransport);
+    stranger.startUdp();
+    stranger.messageHeartbeat(BRAIN_CLIENT);
+    brain.drainUdpPackets();
+    bool strangerRegistered = brain.isClientConnected(BENCH_STRANGER);
+
+    // Everyone heartbeats; halfway through, the middle head goes quiet
+    int victim = 2 + heads / 2;
+    unsigned long start = millis();
+    unsigned long silencedTime = 0;
+    unsigned long runTime = BENCH_RUN_TIME * 2 > QUIET_CLIENT_TIMEOUT + BENCH_RUN_TIME / 2
+        ? BENCH_RUN_TIME * 2 : QUIET_CLIENT_TIMEOUT + BENCH_RUN_TIME / 2;
+    for (unsigned long now = millis(); now - start < runTime; now = millis()) {
+        if (silencedTime == 0 && now - start >= BENCH_RUN_TIME) {
+            fleet[victim - 2].alive = false;
+            silencedTime = now;
+        }
+        for (Head &head : fleet) {
+            if (!head.alive)
+                continue;
+            head.comms->drainUdpPackets();
+            head.comms->checkClients();
+        }
+        brain.drainUdpPackets();
+        brain.checkClients();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    bool dropped = droppedClient == victim;
+    printf("head %d silenced      %s after %lu ms (timeout %d ms, heartbeat %d ms), %d others dropped\n", victim,
+        dropped ? "dropped" : "NOT DROPPED", dropped ? droppedTime - silencedTime : 0, CLIENT_TIMEOUT,
+        HEARTBEAT_INTERVAL, unexpectedDrops);
+    bool strangerDropped = strangerRegistered && !brain.isClientConnected(BENCH_STRANGER);
+    printf("stranger %d           %s\n", BENCH_STRANGER, strangerDropped ? "dropped" : "NOT DROPPED");
+
+    const ClientInfo *client = brain.getClient(2);
+    if (client)
+        printf("head 2                rx %u  tx %u  over %.1f s\n", client->received, client->sent,
+            (millis() - start) / 1e3);
+
+    // O(1) lookups, hits and misses alike
+    auto lookupStart = std::chrono::steady_clock::now();
+    unsigned long found = 0;
+    for (int i = 0; i < BENCH_LOOKUPS; i++)
+        found += brain.getClient(i & 31) != NULL;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - lookupStart).count();
+    printf("lookup                %.1f ns (%lu of %d found)\n", elapsed * 1e9 / BENCH_LOOKUPS, found, BENCH_LOOKUPS);
+
+    bool ok = registered == heads && connections == heads && dropped && unexpectedDrops == 0 && strangerDropped
+        && droppedTime - silencedTime <= CLIENT_TIMEOUT + HEARTBEAT_INTERVAL;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+/**
+ * Clock sync benchmark
+ * --------------------
+ * First pings swol's clock from the brain over the in-memory channel and checks batched samples come out
+ * on the brain's timeline. Both ends share the host clock there, so the offset should come out near zero.
+ *
+ * Then simulates a node whose crystal drifts against the brain's, over a Wi-Fi link with jitter and the
+ * occasional long retry, starting just short of the 32 bit us wrap. Samples are put on the brain's
+ * timeline with ClockSync and compared with the true time they were taken, against stamping them on
+ * arrival as bigbrain used to.
+ *
+ * Usage: ClockSyncBench [seconds] [skew ppm]
+ */
+
+#include <ClockSync.h>
+#include <LidarComms.h>
+#include <MemoryUdp.h>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define BENCH_SECONDS             300               // Default simulated run time
+#define BENCH_SKEW_PPM            35                // Default node drift against the brain
+#define BENCH_START_TIME          4290000000u       // Brain clock at the start, ~5 s short of the wrap
+#define BENCH_NODE_OFFSET         123456789         // Node clock minus the brain's at the start (us)
+#define BENCH_BASE_DELAY          1500              // One-way network delay without jitter (us)
+#define BENCH_JITTER              800               // Mean extra delay (us), exponentially distributed
+#define BENCH_RETRY_CHANCE        10                // One in this many packets is held up by a retry...
+#define BENCH_RETRY_DELAY         15000             // ...for this long (us)
+#define BENCH_SAMPLE_INTERVAL     20000             // Time between samples on the node (us)
+#define BENCH_BATCH_INTERVAL      250000            // Time between batches leaving the node (us)
+#define BENCH_PING_FAST           100000            // Bigbrain's CLOCK_SYNC_FAST_INTERVAL (us)
+#define BENCH_PING_SLOW           1000000           // Bigbrain's CLOCK_SYNC_INTERVAL (us)
+#define BENCH_ERROR_LIMIT         1000              // Largest acceptable 99th percentile error (us)
+
+static std::vector<PollSample> brainSamples;
+
+void handleBrainSample(void *, int, const PollSample &sample)
+{
+    brainSamples.push_back(sample);
+}
+
+static double randomUnit()
+{
+    return (rand() + 1.0) / (RAND_MAX + 2.0);
+}
+
+static double networkDelay()
+{
+    double delay = BENCH_BASE_DELAY - BENCH_JITTER * log(randomUnit());
+    if (rand() % BENCH_RETRY_CHANCE == 0)
+        delay += BENCH_RETRY_DELAY;
+    return delay;
+}
+
+/**
+ * The node's clock for a true (brain) time
+ */
+static uint32_t nodeClock(double time, double skew)
+{
+    return (uint32_t)(uint64_t)llround(BENCH_NODE_OFFSET + time * (1 + skew));
+}
+
+static uint32_t brainClock(double time)
+{
+    return (uint32_t)(BENCH_START_TIME + (uint64_t)llround(time));
+}
+
+struct ErrorStats {
+    double mean;
+    double p99;
+    double max;
+};
+
+static ErrorStats summarise(std::vector<double> &errors)
+{
+    ErrorStats stats = { 0, 0, 0 };
+    if (errors.empty())
+        return stats;
+
+    std::sort(errors.begin(), errors.end());
+    for (double error : errors)
+        stats.mean += error;
+    stats.mean /= errors.size();
+    stats.p99 = errors[errors.size() * 99 / 100];
+    stats.max = errors.back();
+    return stats;
+}
+
+static bool checkWire()
+{
+    WiFi.config(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1));
+    MemoryNetwork network;
+    MemoryUdp brainTransport(network, IPAddress(192, 168, 4, 1));
+    MemoryUdp swolTransport(network, IPAddress(192, 168, 4, 2));
+    LidarComms brain(1, true, false);
+    LidarComms swol(2, false, false);
+    brain.setTransport(&brainTransport);
+    swol.setTransport(&swolTransport);
+    brain.setPollSampleHandler(handleBrainSample);
+    brain.startUdp();
+    swol.startUdp();
+
+    // Each side learns what the other can do
+    brain.messageId(2);
+    swol.messageId(1);
+    swol.drainUdpPackets();
+    brain.drainUdpPackets();
+
+    for (int i = 0; i < CLOCK_SYNC_WINDOW; i++) {
+        brain.messageClockPing(2);
+        swol.drainUdpPackets();
+        brain.drainUdpPackets();
+    }
+
+    ClockSync *clockSync = brain.getClockSync(2);
+    uint32_t sampleTimes[4];
+    for (int i = 0; i < 4; i++) {
+        sampleTimes[i] = micros();
+        PollSample sample = { i, 1000 + i, sampleTimes[i] };
+        swol.queuePollResult(sample);
+        delayMicroseconds(2000);
+    }
+    swol.flushPollResults();
+    brain.drainUdpPackets();
+
+    int32_t worst = 0;
+    for (size_t i = 0; i < brainSamples.size() && i < 4; i++) {
+        int32_t error = abs((int32_t)(brainSamples[i].timestamp - sampleTimes[i]));
+        worst = std::max(worst, error);
+    }
+
+    bool ok = clockSync->getExchangeCount() == CLOCK_SYNC_WINDOW && brainSamples.size() == 4
+        && abs(clockSync->getOffset(micros())) < 1000 && worst < 1000;
+    printf("wire                    %d exchanges, offset %d us, round trip %u us, %zu samples, worst stamp error %d us: %s\n",
+        clockSync->getExchangeCount(), clockSync->getOffset(micros()), clockSync->getRoundTrip(), brainSamples.size(),
+        worst, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : BENCH_SECONDS;
+    double skewPpm = argc > 2 ? atof(argv[2]) : BENCH_SKEW_PPM;
+    if (seconds <= 0)
+        seconds = BENCH_SECONDS;
+    double skew = skewPpm / 1e6;
+
+    bool ok = checkWire();
+
+    ClockSync clockSync;
+    std::vector<double> syncErrors, arrivalErrors;
+    double duration = seconds * 1e6;
+    double nextPing = 0, nextBatch = BENCH_BATCH_INTERVAL;
+    double sampleTime = 0;
+    int pings = 0;
+
+    for (double time = 0; time < duration; time = std::min(nextPing, nextBatch)) {
+        if (time == nextPing) {
+            // Ping out, a little time on the node, pong back
+            double arrives = time + networkDelay();
+            double replies = arrives + 50 + rand() % 150;
+            double returns = replies + networkDelay();
+            clockSync.addExchange(brainClock(time), nodeClock(arrives, skew), nodeClock(replies, skew), brainClock(returns));
+            pings++;
+            nextPing += clockSync.getExchangeCount() < CLOCK_SYNC_WINDOW ? BENCH_PING_FAST : BENCH_PING_SLOW;
+            continue;
+        }
+
+        // A batch of samples leaves the node and arrives after the network's had it
+        double arrives = time + networkDelay();
+        for (; sampleTime < time; sampleTime += BENCH_SAMPLE_INTERVAL) {
+            if (!clockSync.isSynced())
+                continue;
+            uint32_t truth = brainClock(sampleTime);
+            syncErrors.push_back(fabs((double)(int32_t)(clockSync.toLocal(nodeClock(sampleTime, skew)) - truth)));
+            arrivalErrors.push_back(fabs((double)(int32_t)(brainClock(arrives) - truth)));
+        }
+        nextBatch += BENCH_BATCH_INTERVAL;
+    }
+
+    ErrorStats sync = summarise(syncErrors);
+    ErrorStats arrival = summarise(arrivalErrors);
+    printf("simulated               %d s, %d pings, skew %.1f ppm (estimated %.2f), %u exchanges rejected\n", seconds, pings,
+        skewPpm, clockSync.getSkewPpm(), clockSync.getRejectedCount());
+    printf("stamp error (us)        %-10s %-10s %s\n", "mean", "p99", "max");
+    printf("  on arrival            %-10.0f %-10.0f %.0f\n", arrival.mean, arrival.p99, arrival.max);
+    printf("  clock sync            %-10.0f %-10.0f %.0f\n", sync.mean, sync.p99, sync.max);
+
+    ok &= sync.p99 < BENCH_ERROR_LIMIT;
+    return ok ? 0 : 1;
+}
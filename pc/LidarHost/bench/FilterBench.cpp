@@ -0,0 +1,188 @@
+/**
+ * Filter benchmark
+ * ----------------
+ * Checks SlidingMedian and the sorting networks against a plain sort, then compares the cost of smol's
+ * original path (collect SAMPLE_SIZE readings, qsort, take the middle) with streaming them through
+ * SlidingMedian, and the cost of the trimmed mean and MAD filters on the same window.
+ *
+ * Usage: FilterBench [readings]
+ */
+
+#include <LidarFilter.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_READINGS            2000000           // Default readings per run
+#define BENCH_WINDOW              50                // smol's SAMPLE_SIZE
+#define BENCH_CHECK_READINGS      20000             // Readings per window size in the correctness check
+
+static volatile float sink;
+
+/**
+ * ToF-like readings of a fixed distance: +/-5 mm of noise, and one wild reading in 50
+ */
+static float nextReading(float distance)
+{
+    static unsigned int seed = 12345;
+    seed = seed * 1103515245 + 12345;
+    float noise = ((int)(seed >> 16) % 201 - 100) * 0.05f;
+    if ((seed >> 20) % 50 == 0)
+        noise += 4000;
+    return distance + noise;
+}
+
+/**
+ * smol's original comparator, kept as it was: it sorts the floats' bit patterns as ints, which happens to
+ * order positive floats correctly.
+ */
+static int qSortAlgo(const void *cmp1, const void *cmp2)
+{
+    int a = *((int *)cmp1);
+    int b = *((int *)cmp2);
+    return a > b ? -1 : (a < b ? 1 : 0);
+}
+
+static float referenceMedian(const float *values, int count)
+{
+    float sorted[BENCH_WINDOW * 2];
+    std::copy(values, values + count, sorted);
+    std::sort(sorted, sorted + count);
+    return (count & 1) ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+template <int N>
+static long checkSlidingMedian()
+{
+    SlidingMedian<float, N> median;
+    float window[N];
+    long errors = 0;
+    for (int i = 0; i < BENCH_CHECK_READINGS; i++) {
+        float reading = (float)(rand() % 100);
+        median.add(reading);
+        window[i % N] = reading;
+        int count = i + 1 < N ? i + 1 : N;
+        if (median.median() != referenceMedian(window, count))
+            errors++;
+    }
+    return errors;
+}
+
+static long checkNetworks()
+{
+    long errors = 0;
+    const int sizes[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    for (int size : sizes) {
+        for (int i = 0; i < BENCH_CHECK_READINGS; i++) {
+            float values[10];
+            for (int j = 0; j < size; j++)
+                values[j] = (float)(rand() % 20);
+            float expected = referenceMedian(values, size);
+            if (smallMedian(values, size) != expected)
+                errors++;
+        }
+    }
+    return errors;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int readings = argc > 1 ? atoi(argv[1]) : BENCH_READINGS;
+    if (readings <= 0)
+        readings = BENCH_READINGS;
+
+    long errors = checkSlidingMedian<1>() + checkSlidingMedian<2>() + checkSlidingMedian<5>()
+        + checkSlidingMedian<BENCH_WINDOW>() + checkSlidingMedian<BENCH_WINDOW + 1>();
+    long networkErrors = checkNetworks();
+    printf("check                   sliding median %ld errors, networks %ld errors\n", errors, networkErrors);
+
+    // A new distance for every window's worth of readings, as if smol moved to a new step
+    float *stream = new float[readings];
+    float *truth = new float[readings / BENCH_WINDOW + 1];
+    for (int i = 0; i < readings; i++) {
+        if (i % BENCH_WINDOW == 0)
+            truth[i / BENCH_WINDOW] = 100 + rand() % 2000;
+        stream[i] = nextReading(truth[i / BENCH_WINDOW]);
+    }
+
+    // Original: a full qsort of the window for every result
+    float samples[BENCH_WINDOW];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i + BENCH_WINDOW <= readings; i += BENCH_WINDOW) {
+        std::copy(stream + i, stream + i + BENCH_WINDOW, samples);
+        qsort(samples, BENCH_WINDOW, sizeof(samples[0]), qSortAlgo);
+        sink = samples[BENCH_WINDOW / 2];
+    }
+    double qsortTime = secondsSince(start);
+    int results = readings / BENCH_WINDOW;
+    printf("qsort per result        %.0f ns (window %d)\n", qsortTime * 1e9 / results, BENCH_WINDOW);
+
+    // Streaming: every reading updates the median, which is ready whenever it is asked for
+    SlidingMedian<float, BENCH_WINDOW> median;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < readings; i++) {
+        median.add(stream[i]);
+        sink = median.median();
+    }
+    double streamTime = secondsSince(start);
+    printf("sliding median          %.1f ns per reading, result ready every reading\n", streamTime * 1e9 / readings);
+    printf("                        %.1fx less latency per result than qsort\n",
+        qsortTime * 1e9 / results / (streamTime * 1e9 / readings));
+
+    // Small windows through the sorting networks
+    const int networkSizes[] = { 3, 5, 7, 9 };
+    for (int size : networkSizes) {
+        float values[9];
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i + size <= readings; i += size) {
+            std::copy(stream + i, stream + i + size, values);
+            sink = smallMedian(values, size);
+        }
+        printf("network median of %d     %.1f ns\n", size, secondsSince(start) * 1e9 / (readings / size));
+    }
+
+    // Per-result cost of the window statistics smol can report instead of the median
+    float window[BENCH_WINDOW];
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i + BENCH_WINDOW <= readings; i += BENCH_WINDOW) {
+        std::copy(stream + i, stream + i + BENCH_WINDOW, window);
+        sink = trimmedMean(window, BENCH_WINDOW, 10);
+    }
+    printf("trimmed mean (10%%)      %.0f ns per result\n", secondsSince(start) * 1e9 / results);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i + BENCH_WINDOW <= readings; i += BENCH_WINDOW) {
+        std::copy(stream + i, stream + i + BENCH_WINDOW, window);
+        sink = rejectOutliersMean(window, BENCH_WINDOW);
+    }
+    printf("MAD outlier rejection   %.0f ns per result\n", secondsSince(start) * 1e9 / results);
+
+    // How far each filter lands from the true distance
+    double errorMean = 0, errorMedian = 0, errorTrimmed = 0, errorMad = 0;
+    for (int i = 0; i + BENCH_WINDOW <= readings; i += BENCH_WINDOW) {
+        float distance = truth[i / BENCH_WINDOW];
+        float total = 0;
+        for (int j = 0; j < BENCH_WINDOW; j++)
+            total += stream[i + j];
+        errorMean += fabsf(total / BENCH_WINDOW - distance);
+        std::copy(stream + i, stream + i + BENCH_WINDOW, window);
+        errorMedian += fabsf(smallMedian(window, BENCH_WINDOW) - distance);
+        std::copy(stream + i, stream + i + BENCH_WINDOW, window);
+        errorTrimmed += fabsf(trimmedMean(window, BENCH_WINDOW, 10) - distance);
+        std::copy(stream + i, stream + i + BENCH_WINDOW, window);
+        errorMad += fabsf(rejectOutliersMean(window, BENCH_WINDOW) - distance);
+    }
+    printf("mean error (mm)         mean %.2f  median %.2f  trimmed %.2f  MAD %.2f\n",
+        errorMean / results, errorMedian / results, errorTrimmed / results, errorMad / results);
+
+    delete[] stream;
+    delete[] truth;
+    return errors == 0 && networkErrors == 0 ? 0 : 1;
+}
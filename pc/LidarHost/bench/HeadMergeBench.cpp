@@ -0,0 +1,133 @@
+/**
+ * Head merge benchmark
+ * --------------------
+ * Simulates bigbrain polling several sensor heads, one of them flooding, with the serial link as the
+ * bottleneck. Compares the old single shared sample ring, emptied first in first out, with SampleMerger's
+ * per-head rings taken in turn a frame at a time. Reports each head's share of the output, its samples
+ * dropped and the worst time a sample waited. The merge must drop nothing from the well-behaved heads and
+ * keep their wait within the timeout plus a frame from each head.
+ *
+ * Usage: HeadMergeBench [seconds]
+ */
+
+#include <SampleMerger.h>
+#include <PollStream.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_SECONDS             20                // Default simulated run time
+#define BENCH_HEADS               4                 // As bigbrain's MAX_HEADS
+#define BENCH_HEAD_RING_SIZE      256               // As bigbrain's HEAD_RING_SIZE
+#define BENCH_SHARED_RING_SIZE    1024              // As bigbrain's single shared ring was
+#define BENCH_QUANTUM             32                // As FRAME_MAX_SAMPLES
+#define BENCH_FRAME_TIMEOUT       50                // As bigbrain's SERIAL_FRAME_TIMEOUT (ms)
+#define BENCH_OUTPUT_RATE         1000              // Samples/s the serial link carries
+#define BENCH_FLOOD_RATE          4000              // Samples/s from the flooding head
+#define BENCH_HEAD_RATE           100               // Samples/s from each other head
+
+struct HeadSample {
+    PollSample sample;
+    int head;
+};
+
+struct HeadStats {
+    unsigned long produced;
+    unsigned long output;
+    unsigned long dropped;
+    uint32_t maxWait;
+};
+
+/**
+ * Samples a head produces in a given ms, spread evenly over the second
+ */
+static int producedAt(int head, uint32_t now)
+{
+    int rate = head == 0 ? BENCH_FLOOD_RATE : BENCH_HEAD_RATE;
+    return (int)((uint64_t)(now + 1) * rate / 1000 - (uint64_t)now * rate / 1000);
+}
+
+static void output(HeadStats *stats, const HeadSample &item, uint32_t now)
+{
+    HeadStats &head = stats[item.head];
+    head.output++;
+    if (now - item.sample.timestamp > head.maxWait)
+        head.maxWait = now - item.sample.timestamp;
+}
+
+static void print(const char *name, const HeadStats *stats)
+{
+    unsigned long total = 0;
+    for (int i = 0; i < BENCH_HEADS; i++)
+        total += stats[i].output;
+
+    for (int i = 0; i < BENCH_HEADS; i++) {
+        printf("%-8s head %d  %s  produced %7lu  output %6lu (%5.1f%%)  dropped %7lu  max wait %5u ms\n", name, i,
+            i == 0 ? "flood" : "light", stats[i].produced, stats[i].output, 100.0 * stats[i].output / total,
+            stats[i].dropped, stats[i].maxWait);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : BENCH_SECONDS;
+    if (seconds <= 0)
+        seconds = BENCH_SECONDS;
+    uint32_t duration = seconds * 1000;
+
+    static SampleRing<HeadSample, BENCH_SHARED_RING_SIZE> shared;
+    static SampleMerger<HeadSample, BENCH_HEAD_RING_SIZE, BENCH_HEADS> merger;
+    HeadStats sharedStats[BENCH_HEADS] = {};
+    HeadStats mergedStats[BENCH_HEADS] = {};
+
+    // Each ms the heads produce, then the link takes what it has credit for. A frame goes out whole, so
+    // the merge can run into debt that the following ms pay off.
+    long sharedCredit = 0;
+    long mergedCredit = 0;
+    HeadSample batch[BENCH_QUANTUM];
+    for (uint32_t now = 0; now < duration; now++) {
+        for (int head = 0; head < BENCH_HEADS; head++) {
+            for (int n = producedAt(head, now); n > 0; n--) {
+                HeadSample item = { { 90, 1000, now }, head };
+                sharedStats[head].produced++;
+                mergedStats[head].produced++;
+                if (!shared.push(item))
+                    sharedStats[head].dropped++;
+                if (!merger.push(head, item))
+                    mergedStats[head].dropped++;
+            }
+        }
+
+        sharedCredit += BENCH_OUTPUT_RATE / 1000;
+        HeadSample item;
+        while (sharedCredit > 0 && shared.pop(item)) {
+            output(sharedStats, item, now);
+            sharedCredit--;
+        }
+        if (shared.size() == 0 && sharedCredit > 0)
+            sharedCredit = 0;
+
+        mergedCredit += BENCH_OUTPUT_RATE / 1000;
+        int stream;
+        int count;
+        while (mergedCredit > 0 && (count = merger.pop(batch, BENCH_QUANTUM, stream, now, BENCH_FRAME_TIMEOUT)) > 0) {
+            for (int i = 0; i < count; i++)
+                output(mergedStats, batch[i], now);
+            mergedCredit -= count;
+        }
+        if (mergedCredit > 0)
+            mergedCredit = 0;
+    }
+
+    print("shared", sharedStats);
+    print("merged", mergedStats);
+
+    // A light head's sample waits out the timeout at most, then behind at most a frame from each head
+    uint32_t bound = BENCH_FRAME_TIMEOUT + BENCH_HEADS * BENCH_QUANTUM * 1000 / BENCH_OUTPUT_RATE;
+    bool ok = true;
+    for (int i = 1; i < BENCH_HEADS; i++) {
+        if (mergedStats[i].dropped != 0 || mergedStats[i].maxWait > bound)
+            ok = false;
+    }
+    printf("merged   light heads %s (bound %u ms)\n", ok ? "dropped nothing, waited within bound" : "FAILED", bound);
+    return ok ? 0 : 1;
+}
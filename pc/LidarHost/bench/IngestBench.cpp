@@ -0,0 +1,182 @@
+/**
+ * Ingestion benchmark
+ * -------------------
+ * Feeds the host ingestion pipeline text in dummy-data.ino's format: a rising sweep of "[POLL:angle,distance]"
+ * from 0 to 180 degrees with no newlines, then a falling one with a newline after each sample. Times the
+ * parser alone and the whole pipeline through to point clouds, against a per-line std::regex like the
+ * visualiser's, and checks that every sample comes out, sweeps split where the servo turns round, and
+ * nothing is allocated once the pipeline is running. Also checks that a sample arriving late doesn't split
+ * its sweep.
+ *
+ * Usage: IngestBench [loops]
+ */
+
+#include <IngestPipeline.h>
+#include "AllocationCounter.h"
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <regex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#define BENCH_LOOPS               20000             // Default dummy-data loops, each a rising and a falling sweep
+#define BENCH_CHUNK               256               // Bytes fed at a time, about what a serial read returns
+#define BENCH_REGEX_LINES         2000              // Lines given to the regex baseline; it is far slower
+#define BENCH_BAUD                115200            // bigbrain's serial rate
+
+/**
+ * Counts what reaches it, as a stand-in for a real sink
+ */
+class CountingSink : public PointCloudSink {
+    public:
+        unsigned long clouds = 0;
+        unsigned long complete = 0;
+        unsigned long points = 0;
+        unsigned long shortest = ~0UL;
+        double checksum = 0;
+
+        void write(const PointCloud &cloud)
+        {
+            clouds++;
+            complete += cloud.complete;
+            points += cloud.count;
+            if (cloud.complete && (unsigned long)cloud.count < shortest)
+                shortest = cloud.count;
+            for (int i = 0; i < cloud.count; i++)
+                checksum += cloud.x[i] * cloud.x[i] + cloud.y[i] * cloud.y[i];
+        }
+};
+
+static unsigned long parsed = 0;
+
+static void countSample(void *, int, const PollSample &)
+{
+    parsed++;
+}
+
+static int lateSweeps[4];
+static int lateSweepCount = 0;
+
+static void countLateSweep(void *, const Sweep &sweep)
+{
+    if (lateSweepCount < 4)
+        lateSweeps[lateSweepCount] = sweep.count;
+    lateSweepCount++;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void feedChunks(IngestPipeline &pipeline, const std::string &text)
+{
+    for (size_t i = 0; i < text.size(); i += BENCH_CHUNK) {
+        size_t length = text.size() - i < BENCH_CHUNK ? text.size() - i : BENCH_CHUNK;
+        pipeline.feed((const uint8_t *)text.data() + i, (int)length, (uint32_t)i);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int loops = argc > 1 ? atoi(argv[1]) : BENCH_LOOPS;
+    if (loops <= 0)
+        loops = BENCH_LOOPS;
+
+    // dummy-data.ino's output
+    std::string text;
+    text.reserve((size_t)loops * 362 * 16);
+    unsigned long samples = 0;
+    double expectedChecksum = 0;
+    char line[32];
+    srand(1);
+    for (int loop = 0; loop < loops; loop++) {
+        for (int i = 0; i <= 180; i++, samples++) {
+            int measure = 50 + rand() % 2450;
+            text.append(line, snprintf(line, sizeof(line), "[POLL:%d,%d]", i, measure));
+            expectedChecksum += (double)measure * measure;
+        }
+        for (int i = 180; i >= 0; i--, samples++) {
+            int measure = 50 + rand() % 2450;
+            text.append(line, snprintf(line, sizeof(line), "[POLL:%d,%d]\n", i, measure));
+            expectedChecksum += (double)measure * measure;
+        }
+    }
+
+    // The visualiser's way: a regex compiled for every line read, matched against it
+    auto start = std::chrono::steady_clock::now();
+    unsigned long regexSamples = 0;
+    size_t lineStart = 0;
+    for (int lines = 0; lines < BENCH_REGEX_LINES && lineStart < text.size(); lines++) {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = text.size();
+        std::string dataRecv = text.substr(lineStart, lineEnd - lineStart);
+        std::regex rx("\\[POLL:([0-9]+),([0-9\\.]+)(?:,([0-9]+))?\\]");
+        for (std::sregex_iterator match(dataRecv.begin(), dataRecv.end(), rx), end; match != end; ++match) {
+            int step = atoi((*match)[1].str().c_str());
+            int distance = atoi((*match)[2].str().c_str());
+            regexSamples += step >= 0 && distance >= 0;
+        }
+        lineStart = lineEnd + 1;
+    }
+    double regexTime = secondsSince(start);
+    double regexBytes = (double)lineStart;
+
+    // Parser alone
+    SampleParser parser(countSample);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < text.size(); i += BENCH_CHUNK) {
+        size_t length = text.size() - i < BENCH_CHUNK ? text.size() - i : BENCH_CHUNK;
+        parser.feed((const uint8_t *)text.data() + i, (int)length);
+    }
+    double parseTime = secondsSince(start);
+
+    // The whole pipeline, counting allocations once it exists
+    CountingSink sink;
+    std::unique_ptr<IngestPipeline> pipeline(new IngestPipeline(&sink));
+    unsigned long allocationsBefore = allocations;
+    start = std::chrono::steady_clock::now();
+    feedChunks(*pipeline, text);
+    pipeline->flush();
+    double pipelineTime = secondsSince(start);
+    unsigned long pipelineAllocations = allocations - allocationsBefore;
+
+    double bytes = (double)text.size();
+    printf("regex     %9.0f samples/s  %7.1f MB/s  (%lu samples from %d lines)\n", regexSamples / regexTime,
+        regexBytes / regexTime / 1e6, regexSamples, BENCH_REGEX_LINES);
+    printf("parser    %9.0f samples/s  %7.1f MB/s  (%lu samples)\n", parsed / parseTime, bytes / parseTime / 1e6, parsed);
+    printf("pipeline  %9.0f samples/s  %7.1f MB/s  (%lu clouds, %lu complete, %lu points, %lu allocations)\n",
+        sink.points / pipelineTime, bytes / pipelineTime / 1e6, sink.clouds, sink.complete, sink.points,
+        pipelineAllocations);
+    printf("serial    %9.0f samples/s at %d baud in this format, %.0fx headroom\n",
+        BENCH_BAUD / 10 / (bytes / samples), BENCH_BAUD, (sink.points / pipelineTime) / (BENCH_BAUD / 10 / (bytes / samples)));
+
+    // 0 to 90 with 40 arriving after 60, then back down: still one sweep each way
+    SweepAssembler assembler(countLateSweep);
+    for (int i = 0; i <= 90; i++) {
+        if (i != 40)
+            assembler.add(0, PollSample { i, 1000, 0 });
+        if (i == 60)
+            assembler.add(0, PollSample { 40, 1000, 0 });
+    }
+    for (int i = 89; i >= 0; i--)
+        assembler.add(0, PollSample { i, 1000, 0 });
+    assembler.flush();
+    bool lateKept = lateSweepCount == 2 && lateSweeps[0] == 91 && lateSweeps[1] == 90
+        && assembler.getStats().sweeps == 1;
+    printf("late      %d sweeps from one with a late sample, %d and %d samples\n", lateSweepCount, lateSweeps[0],
+        lateSweeps[1]);
+
+    // Every sample out, one cloud per sweep: the rising and falling sweeps of each loop, the last flushed partial
+    bool checksumMatches = fabs(sink.checksum - expectedChecksum) <= expectedChecksum * 1e-6;
+    bool ok = parsed == samples && sink.points == samples && sink.clouds == (unsigned long)loops * 2
+        && sink.complete == (unsigned long)loops * 2 - 1 && sink.shortest >= 180 && checksumMatches
+        && pipelineAllocations == 0 && pipeline->getParserStats().malformed == 0 && lateKept;
+    if (!ok)
+        printf("FAILED: %lu of %lu samples parsed, %lu points, shortest sweep %lu, checksum %s\n", parsed, samples,
+            sink.points, sink.shortest, checksumMatches ? "matches" : "differs");
+    return ok ? 0 : 1;
+}
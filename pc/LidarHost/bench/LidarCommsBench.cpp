@@ -0,0 +1,270 @@
+/**
+ * LidarComms benchmark
+ * --------------------
+ * Runs the real LidarComms encode/decode paths on the host and reports throughput and latency.
+ *
+ * Usage: LidarCommsBench [memory|loopback] [messages]
+ *    memory      in-memory channel between two LidarComms instances (default)
+ *    loopback    real UDP sockets over 127.0.0.1, sender on its own thread
+ */
+
+#include <LidarComms.h>
+#include <MemoryUdp.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define BENCH_MESSAGES            200000            // Default messages per run
+#define BENCH_IN_FLIGHT           32                // Max unreceived messages before the loopback sender waits
+
+static std::atomic<unsigned long> received(0);
+static std::vector<unsigned long> latencies;
+static bool recordLatency = false;
+
+/**
+ * Receiver message handler. Poll results carry the send time (micros) in their value.
+ */
+void handleMessage(int, int, int msgDescriptor, int, int msgValue)
+{
+    if (msgDescriptor != MSG_POLL_RESULT)
+        return;
+
+    if (recordLatency)
+        latencies.push_back((unsigned long)(unsigned int)micros() - (unsigned int)msgValue);
+
+    received++;
+}
+
+/**
+ * Receiver descriptor handler, counting into its context
+ */
+void handlePollResult(void *context, const MessageView &)
+{
+    (*(unsigned long *)context)++;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void printLatencies()
+{
+    if (latencies.empty())
+        return;
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t last = latencies.size() - 1;
+    printf("  latency (us)          p50 %lu  p90 %lu  p99 %lu  p99.9 %lu  max %lu\n",
+        latencies[last * 50 / 100], latencies[last * 90 / 100], latencies[last * 99 / 100],
+        latencies[last * 999 / 1000], latencies[last]);
+}
+
+/**
+ * Encode cost: build and send poll results into a transport nobody listens on
+ */
+static void benchEncode(int messages)
+{
+    MemoryNetwork network;
+    MemoryUdp transport(network, IPAddress(192, 168, 4, 2));
+    LidarComms sender(2, false, false);
+    sender.setTransport(&transport);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++)
+        sender.messageBroadcastPollResult(i % 181, i);
+    double elapsed = secondsSince(start);
+
+    printf("encode                  %.1f ns/message\n", elapsed * 1e9 / messages);
+}
+
+/**
+ * Decode cost: hand a pre-built message straight to handleMessage
+ */
+static void benchDecode(int messages)
+{
+    int message[5] = { 2, 0, MSG_POLL_RESULT, 90, 1234 };
+    LidarComms receiver(1, true, false);
+    receiver.setMessageHandler(handleMessage);
+
+    received = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++)
+        receiver.handleMessage(IPAddress(192, 168, 4, 2), (char *)message, MESSAGE_SIZE);
+    double elapsed = secondsSince(start);
+
+    printf("decode                  %.1f ns/message (%lu handled)\n", elapsed * 1e9 / messages, received.load());
+}
+
+/**
+ * Decode cost when the receiver registers for the descriptor, getting the message view rather than five ints
+ */
+static void benchDispatch(int messages)
+{
+    int message[5] = { 2, 0, MSG_POLL_RESULT, 90, 1234 };
+    unsigned long handled = 0;
+    LidarComms receiver(1, true, false);
+    receiver.setDescriptorHandler(MSG_POLL_RESULT, handlePollResult, &handled);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++)
+        receiver.handleMessage(IPAddress(192, 168, 4, 2), (char *)message, MESSAGE_SIZE);
+    double elapsed = secondsSince(start);
+
+    printf("decode, dispatched      %.1f ns/message (%lu handled)\n", elapsed * 1e9 / messages, handled);
+}
+
+/**
+ * Queue a bouncing sweep of poll results through swol, draining them at the brain
+ */
+static void benchQueued(MemoryNetwork &network, LidarComms &brain, MemoryUdp &brainTransport, LidarComms &swol,
+    int messages, const char *label)
+{
+    received = 0;
+    brainTransport.resetCounters();
+    network.resetCounters();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        int angle = (i / 181) % 2 ? 180 - (i % 181) : i % 181;
+        swol.queuePollResult(angle, 800 + ((i * 37) % 64));
+        brain.drainUdpPackets();
+    }
+    swol.flushPollResults();
+    brain.drainUdpPackets();
+    double elapsed = secondsSince(start);
+
+    unsigned long packets = brainTransport.getReceivedPackets();
+    printf("%-23s %.0f samples/s (%lu received, %lu datagrams, %.2f bytes/sample, %lu broadcast)\n", label,
+        messages / elapsed, received.load(), packets, (double)brainTransport.getReceivedBytes() / messages,
+        network.getBroadcasts());
+}
+
+/**
+ * End to end over the in-memory channel, one message in flight at a time
+ */
+static void benchMemory(int messages)
+{
+    WiFi.config(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1));
+
+    MemoryNetwork network;
+    MemoryUdp brainTransport(network, IPAddress(192, 168, 4, 1));
+    MemoryUdp swolTransport(network, IPAddress(192, 168, 4, 2));
+    LidarComms brain(1, true, false);
+    LidarComms swol(2, false, false);
+    brain.setTransport(&brainTransport);
+    swol.setTransport(&swolTransport);
+    brain.setMessageHandler(handleMessage);
+    brain.startUdp();
+    swol.startUdp();
+
+    received = 0;
+    latencies.clear();
+    latencies.reserve(messages);
+    recordLatency = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        swol.messageBroadcastPollResult(i % 181, (int)micros());
+        brain.checkUdpPacket();
+    }
+    double elapsed = secondsSince(start);
+    recordLatency = false;
+
+    printf("memory, single          %.0f messages/s (%lu received, %lu dropped)\n", messages / elapsed, received.load(), brainTransport.getDropped());
+    printLatencies();
+
+    // Say hello so swol learns what the brain can decode and where it is, then compare the queued formats
+    WiFiEventInfo_t info = {0};
+    swol.wifiEvent(SYSTEM_EVENT_STA_GOT_IP, info);
+    brain.checkUdpPacket();
+    swol.checkUdpPacket();
+
+    swol.setCompactPollResults(false);
+    benchQueued(network, brain, brainTransport, swol, messages, "memory, batched");
+    swol.setCompactPollResults(true);
+    benchQueued(network, brain, brainTransport, swol, messages, "memory, compact");
+
+    // Bursts filling the receive queue, drained once per "loop"
+    received = 0;
+    int loops = 0;
+    int exhausted = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i += MEMORY_UDP_QUEUE_SIZE) {
+        for (int j = 0; j < MEMORY_UDP_QUEUE_SIZE; j++)
+            swol.messageBroadcastPollResult(j, i + j);
+        while (brain.drainUdpPackets() > 0) {
+            loops++;
+            if (brain.isDrainBudgetExhausted())
+                exhausted++;
+        }
+    }
+    elapsed = secondsSince(start);
+
+    printf("memory, burst drain     %.0f messages/s (%lu received, %d drains, %d hit budget of %d)\n", received.load() / elapsed, received.load(), loops, exhausted, DRAIN_BUDGET);
+}
+
+/**
+ * End to end over loopback UDP sockets, sender on its own thread
+ */
+static void benchLoopback(int messages)
+{
+    LidarComms brain(1, true, false);
+    brain.setMessageHandler(handleMessage);
+    brain.startUdp();
+
+    received = 0;
+    latencies.clear();
+    latencies.reserve(messages);
+    recordLatency = true;
+
+    std::atomic<bool> sending(true);
+    auto start = std::chrono::steady_clock::now();
+    std::thread senderThread([messages, &sending]() {
+        LidarComms swol(2, false, false);
+        for (int i = 0; i < messages; i++) {
+            while (i - (long)received.load() > BENCH_IN_FLIGHT && sending)
+                std::this_thread::yield();
+            swol.messageBroadcastPollResult(i % 181, (int)micros());
+        }
+    });
+
+    // Give up on stragglers once the sender is done and the socket has gone quiet
+    unsigned long lastProgress = millis();
+    while ((int)received.load() < messages && millis() - lastProgress < 1000) {
+        unsigned long before = received.load();
+        brain.checkUdpPacket();
+        if (received.load() != before)
+            lastProgress = millis();
+    }
+    sending = false;
+    senderThread.join();
+    double elapsed = secondsSince(start);
+    recordLatency = false;
+
+    printf("loopback, single        %.0f messages/s (%lu of %d received)\n", received.load() / elapsed, received.load(), messages);
+    printLatencies();
+}
+
+int main(int argc, char **argv)
+{
+    const char *mode = argc > 1 ? argv[1] : "memory";
+    int messages = argc > 2 ? atoi(argv[2]) : BENCH_MESSAGES;
+    if (messages <= 0)
+        messages = BENCH_MESSAGES;
+
+    Serial.setQuiet(true);
+
+    benchEncode(messages);
+    benchDecode(messages);
+    benchDispatch(messages);
+
+    if (strcmp(mode, "loopback") == 0)
+        benchLoopback(messages);
+    else
+        benchMemory(messages);
+
+    return 0;
+}
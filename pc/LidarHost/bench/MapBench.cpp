@@ -0,0 +1,231 @@
+/**
+ * Occupancy grid benchmark
+ * ------------------------
+ * Simulates two sensor heads sweeping 0 to 180 degrees and back, 100 m apart: one in a small room with a
+ * pillar, where every reading hits something, and one facing a single wall, where readings off to the sides
+ * come back as no return. Times the grid taking their samples, interleaved as bigbrain merges them, in rays
+ * per second, and checks that walls come out occupied, the space in front of them free and the rest unknown,
+ * that ray walks visit the cells they should across tile boundaries, that memory follows the area seen
+ * rather than the 100 m between the heads, and that a map which has stopped growing allocates nothing.
+ *
+ * Usage: MapBench [loops]
+ */
+
+#include <OccupancyGrid.h>
+#include "AllocationCounter.h"
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define BENCH_LOOPS               2000              // Default loops, each a rising and a falling sweep from both heads
+#define BENCH_NO_RETURN           8190              // What the VL53L0X reports when nothing comes back
+
+/**
+ * Walls around a head (mm, relative to it), any of which may be missing, and a round pillar
+ */
+struct Room {
+    bool hasLeft, hasRight, hasBack, hasFront;
+    double left, right, back, front;
+    double pillarX, pillarY, pillarRadius;
+};
+
+struct Head {
+    int id;
+    GridPose pose;
+    Room room;
+};
+
+/**
+ * How far a reading at a map angle goes before it hits something, or BENCH_NO_RETURN past GRID_MAX_RANGE
+ */
+static int readDistance(const Room &room, double angle)
+{
+    double dx = cos(angle);
+    double dy = sin(angle);
+    double nearest = INFINITY;
+    if (room.hasRight && dx > 1e-9)
+        nearest = fmin(nearest, room.right / dx);
+    if (room.hasLeft && dx < -1e-9)
+        nearest = fmin(nearest, room.left / dx);
+    if (room.hasFront && dy > 1e-9)
+        nearest = fmin(nearest, room.front / dy);
+    if (room.hasBack && dy < -1e-9)
+        nearest = fmin(nearest, room.back / dy);
+
+    if (room.pillarRadius > 0) {
+        double along = room.pillarX * dx + room.pillarY * dy;
+        double across = room.pillarX * room.pillarX + room.pillarY * room.pillarY - along * along;
+        double radius2 = room.pillarRadius * room.pillarRadius;
+        if (along > 0 && across < radius2)
+            nearest = fmin(nearest, along - sqrt(radius2 - across));
+    }
+    return nearest <= GRID_MAX_RANGE ? (int)lround(nearest) : BENCH_NO_RETURN;
+}
+
+/**
+ * The cell a reading ends in, worked out as the grid does
+ */
+static void endCell(OccupancyGrid &grid, const GridPose &pose, int angle, float distance, int &cellX, int &cellY)
+{
+    float radians = (pose.heading + angle) * ((float)M_PI / 180.0f);
+    cellX = grid.toCell(pose.x + distance * cosf(radians));
+    cellY = grid.toCell(pose.y + distance * sinf(radians));
+}
+
+/**
+ * Whether the cell a walk from one cell to another passes through part way along it is free. The walk
+ * rounds to the line between the two, so it is one of the two cells either side of it.
+ */
+static bool freeOnPath(OccupancyGrid &grid, int fromX, int fromY, int toX, int toY, double fraction)
+{
+    int dx = toX - fromX;
+    int dy = toY - fromY;
+    bool alongX = abs(dx) >= abs(dy);
+    int major = alongX ? abs(dx) : abs(dy);
+    int step = (int)(fraction * major);
+    double minor = alongX ? fromY + (double)step * dy / major : fromX + (double)step * dx / major;
+    int majorCell = alongX ? fromX + (dx < 0 ? -step : step) : fromY + (dy < 0 ? -step : step);
+    for (int minorCell = (int)floor(minor); minorCell <= (int)ceil(minor); minorCell++) {
+        int state = alongX ? grid.getCellState(majorCell, minorCell) : grid.getCellState(minorCell, majorCell);
+        if (state == CELL_FREE)
+            return true;
+    }
+    return false;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int loops = argc > 1 ? atoi(argv[1]) : BENCH_LOOPS;
+    if (loops <= 0)
+        loops = BENCH_LOOPS;
+    bool ok = true;
+
+    // Ray walks: one cell per step along the longer axis, across tiles and into negative cells
+    OccupancyGrid walk;
+    walk.traceRay(0, 0, 10, 3, true);
+    bool walkOk = walk.getStats().cells == 11 && walk.getStats().hits == 1
+        && walk.getCellState(10, 3) == CELL_OCCUPIED && walk.getLogOdds(0, 0) == GRID_LOG_ODDS_MISS;
+    walk.traceRay(5, 5, -70, -20, false);
+    walkOk = walkOk && walk.getStats().cells == 11 + 76 && walk.getLogOdds(-70, -20) == GRID_LOG_ODDS_MISS
+        && walk.getLogOdds(-71, -20) == 0 && walk.getTileCount() == 4;
+    for (int i = 0; i < 20; i++)
+        walk.traceRay(0, 0, 10, 3, true);
+    walkOk = walkOk && walk.getLogOdds(10, 3) == GRID_LOG_ODDS_MAX && walk.getLogOdds(0, 0) == GRID_LOG_ODDS_MIN;
+    if (!walkOk) {
+        printf("FAILED: ray walks updated %lu cells over %d tiles\n", walk.getStats().cells, walk.getTileCount());
+        ok = false;
+    }
+
+    // Capped tiles: what falls outside them is dropped, not allocated
+    OccupancyGrid capped(GRID_CELL_SIZE, 1);
+    capped.traceRay(0, 0, 200, 0, true);
+    if (capped.getTileCount() != 1 || capped.getStats().clipped != 201 - GRID_TILE_SIZE) {
+        printf("FAILED: capped grid has %d tiles, clipped %lu cells\n", capped.getTileCount(), capped.getStats().clipped);
+        ok = false;
+    }
+
+    // A room with a pillar, and 100 m away a head facing one wall, with nothing in range to either side
+    Head heads[2] = {
+        { 0, { 0, 0, 0 }, { true, true, false, true, -1010, 1010, 0, 1210, 500, 700, 150 } },
+        { 1, { 100000, 50000, -90 }, { false, true, false, false, 0, 800, 0, 0, 0, 0, 0 } },
+    };
+
+    std::vector<int> headBySample;
+    std::vector<PollSample> samples;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i <= 180; i++) {
+            int angle = pass == 0 ? i : 180 - i;
+            for (Head &head : heads) {
+                double mapAngle = (head.pose.heading + angle) * M_PI / 180.0;
+                samples.push_back({ angle, readDistance(head.room, mapAngle), 0 });
+                headBySample.push_back(head.id);
+            }
+        }
+    }
+
+    std::unique_ptr<OccupancyGrid> grid(new OccupancyGrid());
+    for (Head &head : heads)
+        grid->setPose(head.id, head.pose);
+    for (size_t i = 0; i < samples.size(); i++)
+        grid->addSample(headBySample[i], samples[i]);
+
+    // The map has stopped growing after a loop, so from here nothing should be allocated
+    unsigned long allocationsBefore = allocations;
+    unsigned long cellsBefore = grid->getStats().cells;
+    auto start = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++) {
+        for (size_t i = 0; i < samples.size(); i++)
+            grid->addSample(headBySample[i], samples[i]);
+    }
+    double elapsed = secondsSince(start);
+    unsigned long mapAllocations = allocations - allocationsBefore;
+    double rays = (double)loops * samples.size();
+    double cells = (double)(grid->getStats().cells - cellsBefore);
+
+    int minCellX, minCellY, maxCellX, maxCellY;
+    grid->getBounds(minCellX, minCellY, maxCellX, maxCellY);
+    double dense = (double)(maxCellX - minCellX + 1) * (maxCellY - minCellY + 1);
+    const GridStats &stats = grid->getStats();
+    printf("grid      %9.0f rays/s  %7.1f ns/ray  %6.1f M cells/s  (%.0f cells/ray, %lu allocations)\n", rays / elapsed,
+        elapsed / rays * 1e9, cells / elapsed / 1e6, cells / rays, mapAllocations);
+    printf("memory    %d tiles, %.2f MB for %.0f x %.0f m of bounds, %.0f MB dense at a byte a cell\n",
+        grid->getTileCount(), grid->getMemory() / 1e6, (maxCellX - minCellX + 1) * GRID_CELL_SIZE / 1000.0,
+        (maxCellY - minCellY + 1) * GRID_CELL_SIZE / 1000.0, dense / 1e6);
+    printf("rays      %lu, %lu hits, %lu no return, %lu clipped\n", stats.rays, stats.hits, stats.noReturn, stats.clipped);
+
+    // Walls and pillar occupied, the space before them free, behind them unknown
+    int wrong = 0;
+    const GridPose &room = heads[0].pose;
+    int fromX = grid->toCell(room.x);
+    int fromY = grid->toCell(room.y);
+    for (int angle = 0; angle <= 180; angle += 5) {
+        double mapAngle = (room.heading + angle) * M_PI / 180.0;
+        int distance = readDistance(heads[0].room, mapAngle);
+        int cellX, cellY;
+        endCell(*grid, room, angle, distance, cellX, cellY);
+        wrong += grid->getCellState(cellX, cellY) != CELL_OCCUPIED;
+        wrong += !freeOnPath(*grid, fromX, fromY, cellX, cellY, 0.5);
+        endCell(*grid, room, angle, distance + 3.0f * GRID_CELL_SIZE, cellX, cellY);
+        wrong += grid->getCellState(cellX, cellY) != CELL_UNKNOWN;
+    }
+    wrong += grid->getCellState(grid->toCell(0), grid->toCell(-500)) != CELL_UNKNOWN;
+
+    // Facing the one wall: hits straight ahead, free space to the range limit off to the sides and nothing past it
+    const GridPose &open = heads[1].pose;
+    fromX = grid->toCell(open.x);
+    fromY = grid->toCell(open.y);
+    int noReturnAngles = 0;
+    for (int angle = 0; angle <= 180; angle += 5) {
+        double mapAngle = (open.heading + angle) * M_PI / 180.0;
+        int distance = readDistance(heads[1].room, mapAngle);
+        int cellX, cellY;
+        if (distance == BENCH_NO_RETURN) {
+            noReturnAngles++;
+            endCell(*grid, open, angle, GRID_MAX_RANGE, cellX, cellY);
+            wrong += grid->getCellState(cellX, cellY) != CELL_FREE;
+            wrong += !freeOnPath(*grid, fromX, fromY, cellX, cellY, 0.9);
+            endCell(*grid, open, angle, GRID_MAX_RANGE + 3.0f * GRID_CELL_SIZE, cellX, cellY);
+            wrong += grid->getCellState(cellX, cellY) != CELL_UNKNOWN;
+        } else {
+            endCell(*grid, open, angle, distance, cellX, cellY);
+            wrong += grid->getCellState(cellX, cellY) != CELL_OCCUPIED;
+        }
+    }
+
+    // Two heads 100 m apart need a few tiles each, not the 5000 x 2500 cells between them
+    bool sparse = grid->getMemory() * 50 < dense && grid->getTileCount() < 64;
+    if (wrong > 0 || noReturnAngles == 0 || !sparse || mapAllocations != 0 || stats.rejected != 0 || stats.clipped != 0) {
+        printf("FAILED: %d cells wrong, %d angles with no return, %s, %lu allocations\n", wrong, noReturnAngles,
+            sparse ? "sparse" : "not sparse", mapAllocations);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/**
+ * Motion benchmark
+ * ----------------
+ * Checks swol's step ramps (speed never falls while accelerating, acceleration stays near the limit asked
+ * for, moves are symmetric) and that StepperMotion lands on the last of a stream of targets queued from
+ * another thread while it steps. Then compares move times against the old fixed STEPPER_DELAY and times
+ * tick(), which runs in the step timer interrupt.
+ *
+ * Usage: MotionBench [moves]
+ */
+
+#include <StepperMotion.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#define BENCH_MOVES               2000              // Default queued moves in the threaded check
+#define BENCH_STEPS_REV           4096              // swol's STEPS_REV
+#define BENCH_FIXED_DELAY         10                // swol's old STEPPER_DELAY (ms)
+#define BENCH_MAX_SPEED           800               // swol's MOTION_MAX_SPEED
+#define BENCH_ACCELERATION        4000              // swol's MOTION_ACCELERATION
+#define BENCH_START_SPEED         200               // swol's MOTION_START_SPEED
+#define BENCH_ACCEL_TOLERANCE     1.1               // Slack for measuring acceleration from whole-us intervals
+
+static volatile uint32_t sink;
+
+/**
+ * Largest acceleration (steps/s^2) between consecutive ramp steps, or -1 if the speed ever drops
+ */
+static double peakAcceleration(const StepRamp &ramp)
+{
+    double peak = 0;
+    int steps = 2 * ramp.getLength() + 2;
+    for (int i = 1; i < ramp.getLength(); i++) {
+        double before = ramp.getInterval(i - 1, steps), after = ramp.getInterval(i, steps);
+        if (after > before)
+            return -1;
+        double acceleration = (1e6 / after - 1e6 / before) / ((before + after) / 2e6);
+        if (acceleration > peak)
+            peak = acceleration;
+    }
+    return peak;
+}
+
+static long checkSymmetry(const StepRamp &ramp)
+{
+    long errors = 0;
+    for (int steps = 1; steps < 3 * ramp.getLength(); steps++)
+        for (int i = 0; i < steps; i++)
+            if (ramp.getInterval(i, steps) != ramp.getInterval(steps - 1 - i, steps))
+                errors++;
+    return errors;
+}
+
+/**
+ * Queue targets from one thread while another ticks, as swol's comms loop and step timer would
+ */
+static long checkQueuedMoves(int moves)
+{
+    StepperMotion motion;
+    motion.configure(MOTION_TRAPEZOID, 20000, 4000000, 0);
+
+    std::atomic<bool> done(false);
+    std::atomic<long> outOfRange(0);
+    std::thread timer([&]() {
+        while (!done.load() || motion.isMoving()) {
+            motion.tick();
+            int position = motion.getPosition();
+            if (position < 0 || position >= BENCH_STEPS_REV)
+                outOfRange++;
+        }
+    });
+
+    int last = 0;
+    for (int i = 0; i < moves; i++) {
+        last = rand() % BENCH_STEPS_REV;
+        while (!motion.moveTo(last))
+            std::this_thread::yield();
+    }
+    done.store(true);
+    timer.join();
+
+    return outOfRange.load() + (motion.getPosition() != last) + (motion.getTarget() != last);
+}
+
+int main(int argc, char **argv)
+{
+    int moves = argc > 1 ? atoi(argv[1]) : BENCH_MOVES;
+    if (moves <= 0)
+        moves = BENCH_MOVES;
+
+    StepRamp trapezoid, sCurve;
+    trapezoid.build(MOTION_TRAPEZOID, BENCH_MAX_SPEED, BENCH_ACCELERATION, BENCH_START_SPEED);
+    sCurve.build(MOTION_SCURVE, BENCH_MAX_SPEED, BENCH_ACCELERATION, BENCH_START_SPEED);
+
+    double trapezoidPeak = peakAcceleration(trapezoid);
+    double sCurvePeak = peakAcceleration(sCurve);
+    long symmetryErrors = checkSymmetry(trapezoid) + checkSymmetry(sCurve);
+    long queueErrors = checkQueuedMoves(moves);
+    bool accelerationOk = trapezoidPeak > 0 && trapezoidPeak <= BENCH_ACCELERATION * BENCH_ACCEL_TOLERANCE
+        && sCurvePeak > 0 && sCurvePeak <= BENCH_ACCELERATION * BENCH_ACCEL_TOLERANCE;
+    printf("check                   symmetry %ld errors, queued moves %ld errors\n", symmetryErrors, queueErrors);
+    printf("ramp                    trapezoid %d steps, peak %.0f steps/s^2; S-curve %d steps, peak %.0f steps/s^2 (limit %d)\n",
+        trapezoid.getLength(), trapezoidPeak, sCurve.getLength(), sCurvePeak, BENCH_ACCELERATION);
+
+    printf("move time (ms)          %-8s %-10s %-10s %s\n", "steps", "fixed", "trapezoid", "S-curve");
+    const int lengths[] = { 1, 16, 128, 512, BENCH_STEPS_REV };
+    for (int steps : lengths) {
+        printf("                        %-8d %-10d %-10.1f %.1f\n", steps, steps * BENCH_FIXED_DELAY,
+            trapezoid.getMoveTime(steps) / 1000.0, sCurve.getMoveTime(steps) / 1000.0);
+    }
+
+    // Cost of the interrupt's work, stepping through full revolutions back and forth
+    StepperMotion motion;
+    motion.configure(MOTION_SCURVE, BENCH_MAX_SPEED, BENCH_ACCELERATION, BENCH_START_SPEED);
+    long ticks = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 200; i++) {
+        motion.moveTo((i & 1) ? 0 : BENCH_STEPS_REV - 1);
+        do {
+            sink = motion.tick();
+            ticks++;
+        } while (motion.isMoving());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("tick                    %.1f ns\n", seconds * 1e9 / ticks);
+
+    return symmetryErrors == 0 && queueErrors == 0 && accelerationOk ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+/**
+ * Polar conversion benchmark
+ * --------------------------
+ * Converts batches of (angle, distance) samples to x and y with each kernel this CPU has, against per-sample
+ * libm trig as sweepToPointCloud() used to do it and against the visualiser's RadarPoint (Math.Sin for the
+ * opposite side, Pythagoras for the adjacent). Checks that every kernel gives exactly the bits a plain
+ * reference does, for servo degrees, stepper microsteps and angles any number of turns out, at every batch
+ * length's tail, and that the tables are as close to the true sines and cosines as a float gets.
+ *
+ * Usage: PolarBench [loops]
+ */
+
+#include <PolarConverter.h>
+#include <chrono>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define BENCH_LOOPS               4000              // Default passes over each batch
+#define BENCH_BATCH               4096              // Samples per batch, a few sweeps' worth, so they stay in cache
+#define BENCH_MAX_DISTANCE        8191              // VL53L0X readings, up to its no-return value
+
+static const char *kernelNames[] = { "scalar", "sse2", "avx2" };
+
+/**
+ * A batch of samples, in struct-of-arrays form
+ */
+struct Batch {
+    const char *name;
+    int steps;
+    std::vector<int32_t> angles;
+    std::vector<int32_t> distances;
+};
+
+/**
+ * The conversion as written out plainly, one sample at a time
+ */
+static void reference(const PolarConverter &converter, const Batch &batch, int count, float *xs, float *ys)
+{
+    int steps = converter.getSteps();
+    for (int i = 0; i < count; i++) {
+        int index = ((batch.angles[i] % steps) + steps) % steps;
+        xs[i] = (float)batch.distances[i] * converter.getCos(index);
+        ys[i] = (float)batch.distances[i] * converter.getSin(index);
+    }
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int loops = argc > 1 ? atoi(argv[1]) : BENCH_LOOPS;
+    if (loops <= 0)
+        loops = BENCH_LOOPS;
+    bool ok = true;
+
+    // The servo sweeping up and down in whole degrees, the stepper going round, and angles from anywhere
+    Batch batches[3] = {
+        { "servo", POLAR_DEGREE_STEPS, {}, {} },
+        { "stepper", POLAR_STEPPER_STEPS, {}, {} },
+        { "any", POLAR_DEGREE_STEPS, {}, {} },
+    };
+    srand(1);
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        int distance = rand() % (BENCH_MAX_DISTANCE + 1);
+        batches[0].angles.push_back(i / 181 % 2 == 0 ? i % 181 : 180 - i % 181);
+        batches[1].angles.push_back((i * 7) % POLAR_STEPPER_STEPS);
+        batches[2].angles.push_back(rand() % (POLAR_DEGREE_STEPS * 8) - POLAR_DEGREE_STEPS * 4);
+        for (Batch &batch : batches)
+            batch.distances.push_back(distance);
+    }
+    batches[2].angles[5] = INT_MIN;
+    batches[2].angles[6] = INT_MAX;
+    batches[2].angles[7] = -POLAR_DEGREE_STEPS;
+    batches[2].distances[8] = INT_MAX;
+    batches[2].distances[9] = INT_MIN;
+
+    std::vector<float> xs(BENCH_BATCH), ys(BENCH_BATCH), expectedXs(BENCH_BATCH), expectedYs(BENCH_BATCH);
+
+    // Bit for bit against the reference, for every kernel, batch and tail length
+    const int lengths[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 17, 1023, BENCH_BATCH };
+    for (Batch &batch : batches) {
+        PolarConverter converter(batch.steps);
+        reference(converter, batch, BENCH_BATCH, expectedXs.data(), expectedYs.data());
+        for (int kernel = POLAR_KERNEL_SCALAR; kernel <= POLAR_KERNEL_AVX2; kernel++) {
+            if (!converter.setKernel(kernel))
+                continue;
+            for (int length : lengths) {
+                std::fill(xs.begin(), xs.end(), -1.0f);
+                std::fill(ys.begin(), ys.end(), -1.0f);
+                converter.convert(batch.angles.data(), batch.distances.data(), length, xs.data(), ys.data());
+                bool same = memcmp(xs.data(), expectedXs.data(), length * sizeof(float)) == 0
+                    && memcmp(ys.data(), expectedYs.data(), length * sizeof(float)) == 0
+                    && (length == BENCH_BATCH || (xs[length] == -1.0f && ys[length] == -1.0f));
+                if (!same) {
+                    printf("FAILED: %s kernel differs from the reference on %d %s samples\n", kernelNames[kernel],
+                        length, batch.name);
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    // The tables against double precision trig: within half a float step, with the axes exact
+    double worst = 0;
+    for (int steps : { POLAR_DEGREE_STEPS, POLAR_STEPPER_STEPS }) {
+        PolarConverter converter(steps);
+        for (int i = 0; i < steps; i++) {
+            double angle = 2.0 * M_PI * i / steps;
+            worst = fmax(worst, fabs(converter.getCos(i) - cos(angle)));
+            worst = fmax(worst, fabs(converter.getSin(i) - sin(angle)));
+        }
+        bool axes = converter.getCos(0) == 1.0f && converter.getSin(0) == 0.0f
+            && converter.getCos(steps / 4) == 0.0f && converter.getSin(steps / 4) == 1.0f
+            && converter.getCos(steps / 2) == -1.0f && converter.getSin(steps * 3 / 4) == -1.0f;
+        if (!axes) {
+            printf("FAILED: %d step table isn't exact on the axes\n", steps);
+            ok = false;
+        }
+    }
+    if (worst > 1.0 / (1 << 24)) {
+        printf("FAILED: table is out by up to %.3g\n", worst);
+        ok = false;
+    }
+
+    // Speed, on the servo batch
+    const Batch &servo = batches[0];
+    double points = (double)loops * BENCH_BATCH;
+    double checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++) {
+        const float radiansPerDegree = (float)M_PI / 180.0f;
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            float angle = servo.angles[i] * radiansPerDegree;
+            xs[i] = servo.distances[i] * cosf(angle);
+            ys[i] = servo.distances[i] * sinf(angle);
+        }
+        checksum += xs[loop % BENCH_BATCH];
+    }
+    double libmTime = secondsSince(start);
+    printf("libm      %7.1f M points/s  (cosf and sinf per sample)\n", points / libmTime / 1e6);
+
+    start = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++) {
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            double radians = servo.angles[i] * (M_PI / 180.0);
+            double opposite = sin(radians) * servo.distances[i];
+            double adjacent = sqrt(pow(servo.distances[i], 2) - pow(opposite, 2));
+            xs[i] = (float)(servo.angles[i] <= 90 ? adjacent : -adjacent);
+            ys[i] = (float)opposite;
+        }
+        checksum += xs[loop % BENCH_BATCH];
+    }
+    double radarTime = secondsSince(start);
+    printf("radar     %7.1f M points/s  (RadarPoint: sin, pow and sqrt per sample)\n", points / radarTime / 1e6);
+
+    PolarConverter converter(POLAR_DEGREE_STEPS);
+    int best = PolarConverter::getBestKernel();
+    double scalarTime = 0;
+    for (int kernel = POLAR_KERNEL_SCALAR; kernel <= POLAR_KERNEL_AVX2; kernel++) {
+        if (!converter.setKernel(kernel)) {
+            printf("%-9s not supported here\n", kernelNames[kernel]);
+            continue;
+        }
+        start = std::chrono::steady_clock::now();
+        for (int loop = 0; loop < loops; loop++) {
+            converter.convert(servo.angles.data(), servo.distances.data(), BENCH_BATCH, xs.data(), ys.data());
+            checksum += xs[loop % BENCH_BATCH];
+        }
+        double elapsed = secondsSince(start);
+        if (kernel == POLAR_KERNEL_SCALAR)
+            scalarTime = elapsed;
+        printf("%-9s %7.1f M points/s  %.1fx libm, %.1fx scalar%s\n", kernelNames[kernel], points / elapsed / 1e6,
+            libmTime / elapsed, scalarTime / elapsed, kernel == best ? "  (used)" : "");
+    }
+    printf("table     out by up to %.3g from double precision trig, %.4f mm at %d mm\n", worst,
+        worst * BENCH_MAX_DISTANCE, BENCH_MAX_DISTANCE);
+
+    if (checksum == 0)
+        printf("\n");
+    return ok ? 0 : 1;
+}
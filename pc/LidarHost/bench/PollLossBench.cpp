@@ -0,0 +1,131 @@
+/**
+ * Poll loss benchmark
+ * -------------------
+ * Streams numbered samples from swol to the brain over an in-memory link that drops, duplicates and
+ * reorders datagrams, first with NACKs disabled and then with them, and checks what the brain ends up
+ * with against what was sent: every sample delivered once, and the stats agreeing with what happened.
+ * Samples go out in real time, as NACKs are timed by millis(), at ten times swol's rate so the retransmit
+ * buffer is under more pressure than it would be.
+ *
+ * Usage: PollLossBench [samples] [drop %] [duplicate %] [reorder %]
+ */
+
+#include <LidarComms.h>
+#include <MemoryUdp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#define BENCH_SAMPLES             10000             // Default samples streamed per run
+#define BENCH_DROP                5                 // Default datagrams dropped (%)
+#define BENCH_DUPLICATE           2                 // Default datagrams duplicated (%)
+#define BENCH_REORDER             3                 // Default datagrams swapped with the next (%)
+#define BENCH_BATCH               10                // Samples per datagram
+#define BENCH_BATCH_INTERVAL      5                 // Time (ms) between datagrams: 2000 samples/s, ten times a fast sweep
+#define BENCH_SETTLE_TIME         (STREAM_NACK_DELAY + STREAM_NACK_INTERVAL * (STREAM_NACK_RETRIES + 1)) // Time (ms) for the last NACKs
+
+static std::vector<int> deliveries;
+
+void handleBrainSample(void *, int, const PollSample &sample)
+{
+    if (sample.angle >= 0 && sample.angle < (int)deliveries.size())
+        deliveries[sample.angle]++;
+}
+
+struct RunResult {
+    int missing;
+    int repeated;
+    PollStreamStats received;
+    PollStreamStats sent;
+};
+
+static void exchange(LidarComms &brain, LidarComms &swol)
+{
+    brain.drainUdpPackets();
+    brain.checkPollStreams();
+    swol.drainUdpPackets();
+}
+
+static RunResult run(int samples, int drop, int duplicate, int reorder, bool nacks)
+{
+    WiFi.config(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1));
+    MemoryNetwork network;
+    MemoryUdp brainTransport(network, IPAddress(192, 168, 4, 1));
+    MemoryUdp swolTransport(network, IPAddress(192, 168, 4, 2));
+    LidarComms brain(1, true, false);
+    LidarComms swol(2, false, false);
+    brain.setTransport(&brainTransport);
+    swol.setTransport(&swolTransport);
+    brain.setPollSampleHandler(handleBrainSample);
+    brain.startUdp();
+    swol.startUdp();
+
+    // Swol needs to know the brain takes compact results; the brain only NACKs if swol says it can answer
+    brain.messageId(2);
+    swol.drainUdpPackets();
+    if (nacks) {
+        swol.messageId(1);
+        brain.drainUdpPackets();
+    }
+
+    network.setImpairment(drop, duplicate, reorder);
+    deliveries.assign(samples, 0);
+    for (int i = 0; i < samples; i++) {
+        PollSample sample = { i, 1000 + i % 500, (uint32_t)i * 20000 };
+        swol.queuePollResult(sample);
+        if ((i + 1) % BENCH_BATCH == 0) {
+            swol.flushPollResults();
+            exchange(brain, swol);
+            std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_BATCH_INTERVAL));
+        }
+    }
+    swol.flushPollResults();
+
+    // Let the last gaps be NACKed, answered or given up on
+    for (int elapsed = 0; elapsed < BENCH_SETTLE_TIME * 2; elapsed += 5) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        exchange(brain, swol);
+    }
+
+    RunResult result = { 0, 0, *brain.getReceiveStats(2), swol.getSendStats() };
+    for (int count : deliveries) {
+        if (count == 0)
+            result.missing++;
+        if (count > 1)
+            result.repeated++;
+    }
+    return result;
+}
+
+static void print(const char *name, const RunResult &result)
+{
+    printf("%-18s missing %5d  repeated %d  | lost %5u  recovered %5u  reordered %4u  duplicates %4u  nacks %4u/%-4u  retransmitted %u\n",
+        name, result.missing, result.repeated, result.received.lost, result.received.recovered, result.received.reordered,
+        result.received.duplicates, result.received.nacks, result.sent.nacks, result.sent.retransmitted);
+}
+
+int main(int argc, char **argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : BENCH_SAMPLES;
+    int drop = argc > 2 ? atoi(argv[2]) : BENCH_DROP;
+    int duplicate = argc > 3 ? atoi(argv[3]) : BENCH_DUPLICATE;
+    int reorder = argc > 4 ? atoi(argv[4]) : BENCH_REORDER;
+    if (samples <= 0)
+        samples = BENCH_SAMPLES;
+
+    printf("%d samples, %d per datagram, %d%% dropped, %d%% duplicated, %d%% reordered\n", samples, BENCH_BATCH, drop,
+        duplicate, reorder);
+
+    RunResult plain = run(samples, drop, duplicate, reorder, false);
+    print("fire and forget", plain);
+    RunResult nacked = run(samples, drop, duplicate, reorder, true);
+    print("with NACKs", nacked);
+
+    // Without NACKs every gap is loss, and the stats must say so exactly. With them, a gap stays lost only
+    // if its NACK or retransmit is dropped on every retry that still finds it in the buffer, so NACKs must
+    // win back at least 95% of it.
+    bool ok = plain.repeated == 0 && (int)plain.received.lost == plain.missing;
+    ok &= nacked.repeated == 0 && (int)nacked.received.lost == nacked.missing && nacked.missing * 20 <= plain.missing;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,302 @@
+/**
+ * Radar view benchmark
+ * --------------------
+ * Simulates two sensor heads sweeping 0 to 180 degrees and back in a room someone is walking across, a sample
+ * every 2 ms from each, and draws them with RadarView at a capped frame rate, handing each frame's changed
+ * tiles on to a stand-in display. Checks that frames drawn tile by tile are pixel for pixel what drawing
+ * everything would give, whether samples come one at a time or a sweep at a time, that the frame rate is
+ * held to, that PNGs come out well formed, and that nothing is allocated once the view is made. For
+ * comparison, the visualiser's way: draw each sample straight away and save the whole bitmap as a BMP.
+ *
+ * Usage: RadarBench [seconds]
+ */
+
+#include <RadarView.h>
+#include "AllocationCounter.h"
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define BENCH_SECONDS             600               // Default sample time simulated
+#define BENCH_PERIOD              2000              // us between a head's samples
+#define BENCH_FRAME_RATE          30
+#define BENCH_PNG_RATE            10
+#define BENCH_CHECK_SWEEPS        200               // Sweeps compared against full redraws
+#define BENCH_BMP_SAMPLES         2000              // Samples drawn the visualiser's way
+#define BENCH_NO_RETURN           8190
+
+/**
+ * How far a head at the origin reads at an angle: a room 2.7 m wide and 1.6 m deep, its corners out of
+ * range, and someone 300 mm across walking side to side in it
+ */
+static int readDistance(int head, int degrees, uint32_t time)
+{
+    double angle = degrees * M_PI / 180.0;
+    double dx = -cos(angle);        // The radar's 0 degrees is to the left
+    double dy = sin(angle);
+    double nearest = 1600 / (dy > 1e-9 ? dy : 1e-9);
+    if (dx < -1e-9)
+        nearest = fmin(nearest, -1500 / dx);
+    if (dx > 1e-9)
+        nearest = fmin(nearest, (head ? 1000 : 1200) / dx);
+
+    double personX = 900 * sin(time / 3e6);
+    double personY = 800;
+    double along = dx * personX + dy * personY;
+    double across = personX * personX + personY * personY - along * along;
+    if (along > 0 && across < 150 * 150)
+        nearest = fmin(nearest, along - sqrt(150 * 150 - across));
+    return nearest >= RADAR_MAX_RANGE ? BENCH_NO_RETURN : (int)nearest;
+}
+
+/**
+ * Head 0 rising as head 1 falls, one degree a sample each
+ */
+static int angleAt(int head, unsigned long step)
+{
+    int phase = (int)(step % 360);
+    int angle = phase <= 180 ? phase : 360 - phase;
+    return head ? 180 - angle : angle;
+}
+
+/**
+ * A display with its own copy of the frame, kept up to date with tiles
+ */
+struct Display {
+    std::vector<uint8_t> pixels;
+    int stride;
+    unsigned long tiles;
+    unsigned long bytes;
+};
+
+static void handleTile(void *context, int x, int y, int width, int height, const uint8_t *pixels, int stride)
+{
+    Display *display = (Display *)context;
+    for (int row = 0; row < height; row++)
+        memcpy(&display->pixels[(size_t)(y + row) * display->stride + x * RADAR_BYTES_PER_PIXEL],
+            pixels + (size_t)row * stride, width * RADAR_BYTES_PER_PIXEL);
+    display->tiles++;
+    display->bytes += (unsigned long)width * height * RADAR_BYTES_PER_PIXEL;
+}
+
+static void handleFrame(void *context, RadarView &view)
+{
+    view.exportTiles(handleTile, context);
+}
+
+static uint32_t readBigEndian(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static uint32_t crc32(const uint8_t *data, size_t length)
+{
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+    }
+    return ~crc;
+}
+
+/**
+ * Signature, chunk CRCs, IHDR first with the view's size, IDATs together, IEND last
+ */
+static bool isWellFormedPng(const std::vector<uint8_t> &png, int width, int height)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0)
+        return false;
+
+    size_t at = 8;
+    int chunks = 0;
+    bool idat = false, idatEnded = false;
+    while (at + 12 <= png.size()) {
+        uint32_t length = readBigEndian(&png[at]);
+        if (at + 12 + length > png.size() || readBigEndian(&png[at + 8 + length]) != crc32(&png[at + 4], length + 4))
+            return false;
+        const char *type = (const char *)&png[at + 4];
+        if (chunks == 0 && (memcmp(type, "IHDR", 4) != 0 || readBigEndian(&png[at + 8]) != (uint32_t)width
+            || readBigEndian(&png[at + 12]) != (uint32_t)height))
+            return false;
+        if (memcmp(type, "IDAT", 4) == 0) {
+            if (idatEnded)
+                return false;
+            idat = true;
+        } else if (idat) {
+            idatEnded = true;
+        }
+        chunks++;
+        at += 12 + length;
+        if (memcmp(type, "IEND", 4) == 0)
+            return idat && at == png.size();
+    }
+    return false;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : BENCH_SECONDS;
+    if (seconds <= 0)
+        seconds = BENCH_SECONDS;
+    bool ok = true;
+
+    // One head, sample by sample and sweep by sweep, against everything redrawn after each sweep
+    std::unique_ptr<RadarView> bySample(new RadarView());
+    std::unique_ptr<RadarView> bySweep(new RadarView());
+    std::unique_ptr<RadarView> full(new RadarView());
+    bySample->setFrameRate(BENCH_FRAME_RATE);
+    bySweep->setFrameRate(BENCH_FRAME_RATE);
+    full->setFrameRate(0);
+    std::unique_ptr<SweepArrays> sweep(new SweepArrays());
+    size_t frameBytes = (size_t)full->getStride() * full->getHeight();
+    int mismatches = 0;
+    uint32_t time = 0;
+    for (int s = 0; s < BENCH_CHECK_SWEEPS; s++) {
+        sweep->head = 0;
+        sweep->count = 0;
+        for (int i = 0; i < 180; i++, time += BENCH_PERIOD) {
+            PollSample sample;
+            sample.angle = angleAt(0, (unsigned long)s * 180 + i);
+            sample.distance = readDistance(0, sample.angle, time);
+            sample.timestamp = time;
+            bySample->addSample(0, sample);
+            full->addSample(0, sample);
+            sweep->angle[i] = sample.angle;
+            sweep->distance[i] = sample.distance;
+            sweep->timestamp[i] = sample.timestamp;
+            sweep->count++;
+        }
+        bySweep->addSweep(*sweep);
+        bySample->render();
+        bySweep->render();
+        full->redraw();
+        full->render();
+        mismatches += memcmp(bySample->getPixels(), full->getPixels(), frameBytes) != 0;
+        mismatches += memcmp(bySweep->getPixels(), full->getPixels(), frameBytes) != 0;
+    }
+    if (mismatches > 0) {
+        printf("FAILED: %d of %d frames drawn by tiles differ from a full redraw\n", mismatches,
+            BENCH_CHECK_SWEEPS * 2);
+        ok = false;
+    }
+
+    // Two heads at the frame rate, the display kept up to date tile by tile
+    std::unique_ptr<RadarView> view(new RadarView());
+    Display display;
+    display.stride = view->getStride();
+    display.pixels.assign(frameBytes, 0);
+    display.tiles = 0;
+    display.bytes = 0;
+    view->setFrameRate(BENCH_FRAME_RATE);
+    view->setFrameHandler(handleFrame, &display);
+
+    unsigned long steps = (unsigned long)seconds * 1000000 / BENCH_PERIOD;
+    std::vector<PollSample> samples(steps * 2);
+    for (unsigned long step = 0; step < steps; step++) {
+        for (int head = 0; head < 2; head++) {
+            PollSample &sample = samples[step * 2 + head];
+            sample.angle = angleAt(head, step);
+            sample.timestamp = (uint32_t)(step * BENCH_PERIOD + head * BENCH_PERIOD / 2);
+            sample.distance = readDistance(head, sample.angle, sample.timestamp);
+        }
+    }
+
+    unsigned long allocationsBefore = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < samples.size(); i++)
+        view->addSample((int)(i & 1), samples[i]);
+    view->render();
+    double tileTime = secondsSince(start);
+    unsigned long viewAllocations = allocations - allocationsBefore;
+    const RadarStats &stats = view->getStats();
+    unsigned long frameCap = (unsigned long)seconds * BENCH_FRAME_RATE + 2;
+    bool displayMatches = memcmp(display.pixels.data(), view->getPixels(), frameBytes) == 0;
+
+    // The same, with every frame written out as a PNG
+    std::unique_ptr<RadarView> pngView(new RadarView());
+    pngView->setFrameRate(BENCH_PNG_RATE);
+    unsigned long pngSamples = samples.size() / 10;
+    unsigned long pngFrames = 0;
+    size_t pngBytes = 0;
+    std::vector<uint8_t> png;
+    bool pngOk = true;
+    start = std::chrono::steady_clock::now();
+    FILE *nowhere = fopen("/dev/null", "wb");
+    for (unsigned long i = 0; i < pngSamples && nowhere; i++) {
+        pngView->addSample((int)(i & 1), samples[i]);
+        if (pngView->getStats().frames != pngFrames) {
+            pngFrames = pngView->getStats().frames;
+            pngOk = pngView->writePng(nowhere) && pngOk;
+        }
+    }
+    double pngTime = secondsSince(start);
+    if (nowhere)
+        fclose(nowhere);
+    FILE *file = tmpfile();
+    if (!file || !pngView->writePng(file)) {
+        pngOk = false;
+    } else {
+        pngBytes = (size_t)ftell(file);
+        png.resize(pngBytes);
+        rewind(file);
+        pngOk = fread(png.data(), 1, pngBytes, file) == pngBytes && isWellFormedPng(png, pngView->getWidth(),
+            pngView->getHeight()) && pngOk;
+    }
+    if (file)
+        fclose(file);
+
+    // The visualiser's way: draw every sample as it comes, then save the whole bitmap
+    std::unique_ptr<RadarView> bmpView(new RadarView());
+    bmpView->setFrameRate(0);
+    int bmpRow = (bmpView->getWidth() * 3 + 3) & ~3;
+    std::vector<uint8_t> bmp(54 + (size_t)bmpRow * bmpView->getHeight());
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < BENCH_BMP_SAMPLES && i < samples.size(); i++) {
+        bmpView->addSample((int)(i & 1), samples[i]);
+        bmpView->render();
+        for (int y = 0; y < bmpView->getHeight(); y++) {
+            const uint8_t *in = bmpView->getPixels() + (size_t)(bmpView->getHeight() - 1 - y) * bmpView->getStride();
+            uint8_t *out = &bmp[54 + (size_t)y * bmpRow];
+            for (int x = 0; x < bmpView->getWidth(); x++) {
+                out[x * 3] = in[x * 3 + 2];
+                out[x * 3 + 1] = in[x * 3 + 1];
+                out[x * 3 + 2] = in[x * 3];
+            }
+        }
+    }
+    double bmpTime = secondsSince(start);
+    unsigned long bmpSamples = BENCH_BMP_SAMPLES < samples.size() ? BENCH_BMP_SAMPLES : samples.size();
+
+    printf("view      %d x %d, %.2f MB a frame, %d px tiles\n", view->getWidth(), view->getHeight(), frameBytes / 1e6,
+        RADAR_TILE_SIZE);
+    printf("tiles     %9.0f samples/s (%lu samples, %lu dropped), %lu frames for %d s at %d fps, "
+        "%.1f tiles and %.1f KB a frame to the display  (%lu allocations)\n", samples.size() / tileTime,
+        stats.samples, stats.dropped, stats.frames, seconds, BENCH_FRAME_RATE, (double)display.tiles / stats.frames,
+        display.bytes / 1e3 / stats.frames, viewAllocations);
+    printf("png       %9.0f samples/s, %lu frames at %d fps, %.1f KB a frame\n", pngSamples / pngTime, pngFrames,
+        BENCH_PNG_RATE, pngBytes / 1e3);
+    printf("bmp       %9.0f samples/s, a %.2f MB bitmap saved per sample\n", bmpSamples / bmpTime, bmp.size() / 1e6);
+    printf("checked   %d sweeps drawn by tiles against full redraws, %d mismatches\n", BENCH_CHECK_SWEEPS, mismatches);
+
+    if (viewAllocations != 0 || stats.frames > frameCap || stats.samples != samples.size() || !displayMatches) {
+        printf("FAILED: %lu allocations, %lu frames (at most %lu), display %s\n", viewAllocations, stats.frames,
+            frameCap, displayMatches ? "matches" : "differs");
+        ok = false;
+    }
+    if (!pngOk) {
+        printf("FAILED: PNG frames\n");
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+/**
+ * Capture replay benchmark
+ * ------------------------
+ * Records a synthetic session of several sensor heads sweeping back and forth to a capture, then checks
+ * and times what can be done with it:
+ *    - size on disk against bigbrain's text output
+ *    - random access by time and by sweep through the memory mapped index
+ *    - replay flat out through LidarComms' decode path, re-recorded and compared sweep for sweep, so a
+ *      replay must come out exactly as recorded
+ *    - replay paced at a multiple of real time
+ *    - reading a capture cut short, as after a crash, up to its last whole sweep
+ *    - reading one whose index trailer is damaged, by scanning the chunks instead
+ *
+ * Usage: ReplayBench [sweeps per head]
+ */
+
+#include <CaptureReplay.h>
+#include <IngestPipeline.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_SWEEPS              2000              // Default sweeps per head
+#define BENCH_HEADS               3                 // Sensor heads in the session
+#define BENCH_SAMPLE_INTERVAL     2000              // Time (us) between a head's samples
+#define BENCH_LOOKUPS             1000000           // Random lookups timed
+#define BENCH_PACED_SPEED         50                // Speed-up for the paced replay
+#define BENCH_PACED_SWEEPS        60                // Sweeps in the paced replay
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Copy the first length bytes of a file
+ */
+static void copyFile(const char *from, const char *to, uint64_t length)
+{
+    FILE *in = fopen(from, "rb");
+    FILE *out = fopen(to, "wb");
+    static uint8_t buffer[1 << 16];
+    for (uint64_t copied = 0; copied < length; ) {
+        size_t chunk = fread(buffer, 1, length - copied < sizeof(buffer) ? length - copied : sizeof(buffer), in);
+        if (chunk == 0)
+            break;
+        fwrite(buffer, 1, chunk, out);
+        copied += chunk;
+    }
+    fclose(in);
+    fclose(out);
+}
+
+/**
+ * Replayed samples go on into the pipeline, as decoded ones do in LidarIngestd
+ */
+static void handleSample(void *context, int head, const PollSample &sample)
+{
+    ((IngestPipeline *)context)->addSample(head, sample);
+}
+
+/**
+ * Replay a capture's chunks first to end - 1 into a new capture, returning the seconds it took
+ */
+static double replayInto(CaptureReader &reader, const char *path, uint32_t first, uint32_t end, double speed,
+    unsigned long *samples)
+{
+    CaptureWriter recorder;
+    recorder.open(path);
+    std::unique_ptr<IngestPipeline> pipeline(new IngestPipeline(NULL));
+    pipeline->setRecorder(&recorder);
+    std::unique_ptr<CaptureReplay> replay(new CaptureReplay(reader, handleSample, pipeline.get()));
+
+    auto start = std::chrono::steady_clock::now();
+    replay->run(first, end, speed);
+    pipeline->flush();
+    double elapsed = secondsSince(start);
+    recorder.close();
+    *samples = pipeline->getAssemblerStats().samples;
+    return elapsed;
+}
+
+/**
+ * Whether capture b holds the same sweeps, sample for sample, as chunks first to first + count - 1 of a. Heads
+ * can finish their sweeps in a different order, so sweeps are matched up by head and start time. A replay of
+ * part of a capture can't know the last sweep of each head was complete, so that is only compared if asked.
+ */
+static bool sameSweeps(CaptureReader &a, CaptureReader &b, uint32_t first, uint32_t count, bool compareComplete)
+{
+    static Sweep sweepA;
+    static Sweep sweepB;
+    if (b.getChunkCount() != count)
+        return false;
+
+    std::map<std::pair<int, uint64_t>, uint32_t> chunks;
+    for (uint32_t i = first; i < first + count; i++)
+        chunks[std::make_pair((int)a.getEntry(i).head, a.getEntry(i).startTime)] = i;
+
+    for (uint32_t i = 0; i < count; i++) {
+        auto match = chunks.find(std::make_pair((int)b.getEntry(i).head, b.getEntry(i).startTime));
+        if (match == chunks.end() || !a.readSweep(match->second, sweepA) || !b.readSweep(i, sweepB))
+            return false;
+        if (sweepA.head != sweepB.head || sweepA.direction != sweepB.direction || sweepA.count != sweepB.count
+            || (compareComplete && sweepA.complete != sweepB.complete))
+            return false;
+        for (int j = 0; j < sweepA.count; j++) {
+            const PollSample &x = sweepA.samples[j];
+            const PollSample &y = sweepB.samples[j];
+            if (x.angle != y.angle || x.distance != y.distance || x.timestamp != y.timestamp)
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int sweeps = argc > 1 ? atoi(argv[1]) : BENCH_SWEEPS;
+    if (sweeps <= BENCH_PACED_SWEEPS)
+        sweeps = BENCH_SWEEPS;
+
+    char path[64], replayPath[64], pacedPath[64], cutPath[64], damagedPath[64];
+    snprintf(path, sizeof(path), "/tmp/ReplayBench-%d.lcap", (int)getpid());
+    snprintf(replayPath, sizeof(replayPath), "/tmp/ReplayBench-%d-replay.lcap", (int)getpid());
+    snprintf(pacedPath, sizeof(pacedPath), "/tmp/ReplayBench-%d-paced.lcap", (int)getpid());
+    snprintf(cutPath, sizeof(cutPath), "/tmp/ReplayBench-%d-cut.lcap", (int)getpid());
+    snprintf(damagedPath, sizeof(damagedPath), "/tmp/ReplayBench-%d-damaged.lcap", (int)getpid());
+    Serial.setQuiet(true);
+
+    // A session, recorded as LidarIngestd would: each head sweeps 0-180 and back, a little after the last,
+    // with timestamps wrapping the 32-bit counter partway through
+    CaptureWriter writer;
+    if (!writer.open(path)) {
+        printf("Can't write %s\n", path);
+        return 1;
+    }
+    std::unique_ptr<IngestPipeline> recording(new IngestPipeline(NULL));
+    recording->setRecorder(&writer);
+    long steps = (long)sweeps * 180;
+    uint32_t baseTime = 0xFFFFFFFFu - (uint32_t)(steps / 2) * BENCH_SAMPLE_INTERVAL;
+    unsigned long samples = 0;
+    unsigned long textBytes = 0;
+    srand(1);
+    for (long step = 0; step <= steps; step++) {
+        for (int head = 1; head <= BENCH_HEADS; head++) {
+            PollSample sample;
+            sample.angle = (step / 180) % 2 ? 180 - step % 180 : step % 180;
+            sample.distance = 300 + 20 * head + (rand() % 2200);
+            sample.timestamp = baseTime + (uint32_t)(step * BENCH_SAMPLE_INTERVAL + head * 300);
+            textBytes += snprintf(NULL, 0, "[POLL:%d,%d,%d]", sample.angle, sample.distance, head);
+            recording->addSample(head, sample);
+            samples++;
+        }
+    }
+    recording->flush();
+    if (!writer.close()) {
+        printf("Writing %s failed\n", path);
+        return 1;
+    }
+    printf("capture   %lu samples in %u sweeps, %.2f bytes/sample (text %.2f), %.1f s of session\n", samples,
+        writer.getChunkCount(), (double)writer.getBytes() / samples, (double)textBytes / samples,
+        samples / BENCH_HEADS * BENCH_SAMPLE_INTERVAL / 1e6);
+
+    CaptureReader reader;
+    if (!reader.open(path)) {
+        printf("Can't read %s\n", path);
+        return 1;
+    }
+    uint32_t chunks = reader.getChunkCount();
+    uint64_t startTime = reader.getEntry(0).startTime;
+    uint64_t endTime = reader.getEntry(chunks - 1).endTime;
+
+    // Random access
+    auto start = std::chrono::steady_clock::now();
+    unsigned long found = 0;
+    bool lookupsRight = true;
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        uint64_t time = startTime + (uint64_t)rand() * rand() % (endTime - startTime);
+        uint32_t index = reader.findTime(time);
+        found += index < chunks;
+        if (index >= chunks || reader.getEntry(index).endTime < time || (index > 0 && reader.getEntry(index - 1).endTime >= time))
+            lookupsRight = false;
+    }
+    double lookupTime = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    std::unique_ptr<Sweep> sweep(new Sweep());
+    int sweepIndex = reader.findSweep(2, sweeps - 1);
+    bool decoded = sweepIndex >= 0 && reader.readSweep(sweepIndex, *sweep) && sweep->head == 2 && sweep->sequence == (uint32_t)sweeps - 1
+        && sweep->count == 180;
+    double seekTime = secondsSince(start);
+    printf("seek      %.0f ns by time (%lu of %d found%s), %.1f us to find and decode the last sweep of head 2\n",
+        lookupTime * 1e9 / BENCH_LOOKUPS, found, BENCH_LOOKUPS, lookupsRight ? "" : ", SOME WRONG", seekTime * 1e6);
+
+    // Flat out through LidarComms
+    unsigned long replayed;
+    double replayTime = replayInto(reader, replayPath, 0, chunks, 0, &replayed);
+    CaptureReader replayReader;
+    bool replayMatches = replayReader.open(replayPath) && sameSweeps(reader, replayReader, 0, chunks, true);
+    printf("replay    %.0f samples/s flat out, %.0fx real time, %lu samples, %s\n", replayed / replayTime,
+        (endTime - startTime) / 1e6 / replayTime, replayed, replayMatches ? "every sweep as recorded" : "SWEEPS DIFFER");
+
+    // Paced, from the middle of the session
+    uint32_t pacedFirst = reader.findTime(startTime + (endTime - startTime) / 2);
+    uint32_t pacedEnd = pacedFirst + BENCH_PACED_SWEEPS;
+    double pacedSpan = (reader.getEntry(pacedEnd - 1).endTime - reader.getEntry(pacedFirst).startTime) / 1e6;
+    unsigned long pacedSamples;
+    double pacedTime = replayInto(reader, pacedPath, pacedFirst, pacedEnd, BENCH_PACED_SPEED, &pacedSamples);
+    CaptureReader pacedReader;
+    bool pacedMatches = pacedReader.open(pacedPath) && sameSweeps(reader, pacedReader, pacedFirst, BENCH_PACED_SWEEPS, false);
+    double expected = pacedSpan / BENCH_PACED_SPEED;
+    bool pacedOnTime = pacedTime >= expected * 0.95 && pacedTime <= expected * 1.2 + 0.05;
+    printf("paced     %.3f s of session at %dx took %.3f s (expected %.3f s), %s\n", pacedSpan, BENCH_PACED_SPEED,
+        pacedTime, expected, pacedMatches ? "every sweep as recorded" : "SWEEPS DIFFER");
+
+    // Cut off partway through a chunk, as if the recorder had died: the whole chunks before must still read
+    uint64_t cut = reader.getEntry(chunks / 2).offset + CAPTURE_CHUNK_HEADER_SIZE + 10;
+    copyFile(path, cutPath, cut);
+    CaptureReader cutReader;
+    bool recovered = cutReader.open(cutPath) && cutReader.wasRecovered() && cutReader.getChunkCount() == chunks / 2
+        && sameSweeps(reader, cutReader, 0, chunks / 2, true);
+    printf("cut       capture cut inside sweep %u: %s %u whole sweeps\n", chunks / 2, recovered ? "recovered" : "FAILED to recover",
+        cutReader.getChunkCount());
+
+    // A trailer whose index offset and count add up to the file's size only by wrapping round
+    FILE *damaged = fopen(path, "rb");
+    fseek(damaged, 0, SEEK_END);
+    uint64_t size = ftell(damaged);
+    fclose(damaged);
+    copyFile(path, damagedPath, size);
+    uint32_t badCount = 0x08000001;     // Times the entry size: 32 bytes past 4 GB, as an int
+    uint64_t badOffset = size - CAPTURE_TRAILER_SIZE - (uint64_t)badCount * CAPTURE_INDEX_ENTRY_SIZE;
+    uint8_t badFields[12];
+    for (int i = 0; i < 8; i++)
+        badFields[i] = badOffset >> (i * 8);
+    for (int i = 0; i < 4; i++)
+        badFields[8 + i] = badCount >> (i * 8);
+    damaged = fopen(damagedPath, "r+b");
+    fseek(damaged, size - CAPTURE_TRAILER_SIZE + 8, SEEK_SET);
+    fwrite(badFields, 1, sizeof(badFields), damaged);
+    fclose(damaged);
+    CaptureReader damagedReader;
+    bool rescanned = damagedReader.open(damagedPath) && damagedReader.wasRecovered()
+        && damagedReader.getChunkCount() == chunks && sameSweeps(reader, damagedReader, 0, chunks, true);
+    printf("damaged   index trailer pointing outside the file: %s %u sweeps\n",
+        rescanned ? "scanned" : "FAILED to scan", damagedReader.getChunkCount());
+
+    replayReader.close();
+    pacedReader.close();
+    cutReader.close();
+    damagedReader.close();
+    reader.close();
+    unlink(path);
+    unlink(replayPath);
+    unlink(pacedPath);
+    unlink(cutPath);
+    unlink(damagedPath);
+
+    bool ok = lookupsRight && decoded && replayMatches && replayed == samples && pacedMatches && pacedOnTime && recovered
+        && rescanned;
+    return ok ? 0 : 1;
+}
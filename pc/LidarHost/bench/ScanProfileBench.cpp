@@ -0,0 +1,180 @@
+/**
+ * Scan profile benchmark
+ * ----------------------
+ * Sends scan profiles from a brain LidarComms to a swol LidarComms over the in-memory channel, checks they
+ * arrive intact, then runs each through SweepSampler against the simulated servo to show what a sector or
+ * region of interest does to the sweep rate.
+ *
+ * Usage: ScanProfileBench [sweeps] [read ms]
+ */
+
+#include <LidarComms.h>
+#include <MemoryUdp.h>
+#include <SampleRing.h>
+#include <SettleModel.h>
+#include <SweepPlanner.h>
+#include <SweepSampler.h>
+#include "SimulatedServo.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_SWEEPS              20                // Default one-way sweeps per profile
+#define BENCH_READ_TIME           20                // Default ToF read time (ms)
+#define BENCH_SLEW_RATE           0.35f             // Servo speed (deg/ms)
+#define BENCH_DEAD_TIME           3                 // Time (ms) before the servo starts moving
+
+typedef SampleRing<PollSample, 16> BenchRing;
+
+static ScanProfile receivedProfile;
+static int receivedProfileId = -1;
+static int confirmedProfileId = -1;
+static bool confirmedAccepted = false;
+
+void handleScanProfile(int, int profileId, const ScanProfile &profile)
+{
+    receivedProfile = profile;
+    receivedProfileId = profileId;
+}
+
+void handleBrainMessage(int, int, int msgDescriptor, int msgMetaData, int msgValue)
+{
+    if (msgDescriptor != MSG_SCAN_PROFILE_CONFIRM)
+        return;
+
+    confirmedProfileId = msgMetaData;
+    confirmedAccepted = msgValue;
+}
+
+static bool sameProfile(const ScanProfile &a, const ScanProfile &b)
+{
+    if (a.startAngle != b.startAngle || a.endAngle != b.endAngle || a.step != b.step || a.dwell != b.dwell
+        || a.oversample != b.oversample || a.regionCount != b.regionCount)
+        return false;
+
+    for (int i = 0; i < a.regionCount; i++) {
+        if (a.regions[i].startAngle != b.regions[i].startAngle || a.regions[i].endAngle != b.regions[i].endAngle
+            || a.regions[i].step != b.regions[i].step)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Push a profile from brain to swol and have swol confirm it, as the sketches do
+ */
+static bool sendProfile(LidarComms &brain, LidarComms &swol, int profileId, const ScanProfile &profile)
+{
+    receivedProfileId = -1;
+    confirmedProfileId = -1;
+    brain.messageScanProfile(0, profileId, profile);
+    swol.drainUdpPackets();
+    if (receivedProfileId == profileId)
+        swol.messageScanProfileConfirm(1, profileId, true);
+    brain.drainUdpPackets();
+
+    return receivedProfileId == profileId && sameProfile(receivedProfile, profile)
+        && confirmedProfileId == profileId && confirmedAccepted;
+}
+
+/**
+ * Sweep with a profile until the planner has turned round the given number of times
+ */
+static bool runProfile(const char *name, const ScanProfile &profile, int sweeps, int readTime)
+{
+    static BenchRing ring;
+    SweepPlanner planner;
+    SettleModel settleModel;
+    SimulatedServo servo(readTime, BENCH_SLEW_RATE, BENCH_DEAD_TIME);
+    SweepSampler<BenchRing> sampler(planner, ring, servo, settleModel);
+
+    if (!sampler.requestProfile(profile))
+        return false;
+
+    // The first step picks up the profile and settles onto its start
+    PollSample sample;
+    sampler.step();
+    if (!ring.pop(sample))
+        return false;
+    double start = servo.elapsed();
+
+    long samples = 0;
+    long inRegions = 0;
+    bool reached[2] = { sample.angle == profile.startAngle, false };
+    bool reversing = planner.isReversing();
+    for (int turns = 0; turns < sweeps; ) {
+        sampler.step();
+        while (ring.pop(sample)) {
+            samples++;
+            for (int i = 0; i < profile.regionCount; i++) {
+                if (sample.angle >= profile.regions[i].startAngle && sample.angle <= profile.regions[i].endAngle)
+                    inRegions++;
+            }
+            if (sample.angle == profile.startAngle)
+                reached[0] = true;
+            if (sample.angle == profile.endAngle)
+                reached[1] = true;
+        }
+
+        if (planner.isReversing() != reversing) {
+            reversing = planner.isReversing();
+            turns++;
+        }
+    }
+    double elapsed = (servo.elapsed() - start) / 1e3;
+
+    printf("%-22s %6.1f sweeps/min  %5.1f samples/sweep  %4.1f in regions  ends %s\n",
+        name, sweeps / elapsed * 60, (double)samples / sweeps, (double)inRegions / sweeps,
+        reached[0] && reached[1] ? "reached" : "MISSED");
+
+    return reached[0] && reached[1];
+}
+
+int main(int argc, char **argv)
+{
+    int sweeps = argc > 1 ? atoi(argv[1]) : BENCH_SWEEPS;
+    int readTime = argc > 2 ? atoi(argv[2]) : BENCH_READ_TIME;
+    if (sweeps <= 0)
+        sweeps = BENCH_SWEEPS;
+
+    ScanProfile full;
+
+    ScanProfile sector(60, 120, 1);
+
+    ScanProfile focused(0, 180, 5);
+    focused.addRegion(60, 120, 1);
+
+    ScanProfile oversampled(60, 120, 2);
+    oversampled.oversample = 4;
+    oversampled.dwell = 5;
+
+    ScanProfile invalid(120, 60, 1);
+
+    // Over the wire first
+    WiFi.config(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1));
+    MemoryNetwork network;
+    MemoryUdp brainTransport(network, IPAddress(192, 168, 4, 1));
+    MemoryUdp swolTransport(network, IPAddress(192, 168, 4, 2));
+    LidarComms brain(1, true, false);
+    LidarComms swol(2, false, false);
+    brain.setTransport(&brainTransport);
+    swol.setTransport(&swolTransport);
+    brain.setMessageHandler(handleBrainMessage);
+    swol.setScanProfileHandler(handleScanProfile);
+    brain.startUdp();
+    swol.startUdp();
+
+    bool ok = sendProfile(brain, swol, 1, full) && sendProfile(brain, swol, 2, sector)
+        && sendProfile(brain, swol, 3, focused) && sendProfile(brain, swol, 4, oversampled);
+    bool rejected = !brain.messageScanProfile(0, 5, invalid);
+    printf("wire                   %s, invalid profile %s\n", ok ? "4 profiles round-tripped" : "ROUND TRIP FAILED",
+        rejected ? "refused" : "SENT");
+    ok &= rejected;
+
+    printf("read %d ms  %d sweeps\n", readTime, sweeps);
+    ok &= runProfile("full 0-180 @1", full, sweeps, readTime);
+    ok &= runProfile("sector 60-120 @1", sector, sweeps, readTime);
+    ok &= runProfile("0-180 @5, 60-120 @1", focused, sweeps, readTime);
+    ok &= runProfile("60-120 @2, 4x, 5ms", oversampled, sweeps, readTime);
+
+    return ok ? 0 : 1;
+}
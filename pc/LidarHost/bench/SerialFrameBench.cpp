@@ -0,0 +1,155 @@
+/**
+ * Serial frame benchmark
+ * ----------------------
+ * Compares bigbrain's "[POLL:angle,distance]" text output against binary sample frames:
+ * bytes per sample, encode/decode cost, and how many samples fit through a 115200 baud UART.
+ *
+ * Usage: SerialFrameBench [samples]
+ */
+
+#include <SerialFrame.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define BENCH_SAMPLES             1000000           // Default samples per run
+#define BENCH_BAUD                115200            // UART rate to project throughput for
+#define BENCH_CHUNK               64                // Bytes handed to the decoder at a time, like a UART FIFO
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void countSample(void *context, int, const PollSample &sample)
+{
+    (*(unsigned long *)context) += sample.distance;
+}
+
+static void countHeadSample(void *context, int head, const PollSample &sample)
+{
+    ((unsigned long *)context)[head & 3] += sample.distance;
+}
+
+/**
+ * Hand-rolled parser for the text format, no regex or allocation
+ */
+static unsigned long parseText(const char *text, size_t length, unsigned long *samples)
+{
+    unsigned long checksum = 0;
+    const char *end = text + length;
+    while (text < end) {
+        if (*text++ != '[' || end - text < 6 || text[0] != 'P')
+            continue;
+
+        text += 5;
+        long values[2] = { 0, 0 };
+        for (int field = 0; field < 2 && text < end; field++, text++) {
+            while (text < end && *text >= '0' && *text <= '9')
+                values[field] = values[field] * 10 + (*text++ - '0');
+        }
+        checksum += values[1];
+        (*samples)++;
+    }
+    return checksum;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : BENCH_SAMPLES;
+    if (count <= 0)
+        count = BENCH_SAMPLES;
+
+    // A bouncing 0-180 sweep with a little range noise, ~20ms apart (timestamps in us)
+    std::vector<PollSample> samples(count);
+    for (int i = 0; i < count; i++) {
+        samples[i].angle = (i / 181) % 2 ? 180 - (i % 181) : i % 181;
+        samples[i].distance = 300 + (i % 181) * 7 + ((i * 37) % 23);
+        samples[i].timestamp = i * 20000;
+    }
+
+    // Text
+    std::vector<char> text;
+    text.reserve((size_t)count * 16);
+    char line[32];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        int length = snprintf(line, sizeof line, "[POLL:%d,%d]", samples[i].angle, samples[i].distance);
+        text.insert(text.end(), line, line + length);
+    }
+    double textEncode = secondsSince(start);
+
+    unsigned long textSamples = 0;
+    start = std::chrono::steady_clock::now();
+    unsigned long textChecksum = parseText(text.data(), text.size(), &textSamples);
+    double textDecode = secondsSince(start);
+
+    // Binary frames
+    std::vector<uint8_t> binary;
+    binary.reserve((size_t)count * 4);
+    uint8_t frame[FRAME_MAX_SIZE];
+    uint16_t sequence = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i += FRAME_MAX_SAMPLES) {
+        int batch = count - i < FRAME_MAX_SAMPLES ? count - i : FRAME_MAX_SAMPLES;
+        int length = encodeSampleFrame(frame, sizeof frame, sequence++, &samples[i], batch);
+        binary.insert(binary.end(), frame, frame + length);
+    }
+    double binaryEncode = secondsSince(start);
+
+    unsigned long binaryChecksum = 0;
+    SerialFrameDecoder decoder(countSample, &binaryChecksum);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < binary.size(); i += BENCH_CHUNK) {
+        size_t chunk = binary.size() - i < BENCH_CHUNK ? binary.size() - i : BENCH_CHUNK;
+        decoder.feed(&binary[i], (int)chunk);
+    }
+    double binaryDecode = secondsSince(start);
+
+    double textBytes = (double)text.size() / count;
+    double binaryBytes = (double)binary.size() / count;
+    printf("text     %6.2f bytes/sample  encode %6.1f ns  decode %6.1f ns  %7.0f samples/s at %d baud (%lu parsed)\n",
+        textBytes, textEncode * 1e9 / count, textDecode * 1e9 / count, BENCH_BAUD / 10 / textBytes, BENCH_BAUD, textSamples);
+    printf("binary   %6.2f bytes/sample  encode %6.1f ns  decode %6.1f ns  %7.0f samples/s at %d baud (%lu decoded)\n",
+        binaryBytes, binaryEncode * 1e9 / count, binaryDecode * 1e9 / count, BENCH_BAUD / 10 / binaryBytes, BENCH_BAUD, decoder.getStats().samples);
+    if (textChecksum != binaryChecksum)
+        printf("MISMATCH: text and binary decoded different distances\n");
+
+    // Frames tagged by sensor head, as from a bigbrain polling several; each head's samples must come back as its own
+    std::vector<uint8_t> tagged;
+    tagged.reserve(binary.size() + count / FRAME_MAX_SAMPLES + 1);
+    unsigned long sentByHead[4] = { 0 };
+    for (int i = 0; i < count; i += FRAME_MAX_SAMPLES) {
+        int batch = count - i < FRAME_MAX_SAMPLES ? count - i : FRAME_MAX_SAMPLES;
+        int head = 1 + (i / FRAME_MAX_SAMPLES) % 4;
+        int length = encodeSampleFrame(frame, sizeof frame, sequence++, &samples[i], batch, head);
+        tagged.insert(tagged.end(), frame, frame + length);
+        for (int j = 0; j < batch; j++)
+            sentByHead[head & 3] += samples[i + j].distance;
+    }
+    unsigned long receivedByHead[4] = { 0 };
+    SerialFrameDecoder headDecoder(countHeadSample, receivedByHead);
+    headDecoder.feed(tagged.data(), (int)tagged.size());
+    bool headsMatch = memcmp(sentByHead, receivedByHead, sizeof(sentByHead)) == 0;
+    printf("tagged   %6.2f bytes/sample  4 heads, %lu decoded, %s\n", (double)tagged.size() / count,
+        headDecoder.getStats().samples, headsMatch ? "every sample under its own head" : "HEADS MIXED UP");
+
+    // Corrupt one byte in every 1000 and check the decoder recovers
+    srand(1);
+    for (size_t i = 0; i < binary.size(); i += 1000)
+        binary[i + rand() % 1000 % (binary.size() - i)] ^= 0x5A;
+
+    binaryChecksum = 0;
+    SerialFrameDecoder noisy(countSample, &binaryChecksum);
+    for (size_t i = 0; i < binary.size(); i += BENCH_CHUNK) {
+        size_t chunk = binary.size() - i < BENCH_CHUNK ? binary.size() - i : BENCH_CHUNK;
+        noisy.feed(&binary[i], (int)chunk);
+    }
+    const FrameStats &stats = noisy.getStats();
+    printf("noisy    %lu frames, %lu samples, %lu CRC errors, %lu malformed, %lu lost frames, %lu bytes skipped\n",
+        stats.frames, stats.samples, stats.crcErrors, stats.malformed, stats.lostFrames, stats.skippedBytes);
+
+    return headsMatch ? 0 : 1;
+}
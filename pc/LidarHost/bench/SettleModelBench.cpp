@@ -0,0 +1,85 @@
+/**
+ * Settle model benchmark
+ * ----------------------
+ * Runs SweepSampler against a simulated servo and ToF sensor on a virtual clock. Compares swol's old fixed
+ * 10 ms settle, the default linear model, a calibrated model and continuous sweep on samples/s and on how far
+ * each reported angle is from where the servo really was during the read.
+ *
+ * Usage: SettleModelBench [samples] [read ms] [slew deg/ms] [dead time ms]
+ */
+
+#include <SampleRing.h>
+#include <SettleModel.h>
+#include <SweepPlanner.h>
+#include <SweepSampler.h>
+#include "SimulatedServo.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_SAMPLES             5000              // Default samples per run
+#define BENCH_READ_TIME           20                // Default ToF read time (ms), the VL53L0X high speed budget
+#define BENCH_SLEW_RATE           0.35f             // Default servo speed (deg/ms), an MG995 at 0.17 s/60 deg
+#define BENCH_DEAD_TIME           3                 // Default time (ms) before the servo starts moving
+
+typedef SampleRing<PollSample, 16> BenchRing;
+
+static void runSweep(const char *name, SettleModel &settleModel, bool continuous, int count, int readTime, float slewRate, int deadTime)
+{
+    static BenchRing ring;
+    SweepPlanner planner;
+    SimulatedServo servo(readTime, slewRate, deadTime);
+    SweepSampler<BenchRing> sampler(planner, ring, servo, settleModel, continuous);
+
+    // The first step settles from wherever the servo was, so leave it out
+    PollSample sample;
+    sampler.step();
+    ring.pop(sample);
+    double start = servo.elapsed();
+
+    double totalError = 0;
+    float worstError = 0;
+    for (int i = 0; i < count; i++) {
+        sampler.step();
+        float error = 0;
+        while (ring.pop(sample))
+            error = fabsf(sample.angle - servo.lastReadAngle);
+        totalError += error;
+        if (error > worstError)
+            worstError = error;
+    }
+    double elapsed = (servo.elapsed() - start) / 1e3;
+
+    printf("%-12s %6.1f samples/s  %6.2f sweeps/min  angle error mean %.2f max %.2f deg\n",
+        name, count / elapsed, count / elapsed * 60 / (2 * (SWEEP_MAX_ANGLE - SWEEP_MIN_ANGLE)), totalError / count, worstError);
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : BENCH_SAMPLES;
+    int readTime = argc > 2 ? atoi(argv[2]) : BENCH_READ_TIME;
+    float slewRate = argc > 3 ? atof(argv[3]) : BENCH_SLEW_RATE;
+    int deadTime = argc > 4 ? atoi(argv[4]) : BENCH_DEAD_TIME;
+    if (count <= 0)
+        count = BENCH_SAMPLES;
+
+    printf("read %d ms  slew %.2f deg/ms  dead time %d ms  %d samples\n", readTime, slewRate, deadTime, count);
+
+    SettleModel fixedModel(10, 0);
+    SettleModel defaultModel;
+    SettleModel calibratedModel;
+    SimulatedServo calibrationServo(readTime, slewRate, deadTime);
+    bool complete = calibratedModel.calibrate(calibrationServo, 90);
+
+    printf("calibrated   %s, %.0f s  ", complete ? "complete" : "incomplete", calibrationServo.elapsed() / 1e3);
+    for (int step = 1; step <= SETTLE_MAX_STEP; step *= 2)
+        printf(" %d:%d/%d", step, calibratedModel.getSettleTime(0, step), calibratedModel.getSettleTime(step, 0));
+    printf(" ms\n");
+
+    runSweep("fixed 10ms", fixedModel, false, count, readTime, slewRate, deadTime);
+    runSweep("linear", defaultModel, false, count, readTime, slewRate, deadTime);
+    runSweep("calibrated", calibratedModel, false, count, readTime, slewRate, deadTime);
+    runSweep("continuous", calibratedModel, true, count, readTime, slewRate, deadTime);
+
+    return complete ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#ifndef SIMULATEDSERVO_H
+#define SIMULATEDSERVO_H
+
+#include <SweepHardware.h>
+#include <math.h>
+
+#define SIMULATED_SCENE_SLOPE     8                 // Sloped wall: distance changes this much (mm) per degree
+#define SIMULATED_READ_POINTS     8                 // Points the simulated sensor averages over each read
+
+/**
+ * Servo with a dead time from rest and a fixed slew rate, and a sensor that averages over each read
+ */
+class SimulatedServo : public SweepHardware {
+    private:
+        int readTime;
+        float slewRate;
+        int deadTime;
+        double clock;
+        float moveFrom;
+        int target;
+        double moveTime;
+        uint32_t noise;
+
+        float positionAt(double time)
+        {
+            double moving = time - moveTime - deadTime;
+            if (moving <= 0)
+                return moveFrom;
+
+            float travel = slewRate * moving;
+            float distance = fabsf(target - moveFrom);
+            if (travel >= distance)
+                return target;
+
+            return moveFrom + (target > moveFrom ? travel : -travel);
+        }
+
+    public:
+        float lastReadAngle;
+
+        SimulatedServo(int readTime, float slewRate, int deadTime)
+            : readTime(readTime), slewRate(slewRate), deadTime(deadTime), clock(0), moveFrom(0), target(0),
+              moveTime(-1000), noise(1), lastReadAngle(0) {}
+
+        void moveTo(int angle)
+        {
+            bool moving = clock - moveTime > deadTime && positionAt(clock) != target;
+            moveFrom = positionAt(clock);
+            target = angle;
+
+            // Already moving: just retarget, no dead time
+            moveTime = moving ? clock - deadTime : clock;
+        }
+
+        int readDistance()
+        {
+            lastReadAngle = 0;
+            for (int i = 0; i < SIMULATED_READ_POINTS; i++)
+                lastReadAngle += positionAt(clock + readTime * (i + 0.5) / SIMULATED_READ_POINTS) / SIMULATED_READ_POINTS;
+            clock += readTime;
+            noise = noise * 1103515245 + 12345;
+            return 600 + (int)lroundf(lastReadAngle * SIMULATED_SCENE_SLOPE) + (int)(noise >> 16) % 3 - 1;
+        }
+
+        uint32_t now() { return (uint32_t)clock; }
+        uint32_t nowMicros() { return (uint32_t)(clock * 1000); }
+        void wait(int ms) { clock += ms; }
+        double elapsed() { return clock; }
+};
+
+#endif
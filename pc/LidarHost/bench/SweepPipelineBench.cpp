@@ -0,0 +1,124 @@
+/**
+ * Sweep pipeline benchmark
+ * ------------------------
+ * Compares swol's original sequential loop (move, settle, read, send) against the pipelined one, where
+ * a sensor thread runs SweepSampler and the main thread sends whatever comes out of the ring.
+ * Servo settling, sensor reads and sends are simulated with sleeps, so this measures overlap, not the radio.
+ *
+ * Usage: SweepPipelineBench [samples] [settle ms] [read ms] [send ms]
+ */
+
+#include <SampleRing.h>
+#include <SweepPlanner.h>
+#include <SweepSampler.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#define BENCH_SAMPLES             200               // Default samples per run
+#define BENCH_SETTLE_TIME         10                // Default servo settle time (ms), as swol's SERVO_SETTLE_TIME
+#define BENCH_READ_TIME           3                 // Default simulated ToF read time (ms)
+#define BENCH_SEND_TIME           4                 // Default simulated send time per sample (ms)
+
+typedef SampleRing<PollSample, 256> BenchRing;
+
+static void sleepMs(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+/**
+ * Servo and sensor stand-in. Readings are the angle, so the consumer can check the sweep order.
+ */
+class SimulatedHardware : public SweepHardware {
+    private:
+        int readTime;
+        int angle;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        SimulatedHardware(int readTime) : readTime(readTime), angle(0), start(std::chrono::steady_clock::now()) {}
+
+        void moveTo(int angle) { this->angle = angle; }
+        int readDistance() { sleepMs(readTime); return angle; }
+        uint32_t now() { return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(); }
+        uint32_t nowMicros() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(); }
+        void wait(int ms) { sleepMs(ms); }
+};
+
+static double runSequential(int count, int settleTime, int readTime, int sendTime)
+{
+    SweepPlanner planner;
+    SimulatedHardware hardware(readTime);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        hardware.moveTo(planner.current());
+        hardware.wait(settleTime);
+        hardware.readDistance();
+        sleepMs(sendTime);
+        planner.advance();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double runPipelined(int count, int settleTime, int readTime, int sendTime, long &badSamples)
+{
+    static BenchRing ring;
+    SweepPlanner planner;
+    SimulatedHardware hardware(readTime);
+    SettleModel settleModel(settleTime, 0);
+    SweepSampler<BenchRing> sampler(planner, ring, hardware, settleModel);
+    std::atomic<bool> running(true);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread sensor([&]() {
+        while (running.load())
+            sampler.step();
+    });
+
+    SweepPlanner expected;
+    PollSample sample;
+    badSamples = 0;
+    for (int received = 0; received < count; ) {
+        if (!ring.pop(sample)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        if (sample.distance != expected.current())
+            badSamples++;
+        expected.advance();
+        sleepMs(sendTime);
+        received++;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    running = false;
+    sensor.join();
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : BENCH_SAMPLES;
+    int settleTime = argc > 2 ? atoi(argv[2]) : BENCH_SETTLE_TIME;
+    int readTime = argc > 3 ? atoi(argv[3]) : BENCH_READ_TIME;
+    int sendTime = argc > 4 ? atoi(argv[4]) : BENCH_SEND_TIME;
+    if (count <= 0)
+        count = BENCH_SAMPLES;
+
+    printf("settle %d ms  read %d ms  send %d ms  %d samples\n", settleTime, readTime, sendTime, count);
+
+    double sequential = runSequential(count, settleTime, readTime, sendTime);
+    printf("sequential  %.1f samples/s  %.2f ms/sample\n", count / sequential, sequential * 1e3 / count);
+
+    long badSamples;
+    double pipelined = runPipelined(count, settleTime, readTime, sendTime, badSamples);
+    printf("pipelined   %.1f samples/s  %.2f ms/sample  out of sweep order %ld\n", count / pipelined, pipelined * 1e3 / count, badSamples);
+
+    printf("speedup     %.2fx\n", sequential / pipelined);
+
+    return badSamples == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+/**
+ * Sweep ring benchmark
+ * --------------------
+ * One thread publishes sweeps into a SweepRing sample by sample, as fast as it can, while reader threads
+ * take the newest complete sweep over and over. Every field of every sample is a function of the sweep's
+ * position, so a reader can tell if it ever got a sweep that was half one thing and half another. Checks
+ * that none are torn, that readers only ever move forward, that heads, positions still in the ring and ones
+ * written over, and sweeps cut short are told apart, and that the writer allocates nothing. For comparison,
+ * the visualiser's way: a queue of heap allocated points capped at 360, at one allocation per sample.
+ *
+ * Usage: SweepRingBench [sweeps] [readers]
+ */
+
+#include <SweepRing.h>
+#include "AllocationCounter.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#define BENCH_SWEEPS              200000            // Default sweeps published
+#define BENCH_READERS             2                 // Default reader threads
+#define BENCH_HEADS               3
+#define BENCH_RADAR_POINTS        360               // Radar's maxPoints
+
+/**
+ * What the sweep at a position holds
+ */
+static int countAt(uint64_t position)
+{
+    return 100 + (int)(position % 81);
+}
+
+static PollSample sampleAt(uint64_t position, int i)
+{
+    PollSample sample;
+    sample.angle = (position & 1) ? 180 - i : i;
+    sample.distance = (int)((position * 31 + i * 7) & 0x1FFF);
+    sample.timestamp = (uint32_t)(position * 1000 + i);
+    return sample;
+}
+
+static bool matches(const SweepArrays &sweep)
+{
+    if (sweep.count != countAt(sweep.position) || sweep.head != (int)(sweep.position % BENCH_HEADS)
+        || sweep.sequence != (uint32_t)(sweep.position / BENCH_HEADS) || !sweep.complete)
+        return false;
+    for (int i = 0; i < sweep.count; i++) {
+        PollSample sample = sampleAt(sweep.position, i);
+        if (sweep.angle[i] != sample.angle || sweep.distance[i] != sample.distance
+            || sweep.timestamp[i] != sample.timestamp || sweep.quality[i] != SweepRing::qualityOf(sample))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * The visualiser's RadarPoint, as far as memory goes
+ */
+struct RadarPoint {
+    int angleDegrees;
+    double angleRadians;
+    int length;
+    int x, y, x2, y2;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    long sweeps = argc > 1 ? atol(argv[1]) : BENCH_SWEEPS;
+    int readerCount = argc > 2 ? atoi(argv[2]) : BENCH_READERS;
+    if (sweeps <= 0)
+        sweeps = BENCH_SWEEPS;
+    if (readerCount < 1)
+        readerCount = BENCH_READERS;
+    bool ok = true;
+
+    // One thread: positions in the ring, written over, not yet published; heads; starting over; overfilling
+    std::unique_ptr<SweepRing> ring(new SweepRing(4));
+    std::unique_ptr<SweepArrays> out(new SweepArrays());
+    bool basics = !ring->readLatest(*out) && !ring->read(0, *out);
+    for (uint64_t position = 0; position < 6; position++) {
+        ring->begin((int)(position % BENCH_HEADS), 1, (uint32_t)(position / BENCH_HEADS));
+        if (position == 5) {
+            ring->add(sampleAt(99, 0));
+            ring->begin((int)(position % BENCH_HEADS), 1, (uint32_t)(position / BENCH_HEADS));
+        }
+        for (int i = 0; i < countAt(position); i++)
+            ring->add(sampleAt(position, i), SweepRing::qualityOf(sampleAt(position, i)));
+        ring->finish(true);
+    }
+    basics = basics && ring->getPublished() == 6 && !ring->read(1, *out) && !ring->read(6, *out)
+        && ring->read(2, *out) && out->position == 2 && matches(*out)
+        && ring->readLatest(*out) && out->position == 5 && matches(*out)
+        && ring->readLatest(*out, 0) && out->position == 3 && ring->readLatest(*out, 2) && out->position == 5
+        && !ring->readLatest(*out, 7);
+    ring->begin(0, 1, 0);
+    for (int i = 0; i < SWEEP_MAX_SAMPLES; i++)
+        basics = basics && ring->add(sampleAt(0, i));
+    basics = basics && !ring->add(sampleAt(0, 0)) && ring->readLatest(*out) && out->position == 5;
+    ring->finish(false);
+    basics = basics && ring->readLatest(*out) && out->position == 5 && ring->readLatest(*out, 2) && out->position == 5
+        && ring->readLatest(*out, -1, true) && out->position == 6 && !out->complete;
+    PollSample noReturn = { 90, SWEEP_NO_RETURN, 0 };
+    basics = basics && SweepRing::qualityOf(noReturn) == QUALITY_NONE;
+    if (!basics) {
+        printf("FAILED: single threaded reads and writes\n");
+        ok = false;
+    }
+
+    // A writer flat out, readers taking the newest sweep as often as they can
+    ring.reset(new SweepRing());
+    std::atomic<bool> go(false);
+    std::atomic<bool> done(false);
+    std::atomic<int> ready(0);
+    std::atomic<unsigned long> reads(0), torn(0), backwards(0), distinct(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < readerCount; r++) {
+        readers.emplace_back([&]() {
+            std::unique_ptr<SweepArrays> copy(new SweepArrays());
+            uint64_t last = 0;
+            bool any = false;
+            ready++;
+            while (!go)
+                std::this_thread::yield();
+            while (!done) {
+                if (!ring->readLatest(*copy))
+                    continue;
+                reads++;
+                torn += !matches(*copy);
+                backwards += any && copy->position < last;
+                distinct += !any || copy->position != last;
+                last = copy->position;
+                any = true;
+            }
+        });
+    }
+
+    // Readers' own copies and thread startup aren't the writer's
+    while (ready < readerCount)
+        std::this_thread::yield();
+    unsigned long allocationsBefore = allocations;
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    unsigned long samples = 0;
+    for (uint64_t position = 0; position < (uint64_t)sweeps; position++) {
+        ring->begin((int)(position % BENCH_HEADS), 1, (uint32_t)(position / BENCH_HEADS));
+        int count = countAt(position);
+        for (int i = 0; i < count; i++) {
+            PollSample sample = sampleAt(position, i);
+            ring->add(sample, SweepRing::qualityOf(sample));
+        }
+        ring->finish(true);
+        samples += count;
+    }
+    double writeTime = secondsSince(start);
+    unsigned long ringAllocations = allocations - allocationsBefore;
+    done = true;
+    for (std::thread &reader : readers)
+        reader.join();
+
+    // The visualiser's queue, fed the same samples
+    std::deque<RadarPoint *> points;
+    allocationsBefore = allocations;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t position = 0; position < (uint64_t)sweeps; position++) {
+        int count = countAt(position);
+        for (int i = 0; i < count; i++) {
+            PollSample sample = sampleAt(position, i);
+            while (points.size() >= BENCH_RADAR_POINTS) {
+                delete points.front();
+                points.pop_front();
+            }
+            points.push_back(new RadarPoint { sample.angle, sample.angle * 0.0174533, sample.distance, 0, 0, -100, -100 });
+        }
+    }
+    double radarTime = secondsSince(start);
+    unsigned long radarAllocations = allocations - allocationsBefore;
+    for (RadarPoint *point : points)
+        delete point;
+
+    printf("ring      %7.1f M samples/s written, %lu sweeps  (%lu allocations)\n", samples / writeTime / 1e6,
+        (unsigned long)sweeps, ringAllocations);
+    printf("readers   %lu reads of the newest sweep by %d threads, %lu different sweeps, %lu retries, %lu torn\n",
+        reads.load(), readerCount, distinct.load(), ring->getRetries(), torn.load());
+    printf("radar     %7.1f M samples/s into a queue of %d heap points  (%.2f allocations a sample)\n",
+        samples / radarTime / 1e6, BENCH_RADAR_POINTS, (double)radarAllocations / samples);
+    printf("memory    %.2f MB for %u sweeps, allocated once\n", ring->getCapacity() * sizeof(SweepArrays) / 1e6,
+        ring->getCapacity());
+
+    if (torn > 0 || backwards > 0 || ringAllocations != 0 || reads == 0 || ring->getPublished() != (uint64_t)sweeps
+        || !ring->readLatest(*out) || out->position != (uint64_t)sweeps - 1 || !matches(*out)) {
+        printf("FAILED: %lu torn, %lu out of order, %lu allocations, %lu reads\n", torn.load(), backwards.load(),
+            ringAllocations, reads.load());
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+/**
+ * Typed value benchmark
+ * ---------------------
+ * Round-trips ToF-like distances through each of the v1.0 value types to show what precision each keeps,
+ * and times encode + decode against the plain int cast the messages used before.
+ *
+ * Usage: ValueBench [values]
+ */
+
+#include <LidarValue.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_VALUES              10000000          // Default values per run
+#define BENCH_MAX_DISTANCE        8000.0f           // Furthest distance (mm) to test, beyond the sensor's range
+
+static volatile float sink;
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : BENCH_VALUES;
+    if (count <= 0)
+        count = BENCH_VALUES;
+
+    float *values = new float[count];
+    for (int i = 0; i < count; i++)
+        values[i] = BENCH_MAX_DISTANCE * rand() / RAND_MAX;
+
+    // The descriptor must survive packing whatever the type
+    int descriptorErrors = 0;
+    for (int type = VALUE_INT; type <= VALUE_FLOAT; type++) {
+        for (int descriptor = 0; descriptor < 100; descriptor++) {
+            int packed = packDescriptor(descriptor, type);
+            if (unpackDescriptor(packed) != descriptor || unpackValueType(packed) != type)
+                descriptorErrors++;
+        }
+    }
+    printf("check                   descriptor packing %d errors\n", descriptorErrors);
+
+    const char *names[] = { "int (whole mm)", "fixed Q23.8", "float" };
+    double errors[3];
+    for (int type = VALUE_INT; type <= VALUE_FLOAT; type++) {
+        double worst = 0;
+        for (int i = 0; i < count; i++) {
+            double error = fabs(decodeValue(encodeValue(values[i], type), type) - values[i]);
+            if (error > worst)
+                worst = error;
+        }
+        errors[type] = worst;
+        printf("%-23s worst error %.4f mm\n", names[type], worst);
+    }
+
+    // What the old messageResponseTof did: truncate to an int and send it as is
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
+        sink = (float)(int)values[i];
+    double castTime = secondsSince(start);
+    printf("int cast                %.2f ns per value\n", castTime * 1e9 / count);
+
+    for (int type = VALUE_INT; type <= VALUE_FLOAT; type++) {
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+            sink = decodeValue(encodeValue(values[i], type), type);
+        printf("%-23s %.2f ns per value encode + decode\n", names[type], secondsSince(start) * 1e9 / count);
+    }
+
+    delete[] values;
+    bool precise = errors[VALUE_FIXED] <= 0.5 / (1 << VALUE_FRACTION_BITS) + 0.001 && errors[VALUE_FLOAT] == 0;
+    return descriptorErrors == 0 && precise ? 0 : 1;
+}
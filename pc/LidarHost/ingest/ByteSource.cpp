@@ -0,0 +1,143 @@
+#include "ByteSource.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+FileSource::FileSource()
+{
+    file = NULL;
+}
+
+FileSource::~FileSource()
+{
+    close();
+}
+
+bool FileSource::open(const char *path)
+{
+    close();
+    file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    return file != NULL;
+}
+
+void FileSource::close()
+{
+    if (file && file != stdin)
+        fclose(file);
+    file = NULL;
+}
+
+int FileSource::read(uint8_t *buffer, int size)
+{
+    if (!file)
+        return -1;
+
+    size_t length = fread(buffer, 1, size, file);
+    return length > 0 ? (int)length : -1;
+}
+
+SerialSource::SerialSource()
+{
+    fd = -1;
+}
+
+SerialSource::~SerialSource()
+{
+    close();
+}
+
+/**
+ * The termios speed for a baud rate, or 0 if it isn't one
+ */
+static speed_t baudToSpeed(int baud)
+{
+    switch (baud) {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 921600:    return B921600;
+        default:        return 0;
+    }
+}
+
+bool SerialSource::open(const char *device, int baud)
+{
+    close();
+    speed_t speed = baudToSpeed(baud);
+    if (!speed)
+        return false;
+
+    fd = ::open(device, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0) {
+        close();
+        return false;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+        close();
+        return false;
+    }
+
+    tcflush(fd, TCIFLUSH);
+    return true;
+}
+
+void SerialSource::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+int SerialSource::read(uint8_t *buffer, int size)
+{
+    if (fd < 0)
+        return -1;
+
+    struct pollfd waiting = { fd, POLLIN, 0 };
+    int ready = poll(&waiting, 1, SERIAL_READ_TIMEOUT);
+    if (ready < 0)
+        return errno == EINTR ? 0 : -1;
+    if (ready == 0)
+        return 0;
+    if (waiting.revents & (POLLERR | POLLHUP | POLLNVAL))
+        return -1;
+
+    ssize_t length = ::read(fd, buffer, size);
+    if (length < 0)
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    // Readable but nothing there means the device has gone, e.g. unplugged
+    return length > 0 ? (int)length : -1;
+}
+
+bool SerialSource::write(const uint8_t *data, int length)
+{
+    while (fd >= 0 && length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return fd >= 0;
+}
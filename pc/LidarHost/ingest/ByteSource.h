@@ -0,0 +1,60 @@
+#ifndef BYTESOURCE_H
+#define BYTESOURCE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SERIAL_READ_TIMEOUT       100               // Time (ms) a serial read waits for data before returning none
+
+/**
+ * Where bigbrain's output comes from
+ */
+class ByteSource {
+    public:
+        virtual ~ByteSource() {}
+
+        /**
+         * Read up to size bytes. Returns how many, 0 if none arrived in time, or -1 at the end or on error.
+         */
+        virtual int read(uint8_t *buffer, int size) = 0;
+
+        /**
+         * Send bytes back, e.g. commands to bigbrain. Returns false where there is no way back.
+         */
+        virtual bool write(const uint8_t *, int) { return false; }
+};
+
+/**
+ * A capture of bigbrain's output in a file, or stdin for "-"
+ */
+class FileSource : public ByteSource {
+    private:
+        FILE *file;
+
+    public:
+        FileSource();
+        ~FileSource();
+
+        bool open(const char *path);
+        void close();
+        int read(uint8_t *buffer, int size);
+};
+
+/**
+ * A serial port, raw 8N1 at the given baud, as bigbrain's USB serial shows up on Linux
+ */
+class SerialSource : public ByteSource {
+    private:
+        int fd;
+
+    public:
+        SerialSource();
+        ~SerialSource();
+
+        bool open(const char *device, int baud);
+        void close();
+        int read(uint8_t *buffer, int size);
+        bool write(const uint8_t *data, int length);
+};
+
+#endif
@@ -0,0 +1,427 @@
+#include "CaptureFile.h"
+#include <SerialFrame.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char FILE_MAGIC[8] = { 'L', 'I', 'D', 'A', 'R', 'C', 'A', 'P' };
+static const char CHUNK_MAGIC[4] = { 'L', 'C', 'H', 'K' };
+static const char INDEX_MAGIC[8] = { 'L', 'C', 'A', 'P', 'I', 'N', 'D', 'X' };
+
+static void store16(uint8_t *data, uint16_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static void store32(uint8_t *data, uint32_t value)
+{
+    store16(data, value);
+    store16(data + 2, value >> 16);
+}
+
+static void store64(uint8_t *data, uint64_t value)
+{
+    store32(data, value);
+    store32(data + 4, value >> 32);
+}
+
+static uint16_t load16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t load32(const uint8_t *data)
+{
+    return load16(data) | ((uint32_t)load16(data + 2) << 16);
+}
+
+static uint64_t load64(const uint8_t *data)
+{
+    return load32(data) | ((uint64_t)load32(data + 4) << 32);
+}
+
+static void storeEntry(uint8_t *data, const CaptureEntry &entry)
+{
+    store64(data, entry.offset);
+    store64(data + 8, entry.startTime);
+    store64(data + 16, entry.endTime);
+    store32(data + 24, entry.sequence);
+    data[28] = entry.head;
+    data[29] = entry.flags;
+    store16(data + 30, entry.count);
+}
+
+static CaptureEntry loadEntry(const uint8_t *data)
+{
+    CaptureEntry entry;
+    entry.offset = load64(data);
+    entry.startTime = load64(data + 8);
+    entry.endTime = load64(data + 16);
+    entry.sequence = load32(data + 24);
+    entry.head = data[28];
+    entry.flags = data[29];
+    entry.count = load16(data + 30);
+    return entry;
+}
+
+CaptureWriter::CaptureWriter()
+{
+    file = NULL;
+    position = 0;
+    failed = false;
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+/**
+ * Start a new capture, replacing anything at path
+ */
+bool CaptureWriter::open(const char *path)
+{
+    close();
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    setvbuf(file, NULL, _IOFBF, CAPTURE_WRITE_BUFFER);
+
+    entries.clear();
+    entries.reserve(CAPTURE_INDEX_RESERVE);
+    timeKnown = false;
+    failed = false;
+
+    uint8_t header[CAPTURE_HEADER_SIZE] = { 0 };
+    memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+    store16(header + 8, CAPTURE_VERSION);
+    store16(header + 10, CAPTURE_HEADER_SIZE);
+    failed = fwrite(header, sizeof(header), 1, file) != 1;
+    position = sizeof(header);
+    return !failed;
+}
+
+/**
+ * Put a 32-bit timestamp on the capture's 64-bit timeline. Timestamps are taken to be within 35 minutes of
+ * the last one, either way.
+ */
+uint64_t CaptureWriter::unwrap(uint32_t timestamp)
+{
+    if (!timeKnown) {
+        timeKnown = true;
+        lastTime = timestamp;
+    } else {
+        lastTime += (int32_t)(timestamp - lastTimestamp);
+    }
+    lastTimestamp = timestamp;
+    return lastTime;
+}
+
+/**
+ * Append a sweep as one chunk. Returns false if it couldn't be written; the capture stays readable up to
+ * the last chunk that was.
+ */
+bool CaptureWriter::write(const Sweep &sweep)
+{
+    if (!file || failed)
+        return false;
+    if (sweep.count == 0)
+        return true;
+
+    CaptureEntry entry;
+    entry.offset = position;
+    entry.startTime = unwrap(sweep.samples[0].timestamp);
+    entry.endTime = unwrap(sweep.samples[sweep.count - 1].timestamp);
+    entry.sequence = sweep.sequence;
+    entry.head = sweep.head;
+    entry.flags = (sweep.complete ? CAPTURE_COMPLETE : 0) | (sweep.direction < 0 ? CAPTURE_FALLING : 0)
+        | (sweep.direction != 0 ? CAPTURE_MOVING : 0);
+    entry.count = sweep.count;
+
+    uint8_t *payload = chunk + CAPTURE_CHUNK_HEADER_SIZE;
+    CompactStreamWriter writer(payload, CAPTURE_MAX_PAYLOAD, sweep.samples[0].timestamp);
+    for (int i = 0; i < sweep.count; i++) {
+        if (!writer.add(sweep.samples[i])) {
+            failed = true;
+            return false;
+        }
+    }
+    int payloadLength = writer.length();
+
+    memset(chunk, 0, CAPTURE_CHUNK_HEADER_SIZE);
+    memcpy(chunk, CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+    store32(chunk + 4, payloadLength);
+    store64(chunk + 8, entry.startTime);
+    store64(chunk + 16, entry.endTime);
+    store32(chunk + 24, entry.sequence);
+    store16(chunk + 28, entry.count);
+    chunk[30] = entry.head;
+    chunk[31] = entry.flags;
+    store16(chunk + 32, frameCrc(payload, payloadLength));
+
+    size_t length = CAPTURE_CHUNK_HEADER_SIZE + payloadLength;
+    if (fwrite(chunk, length, 1, file) != 1) {
+        failed = true;
+        return false;
+    }
+    position += length;
+    entries.push_back(entry);
+    return true;
+}
+
+/**
+ * Write the index and close the capture. Returns false if anything went unwritten.
+ */
+bool CaptureWriter::close()
+{
+    if (!file)
+        return !failed;
+
+    if (!failed) {
+        uint16_t crc = 0xFFFF;
+        uint8_t entry[CAPTURE_INDEX_ENTRY_SIZE];
+        for (size_t i = 0; i < entries.size() && !failed; i++) {
+            storeEntry(entry, entries[i]);
+            crc = frameCrc(entry, sizeof(entry), crc);
+            failed = fwrite(entry, sizeof(entry), 1, file) != 1;
+        }
+
+        uint8_t trailer[CAPTURE_TRAILER_SIZE] = { 0 };
+        memcpy(trailer, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        store64(trailer + 8, position);
+        store32(trailer + 16, entries.size());
+        store16(trailer + 20, crc);
+        if (!failed)
+            failed = fwrite(trailer, sizeof(trailer), 1, file) != 1;
+    }
+
+    if (fclose(file) != 0)
+        failed = true;
+    file = NULL;
+    return !failed;
+}
+
+CaptureReader::CaptureReader()
+{
+    data = NULL;
+    size = 0;
+    recovered = false;
+}
+
+CaptureReader::~CaptureReader()
+{
+    close();
+}
+
+/**
+ * Map a capture and load its index, rebuilding it if the capture was never closed
+ */
+bool CaptureReader::open(const char *path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < CAPTURE_HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    data = (const uint8_t *)mapping;
+    size = info.st_size;
+
+    if (memcmp(data, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || load16(data + 8) != CAPTURE_VERSION) {
+        close();
+        return false;
+    }
+
+    recovered = !loadIndex();
+    if (recovered)
+        scanChunks();
+    sortSweeps();
+    return true;
+}
+
+void CaptureReader::close()
+{
+    if (data)
+        munmap((void *)data, size);
+    data = NULL;
+    size = 0;
+    entries.clear();
+    bySweep.clear();
+}
+
+/**
+ * Load the index written when the capture was closed. Returns false if there isn't a whole one.
+ */
+bool CaptureReader::loadIndex()
+{
+    if (size < CAPTURE_HEADER_SIZE + CAPTURE_TRAILER_SIZE)
+        return false;
+
+    const uint8_t *trailer = data + size - CAPTURE_TRAILER_SIZE;
+    if (memcmp(trailer, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+        return false;
+
+    // Bounds first, so a damaged trailer can't wrap the sum below and point outside the mapping
+    uint64_t indexOffset = load64(trailer + 8);
+    uint32_t count = load32(trailer + 16);
+    if (indexOffset < CAPTURE_HEADER_SIZE || indexOffset > size - CAPTURE_TRAILER_SIZE
+        || count > (size - CAPTURE_TRAILER_SIZE - indexOffset) / CAPTURE_INDEX_ENTRY_SIZE)
+        return false;
+    if (indexOffset + (uint64_t)count * CAPTURE_INDEX_ENTRY_SIZE + CAPTURE_TRAILER_SIZE != size)
+        return false;
+
+    // An entry at a time, as written, so the length never has to fit an int
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i = 0; i < count; i++)
+        crc = frameCrc(data + indexOffset + (uint64_t)i * CAPTURE_INDEX_ENTRY_SIZE, CAPTURE_INDEX_ENTRY_SIZE, crc);
+    if (crc != load16(trailer + 20))
+        return false;
+
+    entries.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        entries[i] = loadEntry(data + indexOffset + (uint64_t)i * CAPTURE_INDEX_ENTRY_SIZE);
+    return true;
+}
+
+/**
+ * Rebuild the index from the chunks themselves, up to the first that isn't whole
+ */
+void CaptureReader::scanChunks()
+{
+    entries.clear();
+    uint64_t offset = CAPTURE_HEADER_SIZE;
+    while (offset + CAPTURE_CHUNK_HEADER_SIZE <= size) {
+        const uint8_t *chunk = data + offset;
+        uint32_t payloadLength = load32(chunk + 4);
+        if (memcmp(chunk, CHUNK_MAGIC, sizeof(CHUNK_MAGIC)) != 0 || payloadLength > CAPTURE_MAX_PAYLOAD
+            || offset + CAPTURE_CHUNK_HEADER_SIZE + payloadLength > size
+            || frameCrc(chunk + CAPTURE_CHUNK_HEADER_SIZE, payloadLength) != load16(chunk + 32))
+            break;
+
+        CaptureEntry entry;
+        entry.offset = offset;
+        entry.startTime = load64(chunk + 8);
+        entry.endTime = load64(chunk + 16);
+        entry.sequence = load32(chunk + 24);
+        entry.count = load16(chunk + 28);
+        entry.head = chunk[30];
+        entry.flags = chunk[31];
+        entries.push_back(entry);
+        offset += CAPTURE_CHUNK_HEADER_SIZE + payloadLength;
+    }
+}
+
+/**
+ * Decode a chunk's sweep. Sample timestamps come back as the 32-bit counter they were taken on; toTime() puts
+ * them on the capture's timeline. Returns false if the chunk is damaged.
+ */
+bool CaptureReader::readSweep(uint32_t index, Sweep &sweep)
+{
+    if (index >= entries.size())
+        return false;
+
+    const CaptureEntry &entry = entries[index];
+    if (entry.offset + CAPTURE_CHUNK_HEADER_SIZE > size || entry.count > SWEEP_MAX_SAMPLES)
+        return false;
+    const uint8_t *chunk = data + entry.offset;
+    uint32_t payloadLength = load32(chunk + 4);
+    if (memcmp(chunk, CHUNK_MAGIC, sizeof(CHUNK_MAGIC)) != 0 || entry.offset + CAPTURE_CHUNK_HEADER_SIZE + payloadLength > size
+        || frameCrc(chunk + CAPTURE_CHUNK_HEADER_SIZE, payloadLength) != load16(chunk + 32))
+        return false;
+
+    CompactStreamReader reader(chunk + CAPTURE_CHUNK_HEADER_SIZE, payloadLength);
+    int count = 0;
+    while (count < entry.count && reader.next(sweep.samples[count]))
+        count++;
+    if (count != entry.count)
+        return false;
+
+    sweep.head = entry.head;
+    sweep.direction = !(entry.flags & CAPTURE_MOVING) ? 0 : (entry.flags & CAPTURE_FALLING) ? -1 : 1;
+    sweep.sequence = entry.sequence;
+    sweep.complete = entry.flags & CAPTURE_COMPLETE;
+    sweep.count = count;
+    return true;
+}
+
+/**
+ * A sample timestamp from a chunk, on the capture's 64-bit timeline
+ */
+uint64_t CaptureReader::toTime(uint32_t index, uint32_t timestamp)
+{
+    uint64_t start = entries[index].startTime;
+    return start + (int32_t)(timestamp - (uint32_t)start);
+}
+
+/**
+ * The first chunk that ends at or after time, or the chunk count if none does. Chunks are in the order their
+ * sweeps finished, which is time order while every head is on the same clock.
+ */
+uint32_t CaptureReader::findTime(uint64_t time)
+{
+    uint32_t low = 0;
+    uint32_t high = entries.size();
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (entries[middle].endTime < time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/**
+ * Order the entries by head and sequence for findSweep(). A head that restarted can repeat a sequence, so
+ * ties go to the earlier chunk.
+ */
+void CaptureReader::sortSweeps()
+{
+    bySweep.resize(entries.size());
+    for (uint32_t i = 0; i < bySweep.size(); i++)
+        bySweep[i] = i;
+    std::sort(bySweep.begin(), bySweep.end(), [this](uint32_t a, uint32_t b) {
+        const CaptureEntry &first = entries[a];
+        const CaptureEntry &second = entries[b];
+        if (first.head != second.head)
+            return first.head < second.head;
+        if (first.sequence != second.sequence)
+            return first.sequence < second.sequence;
+        return a < b;
+    });
+}
+
+/**
+ * The first chunk holding a head's sweep, or -1 if it isn't in the capture
+ */
+int CaptureReader::findSweep(int head, uint32_t sequence)
+{
+    uint32_t low = 0;
+    uint32_t high = bySweep.size();
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const CaptureEntry &entry = entries[bySweep[middle]];
+        if (entry.head < head || (entry.head == head && entry.sequence < sequence))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low == bySweep.size())
+        return -1;
+    const CaptureEntry &entry = entries[bySweep[low]];
+    return entry.head == head && entry.sequence == sequence ? (int)bySweep[low] : -1;
+}
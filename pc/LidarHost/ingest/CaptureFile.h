@@ -0,0 +1,127 @@
+#ifndef CAPTUREFILE_H
+#define CAPTUREFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "SweepAssembler.h"
+
+#define CAPTURE_VERSION           1
+#define CAPTURE_HEADER_SIZE       16
+#define CAPTURE_CHUNK_HEADER_SIZE 40
+#define CAPTURE_INDEX_ENTRY_SIZE  32
+#define CAPTURE_TRAILER_SIZE      24
+#define CAPTURE_MAX_PAYLOAD       (SWEEP_MAX_SAMPLES * COMPACT_SAMPLE_MAX_SIZE + VARINT_MAX_SIZE)
+#define CAPTURE_INDEX_RESERVE     65536             // Index entries the writer makes room for up front
+#define CAPTURE_WRITE_BUFFER      (1 << 20)         // stdio buffer behind the writer
+
+#define CAPTURE_COMPLETE          0x01              // Chunk flags: the sweep ended with the servo turning round...
+#define CAPTURE_FALLING           0x02              // ...its angle fell...
+#define CAPTURE_MOVING            0x04              // ...or moved at all
+
+/**
+ * Capture file, little-endian, only ever appended to:
+ *    "LIDARCAP"  magic
+ *    uint16      version
+ *    uint16      header size
+ *    uint32      reserved
+ * then one chunk per sweep, in the order the sweeps were finished:
+ *    "LCHK"      magic
+ *    uint32      payload length
+ *    uint64      timestamp of the first sample (us, not wrapping)
+ *    uint64      timestamp of the last sample
+ *    uint32      sweep sequence for its head
+ *    uint16      sample count
+ *    uint8       head
+ *    uint8       flags (CAPTURE_*)
+ *    uint16      CRC over the payload (as frameCrc)
+ *    uint16      reserved
+ *    uint32      reserved
+ *    ...         payload: a compact poll sample stream (see PollStream.h) based at the first sample's time
+ * and once the capture is closed, an index of every chunk for random access:
+ *    per chunk:  uint64 offset, uint64 first and uint64 last timestamps, uint32 sequence, uint8 head, uint8 flags,
+ *                uint16 count
+ *    "LCAPINDX"  magic
+ *    uint64      offset of the index
+ *    uint32      chunk count
+ *    uint16      CRC over the index
+ *    uint16      reserved
+ * A capture cut short, e.g. by a crash, has no index; readers rebuild it from the chunks that made it whole.
+ */
+
+/**
+ * Where a chunk is and what it holds
+ */
+struct CaptureEntry {
+    uint64_t offset;            // Of its chunk header, from the start of the file
+    uint64_t startTime;
+    uint64_t endTime;
+    uint32_t sequence;
+    uint8_t head;
+    uint8_t flags;
+    uint16_t count;
+};
+
+/**
+ * Appends sweeps to a capture file, keeping timestamps on a 64-bit timeline across the 32-bit counter's wraps
+ */
+class CaptureWriter {
+    private:
+        FILE *file;
+        uint64_t position;
+        std::vector<CaptureEntry> entries;
+        bool timeKnown;
+        uint32_t lastTimestamp;
+        uint64_t lastTime;
+        uint8_t chunk[CAPTURE_CHUNK_HEADER_SIZE + CAPTURE_MAX_PAYLOAD];
+        bool failed;
+
+        uint64_t unwrap(uint32_t timestamp);
+
+    public:
+        CaptureWriter();
+        ~CaptureWriter();
+
+        bool open(const char *path);
+        bool write(const Sweep &sweep);
+        bool close();
+
+        uint32_t getChunkCount() { return entries.size(); }
+        uint64_t getBytes() { return position; }
+        bool hasFailed() { return failed; }
+};
+
+/**
+ * Reads a capture through a memory mapping, so any sweep can be had at once by index, head and sequence,
+ * or time, without reading what comes before it
+ */
+class CaptureReader {
+    private:
+        const uint8_t *data;
+        size_t size;
+        std::vector<CaptureEntry> entries;
+        std::vector<uint32_t> bySweep;      // Entries by head, then sequence, then where they are
+        bool recovered;
+
+        bool loadIndex();
+        void scanChunks();
+        void sortSweeps();
+
+    public:
+        CaptureReader();
+        ~CaptureReader();
+
+        bool open(const char *path);
+        void close();
+
+        uint32_t getChunkCount() { return entries.size(); }
+        const CaptureEntry &getEntry(uint32_t index) { return entries[index]; }
+        bool wasRecovered() { return recovered; }
+
+        bool readSweep(uint32_t index, Sweep &sweep);
+        uint64_t toTime(uint32_t index, uint32_t timestamp);
+        uint32_t findTime(uint64_t time);
+        int findSweep(int head, uint32_t sequence);
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "CaptureReplay.h"
+#include <chrono>
+#include <thread>
+
+CaptureReplay::CaptureReplay(CaptureReader &reader, handleSample sampleHandler, void *context)
+    : reader(reader), brainTransport(network, IPAddress(192, 168, 4, 1), REPLAY_BRAIN_QUEUE),
+      brain(BRAIN_CLIENT, true, false)
+{
+    this->sampleHandler = sampleHandler;
+    this->context = context;
+    headCount = 0;
+    damaged = 0;
+    for (int i = 0; i < 256; i++) {
+        slotByHead[i] = -1;
+        headByClient[i] = 0;
+    }
+
+    WiFi.config(IPAddress(192, 168, 4, 1), IPAddress(192, 168, 4, 1));
+    brain.setTransport(&brainTransport);
+    brain.setPollSampleHandler(handlePollSample, this);
+    brain.startUdp();
+}
+
+/**
+ * Decoded by the brain: hand over under the head it was recorded from
+ */
+void CaptureReplay::handlePollSample(void *context, int from, const PollSample &sample)
+{
+    CaptureReplay *replay = (CaptureReplay *)context;
+    if (replay->sampleHandler)
+        replay->sampleHandler(replay->context, replay->headByClient[from & 0xFF], sample);
+}
+
+/**
+ * The node replaying a head, joined to the brain the first time it is needed. Returns NULL past REPLAY_MAX_HEADS.
+ */
+LidarComms *CaptureReplay::getHead(int head)
+{
+    if (slotByHead[head] >= 0)
+        return heads[slotByHead[head]].comms.get();
+    if (headCount == REPLAY_MAX_HEADS)
+        return NULL;
+
+    int slot = headCount++;
+    int clientId = REPLAY_FIRST_CLIENT + slot;
+    ReplayHead &added = heads[slot];
+    added.transport.reset(new MemoryUdp(network, IPAddress(192, 168, 4, 10 + slot)));
+    added.comms.reset(new LidarComms(clientId, false, false));
+    added.comms->setTransport(added.transport.get());
+    added.comms->startUdp();
+    slotByHead[head] = slot;
+    headByClient[clientId] = head;
+
+    // Say hello both ways, so each knows where the other is and what it can decode
+    added.comms->messageId(BRAIN_CLIENT);
+    drain();
+    brain.messageId(clientId);
+    added.comms->drainUdpPackets();
+
+    // Recorded timestamps are already on the timeline we want, so the head's clock is taken to be ours
+    ClockSync *clockSync = brain.getClockSync(clientId);
+    if (clockSync)
+        clockSync->addExchange(0, 0, 0, 0);
+    return added.comms.get();
+}
+
+/**
+ * Send any batches that have waited long enough and let the brain take in what has arrived
+ */
+void CaptureReplay::pump()
+{
+    for (int i = 0; i < headCount; i++)
+        heads[i].comms->checkPollResultBatch();
+    drain();
+}
+
+void CaptureReplay::drain()
+{
+    while (brain.drainUdpPackets() > 0)
+        ;
+}
+
+/**
+ * Replay chunks first to end - 1, at speed times as fast as they were recorded, or as fast as they go for 0.
+ * Sweeps go one after another in the order they finished. Returns the samples sent; damaged chunks are
+ * skipped and counted.
+ */
+unsigned long CaptureReplay::run(uint32_t first, uint32_t end, double speed)
+{
+    if (end > reader.getChunkCount())
+        end = reader.getChunkCount();
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t firstTime = first < end ? reader.getEntry(first).startTime : 0;
+    unsigned long sent = 0;
+
+    for (uint32_t index = first; index < end; index++) {
+        if (!reader.readSweep(index, sweep)) {
+            damaged++;
+            continue;
+        }
+        LidarComms *head = getHead(sweep.head);
+        if (!head)
+            continue;
+
+        for (int i = 0; i < sweep.count; i++) {
+            if (speed > 0) {
+                double due = (reader.toTime(index, sweep.samples[i].timestamp) - firstTime) / speed;
+                for (;;) {
+                    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+                    if (elapsed.count() + REPLAY_SLEEP_SLACK >= due)
+                        break;
+                    pump();
+                    std::this_thread::sleep_for(std::chrono::microseconds(REPLAY_SLEEP_SLACK));
+                }
+            }
+
+            head->queuePollResult(sweep.samples[i]);
+            if (++sent % BATCH_MAX_SAMPLES == 0)
+                pump();
+        }
+    }
+
+    for (int i = 0; i < headCount; i++)
+        heads[i].comms->flushPollResults();
+    drain();
+    return sent;
+}
@@ -0,0 +1,56 @@
+#ifndef CAPTUREREPLAY_H
+#define CAPTUREREPLAY_H
+
+#include <stdint.h>
+#include <memory>
+#include <LidarComms.h>
+#include <MemoryUdp.h>
+#include "CaptureFile.h"
+
+#define REPLAY_MAX_HEADS          ASSEMBLER_MAX_HEADS
+#define REPLAY_FIRST_CLIENT       2                 // Client ID of the first replayed head; the rest follow on
+#define REPLAY_BRAIN_QUEUE        1024              // Datagrams the brain's in-memory endpoint holds between drains
+#define REPLAY_SLEEP_SLACK        1000              // How far (us) ahead of the capture's time replay gets before it sleeps
+
+/**
+ * Plays a capture back through the real protocol: each recorded head becomes a LidarComms node sending its
+ * sweeps as poll results over an in-memory network, and a brain decodes them in LidarComms::handleMessage as
+ * bigbrain would. The brain takes the heads' clocks as its own, so samples come out with the timestamps
+ * they were recorded with and a replay is the same every time. Only one replay can run at a time.
+ */
+class CaptureReplay {
+    typedef void (*handleSample)(void *context, int head, const PollSample &sample);
+
+    struct ReplayHead {
+        std::unique_ptr<MemoryUdp> transport;
+        std::unique_ptr<LidarComms> comms;
+    };
+
+    private:
+        CaptureReader &reader;
+        MemoryNetwork network;
+        MemoryUdp brainTransport;
+        LidarComms brain;
+        ReplayHead heads[REPLAY_MAX_HEADS];
+        int headCount;
+        int slotByHead[256];            // -1 for none
+        int headByClient[256];
+        handleSample sampleHandler;
+        void *context;
+        Sweep sweep;
+        unsigned long damaged;
+
+        static void handlePollSample(void *context, int from, const PollSample &sample);
+
+        LidarComms *getHead(int head);
+        void pump();
+        void drain();
+
+    public:
+        CaptureReplay(CaptureReader &reader, handleSample sampleHandler, void *context = 0);
+
+        unsigned long run(uint32_t first, uint32_t end, double speed);
+        unsigned long getDamaged() { return damaged; }
+};
+
+#endif
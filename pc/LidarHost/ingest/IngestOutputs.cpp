@@ -0,0 +1,176 @@
+#include "IngestOutputs.h"
+#include <stdlib.h>
+#include <string.h>
+
+IngestOptions::IngestOptions()
+{
+    xyzPath = "-";
+    pcdDirectory = NULL;
+    recordPath = NULL;
+    mapPath = NULL;
+    cellSize = GRID_CELL_SIZE;
+    radarDirectory = NULL;
+    frameRate = RADAR_FRAME_RATE;
+}
+
+/**
+ * Take the output option at argv[i], if it is one. Returns the arguments used, 0 if it isn't an output
+ * option, or -1 if its value is missing or bad.
+ */
+int IngestOptions::parse(int argc, char **argv, int i)
+{
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    const char *value = hasValue ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--xyz") == 0) {
+        xyzPath = value;
+    } else if (strcmp(arg, "--pcd") == 0) {
+        pcdDirectory = value;
+    } else if (strcmp(arg, "--record") == 0) {
+        recordPath = value;
+    } else if (strcmp(arg, "--map") == 0) {
+        mapPath = value;
+    } else if (strcmp(arg, "--cell") == 0) {
+        cellSize = value ? atoi(value) : 0;
+        if (cellSize <= 0)
+            return -1;
+    } else if (strcmp(arg, "--pose") == 0) {
+        int head;
+        GridPose pose;
+        if (!value || sscanf(value, "%d:%f,%f,%f", &head, &pose.x, &pose.y, &pose.heading) != 4)
+            return -1;
+        poses.push_back(std::make_pair(head, pose));
+    } else if (strcmp(arg, "--radar") == 0) {
+        radarDirectory = value;
+    } else if (strcmp(arg, "--fps") == 0) {
+        frameRate = value ? atoi(value) : 0;
+        if (frameRate <= 0)
+            return -1;
+    } else {
+        return 0;
+    }
+    return hasValue ? 2 : -1;
+}
+
+IngestOutputs::IngestOutputs()
+{
+    options = NULL;
+    xyzFile = NULL;
+    frameFailures = 0;
+}
+
+IngestOutputs::~IngestOutputs()
+{
+    if (xyzFile && xyzFile != stdout)
+        fclose(xyzFile);
+}
+
+/**
+ * Radar frames go to their own numbered PNGs
+ */
+void IngestOutputs::handleFrame(void *context, RadarView &view)
+{
+    IngestOutputs *outputs = (IngestOutputs *)context;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/radar-%06lu.png", outputs->options->radarDirectory, view.getStats().frames);
+    if (!view.writePng(path))
+        outputs->frameFailures++;
+}
+
+/**
+ * Open everything the options ask for, so nothing is allocated once samples arrive. Says what couldn't be
+ * opened on stderr and returns false.
+ */
+bool IngestOutputs::open(const IngestOptions &options)
+{
+    this->options = &options;
+
+    if (options.pcdDirectory) {
+        sink.reset(new PcdSink(options.pcdDirectory));
+    } else {
+        xyzFile = strcmp(options.xyzPath, "-") == 0 ? stdout : fopen(options.xyzPath, "w");
+        if (!xyzFile) {
+            fprintf(stderr, "Can't write %s\n", options.xyzPath);
+            return false;
+        }
+        sink.reset(new XyzSink(xyzFile));
+    }
+
+    if (options.recordPath) {
+        recorder.reset(new CaptureWriter());
+        if (!recorder->open(options.recordPath)) {
+            fprintf(stderr, "Can't write %s\n", options.recordPath);
+            return false;
+        }
+    }
+    if (options.mapPath) {
+        grid.reset(new OccupancyGrid(options.cellSize));
+        for (auto &pose : options.poses)
+            grid->setPose(pose.first, pose.second);
+    }
+    if (options.radarDirectory) {
+        radar.reset(new RadarView());
+        radar->setFrameRate(options.frameRate);
+        radar->setFrameHandler(handleFrame, this);
+    }
+    return true;
+}
+
+/**
+ * Hand the recorder, grid and radar to a pipeline made with getSink()
+ */
+void IngestOutputs::attach(IngestPipeline &pipeline)
+{
+    pipeline.setRecorder(recorder.get());
+    pipeline.setGrid(grid.get());
+    pipeline.setRadar(radar.get());
+}
+
+/**
+ * Once the pipeline is flushed: draw the last radar frame, finish the recording and write the map. Says what
+ * failed on stderr and returns false.
+ */
+bool IngestOutputs::close()
+{
+    bool ok = true;
+    if (radar)
+        radar->render();
+    if (recorder && !recorder->close()) {
+        fprintf(stderr, "Recording to %s failed\n", options->recordPath);
+        ok = false;
+    }
+    if (grid && !grid->writePgm(options->mapPath)) {
+        fprintf(stderr, "Can't write the map to %s\n", options->mapPath);
+        ok = false;
+    }
+    if (xyzFile && xyzFile != stdout)
+        fclose(xyzFile);
+    xyzFile = NULL;
+    return ok;
+}
+
+/**
+ * What went to each output
+ */
+void IngestOutputs::report(FILE *file)
+{
+    if (options->pcdDirectory && ((PcdSink *)sink.get())->getFailures() > 0) {
+        fprintf(file, "%lu clouds couldn't be written to %s\n", ((PcdSink *)sink.get())->getFailures(),
+            options->pcdDirectory);
+    }
+    if (recorder)
+        fprintf(file, "%u sweeps recorded to %s\n", recorder->getChunkCount(), options->recordPath);
+    if (grid) {
+        const GridStats &mapped = grid->getStats();
+        fprintf(file, "%lu rays (%lu with no return) mapped to %s: %d tiles, %.1f MB\n", mapped.rays,
+            mapped.noReturn, options->mapPath, grid->getTileCount(), grid->getMemory() / 1e6);
+    }
+    if (radar) {
+        const RadarStats &drawn = radar->getStats();
+        fprintf(file, "%lu radar frames to %s, %.1f tiles redrawn a frame\n", drawn.frames, options->radarDirectory,
+            drawn.frames ? (double)drawn.tiles / drawn.frames : 0.0);
+        if (frameFailures > 0)
+            fprintf(file, "%lu radar frames couldn't be written\n", frameFailures);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef INGESTOUTPUTS_H
+#define INGESTOUTPUTS_H
+
+#include <stdio.h>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "IngestPipeline.h"
+
+#define INGEST_OUTPUT_USAGE       " [--xyz file|-] [--pcd directory] [--record file] [--map file.pgm] [--cell mm]" \
+                                  " [--pose head:x,y,heading] [--radar directory] [--fps rate]"
+
+/**
+ * Where a tool sends what it ingests, from the command line options every ingesting tool takes:
+ *    --xyz <file | ->    Write clouds as "x y z" lines (default, to stdout)
+ *    --pcd <directory>   Write each cloud to its own PCD file instead
+ *    --record <file>     Record every sweep to a capture, for LidarReplay
+ *    --map <file.pgm>    Build an occupancy grid of the samples and write it here at the end
+ *    --cell <mm>         Grid cell size (default 20)
+ *    --pose <head>:<x>,<y>,<heading>
+ *                        Where a head sits in the map (mm) and where its 0 degrees points; repeat per head
+ *    --radar <directory> Draw the samples as the visualiser's radar, writing each frame to a PNG here
+ *    --fps <rate>        Most radar frames a second, in sample time (default 10)
+ */
+struct IngestOptions {
+    const char *xyzPath;
+    const char *pcdDirectory;
+    const char *recordPath;
+    const char *mapPath;
+    int cellSize;
+    std::vector<std::pair<int, GridPose>> poses;
+    const char *radarDirectory;
+    int frameRate;
+
+    IngestOptions();
+
+    int parse(int argc, char **argv, int i);
+};
+
+/**
+ * The sink, recorder, occupancy grid and radar view the options ask for, made before the pipeline, hooked up
+ * to it, and finished and reported on once it is done
+ */
+class IngestOutputs {
+    private:
+        const IngestOptions *options;
+        FILE *xyzFile;
+        std::unique_ptr<PointCloudSink> sink;
+        std::unique_ptr<CaptureWriter> recorder;
+        std::unique_ptr<OccupancyGrid> grid;
+        std::unique_ptr<RadarView> radar;
+        unsigned long frameFailures;
+
+        static void handleFrame(void *context, RadarView &view);
+
+    public:
+        IngestOutputs();
+        ~IngestOutputs();
+
+        bool open(const IngestOptions &options);
+        PointCloudSink *getSink() { return sink.get(); }
+        void attach(IngestPipeline &pipeline);
+        bool close();
+        void report(FILE *file);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "IngestPipeline.h"
+
+IngestPipeline::IngestPipeline(PointCloudSink *sink, bool binary)
+    : textParser(handleSample, this), frameDecoder(handleSample, this), assembler(handleSweep, this),
+      degrees(POLAR_DEGREE_STEPS)
+{
+    this->sink = sink;
+    this->recorder = NULL;
+    this->grid = NULL;
+    this->ring = NULL;
+    this->radar = NULL;
+    this->binary = binary;
+    this->bytes = 0;
+}
+
+void IngestPipeline::handleSample(void *context, int head, const PollSample &sample)
+{
+    ((IngestPipeline *)context)->addSample(head, sample);
+}
+
+void IngestPipeline::handleSweep(void *context, const Sweep &sweep)
+{
+    IngestPipeline *pipeline = (IngestPipeline *)context;
+    if (pipeline->recorder)
+        pipeline->recorder->write(sweep);
+    if (pipeline->ring)
+        pipeline->ring->push(sweep);
+
+    if (pipeline->sink) {
+        sweepToPointCloud(sweep, pipeline->cloud, pipeline->degrees);
+        pipeline->sink->write(pipeline->cloud);
+    }
+}
+
+/**
+ * Switch between text and binary input, e.g. after asking bigbrain to switch. Sweeps carry on; a partial
+ * sample or frame left from before is counted as malformed if it is ever continued.
+ */
+void IngestPipeline::setBinary(bool binary)
+{
+    this->binary = binary;
+}
+
+/**
+ * Record every sweep to a capture as well, or stop with NULL. The recorder stays the caller's to close.
+ */
+void IngestPipeline::setRecorder(CaptureWriter *recorder)
+{
+    this->recorder = recorder;
+}
+
+/**
+ * Map every sample into an occupancy grid as well, or stop with NULL. The grid stays the caller's.
+ */
+void IngestPipeline::setGrid(OccupancyGrid *grid)
+{
+    this->grid = grid;
+}
+
+/**
+ * Publish every sweep to a ring as well, or stop with NULL. This thread becomes the ring's writer; the ring
+ * stays the caller's.
+ */
+void IngestPipeline::setSweepRing(SweepRing *ring)
+{
+    this->ring = ring;
+}
+
+/**
+ * Draw every sample into a radar view as well, or stop with NULL. The view stays the caller's.
+ */
+void IngestPipeline::setRadar(RadarView *radar)
+{
+    this->radar = radar;
+}
+
+/**
+ * Take a sample that has already been decoded, e.g. by LidarComms
+ */
+void IngestPipeline::addSample(int head, const PollSample &sample)
+{
+    if (grid)
+        grid->addSample(head, sample);
+    if (radar)
+        radar->addSample(head, sample);
+    assembler.add(head, sample);
+}
+
+/**
+ * Take a chunk of bigbrain's output. Text samples are given timestamp (us); binary ones carry their own.
+ */
+void IngestPipeline::feed(const uint8_t *data, int length, uint32_t timestamp)
+{
+    bytes += length;
+    if (binary)
+        frameDecoder.feed(data, length);
+    else
+        textParser.feed(data, length, timestamp);
+}
+
+/**
+ * Pass on the sweeps in progress and flush the sink, e.g. at the end of the input
+ */
+void IngestPipeline::flush()
+{
+    assembler.flush();
+    if (sink)
+        sink->flush();
+}
@@ -0,0 +1,59 @@
+#ifndef INGESTPIPELINE_H
+#define INGESTPIPELINE_H
+
+#include <stdint.h>
+#include <SerialFrame.h>
+#include "SampleParser.h"
+#include "SweepAssembler.h"
+#include "PointCloud.h"
+#include "CaptureFile.h"
+#include "OccupancyGrid.h"
+#include "SweepRing.h"
+#include "RadarView.h"
+
+/**
+ * Bigbrain's output in, point clouds out: parses text samples or decodes binary frames, assembles each
+ * head's samples into sweeps and hands every sweep to the sink as a point cloud. Sweeps also go to the
+ * recorder and the sweep ring, and samples to the occupancy grid and the radar view, for whichever of them
+ * there are.
+ * Everything is sized up front, so nothing is allocated per byte, sample or sweep; it is big, so make one at
+ * startup and keep it.
+ */
+class IngestPipeline {
+    private:
+        SampleParser textParser;
+        SerialFrameDecoder frameDecoder;
+        SweepAssembler assembler;
+        PolarConverter degrees;
+        PointCloud cloud;
+        PointCloudSink *sink;
+        CaptureWriter *recorder;
+        OccupancyGrid *grid;
+        SweepRing *ring;
+        RadarView *radar;
+        bool binary;
+        unsigned long bytes;
+
+        static void handleSample(void *context, int head, const PollSample &sample);
+        static void handleSweep(void *context, const Sweep &sweep);
+
+    public:
+        IngestPipeline(PointCloudSink *sink, bool binary = false);
+
+        void setBinary(bool binary);
+        void setRecorder(CaptureWriter *recorder);
+        void setGrid(OccupancyGrid *grid);
+        void setSweepRing(SweepRing *ring);
+        void setRadar(RadarView *radar);
+        bool isBinary() { return binary; }
+        void feed(const uint8_t *data, int length, uint32_t timestamp = 0);
+        void addSample(int head, const PollSample &sample);
+        void flush();
+
+        unsigned long getBytes() { return bytes; }
+        const ParserStats &getParserStats() { return textParser.getStats(); }
+        const FrameStats &getFrameStats() { return frameDecoder.getStats(); }
+        const AssemblerStats &getAssemblerStats() { return assembler.getStats(); }
+};
+
+#endif
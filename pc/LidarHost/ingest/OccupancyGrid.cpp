@@ -0,0 +1,285 @@
+#include "OccupancyGrid.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+OccupancyGrid::OccupancyGrid(int cellSize, int maxTiles)
+{
+    this->cellSize = cellSize > 0 ? cellSize : GRID_CELL_SIZE;
+    this->cellsPerMm = 1.0f / this->cellSize;
+    this->maxTiles = maxTiles;
+    for (int i = 0; i < 256; i++)
+        poses[i] = { 0, 0, 0 };
+    reset();
+}
+
+/**
+ * Forget everything seen and free the tiles. Poses are kept.
+ */
+void OccupancyGrid::reset()
+{
+    blocks.clear();
+    index.assign(GRID_INDEX_START, 0);
+    indexMask = GRID_INDEX_START - 1;
+    tileCount = 0;
+    minTileX = minTileY = maxTileX = maxTileY = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void OccupancyGrid::setPose(int head, const GridPose &pose)
+{
+    poses[head & 0xFF] = pose;
+}
+
+uint32_t OccupancyGrid::hashTile(int32_t tileX, int32_t tileY)
+{
+    uint32_t hash = (uint32_t)tileX * 0x9E3779B1u ^ (uint32_t)tileY * 0x85EBCA77u;
+    return hash ^ (hash >> 15);
+}
+
+OccupancyGrid::Tile &OccupancyGrid::tileAt(int number)
+{
+    return blocks[number / GRID_TILES_PER_BLOCK][number % GRID_TILES_PER_BLOCK];
+}
+
+OccupancyGrid::Tile *OccupancyGrid::findTile(int32_t tileX, int32_t tileY)
+{
+    for (uint32_t slot = hashTile(tileX, tileY) & indexMask; index[slot] != 0; slot = (slot + 1) & indexMask) {
+        Tile &tile = tileAt(index[slot] - 1);
+        if (tile.tileX == tileX && tile.tileY == tileY)
+            return &tile;
+    }
+    return NULL;
+}
+
+/**
+ * Make a tile that findTile() didn't find, all unknown. Returns NULL once the grid has maxTiles.
+ */
+OccupancyGrid::Tile *OccupancyGrid::addTile(int32_t tileX, int32_t tileY)
+{
+    if (tileCount == maxTiles)
+        return NULL;
+    if ((tileCount + 1) * 2 > (int)index.size())
+        growIndex();
+    if (tileCount % GRID_TILES_PER_BLOCK == 0)
+        blocks.emplace_back(new Tile[GRID_TILES_PER_BLOCK]);
+
+    int number = tileCount++;
+    Tile &tile = tileAt(number);
+    tile.tileX = tileX;
+    tile.tileY = tileY;
+    memset(tile.cells, 0, sizeof(tile.cells));
+
+    uint32_t slot = hashTile(tileX, tileY) & indexMask;
+    while (index[slot] != 0)
+        slot = (slot + 1) & indexMask;
+    index[slot] = number + 1;
+
+    if (number == 0) {
+        minTileX = maxTileX = tileX;
+        minTileY = maxTileY = tileY;
+    } else {
+        minTileX = tileX < minTileX ? tileX : minTileX;
+        minTileY = tileY < minTileY ? tileY : minTileY;
+        maxTileX = tileX > maxTileX ? tileX : maxTileX;
+        maxTileY = tileY > maxTileY ? tileY : maxTileY;
+    }
+    return &tile;
+}
+
+/**
+ * Double the index, keeping it at most half full so probes stay short
+ */
+void OccupancyGrid::growIndex()
+{
+    index.assign(index.size() * 2, 0);
+    indexMask = index.size() - 1;
+    for (int number = 0; number < tileCount; number++) {
+        Tile &tile = tileAt(number);
+        uint32_t slot = hashTile(tile.tileX, tile.tileY) & indexMask;
+        while (index[slot] != 0)
+            slot = (slot + 1) & indexMask;
+        index[slot] = number + 1;
+    }
+}
+
+/**
+ * The cell holding a map coordinate (mm)
+ */
+int OccupancyGrid::toCell(float mm)
+{
+    return (int)floorf(mm * cellsPerMm);
+}
+
+/**
+ * Trace a reading taken by a head from its pose
+ */
+void OccupancyGrid::addSample(int head, const PollSample &sample)
+{
+    if (sample.distance <= 0) {
+        stats.rejected++;
+        return;
+    }
+
+    const GridPose &pose = poses[head & 0xFF];
+    bool hit = sample.distance <= GRID_MAX_RANGE;
+    float distance = hit ? (float)sample.distance : (float)GRID_MAX_RANGE;
+    float angle = (pose.heading + sample.angle) * ((float)M_PI / 180.0f);
+    if (!hit)
+        stats.noReturn++;
+
+    traceRay(toCell(pose.x), toCell(pose.y), toCell(pose.x + distance * cosf(angle)),
+        toCell(pose.y + distance * sinf(angle)), hit);
+}
+
+/**
+ * Trace a ray between two cells: the cells before the last are passed through and made more likely free,
+ * and the last made more likely occupied if the ray hit something there, or free if it ran out of range.
+ * This is a DDA in 32.32 fixed point rather than Bresenham: one cell per step along the longer axis, the
+ * other rounded to the nearest cell, so every step is two additions and none waits on a comparison with the
+ * last. Tiles are only looked up when the walk crosses into another one.
+ */
+void OccupancyGrid::traceRay(int fromX, int fromY, int toX, int toY, bool hit)
+{
+    int64_t dx = (int64_t)toX - fromX;
+    int64_t dy = (int64_t)toY - fromY;
+    int64_t steps = llabs(dx) > llabs(dy) ? llabs(dx) : llabs(dy);
+    int64_t stepX = steps > 0 ? dx * GRID_FIXED_ONE / steps : 0;
+    int64_t stepY = steps > 0 ? dy * GRID_FIXED_ONE / steps : 0;
+    int64_t fixedX = fromX * GRID_FIXED_ONE + GRID_FIXED_ONE / 2;
+    int64_t fixedY = fromY * GRID_FIXED_ONE + GRID_FIXED_ONE / 2;
+
+    Tile *tile = NULL;
+    int32_t tileX = 0;
+    int32_t tileY = 0;
+    bool looked = false;
+    unsigned long clipped = 0;
+
+    // Steps short of the end lose under a unit each to rounding, so the last lands on the end cell
+    for (int64_t i = 0; i <= steps; i++) {
+        int32_t x = (int32_t)(fixedX >> GRID_FIXED_BITS);
+        int32_t y = (int32_t)(fixedY >> GRID_FIXED_BITS);
+        fixedX += stepX;
+        fixedY += stepY;
+
+        int32_t cellTileX = x >> GRID_TILE_BITS;
+        int32_t cellTileY = y >> GRID_TILE_BITS;
+        if (!looked || cellTileX != tileX || cellTileY != tileY) {
+            tileX = cellTileX;
+            tileY = cellTileY;
+            tile = findTile(tileX, tileY);
+            if (!tile)
+                tile = addTile(tileX, tileY);
+            looked = true;
+        }
+        if (!tile) {
+            clipped++;
+            continue;
+        }
+
+        int8_t &cell = tile->cells[((y & GRID_TILE_MASK) << GRID_TILE_BITS) | (x & GRID_TILE_MASK)];
+        if (i == steps && hit) {
+            int value = cell + GRID_LOG_ODDS_HIT;
+            cell = value > GRID_LOG_ODDS_MAX ? GRID_LOG_ODDS_MAX : value;
+        } else {
+            int value = cell + GRID_LOG_ODDS_MISS;
+            cell = value < GRID_LOG_ODDS_MIN ? GRID_LOG_ODDS_MIN : value;
+        }
+    }
+
+    stats.rays++;
+    stats.hits += hit;
+    stats.cells += steps + 1 - clipped;
+    stats.clipped += clipped;
+}
+
+/**
+ * A cell's log-odds of being occupied, in 1/16ths; 0 for one never seen
+ */
+int OccupancyGrid::getLogOdds(int cellX, int cellY)
+{
+    Tile *tile = findTile(cellX >> GRID_TILE_BITS, cellY >> GRID_TILE_BITS);
+    if (!tile)
+        return 0;
+    return tile->cells[((cellY & GRID_TILE_MASK) << GRID_TILE_BITS) | (cellX & GRID_TILE_MASK)];
+}
+
+/**
+ * CELL_FREE, CELL_OCCUPIED, or CELL_UNKNOWN for a cell never seen or not yet seen enough to say
+ */
+int OccupancyGrid::getCellState(int cellX, int cellY)
+{
+    int logOdds = getLogOdds(cellX, cellY);
+    if (logOdds >= GRID_LOG_ODDS_OCCUPIED)
+        return CELL_OCCUPIED;
+    if (logOdds <= GRID_LOG_ODDS_FREE)
+        return CELL_FREE;
+    return CELL_UNKNOWN;
+}
+
+/**
+ * The cells covered by tiles, inclusive. Returns false while nothing has been seen.
+ */
+bool OccupancyGrid::getBounds(int &minCellX, int &minCellY, int &maxCellX, int &maxCellY)
+{
+    if (tileCount == 0)
+        return false;
+    minCellX = minTileX * GRID_TILE_SIZE;
+    minCellY = minTileY * GRID_TILE_SIZE;
+    maxCellX = maxTileX * GRID_TILE_SIZE + GRID_TILE_MASK;
+    maxCellY = maxTileY * GRID_TILE_SIZE + GRID_TILE_MASK;
+    return true;
+}
+
+/**
+ * Bytes held for tiles and their index
+ */
+size_t OccupancyGrid::getMemory()
+{
+    return blocks.size() * GRID_TILES_PER_BLOCK * sizeof(Tile) + index.size() * sizeof(index[0]);
+}
+
+/**
+ * Write the map's bounds as a binary PGM, north up, in map_server's shades: black for occupied, white for
+ * free, grey (205) for never seen. Returns false if the map is empty or the file can't be written in full.
+ */
+bool OccupancyGrid::writePgm(const char *path)
+{
+    int minCellX, minCellY, maxCellX, maxCellY;
+    if (!getBounds(minCellX, minCellY, maxCellX, maxCellY))
+        return false;
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    uint8_t shades[256];
+    for (int logOdds = -128; logOdds < 128; logOdds++) {
+        double occupied = 1.0 / (1.0 + exp(-logOdds / 16.0));
+        shades[(uint8_t)logOdds] = logOdds == 0 ? 205 : (uint8_t)lrint(255.0 * (1.0 - occupied));
+    }
+
+    int width = maxCellX - minCellX + 1;
+    std::vector<uint8_t> row(width);
+    fprintf(file, "P5\n# cell %d mm, origin %d %d mm\n%d %d\n255\n", cellSize, minCellX * cellSize,
+        minCellY * cellSize, width, maxCellY - minCellY + 1);
+
+    for (int y = maxCellY; y >= minCellY; y--) {
+        for (int32_t tileX = minTileX; tileX <= maxTileX; tileX++) {
+            uint8_t *out = &row[(tileX - minTileX) * GRID_TILE_SIZE];
+            Tile *tile = findTile(tileX, y >> GRID_TILE_BITS);
+            if (!tile) {
+                memset(out, 205, GRID_TILE_SIZE);
+                continue;
+            }
+            const int8_t *cells = &tile->cells[(y & GRID_TILE_MASK) << GRID_TILE_BITS];
+            for (int x = 0; x < GRID_TILE_SIZE; x++)
+                out[x] = shades[(uint8_t)cells[x]];
+        }
+        if (fwrite(row.data(), 1, width, file) != (size_t)width) {
+            fclose(file);
+            return false;
+        }
+    }
+    return fclose(file) == 0;
+}
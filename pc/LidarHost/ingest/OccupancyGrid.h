@@ -0,0 +1,108 @@
+#ifndef OCCUPANCYGRID_H
+#define OCCUPANCYGRID_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <PollStream.h>
+
+#define GRID_CELL_SIZE            20                // Default cell edge (mm)
+#define GRID_TILE_BITS            6                 // Tiles are 2^bits cells square
+#define GRID_TILE_SIZE            (1 << GRID_TILE_BITS)
+#define GRID_TILE_MASK            (GRID_TILE_SIZE - 1)
+#define GRID_TILES_PER_BLOCK      64                // Tiles allocated together as the map grows
+#define GRID_MAX_TILES            16384             // Default cap on tiles, bounding memory (4 KB each)
+#define GRID_INDEX_START          256               // Tile index slots to start with (power of 2); doubled as needed
+#define GRID_FIXED_BITS           32                // Fraction bits of the ray walk's fixed point
+#define GRID_FIXED_ONE            ((int64_t)1 << GRID_FIXED_BITS)
+#define GRID_MAX_RANGE            2000              // Longest reading believed (mm), the VL53L0X's; it reports 8190 when nothing returns
+
+#define GRID_LOG_ODDS_HIT         28                // Log-odds in 1/16ths: ln(0.85 / 0.15) for the cell a reading ends in...
+#define GRID_LOG_ODDS_MISS        -6                // ...ln(0.4 / 0.6) for each cell it passes through
+#define GRID_LOG_ODDS_MAX         56                // Clamped at 3.5 and -2.0, so a cell that changes can change its mind
+#define GRID_LOG_ODDS_MIN         -32
+#define GRID_LOG_ODDS_OCCUPIED    16                // At or above this a cell is occupied...
+#define GRID_LOG_ODDS_FREE        -16               // ...at or below this, free
+
+#define CELL_UNKNOWN              0
+#define CELL_FREE                 1
+#define CELL_OCCUPIED             2
+
+/**
+ * Where a sensor head sits in the map: its position (mm) and the map direction of its servo's 0 degrees
+ * (degrees, anticlockwise from x)
+ */
+struct GridPose {
+    float x;
+    float y;
+    float heading;
+};
+
+/**
+ * Stats kept by the grid
+ */
+struct GridStats {
+    unsigned long rays;
+    unsigned long cells;        // Cell updates, free and occupied
+    unsigned long hits;         // Rays that ended on something
+    unsigned long noReturn;     // Rays past GRID_MAX_RANGE, traced as free to it
+    unsigned long rejected;     // Samples with no distance
+    unsigned long clipped;      // Cell updates dropped because the map had reached its tile cap
+};
+
+/**
+ * Occupancy grid built up sample by sample. Each reading is traced from its head's pose with an integer
+ * DDA walk: every cell it passes through is made more likely free and the cell it ends in more likely
+ * occupied, in clamped log-odds. Cells live in tiles that are made the first time a ray touches them, found
+ * through a small hash index, so memory follows the area that has been seen rather than its bounding box.
+ * Tiles are allocated in blocks and never freed until reset(), so a map that has stopped growing allocates
+ * nothing.
+ */
+class OccupancyGrid {
+    struct Tile {
+        int32_t tileX;
+        int32_t tileY;
+        int8_t cells[GRID_TILE_SIZE * GRID_TILE_SIZE];
+    };
+
+    private:
+        int cellSize;
+        float cellsPerMm;
+        int maxTiles;
+        std::vector<std::unique_ptr<Tile[]>> blocks;
+        std::vector<int32_t> index;    // Tile number + 1 by hash, 0 for none
+        uint32_t indexMask;
+        int tileCount;
+        int32_t minTileX, minTileY, maxTileX, maxTileY;
+        GridPose poses[256];
+        GridStats stats;
+
+        static uint32_t hashTile(int32_t tileX, int32_t tileY);
+        Tile &tileAt(int number);
+        Tile *findTile(int32_t tileX, int32_t tileY);
+        Tile *addTile(int32_t tileX, int32_t tileY);
+        void growIndex();
+
+    public:
+        OccupancyGrid(int cellSize = GRID_CELL_SIZE, int maxTiles = GRID_MAX_TILES);
+
+        void setPose(int head, const GridPose &pose);
+        const GridPose &getPose(int head) { return poses[head & 0xFF]; }
+
+        void addSample(int head, const PollSample &sample);
+        void traceRay(int fromX, int fromY, int toX, int toY, bool hit);
+        void reset();
+
+        int toCell(float mm);
+        int getCellSize() { return cellSize; }
+        int getLogOdds(int cellX, int cellY);
+        int getCellState(int cellX, int cellY);
+        bool getBounds(int &minCellX, int &minCellY, int &maxCellX, int &maxCellY);
+        int getTileCount() { return tileCount; }
+        size_t getMemory();
+        const GridStats &getStats() { return stats; }
+
+        bool writePgm(const char *path);
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "PointCloud.h"
+
+/**
+ * Convert a sweep's (angle, distance) samples to points, through a batch converter for whole degrees
+ */
+void sweepToPointCloud(const Sweep &sweep, PointCloud &cloud, const PolarConverter &degrees)
+{
+    cloud.head = sweep.head;
+    cloud.direction = sweep.direction;
+    cloud.sequence = sweep.sequence;
+    cloud.complete = sweep.complete;
+    cloud.count = sweep.count;
+    cloud.startTime = sweep.count > 0 ? sweep.samples[0].timestamp : 0;
+    cloud.endTime = sweep.count > 0 ? sweep.samples[sweep.count - 1].timestamp : 0;
+
+    int32_t angles[SWEEP_MAX_SAMPLES];
+    int32_t distances[SWEEP_MAX_SAMPLES];
+    for (int i = 0; i < sweep.count; i++) {
+        angles[i] = sweep.samples[i].angle;
+        distances[i] = sweep.samples[i].distance;
+    }
+    degrees.convert(angles, distances, sweep.count, cloud.x, cloud.y);
+}
+
+XyzSink::XyzSink(FILE *file)
+{
+    this->file = file;
+}
+
+void XyzSink::write(const PointCloud &cloud)
+{
+    fprintf(file, "# sweep %d %u %d %d\n", cloud.head, cloud.sequence, cloud.direction, cloud.complete);
+    for (int i = 0; i < cloud.count; i++)
+        fprintf(file, "%.1f %.1f 0\n", cloud.x[i], cloud.y[i]);
+}
+
+void XyzSink::flush()
+{
+    fflush(file);
+}
+
+PcdSink::PcdSink(const char *directory)
+{
+    this->directory = directory;
+    this->failures = 0;
+}
+
+void PcdSink::write(const PointCloud &cloud)
+{
+    snprintf(path, sizeof(path), "%s/sweep-%d-%06u.pcd", directory, cloud.head, cloud.sequence);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        failures++;
+        return;
+    }
+
+    fprintf(file, "# .PCD v0.7 - head %d, %s sweep\n", cloud.head, cloud.direction < 0 ? "falling" : "rising");
+    fprintf(file, "VERSION 0.7\nFIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nCOUNT 1 1 1\n");
+    fprintf(file, "WIDTH %d\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS %d\nDATA ascii\n", cloud.count, cloud.count);
+    for (int i = 0; i < cloud.count; i++)
+        fprintf(file, "%.1f %.1f 0\n", cloud.x[i], cloud.y[i]);
+    fclose(file);
+}
+
+/**
+ * Clouds that couldn't be written, e.g. because the directory doesn't exist
+ */
+unsigned long PcdSink::getFailures()
+{
+    return failures;
+}
@@ -0,0 +1,71 @@
+#ifndef POINTCLOUD_H
+#define POINTCLOUD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "SweepAssembler.h"
+#include "PolarConverter.h"
+
+#define PCD_PATH_SIZE             512               // Longest path PcdSink writes to
+
+/**
+ * A sweep converted to Cartesian points in the sensor head's plane (mm), in the order they were sampled: x
+ * along the servo's 0 degree direction, y along 90 degrees. Coordinates are kept in an array each, as the
+ * batch converter writes them.
+ */
+struct PointCloud {
+    int head;
+    int direction;
+    uint32_t sequence;
+    bool complete;
+    uint32_t startTime;         // Timestamps of the first and last samples (us)
+    uint32_t endTime;
+    int count;
+    float x[SWEEP_MAX_SAMPLES];
+    float y[SWEEP_MAX_SAMPLES];
+};
+
+void sweepToPointCloud(const Sweep &sweep, PointCloud &cloud, const PolarConverter &degrees);
+
+/**
+ * Where point clouds go. Implement write() to send them anywhere; the cloud is only valid during the call.
+ */
+class PointCloudSink {
+    public:
+        virtual ~PointCloudSink() {}
+
+        virtual void write(const PointCloud &cloud) = 0;
+        virtual void flush() {}
+};
+
+/**
+ * Writes clouds as "x y z" lines (z is 0), each preceded by a "# sweep head sequence direction complete" line
+ */
+class XyzSink : public PointCloudSink {
+    private:
+        FILE *file;
+
+    public:
+        XyzSink(FILE *file);
+
+        void write(const PointCloud &cloud);
+        void flush();
+};
+
+/**
+ * Writes each cloud to its own ASCII PCD file, "<directory>/sweep-<head>-<sequence>.pcd", for PCL and friends
+ */
+class PcdSink : public PointCloudSink {
+    private:
+        const char *directory;
+        char path[PCD_PATH_SIZE];
+        unsigned long failures;
+
+    public:
+        PcdSink(const char *directory);
+
+        void write(const PointCloud &cloud);
+        unsigned long getFailures();
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "PolarConverter.h"
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POLAR_X86
+#endif
+
+/**
+ * Build the table for a circle of steps, and pick the fastest kernel this CPU has
+ */
+PolarConverter::PolarConverter(int steps)
+{
+    this->steps = steps > 0 ? steps : POLAR_DEGREE_STEPS;
+    cosines.resize(this->steps);
+    sines.resize(this->steps);
+
+    // With whole quarter turns, work out the first quarter and turn it, so the axes come out exactly 0 and 1
+    int quarter = this->steps % 4 == 0 ? this->steps / 4 : this->steps;
+    for (int i = 0; i < this->steps; i++) {
+        int turns = i / quarter;
+        double angle = 2.0 * M_PI * (i % quarter) / this->steps;
+        float c = (float)cos(angle);
+        float s = (float)sin(angle);
+        switch (turns) {
+            case 0: cosines[i] = c; sines[i] = s; break;
+            case 1: cosines[i] = -s; sines[i] = c; break;
+            case 2: cosines[i] = -c; sines[i] = -s; break;
+            default: cosines[i] = s; sines[i] = -c; break;
+        }
+    }
+    kernel = getBestKernel();
+}
+
+bool PolarConverter::isSupported(int kernel)
+{
+    switch (kernel) {
+        case POLAR_KERNEL_SCALAR:
+            return true;
+#ifdef POLAR_X86
+        case POLAR_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case POLAR_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+int PolarConverter::getBestKernel()
+{
+    for (int kernel = POLAR_KERNEL_AVX2; kernel > POLAR_KERNEL_SCALAR; kernel--) {
+        if (isSupported(kernel))
+            return kernel;
+    }
+    return POLAR_KERNEL_SCALAR;
+}
+
+/**
+ * Use a particular kernel, e.g. to compare them. Returns false, keeping the one in use, if this CPU can't run it.
+ */
+bool PolarConverter::setKernel(int kernel)
+{
+    if (!isSupported(kernel))
+        return false;
+    this->kernel = kernel;
+    return true;
+}
+
+/**
+ * An angle's place in the table, going round as many times as it takes either way
+ */
+int PolarConverter::wrap(int32_t angle) const
+{
+    int index = angle % steps;
+    return index < 0 ? index + steps : index;
+}
+
+/**
+ * Convert count samples, angles[i] and distances[i] to xs[i] and ys[i]
+ */
+void PolarConverter::convert(const int32_t *angles, const int32_t *distances, int count, float *xs, float *ys) const
+{
+    switch (kernel) {
+        case POLAR_KERNEL_AVX2:
+            convertAvx2(angles, distances, count, xs, ys);
+            break;
+        case POLAR_KERNEL_SSE2:
+            convertSse2(angles, distances, count, xs, ys);
+            break;
+        default:
+            convertScalar(angles, distances, count, xs, ys);
+            break;
+    }
+}
+
+void PolarConverter::convertScalar(const int32_t *angles, const int32_t *distances, int count, float *xs,
+    float *ys) const
+{
+    for (int i = 0; i < count; i++) {
+        int index = wrap(angles[i]);
+        float distance = (float)distances[i];
+        xs[i] = distance * cosines[index];
+        ys[i] = distance * sines[index];
+    }
+}
+
+#ifdef POLAR_X86
+
+/**
+ * Four at a time. Angles within a turn either side of the table are wrapped in the vector; any further out
+ * send their four back through wrap(). SSE2 has no gather, so the table is read one lane at a time.
+ */
+void PolarConverter::convertSse2(const int32_t *angles, const int32_t *distances, int count, float *xs,
+    float *ys) const
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi32(steps);
+    const __m128i last = _mm_set1_epi32(steps - 1);
+    const float *cosTable = cosines.data();
+    const float *sinTable = sines.data();
+    alignas(16) int32_t index[4];
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i angle = _mm_loadu_si128((const __m128i *)(angles + i));
+        angle = _mm_add_epi32(angle, _mm_and_si128(_mm_cmplt_epi32(angle, zero), limit));
+        angle = _mm_sub_epi32(angle, _mm_andnot_si128(_mm_cmplt_epi32(angle, limit), limit));
+        __m128i outside = _mm_or_si128(_mm_cmplt_epi32(angle, zero), _mm_cmpgt_epi32(angle, last));
+        _mm_store_si128((__m128i *)index, angle);
+        if (_mm_movemask_epi8(outside)) {
+            for (int lane = 0; lane < 4; lane++)
+                index[lane] = wrap(angles[i + lane]);
+        }
+
+        __m128 cosine = _mm_setr_ps(cosTable[index[0]], cosTable[index[1]], cosTable[index[2]], cosTable[index[3]]);
+        __m128 sine = _mm_setr_ps(sinTable[index[0]], sinTable[index[1]], sinTable[index[2]], sinTable[index[3]]);
+        __m128 distance = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(distances + i)));
+        _mm_storeu_ps(xs + i, _mm_mul_ps(distance, cosine));
+        _mm_storeu_ps(ys + i, _mm_mul_ps(distance, sine));
+    }
+    convertScalar(angles + i, distances + i, count - i, xs + i, ys + i);
+}
+
+/**
+ * Eight at a time, wrapped as convertSse2() does, with the table gathered
+ */
+__attribute__((target("avx2")))
+void PolarConverter::convertAvx2(const int32_t *angles, const int32_t *distances, int count, float *xs,
+    float *ys) const
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi32(steps);
+    const __m256i last = _mm256_set1_epi32(steps - 1);
+    const float *cosTable = cosines.data();
+    const float *sinTable = sines.data();
+    alignas(32) int32_t index[8];
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i angle = _mm256_loadu_si256((const __m256i *)(angles + i));
+        angle = _mm256_add_epi32(angle, _mm256_and_si256(_mm256_cmpgt_epi32(zero, angle), limit));
+        angle = _mm256_sub_epi32(angle, _mm256_and_si256(_mm256_cmpgt_epi32(angle, last), limit));
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(zero, angle), _mm256_cmpgt_epi32(angle, last));
+        if (_mm256_movemask_epi8(outside)) {
+            for (int lane = 0; lane < 8; lane++)
+                index[lane] = wrap(angles[i + lane]);
+            angle = _mm256_load_si256((const __m256i *)index);
+        }
+
+        __m256 cosine = _mm256_i32gather_ps(cosTable, angle, 4);
+        __m256 sine = _mm256_i32gather_ps(sinTable, angle, 4);
+        __m256 distance = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(distances + i)));
+        _mm256_storeu_ps(xs + i, _mm256_mul_ps(distance, cosine));
+        _mm256_storeu_ps(ys + i, _mm256_mul_ps(distance, sine));
+    }
+    convertScalar(angles + i, distances + i, count - i, xs + i, ys + i);
+}
+
+#else
+
+void PolarConverter::convertSse2(const int32_t *angles, const int32_t *distances, int count, float *xs,
+    float *ys) const
+{
+    convertScalar(angles, distances, count, xs, ys);
+}
+
+void PolarConverter::convertAvx2(const int32_t *angles, const int32_t *distances, int count, float *xs,
+    float *ys) const
+{
+    convertScalar(angles, distances, count, xs, ys);
+}
+
+#endif
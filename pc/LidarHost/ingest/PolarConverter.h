@@ -0,0 +1,50 @@
+#ifndef POLARCONVERTER_H
+#define POLARCONVERTER_H
+
+#include <stdint.h>
+#include <vector>
+
+#define POLAR_DEGREE_STEPS        360               // Table steps for servo angles, in whole degrees
+#define POLAR_STEPPER_STEPS       4096              // Table steps for swol v1.0's stepper positions (its STEPS_REV)
+
+#define POLAR_KERNEL_SCALAR       0                 // Kernels, slowest first; every one gives the same bits
+#define POLAR_KERNEL_SSE2         1
+#define POLAR_KERNEL_AVX2         2
+
+/**
+ * Converts batches of (angle, distance) samples to x and y, in struct-of-arrays form: angles, distances,
+ * xs and ys each their own array. Angles are steps around a circle, whole degrees for the servo or
+ * microsteps for the stepper, so sines and cosines come from a table built once instead of being worked out
+ * per sample. x is along step 0 and y along a quarter turn, in whatever unit the distances are (mm).
+ *
+ * On x86 the batch runs 8 samples at a time with AVX2 where the CPU has it, else 4 at a time with SSE2, else
+ * one at a time. Each point is the float distance times the table entry, rounded once, so every kernel gives
+ * exactly the same bits.
+ */
+class PolarConverter {
+    private:
+        int steps;
+        std::vector<float> cosines;
+        std::vector<float> sines;
+        int kernel;
+
+        void convertScalar(const int32_t *angles, const int32_t *distances, int count, float *xs, float *ys) const;
+        void convertSse2(const int32_t *angles, const int32_t *distances, int count, float *xs, float *ys) const;
+        void convertAvx2(const int32_t *angles, const int32_t *distances, int count, float *xs, float *ys) const;
+
+    public:
+        PolarConverter(int steps = POLAR_DEGREE_STEPS);
+
+        static bool isSupported(int kernel);
+        static int getBestKernel();
+        bool setKernel(int kernel);
+        int getKernel() const { return kernel; }
+        int getSteps() const { return steps; }
+
+        int wrap(int32_t angle) const;
+        float getCos(int32_t angle) const { return cosines[wrap(angle)]; }
+        float getSin(int32_t angle) const { return sines[wrap(angle)]; }
+        void convert(const int32_t *angles, const int32_t *distances, int count, float *xs, float *ys) const;
+};
+
+#endif
@@ -0,0 +1,506 @@
+#include "RadarView.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RADAR_PNG_CHUNK           32768             // Compressed bytes per IDAT chunk
+#define RADAR_MAX_MATCH           258               // Deflate's longest match
+
+static const uint8_t trailColour[RADAR_BYTES_PER_PIXEL] = { 50, 205, 50 };     // LimeGreen, as the visualiser's lines
+static const uint8_t pointColour[RADAR_BYTES_PER_PIXEL] = { 0, 128, 0 };       // Green, as its lone points
+
+RadarView::RadarView(int maxRange, int mmPerPixel, int trailLength)
+    : degrees(POLAR_DEGREE_STEPS)
+{
+    this->maxRange = maxRange < 1 ? RADAR_MAX_RANGE : maxRange;
+    mmPerPixel = mmPerPixel < 1 ? RADAR_MM_PER_PIXEL : mmPerPixel;
+    pixelsPerMm = 1.0f / mmPerPixel;
+
+    // A half circle: x either side of the origin, y only up
+    int radius = (this->maxRange + mmPerPixel - 1) / mmPerPixel;
+    width = radius * 2 + RADAR_MARGIN * 2;
+    height = radius + RADAR_MARGIN * 2;
+    stride = width * RADAR_BYTES_PER_PIXEL;
+    originX = width / 2;
+    originY = height - RADAR_MARGIN;
+    tilesX = (width + RADAR_TILE_SIZE - 1) >> RADAR_TILE_BITS;
+    tilesY = (height + RADAR_TILE_SIZE - 1) >> RADAR_TILE_BITS;
+
+    pixels.assign((size_t)stride * height, 0);
+    dirty.assign(tilesX * tilesY, 0);
+    dirtyTiles.reserve(tilesX * tilesY);
+    changedTiles.reserve(tilesX * tilesY);
+    trail.resize(trailLength < 1 ? RADAR_TRAIL : trailLength);
+
+    setFrameRate(RADAR_FRAME_RATE);
+    frameHandler = NULL;
+    context = NULL;
+    clear();
+}
+
+/**
+ * Cap frames at this many a second of sample time, or make none but those asked for with render() if 0
+ */
+void RadarView::setFrameRate(int frameRate)
+{
+    frameInterval = frameRate > 0 ? 1000000 / frameRate : 0;
+}
+
+/**
+ * Be called after every frame, e.g. to write it out
+ */
+void RadarView::setFrameHandler(handleFrame frameHandler, void *context)
+{
+    this->frameHandler = frameHandler;
+    this->context = context;
+}
+
+/**
+ * Empty the trail, forget every head and zero the stats; the next frame is all black
+ */
+void RadarView::clear()
+{
+    trailStart = 0;
+    trailCount = 0;
+    memset(hasLast, 0, sizeof(hasLast));
+    lastFrame = 0;
+    framed = false;
+    stats = RadarStats();
+    redraw();
+}
+
+/**
+ * Have the next frame draw everything, not just what has changed
+ */
+void RadarView::redraw()
+{
+    dirtyTiles.clear();
+    for (int i = 0; i < tilesX * tilesY; i++) {
+        dirty[i] = 1;
+        dirtyTiles.push_back(i);
+    }
+}
+
+/**
+ * Join a head's new point to its last, rubbing out the oldest segment if the trail is full
+ */
+void RadarView::addPoint(int head, float x, float y)
+{
+    int32_t pointX = originX - (int32_t)lrintf(x * pixelsPerMm);
+    int32_t pointY = originY - (int32_t)lrintf(y * pixelsPerMm);
+    head &= 0xFF;
+
+    int length = (int)trail.size();
+    if (trailCount == length) {
+        markDirty(trail[trailStart]);
+        trailStart = (trailStart + 1) % length;
+        trailCount--;
+    }
+    Segment &segment = trail[(trailStart + trailCount++) % length];
+    segment.x1 = hasLast[head] ? lastX[head] : pointX;
+    segment.y1 = hasLast[head] ? lastY[head] : pointY;
+    segment.x2 = pointX;
+    segment.y2 = pointY;
+    markDirty(segment);
+
+    lastX[head] = pointX;
+    lastY[head] = pointY;
+    hasLast[head] = true;
+}
+
+/**
+ * Add a sample. Readings out of range are dropped and break the head's line.
+ */
+void RadarView::addSample(int head, const PollSample &sample)
+{
+    stats.samples++;
+    if (sample.distance <= 0 || sample.distance >= maxRange) {
+        hasLast[head & 0xFF] = false;
+        stats.dropped++;
+    } else {
+        addPoint(head, sample.distance * degrees.getCos(sample.angle), sample.distance * degrees.getSin(sample.angle));
+    }
+    tick(sample.timestamp);
+}
+
+/**
+ * Add a whole sweep, converting its points as a batch
+ */
+void RadarView::addSweep(const SweepArrays &sweep)
+{
+    if (sweep.count <= 0)
+        return;
+
+    degrees.convert(sweep.angle, sweep.distance, sweep.count, xs, ys);
+    for (int i = 0; i < sweep.count; i++) {
+        if (sweep.distance[i] <= 0 || sweep.distance[i] >= maxRange) {
+            hasLast[sweep.head & 0xFF] = false;
+            stats.dropped++;
+        } else {
+            addPoint(sweep.head, xs[i], ys[i]);
+        }
+    }
+    stats.samples += sweep.count;
+    tick(sweep.timestamp[sweep.count - 1]);
+}
+
+/**
+ * Make a frame if there is anything to draw and the last was long enough ago. Timestamps are us and wrap.
+ */
+void RadarView::tick(uint32_t now)
+{
+    if (!frameInterval || dirtyTiles.empty())
+        return;
+    if (framed && now - lastFrame < frameInterval)
+        return;
+    framed = true;
+    lastFrame = now;
+    render();
+}
+
+/**
+ * A segment's pixels, less any off the view, as tiles. A segment is drawn 2 pixels thick, down or right.
+ */
+static bool segmentTiles(int32_t x1, int32_t y1, int32_t x2, int32_t y2, int width, int height, int &fromX, int &fromY,
+    int &toX, int &toY)
+{
+    int32_t left = x1 < x2 ? x1 : x2;
+    int32_t right = (x1 > x2 ? x1 : x2) + 1;
+    int32_t top = y1 < y2 ? y1 : y2;
+    int32_t bottom = (y1 > y2 ? y1 : y2) + 1;
+    if (right < 0 || bottom < 0 || left >= width || top >= height)
+        return false;
+
+    fromX = (left < 0 ? 0 : left) >> RADAR_TILE_BITS;
+    fromY = (top < 0 ? 0 : top) >> RADAR_TILE_BITS;
+    toX = (right >= width ? width - 1 : right) >> RADAR_TILE_BITS;
+    toY = (bottom >= height ? height - 1 : bottom) >> RADAR_TILE_BITS;
+    return true;
+}
+
+void RadarView::markDirty(const Segment &segment)
+{
+    int fromX, fromY, toX, toY;
+    if (!segmentTiles(segment.x1, segment.y1, segment.x2, segment.y2, width, height, fromX, fromY, toX, toY))
+        return;
+    for (int tileY = fromY; tileY <= toY; tileY++) {
+        for (int tileX = fromX; tileX <= toX; tileX++) {
+            int tile = tileY * tilesX + tileX;
+            if (!dirty[tile]) {
+                dirty[tile] = 1;
+                dirtyTiles.push_back(tile);
+            }
+        }
+    }
+}
+
+bool RadarView::touchesDirty(const Segment &segment)
+{
+    int fromX, fromY, toX, toY;
+    if (!segmentTiles(segment.x1, segment.y1, segment.x2, segment.y2, width, height, fromX, fromY, toX, toY))
+        return false;
+    for (int tileY = fromY; tileY <= toY; tileY++) {
+        for (int tileX = fromX; tileX <= toX; tileX++) {
+            if (dirty[tileY * tilesX + tileX])
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Bresenham, writing only pixels in tiles being redrawn. A segment from a point to itself is a lone point.
+ */
+void RadarView::drawSegment(const Segment &segment)
+{
+    int32_t x = segment.x1;
+    int32_t y = segment.y1;
+    int32_t dx = abs(segment.x2 - x);
+    int32_t dy = -abs(segment.y2 - y);
+    int stepX = x < segment.x2 ? 1 : -1;
+    int stepY = y < segment.y2 ? 1 : -1;
+    bool steep = -dy > dx;
+    const uint8_t *colour = dx == 0 && dy == 0 ? pointColour : trailColour;
+    int thickness = colour == pointColour ? 1 : 2;
+    int32_t error = dx + dy;
+
+    for (;;) {
+        for (int i = 0; i < thickness; i++) {
+            int32_t plotX = steep ? x + i : x;
+            int32_t plotY = steep ? y : y + i;
+            if (plotX < 0 || plotY < 0 || plotX >= width || plotY >= height)
+                continue;
+            if (!dirty[(plotY >> RADAR_TILE_BITS) * tilesX + (plotX >> RADAR_TILE_BITS)])
+                continue;
+            memcpy(&pixels[(size_t)plotY * stride + plotX * RADAR_BYTES_PER_PIXEL], colour, RADAR_BYTES_PER_PIXEL);
+        }
+        if (x == segment.x2 && y == segment.y2)
+            break;
+        int32_t doubled = error * 2;
+        if (doubled >= dy) {
+            error += dy;
+            x += stepX;
+        }
+        if (doubled <= dx) {
+            error += dx;
+            y += stepY;
+        }
+    }
+}
+
+/**
+ * Redraw the tiles changed since the last frame: clear them, then draw every trail segment crossing them,
+ * oldest first. Returns false, making no frame, if nothing has changed.
+ */
+bool RadarView::render()
+{
+    if (dirtyTiles.empty())
+        return false;
+
+    for (int32_t tile : dirtyTiles) {
+        int x = (tile % tilesX) << RADAR_TILE_BITS;
+        int y = (tile / tilesX) << RADAR_TILE_BITS;
+        int tileWidth = width - x < RADAR_TILE_SIZE ? width - x : RADAR_TILE_SIZE;
+        int tileHeight = height - y < RADAR_TILE_SIZE ? height - y : RADAR_TILE_SIZE;
+        for (int row = 0; row < tileHeight; row++)
+            memset(&pixels[(size_t)(y + row) * stride + x * RADAR_BYTES_PER_PIXEL], 0,
+                tileWidth * RADAR_BYTES_PER_PIXEL);
+    }
+
+    int length = (int)trail.size();
+    for (int i = 0; i < trailCount; i++) {
+        const Segment &segment = trail[(trailStart + i) % length];
+        if (touchesDirty(segment)) {
+            drawSegment(segment);
+            stats.segments++;
+        }
+    }
+
+    stats.tiles += dirtyTiles.size();
+    stats.frames++;
+    changedTiles.swap(dirtyTiles);
+    dirtyTiles.clear();
+    for (int32_t tile : changedTiles)
+        dirty[tile] = 0;
+
+    if (frameHandler)
+        frameHandler(context, *this);
+    return true;
+}
+
+/**
+ * Hand on each tile the last frame changed, e.g. to copy into a display's own buffer. Tiles on the right and
+ * bottom edges may be cut short. Returns the number of tiles.
+ */
+int RadarView::exportTiles(handleTile tileHandler, void *context)
+{
+    for (int32_t tile : changedTiles) {
+        int x = (tile % tilesX) << RADAR_TILE_BITS;
+        int y = (tile / tilesX) << RADAR_TILE_BITS;
+        int tileWidth = width - x < RADAR_TILE_SIZE ? width - x : RADAR_TILE_SIZE;
+        int tileHeight = height - y < RADAR_TILE_SIZE ? height - y : RADAR_TILE_SIZE;
+        tileHandler(context, x, y, tileWidth, tileHeight, &pixels[(size_t)y * stride + x * RADAR_BYTES_PER_PIXEL],
+            stride);
+    }
+    return (int)changedTiles.size();
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length)
+{
+    static struct CrcTable {
+        uint32_t entries[256];
+        CrcTable()
+        {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                    value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+                entries[i] = value;
+            }
+        }
+    } table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBigEndian(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static bool writeChunk(FILE *file, const char *type, const uint8_t *data, uint32_t length)
+{
+    uint8_t header[8];
+    putBigEndian(header, length);
+    memcpy(header + 4, type, 4);
+    uint8_t trailer[4];
+    putBigEndian(trailer, crc32(crc32(0, header + 4, 4), data, length));
+    return fwrite(header, 1, 8, file) == 8 && fwrite(data, 1, length, file) == length
+        && fwrite(trailer, 1, 4, file) == 4;
+}
+
+/**
+ * Deflate with the fixed Huffman codes, written out as IDAT chunks as they fill. The only matches looked for
+ * are runs of the same pixel, which is most of a radar frame.
+ */
+struct PngDeflater {
+    FILE *file;
+    uint8_t buffer[RADAR_PNG_CHUNK];
+    int used;
+    uint64_t bits;
+    int bitCount;
+    uint32_t adlerA, adlerB;
+    bool ok;
+
+    PngDeflater(FILE *file) : file(file), used(0), bits(0), bitCount(0), adlerA(1), adlerB(0), ok(true) {}
+
+    void putByte(uint8_t value)
+    {
+        buffer[used++] = value;
+        if (used == RADAR_PNG_CHUNK)
+            flush();
+    }
+
+    void flush()
+    {
+        if (used > 0)
+            ok = writeChunk(file, "IDAT", buffer, used) && ok;
+        used = 0;
+    }
+
+    void putBits(uint32_t value, int count)
+    {
+        bits |= (uint64_t)value << bitCount;
+        bitCount += count;
+        while (bitCount >= 8) {
+            putByte((uint8_t)bits);
+            bits >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    // Huffman codes go in most significant bit first
+    void putCode(uint32_t code, int count)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; i++)
+            reversed |= ((code >> i) & 1) << (count - 1 - i);
+        putBits(reversed, count);
+    }
+
+    void putSymbol(int symbol)
+    {
+        if (symbol < 144)
+            putCode(0x30 + symbol, 8);
+        else if (symbol < 256)
+            putCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            putCode(symbol - 256, 7);
+        else
+            putCode(0xC0 + symbol - 280, 8);
+    }
+
+    void putMatch(int length, int distanceCode)
+    {
+        static const uint16_t bases[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+            67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint8_t extras[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+            5, 5, 5, 5, 0 };
+        int code = 28;
+        while (bases[code] > length)
+            code--;
+        putSymbol(257 + code);
+        putBits(length - bases[code], extras[code]);
+        putCode(distanceCode, 5);
+    }
+
+    void sum(const uint8_t *data, int length)
+    {
+        while (length > 0) {
+            int run = length < 5552 ? length : 5552;
+            for (int i = 0; i < run; i++) {
+                adlerA += data[i];
+                adlerB += adlerA;
+            }
+            adlerA %= 65521;
+            adlerB %= 65521;
+            data += run;
+            length -= run;
+        }
+    }
+
+    // A row with its filter byte (none); matches stay within the row, a pixel back
+    void putRow(const uint8_t *row, int length)
+    {
+        static const uint8_t filter = 0;
+        sum(&filter, 1);
+        sum(row, length);
+        putSymbol(filter);
+
+        int i = 0;
+        while (i < length) {
+            int match = 0;
+            if (i >= RADAR_BYTES_PER_PIXEL) {
+                while (i + match < length && match < RADAR_MAX_MATCH
+                    && row[i + match] == row[i + match - RADAR_BYTES_PER_PIXEL])
+                    match++;
+            }
+            if (match >= 3) {
+                putMatch(match, RADAR_BYTES_PER_PIXEL - 1);
+                i += match;
+            } else {
+                putSymbol(row[i++]);
+            }
+        }
+    }
+};
+
+/**
+ * Write the framebuffer as a PNG, 8 bit RGB
+ */
+bool RadarView::writePng(FILE *file)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t header[13];
+    putBigEndian(header, width);
+    putBigEndian(header + 4, height);
+    header[8] = 8;              // Bits per channel
+    header[9] = 2;              // RGB
+    header[10] = 0;             // Deflate
+    header[11] = 0;             // Adaptive filtering
+    header[12] = 0;             // Not interlaced
+    if (fwrite(signature, 1, sizeof(signature), file) != sizeof(signature) || !writeChunk(file, "IHDR", header, 13))
+        return false;
+
+    PngDeflater deflater(file);
+    deflater.putByte(0x78);         // zlib: deflate, 32 KB window...
+    deflater.putByte(0x01);         // ...no dictionary, and a check that makes the pair a multiple of 31
+    deflater.putBits(1, 1);         // Final block...
+    deflater.putBits(1, 2);         // ...fixed codes
+    for (int y = 0; y < height; y++)
+        deflater.putRow(&pixels[(size_t)y * stride], stride);
+    deflater.putSymbol(256);
+    deflater.putBits(0, (8 - deflater.bitCount) & 7);
+    uint8_t adler[4];
+    putBigEndian(adler, (deflater.adlerB << 16) | deflater.adlerA);
+    for (int i = 0; i < 4; i++)
+        deflater.putByte(adler[i]);
+    deflater.flush();
+
+    return deflater.ok && writeChunk(file, "IEND", NULL, 0);
+}
+
+bool RadarView::writePng(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = writePng(file);
+    return fclose(file) == 0 && ok;
+}
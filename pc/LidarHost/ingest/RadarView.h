@@ -0,0 +1,107 @@
+#ifndef RADARVIEW_H
+#define RADARVIEW_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <PollStream.h>
+#include "PolarConverter.h"
+#include "SweepRing.h"
+
+#define RADAR_MAX_RANGE           2000              // Longest reading drawn (mm); the visualiser's was 2500
+#define RADAR_MM_PER_PIXEL        4                 // Default scale
+#define RADAR_MARGIN              50                // Border round the half circle (pixels)
+#define RADAR_TRAIL               360               // Samples kept on screen, as the visualiser's maxPoints
+#define RADAR_FRAME_RATE          10                // Default cap on frames a second
+#define RADAR_TILE_BITS           6                 // Dirty tiles are 2^bits pixels square
+#define RADAR_TILE_SIZE           (1 << RADAR_TILE_BITS)
+#define RADAR_BYTES_PER_PIXEL     3                 // RGB
+
+/**
+ * Stats kept by the view
+ */
+struct RadarStats {
+    unsigned long samples;
+    unsigned long dropped;      // Samples out of range, which break their head's line
+    unsigned long frames;
+    unsigned long tiles;        // Tiles redrawn, over all frames
+    unsigned long segments;     // Trail segments drawn into them
+};
+
+/**
+ * The visualiser's radar, drawn into a framebuffer kept in memory: each head's last samples joined up as a
+ * trail of lines round a half circle, 0 degrees to the left, with the oldest rubbed out as new ones come in.
+ * Samples only record what has changed, as the tiles their lines cover; nothing is drawn until a frame, at
+ * most frameRate of them a second by the samples' own timestamps. A frame clears just the tiles changed
+ * since the last one and draws into them the trail segments that cross them, so drawing follows frames and
+ * the area changed rather than samples, and what is on screen is always exactly the trail. After a frame
+ * the tiles it changed can be handed on, or the whole frame written out as a PNG.
+ *
+ * There is no window; it runs the same headless, so frames can be checked pixel for pixel. Everything is
+ * sized up front and nothing is allocated per sample or frame.
+ */
+class RadarView {
+    public:
+        typedef void (*handleFrame)(void *context, RadarView &view);
+        typedef void (*handleTile)(void *context, int x, int y, int width, int height, const uint8_t *pixels,
+            int stride);
+
+    private:
+        struct Segment {
+            int32_t x1, y1, x2, y2;
+        };
+
+        int maxRange;
+        float pixelsPerMm;
+        int width, height, stride;
+        int originX, originY;
+        int tilesX, tilesY;
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> dirty;         // Per tile: changed since the last frame
+        std::vector<int32_t> dirtyTiles;
+        std::vector<int32_t> changedTiles;  // Tiles the last frame changed
+        std::vector<Segment> trail;         // Ring, oldest at trailStart
+        int trailStart, trailCount;
+        int32_t lastX[256], lastY[256];
+        bool hasLast[256];
+        PolarConverter degrees;
+        float xs[SWEEP_MAX_SAMPLES];
+        float ys[SWEEP_MAX_SAMPLES];
+        uint32_t frameInterval;             // us
+        uint32_t lastFrame;
+        bool framed;
+        handleFrame frameHandler;
+        void *context;
+        RadarStats stats;
+
+        void addPoint(int head, float x, float y);
+        void markDirty(const Segment &segment);
+        bool touchesDirty(const Segment &segment);
+        void drawSegment(const Segment &segment);
+        void tick(uint32_t now);
+
+    public:
+        RadarView(int maxRange = RADAR_MAX_RANGE, int mmPerPixel = RADAR_MM_PER_PIXEL, int trailLength = RADAR_TRAIL);
+
+        void setFrameRate(int frameRate);
+        void setFrameHandler(handleFrame frameHandler, void *context);
+
+        void addSample(int head, const PollSample &sample);
+        void addSweep(const SweepArrays &sweep);
+        bool render();
+        void redraw();
+        void clear();
+
+        int getWidth() { return width; }
+        int getHeight() { return height; }
+        int getStride() { return stride; }
+        const uint8_t *getPixels() { return pixels.data(); }
+        int getChangedTileCount() { return (int)changedTiles.size(); }
+        int exportTiles(handleTile tileHandler, void *context);
+        const RadarStats &getStats() { return stats; }
+
+        bool writePng(FILE *file);
+        bool writePng(const char *path);
+};
+
+#endif
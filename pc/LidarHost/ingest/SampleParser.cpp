@@ -0,0 +1,104 @@
+#include "SampleParser.h"
+
+static const char POLL_TAG[] = "[POLL:";
+static const int POLL_TAG_LENGTH = sizeof(POLL_TAG) - 1;
+
+SampleParser::SampleParser(handleSample sampleHandler, void *context)
+{
+    this->sampleHandler = sampleHandler;
+    this->context = context;
+    reset();
+}
+
+/**
+ * Forget any partial sample and zero the stats
+ */
+void SampleParser::reset()
+{
+    state = HUNT;
+    tagMatched = 0;
+    stats = ParserStats();
+}
+
+/**
+ * Give up on the current sample; the byte that ended it may start the next one
+ */
+void SampleParser::restart(uint8_t c)
+{
+    if (c == '[') {
+        state = TAG;
+        tagMatched = 1;
+    } else {
+        state = HUNT;
+    }
+}
+
+/**
+ * Parse a chunk of text. Samples carry no time of their own in text, so they are given timestamp, e.g. when
+ * the chunk was read.
+ */
+void SampleParser::feed(const uint8_t *data, int length, uint32_t timestamp)
+{
+    for (const uint8_t *end = data + length; data < end; data++) {
+        uint8_t c = *data;
+        switch (state) {
+            case HUNT:
+                if (c == '[') {
+                    state = TAG;
+                    tagMatched = 1;
+                }
+            break;
+
+            case TAG:
+                if (c != (uint8_t)POLL_TAG[tagMatched]) {
+                    restart(c);
+                    break;
+                }
+                if (++tagMatched == POLL_TAG_LENGTH) {
+                    state = FIELD;
+                    field = 0;
+                    digits = 0;
+                    values[0] = 0;
+                }
+            break;
+
+            case FIELD:
+            case FRACTION:
+                if (c >= '0' && c <= '9') {
+                    if (state == FIELD) {
+                        if (++digits > PARSER_MAX_DIGITS) {
+                            stats.malformed++;
+                            state = HUNT;
+                            break;
+                        }
+                        values[field] = values[field] * 10 + (c - '0');
+                    }
+                } else if (c == '.' && state == FIELD && field == 1 && digits > 0) {
+                    state = FRACTION;
+                } else if (c == ',' && digits > 0 && field < 2) {
+                    state = FIELD;
+                    field++;
+                    digits = 0;
+                    values[field] = 0;
+                } else if (c == ']' && digits > 0 && field >= 1) {
+                    PollSample sample;
+                    sample.angle = values[0];
+                    sample.distance = values[1];
+                    sample.timestamp = timestamp;
+                    stats.samples++;
+                    if (sampleHandler)
+                        sampleHandler(context, field == 2 ? values[2] : 0, sample);
+                    state = HUNT;
+                } else {
+                    stats.malformed++;
+                    restart(c);
+                }
+            break;
+        }
+    }
+}
+
+const ParserStats &SampleParser::getStats()
+{
+    return stats;
+}
@@ -0,0 +1,48 @@
+#ifndef SAMPLEPARSER_H
+#define SAMPLEPARSER_H
+
+#include <stdint.h>
+#include <PollStream.h>
+
+#define PARSER_MAX_DIGITS         9                 // Digits accepted in a field before the sample is treated as garbage
+
+/**
+ * Stats kept by the parser
+ */
+struct ParserStats {
+    unsigned long samples;
+    unsigned long malformed;    // Started as "[POLL:" but didn't finish as a sample
+};
+
+/**
+ * Incremental parser for bigbrain's text output, "[POLL:angle,distance]" or "[POLL:angle,distance,head]".
+ * Feed it bytes as they arrive, in any sized chunks; newlines, status text such as "[RING:...]" and any other
+ * noise between samples are skipped. A distance with a fraction, as the visualiser accepts, is cut to whole mm.
+ * Nothing is allocated and every byte is looked at once.
+ */
+class SampleParser {
+    typedef void (*handleSample)(void *context, int head, const PollSample &sample);
+
+    private:
+        enum State { HUNT, TAG, FIELD, FRACTION };
+
+        State state;
+        int tagMatched;
+        int field;
+        int digits;
+        int values[3];
+        handleSample sampleHandler;
+        void *context;
+        ParserStats stats;
+
+        void restart(uint8_t c);
+
+    public:
+        SampleParser(handleSample sampleHandler, void *context = 0);
+
+        void feed(const uint8_t *data, int length, uint32_t timestamp = 0);
+        const ParserStats &getStats();
+        void reset();
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "SweepAssembler.h"
+#include <string.h>
+
+SweepAssembler::SweepAssembler(handleSweep sweepHandler, void *context)
+{
+    this->sweepHandler = sweepHandler;
+    this->context = context;
+    reset();
+}
+
+/**
+ * Drop any sweeps in progress, forget every head and zero the stats
+ */
+void SweepAssembler::reset()
+{
+    memset(slotByHead, 0, sizeof(slotByHead));
+    headCount = 0;
+    stats = AssemblerStats();
+}
+
+/**
+ * Hand a sweep over and start the head's next one in the same direction
+ */
+void SweepAssembler::pass(Sweep &sweep, bool complete)
+{
+    sweep.complete = complete;
+    if (complete)
+        stats.sweeps++;
+    else
+        stats.partial++;
+
+    if (sweepHandler)
+        sweepHandler(context, sweep);
+
+    sweep.sequence++;
+    sweep.count = 0;
+}
+
+/**
+ * The servo has turned round: pass on the sweep up to the first sample that fell short, and start the next
+ * one, going the other way, with those samples
+ */
+void SweepAssembler::turn(HeadSweep &current)
+{
+    Sweep &sweep = current.sweep;
+    int count = sweep.count;
+    sweep.count = current.turnIndex;
+    pass(sweep, true);
+
+    sweep.count = count - current.turnIndex;
+    memmove(sweep.samples, sweep.samples + current.turnIndex, sweep.count * sizeof(PollSample));
+    sweep.direction = -sweep.direction;
+    current.furthest = current.turnFurthest;
+    current.turnSamples = 0;
+}
+
+/**
+ * Add a sample from a head, passing on its sweep if the servo has turned round or there is no room left
+ */
+void SweepAssembler::add(int head, const PollSample &sample)
+{
+    head &= 0xFF;
+    int slot = slotByHead[head];
+    if (!slot) {
+        if (headCount == ASSEMBLER_MAX_HEADS) {
+            stats.dropped++;
+            return;
+        }
+        slot = ++headCount;
+        slotByHead[head] = slot;
+
+        HeadSweep &added = heads[slot - 1];
+        added.sweep.head = head;
+        added.sweep.direction = 0;
+        added.sweep.sequence = 0;
+        added.sweep.count = 0;
+        added.furthest = sample.angle;
+        added.turnSamples = 0;
+    }
+
+    HeadSweep &current = heads[slot - 1];
+    Sweep &sweep = current.sweep;
+    stats.samples++;
+
+    if (sweep.count == SWEEP_MAX_SAMPLES) {
+        pass(sweep, false);
+        current.turnSamples = 0;
+    }
+
+    int delta = sample.angle - current.furthest;
+    if (sweep.direction == 0) {
+        if (delta != 0) {
+            sweep.direction = delta > 0 ? 1 : -1;
+            current.furthest = sample.angle;
+        }
+    } else if (delta * sweep.direction > 0) {
+        // Further on, so anything that fell short was only late
+        current.furthest = sample.angle;
+        current.turnSamples = 0;
+    } else if (delta != 0) {
+        if (current.turnSamples++ == 0) {
+            current.turnIndex = sweep.count;
+            current.turnFurthest = sample.angle;
+        } else if ((sample.angle - current.turnFurthest) * sweep.direction < 0) {
+            current.turnFurthest = sample.angle;
+        }
+    }
+
+    sweep.samples[sweep.count++] = sample;
+    if (current.turnSamples == ASSEMBLER_TURN_SAMPLES)
+        turn(current);
+}
+
+/**
+ * Pass on every sweep in progress, e.g. at the end of the input
+ */
+void SweepAssembler::flush()
+{
+    for (int i = 0; i < headCount; i++) {
+        if (heads[i].sweep.count > 0)
+            pass(heads[i].sweep, false);
+    }
+}
+
+const AssemblerStats &SweepAssembler::getStats()
+{
+    return stats;
+}
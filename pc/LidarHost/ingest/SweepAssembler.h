@@ -0,0 +1,72 @@
+#ifndef SWEEPASSEMBLER_H
+#define SWEEPASSEMBLER_H
+
+#include <stdint.h>
+#include <PollStream.h>
+
+#define SWEEP_MAX_SAMPLES         1024              // Samples held per sweep; a longer one is passed on in pieces
+#define ASSEMBLER_MAX_HEADS       8                 // Sensor heads assembled at once
+#define ASSEMBLER_TURN_SAMPLES    3                 // Samples in a row short of the sweep's furthest angle that turn it round
+
+/**
+ * One pass of a sensor head's servo across its arc
+ */
+struct Sweep {
+    int head;
+    int direction;              // 1 while the angle rises, -1 while it falls, 0 before it has moved
+    uint32_t sequence;          // Sweeps passed on from this head before this one
+    bool complete;              // Ended by the servo turning round, rather than cut short
+    int count;
+    PollSample samples[SWEEP_MAX_SAMPLES];
+};
+
+/**
+ * Stats kept by the assembler
+ */
+struct AssemblerStats {
+    unsigned long samples;
+    unsigned long sweeps;       // Complete sweeps passed on
+    unsigned long partial;      // Sweeps passed on cut short: overlong, or flushed
+    unsigned long dropped;      // Samples from heads past ASSEMBLER_MAX_HEADS
+};
+
+/**
+ * Splits each head's samples into sweeps where the servo turns round, as swol's sweep planner does when it
+ * reaches either end of its arc. Samples carry no direction, so it is read from the angles against the
+ * furthest the sweep has reached: repeated angles (dwell, oversampling) stay in the sweep, and it only turns
+ * round once ASSEMBLER_TURN_SAMPLES in a row have fallen short, when the next sweep starts from the first of
+ * them. One late or out of order sample is followed by one that goes further again, so stays where it is.
+ * Sweeps are built in place and handed over by reference, so the handler must copy anything it keeps.
+ */
+class SweepAssembler {
+    typedef void (*handleSweep)(void *context, const Sweep &sweep);
+
+    struct HeadSweep {
+        int furthest;           // Furthest angle in the sweep's direction
+        int turnSamples;        // Samples since then that fell short of it
+        int turnIndex;          // Where the first of them is in the sweep
+        int turnFurthest;       // Furthest of them the other way
+        Sweep sweep;
+    };
+
+    private:
+        HeadSweep heads[ASSEMBLER_MAX_HEADS];
+        uint8_t slotByHead[256];        // Slot + 1, 0 for none
+        int headCount;
+        handleSweep sweepHandler;
+        void *context;
+        AssemblerStats stats;
+
+        void pass(Sweep &sweep, bool complete);
+        void turn(HeadSweep &current);
+
+    public:
+        SweepAssembler(handleSweep sweepHandler, void *context = 0);
+
+        void add(int head, const PollSample &sample);
+        void flush();
+        const AssemblerStats &getStats();
+        void reset();
+};
+
+#endif
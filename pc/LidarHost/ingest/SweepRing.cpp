@@ -0,0 +1,168 @@
+#include "SweepRing.h"
+#include <string.h>
+
+SweepRing::SweepRing(uint32_t capacity)
+    : published(0), retries(0)
+{
+    this->capacity = capacity < 2 ? 2 : capacity;
+    slots.reset(new Slot[this->capacity]);
+    for (uint32_t i = 0; i < this->capacity; i++) {
+        slots[i].version.store(0, std::memory_order_relaxed);
+        slots[i].head.store(-1, std::memory_order_relaxed);
+        slots[i].complete.store(false, std::memory_order_relaxed);
+        slots[i].sweep.position = 0;
+        slots[i].sweep.count = 0;
+    }
+    filling = NULL;
+    fillingVersion = 0;
+}
+
+/**
+ * Writer only. Start the next sweep in the slot after the newest, writing over the oldest; readers stop
+ * getting that one as soon as this is called. Calling it again before finish() starts the sweep over.
+ */
+SweepArrays &SweepRing::begin(int head, int direction, uint32_t sequence)
+{
+    uint64_t position = published.load(std::memory_order_relaxed);
+    if (!filling) {
+        filling = &slots[position % capacity];
+        fillingVersion = filling->version.load(std::memory_order_relaxed) + 1;
+        filling->version.store(fillingVersion, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    SweepArrays &sweep = filling->sweep;
+    sweep.position = position;
+    sweep.head = head;
+    sweep.direction = direction;
+    sweep.sequence = sequence;
+    sweep.complete = false;
+    sweep.count = 0;
+    filling->head.store(head, std::memory_order_relaxed);
+    filling->complete.store(false, std::memory_order_relaxed);
+    return sweep;
+}
+
+/**
+ * Writer only. Add a sample to the sweep begun. Returns false if none was begun or it is full.
+ */
+bool SweepRing::add(const PollSample &sample, uint8_t quality)
+{
+    if (!filling || filling->sweep.count == SWEEP_MAX_SAMPLES)
+        return false;
+
+    SweepArrays &sweep = filling->sweep;
+    int i = sweep.count++;
+    sweep.angle[i] = sample.angle;
+    sweep.distance[i] = sample.distance;
+    sweep.timestamp[i] = sample.timestamp;
+    sweep.quality[i] = quality;
+    return true;
+}
+
+/**
+ * Writer only. Publish the sweep begun, making it the newest readers get.
+ */
+void SweepRing::finish(bool complete)
+{
+    if (!filling)
+        return;
+
+    filling->sweep.complete = complete;
+    filling->complete.store(complete, std::memory_order_relaxed);
+    filling->version.store(fillingVersion + 1, std::memory_order_release);
+    published.store(filling->sweep.position + 1, std::memory_order_release);
+    filling = NULL;
+}
+
+/**
+ * Writer only. Copy a sweep from the assembler in and publish it.
+ */
+void SweepRing::push(const Sweep &sweep)
+{
+    begin(sweep.head, sweep.direction, sweep.sequence);
+    for (int i = 0; i < sweep.count; i++)
+        add(sweep.samples[i], qualityOf(sweep.samples[i]));
+    finish(sweep.complete);
+}
+
+/**
+ * The protocol carries no quality, so it is all or nothing: none for a sample with no distance or the sensor's
+ * no-return reading
+ */
+uint8_t SweepRing::qualityOf(const PollSample &sample)
+{
+    return sample.distance <= 0 || sample.distance >= SWEEP_NO_RETURN ? QUALITY_NONE : QUALITY_FULL;
+}
+
+/**
+ * Copy out the sweep published at position. Returns false if it hasn't been published yet or has since been
+ * written over, including while it was being copied.
+ */
+bool SweepRing::read(uint64_t position, SweepArrays &out)
+{
+    if (position >= published.load(std::memory_order_acquire))
+        return false;
+
+    const Slot &slot = slots[position % capacity];
+    uint32_t before = slot.version.load(std::memory_order_acquire);
+    if (before & 1)
+        return false;
+
+    // The writer may be writing over this as it is copied; what comes out is only kept if the version held
+    const SweepArrays &sweep = slot.sweep;
+    out.position = sweep.position;
+    out.head = sweep.head;
+    out.direction = sweep.direction;
+    out.sequence = sweep.sequence;
+    out.complete = sweep.complete;
+    int count = sweep.count;
+    count = count < 0 ? 0 : count > SWEEP_MAX_SAMPLES ? SWEEP_MAX_SAMPLES : count;
+    memcpy(out.angle, sweep.angle, count * sizeof(out.angle[0]));
+    memcpy(out.distance, sweep.distance, count * sizeof(out.distance[0]));
+    memcpy(out.timestamp, sweep.timestamp, count * sizeof(out.timestamp[0]));
+    memcpy(out.quality, sweep.quality, count * sizeof(out.quality[0]));
+    out.count = count;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.version.load(std::memory_order_relaxed) == before && out.position == position;
+}
+
+/**
+ * Copy out the newest complete sweep published, or the newest from head. Sweeps cut short, e.g. by a head
+ * restarting, are passed over unless partial is set. Returns false if there is none in the ring.
+ */
+bool SweepRing::readLatest(SweepArrays &out, int head, bool partial)
+{
+    for (;;) {
+        uint64_t newest = published.load(std::memory_order_acquire);
+        uint64_t oldest = newest > capacity - 1 ? newest - (capacity - 1) : 0;
+        bool lapped = false;
+
+        for (uint64_t position = newest; position > oldest; position--) {
+            // Pass over sweeps that aren't wanted without copying them, going by the slot's head and completeness
+            // as they were under an even version that held while they were read; read() settles the rest
+            const Slot &slot = slots[(position - 1) % capacity];
+            uint32_t version = slot.version.load(std::memory_order_acquire);
+            int slotHead = slot.head.load(std::memory_order_relaxed);
+            bool slotComplete = slot.complete.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if ((version & 1) || slot.version.load(std::memory_order_relaxed) != version) {
+                lapped = true;
+                break;
+            }
+            if ((head >= 0 && slotHead != head) || (!partial && !slotComplete))
+                continue;
+
+            if (!read(position - 1, out)) {
+                lapped = true;
+                break;
+            }
+            if ((head < 0 || out.head == head) && (partial || out.complete))
+                return true;
+        }
+        if (!lapped)
+            return false;
+        retries.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef SWEEPRING_H
+#define SWEEPRING_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include "SweepAssembler.h"
+
+#define SWEEP_RING_SLOTS          8                 // Default sweeps kept; the oldest is written over
+#define SWEEP_RING_CACHE_LINE     64                // Keeps each slot's version, and the published count, on a line of its own
+#define SWEEP_NO_RETURN           8190              // What the VL53L0X reads when nothing came back
+
+#define QUALITY_NONE              0                 // Sample quality: no return, or no reading at all...
+#define QUALITY_FULL              255               // ...a reading the sensor stood behind
+
+/**
+ * A sweep laid out a field to an array, so a pass over one field, e.g. converting angles and distances,
+ * reads only that field's memory
+ */
+struct SweepArrays {
+    uint64_t position;          // Sweeps published to the ring before this one
+    int head;
+    int direction;              // As Sweep
+    uint32_t sequence;          // The head's own count, as Sweep
+    bool complete;
+    int count;
+    int32_t angle[SWEEP_MAX_SAMPLES];
+    int32_t distance[SWEEP_MAX_SAMPLES];
+    uint32_t timestamp[SWEEP_MAX_SAMPLES];
+    uint8_t quality[SWEEP_MAX_SAMPLES];
+};
+
+/**
+ * Fixed-capacity ring of the latest sweeps, all allocated when it is made. One thread writes a sweep at a
+ * time into the slot after the newest; any number of others read the newest complete sweep, or any older one
+ * still held, without locks. Each slot carries a version that is odd while it is being written: readers copy
+ * a slot out and keep the copy only if the version was even and unchanged throughout, which can only fail
+ * when the writer has come all the way round the ring to that slot in the meantime.
+ */
+class SweepRing {
+    struct Slot {
+        alignas(SWEEP_RING_CACHE_LINE) std::atomic<uint32_t> version;
+        std::atomic<int> head;              // Copies of the sweep's, for readLatest() to pass over it by
+        std::atomic<bool> complete;
+        SweepArrays sweep;
+    };
+
+    private:
+        std::unique_ptr<Slot[]> slots;
+        uint32_t capacity;
+        alignas(SWEEP_RING_CACHE_LINE) std::atomic<uint64_t> published;
+        std::atomic<unsigned long> retries;
+        alignas(SWEEP_RING_CACHE_LINE) Slot *filling;   // Writer only
+        uint32_t fillingVersion;
+
+    public:
+        SweepRing(uint32_t capacity = SWEEP_RING_SLOTS);
+
+        // Writer
+        SweepArrays &begin(int head, int direction, uint32_t sequence);
+        bool add(const PollSample &sample, uint8_t quality = QUALITY_FULL);
+        void finish(bool complete);
+        void push(const Sweep &sweep);
+        static uint8_t qualityOf(const PollSample &sample);
+
+        // Readers
+        bool read(uint64_t position, SweepArrays &out);
+        bool readLatest(SweepArrays &out, int head = -1, bool partial = false);
+        uint64_t getPublished() const { return published.load(std::memory_order_acquire); }
+        unsigned long getRetries() const { return retries.load(std::memory_order_relaxed); }
+        uint32_t getCapacity() const { return capacity; }
+};
+
+#endif
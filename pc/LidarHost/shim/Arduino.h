@@ -0,0 +1,69 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/**
+ * Host stand-in for the ESP32 Arduino core.
+ * Provides only what the LidarComms/LidarState libraries use, so they can be built and profiled on Linux.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IPAddress.h"
+
+#define HIGH                      0x1
+#define LOW                       0x0
+#define INPUT                     0x01
+#define OUTPUT                    0x03
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+/**
+ * Anything text can be printed to, as the core's Print: subclasses only supply write
+ */
+class Print {
+    public:
+        virtual ~Print() {}
+
+        virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+        size_t write(uint8_t value) { return write(&value, 1); }
+
+        int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+        size_t print(const char *text);
+        size_t print(int value);
+        size_t print(const IPAddress &ip);
+        size_t println();
+        size_t println(const char *text);
+        size_t println(int value);
+        size_t println(const IPAddress &ip);
+};
+
+class HostSerial : public Print {
+    private:
+        bool quiet;
+
+    public:
+        HostSerial();
+
+        void begin(unsigned long baud);
+        void setQuiet(bool quiet);
+
+        using Print::write;
+        size_t write(const uint8_t *buffer, size_t size) override;
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,251 @@
+#include "Arduino.h"
+#include "WiFi.h"
+#include <stdarg.h>
+#include <chrono>
+#include <thread>
+
+HostSerial Serial;
+HostWiFi WiFi;
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros()
+{
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield()
+{
+    std::this_thread::yield();
+}
+
+// There are no pins on the host
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+// -------------------------------
+// IPAddress
+// -------------------------------
+
+IPAddress::IPAddress()
+{
+    address.dword = 0;
+}
+
+IPAddress::IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+    address.bytes[0] = a;
+    address.bytes[1] = b;
+    address.bytes[2] = c;
+    address.bytes[3] = d;
+}
+
+IPAddress::IPAddress(uint32_t address)
+{
+    this->address.dword = address;
+}
+
+IPAddress::operator uint32_t() const
+{
+    return address.dword;
+}
+
+bool IPAddress::operator==(const IPAddress &other) const
+{
+    return address.dword == other.address.dword;
+}
+
+bool IPAddress::operator!=(const IPAddress &other) const
+{
+    return address.dword != other.address.dword;
+}
+
+uint8_t IPAddress::operator[](int index) const
+{
+    return address.bytes[index];
+}
+
+uint8_t &IPAddress::operator[](int index)
+{
+    return address.bytes[index];
+}
+
+size_t IPAddress::toChars(char *buffer, size_t size) const
+{
+    return snprintf(buffer, size, "%u.%u.%u.%u", address.bytes[0], address.bytes[1], address.bytes[2], address.bytes[3]);
+}
+
+// -------------------------------
+// Serial
+// -------------------------------
+
+HostSerial::HostSerial()
+{
+    quiet = false;
+}
+
+void HostSerial::begin(unsigned long) {}
+
+/**
+ * Silence all output, e.g. while benchmarking
+ */
+void HostSerial::setQuiet(bool quiet)
+{
+    this->quiet = quiet;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (quiet)
+        return size;
+
+    return fwrite(buffer, 1, size, stdout);
+}
+
+// -------------------------------
+// Print
+// -------------------------------
+
+/**
+ * Formatted into a buffer and written in one go, as the core does; longer output is cut short
+ */
+int Print::printf(const char *format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof text, format, args);
+    va_end(args);
+    if (length < 0)
+        return 0;
+    if (length >= (int)sizeof text)
+        length = sizeof text - 1;
+    return (int)write((const uint8_t *)text, length);
+}
+
+size_t Print::print(const char *text)
+{
+    return write((const uint8_t *)text, strlen(text));
+}
+
+size_t Print::print(int value)
+{
+    return printf("%d", value);
+}
+
+size_t Print::print(const IPAddress &ip)
+{
+    char text[16];
+    ip.toChars(text, sizeof text);
+    return print(text);
+}
+
+size_t Print::println()
+{
+    return print("\n");
+}
+
+size_t Print::println(const char *text)
+{
+    return print(text) + println();
+}
+
+size_t Print::println(int value)
+{
+    return print(value) + println();
+}
+
+size_t Print::println(const IPAddress &ip)
+{
+    return print(ip) + println();
+}
+
+// -------------------------------
+// WiFi
+// -------------------------------
+
+HostWiFi::HostWiFi()
+{
+    local = IPAddress(127, 0, 0, 1);
+    gateway = IPAddress(127, 0, 0, 1);
+    softAp = IPAddress(127, 0, 0, 1);
+    eventHandler = NULL;
+}
+
+/**
+ * Set the addresses reported for this node
+ */
+void HostWiFi::config(IPAddress local, IPAddress gateway)
+{
+    this->local = local;
+    this->gateway = gateway;
+    this->softAp = local;
+}
+
+void HostWiFi::onEvent(WiFiEventFullCb eventHandler)
+{
+    this->eventHandler = eventHandler;
+}
+
+/**
+ * Fire a WiFi event, as the ESP32 event loop would
+ */
+void HostWiFi::raiseEvent(WiFiEvent_t event)
+{
+    if (eventHandler) {
+        WiFiEventInfo_t info = {0};
+        eventHandler(event, info);
+    }
+}
+
+int HostWiFi::begin(const char *, const char *)
+{
+    raiseEvent(SYSTEM_EVENT_STA_GOT_IP);
+    return 1;
+}
+
+bool HostWiFi::disconnect()
+{
+    raiseEvent(SYSTEM_EVENT_STA_DISCONNECTED);
+    return true;
+}
+
+bool HostWiFi::softAP(const char *, const char *)
+{
+    return true;
+}
+
+bool HostWiFi::softAPdisconnect()
+{
+    return true;
+}
+
+IPAddress HostWiFi::localIP()
+{
+    return local;
+}
+
+IPAddress HostWiFi::gatewayIP()
+{
+    return gateway;
+}
+
+IPAddress HostWiFi::softAPIP()
+{
+    return softAp;
+}
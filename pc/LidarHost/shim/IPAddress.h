@@ -0,0 +1,31 @@
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * IPv4 address, stored in network order like the ESP32 core's IPAddress
+ */
+class IPAddress {
+    private:
+        union {
+            uint8_t bytes[4];
+            uint32_t dword;
+        } address;
+
+    public:
+        IPAddress();
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+        IPAddress(uint32_t address);
+
+        operator uint32_t() const;
+        bool operator==(const IPAddress &other) const;
+        bool operator!=(const IPAddress &other) const;
+        uint8_t operator[](int index) const;
+        uint8_t &operator[](int index);
+
+        size_t toChars(char *buffer, size_t size) const;
+};
+
+#endif
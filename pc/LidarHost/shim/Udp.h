@@ -0,0 +1,33 @@
+#ifndef HOST_UDP_H
+#define HOST_UDP_H
+
+#include "Arduino.h"
+
+/**
+ * Datagram transport interface, mirroring the ESP32 core's UDP class.
+ * LidarComms talks to this, so hosts can swap in loopback sockets or an in-memory channel.
+ */
+class UDP {
+    public:
+        virtual ~UDP() {}
+
+        virtual uint8_t begin(uint16_t port) = 0;
+        virtual void stop() = 0;
+
+        virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+        virtual int endPacket() = 0;
+        virtual size_t write(uint8_t value) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+
+        virtual int parsePacket() = 0;
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int read(unsigned char *buffer, size_t len) = 0;
+        virtual int read(char *buffer, size_t len) { return read((unsigned char *)buffer, len); }
+        virtual void flush() = 0;
+
+        virtual IPAddress remoteIP() = 0;
+        virtual uint16_t remotePort() = 0;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include "Arduino.h"
+
+// Event IDs match the ESP-IDF v3 system_event_id_t values used by the ESP32 core
+typedef enum {
+    SYSTEM_EVENT_WIFI_READY = 0,
+    SYSTEM_EVENT_SCAN_DONE,
+    SYSTEM_EVENT_STA_START,
+    SYSTEM_EVENT_STA_STOP,
+    SYSTEM_EVENT_STA_CONNECTED,
+    SYSTEM_EVENT_STA_DISCONNECTED,
+    SYSTEM_EVENT_STA_AUTHMODE_CHANGE,
+    SYSTEM_EVENT_STA_GOT_IP,
+    SYSTEM_EVENT_STA_LOST_IP
+} WiFiEvent_t;
+
+typedef struct {
+    int reason;
+} WiFiEventInfo_t;
+
+typedef void (*WiFiEventFullCb)(WiFiEvent_t event, WiFiEventInfo_t info);
+
+/**
+ * Host stand-in for the ESP32 WiFi singleton. There is no radio; addresses are whatever config() set.
+ */
+class HostWiFi {
+    private:
+        IPAddress local;
+        IPAddress gateway;
+        IPAddress softAp;
+        WiFiEventFullCb eventHandler;
+
+    public:
+        HostWiFi();
+
+        void config(IPAddress local, IPAddress gateway);
+        void onEvent(WiFiEventFullCb eventHandler);
+        void raiseEvent(WiFiEvent_t event);
+
+        int begin(const char *ssid, const char *password);
+        bool disconnect();
+        bool softAP(const char *ssid, const char *password);
+        bool softAPdisconnect();
+
+        IPAddress localIP();
+        IPAddress gatewayIP();
+        IPAddress softAPIP();
+};
+
+extern HostWiFi WiFi;
+
+#endif
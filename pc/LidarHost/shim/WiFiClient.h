@@ -0,0 +1,7 @@
+#ifndef HOST_WIFICLIENT_H
+#define HOST_WIFICLIENT_H
+
+// Nothing in the libraries uses TCP; this only satisfies the include.
+#include "Arduino.h"
+
+#endif
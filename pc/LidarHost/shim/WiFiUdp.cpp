@@ -0,0 +1,176 @@
+#include "WiFiUdp.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiUDP::WiFiUDP()
+{
+    socketFd = -1;
+    txLength = 0;
+    rxLength = 0;
+    rxPosition = 0;
+    txPort = 0;
+    rxPort = 0;
+}
+
+WiFiUDP::~WiFiUDP()
+{
+    stop();
+}
+
+/**
+ * Open a non-blocking socket if we don't already have one
+ */
+bool WiFiUDP::openSocket()
+{
+    if (socketFd >= 0)
+        return true;
+
+    socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (socketFd < 0)
+        return false;
+
+    int enable = 1;
+    setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof enable);
+    int bufferSize = 4 * 1024 * 1024;
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof bufferSize);
+    return true;
+}
+
+/**
+ * Listen on the given port
+ */
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    return begin(IPAddress(), port);
+}
+
+/**
+ * Listen on the given port at one local address only, or every address if it is 0
+ */
+uint8_t WiFiUDP::begin(IPAddress address, uint16_t port)
+{
+    stop();
+    if (!openSocket())
+        return 0;
+
+    sockaddr_in bindAddress = {};
+    bindAddress.sin_family = AF_INET;
+    bindAddress.sin_port = htons(port);
+    bindAddress.sin_addr.s_addr = (uint32_t)address;
+    if (bind(socketFd, (sockaddr *)&bindAddress, sizeof bindAddress) != 0) {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+void WiFiUDP::stop()
+{
+    if (socketFd >= 0)
+        close(socketFd);
+    socketFd = -1;
+    rxLength = 0;
+    rxPosition = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    // No AP to broadcast on, so broadcasts go to ourselves
+    if (ip == IPAddress(255, 255, 255, 255))
+        ip = IPAddress(127, 0, 0, 1);
+
+    txIp = ip;
+    txPort = port;
+    txLength = 0;
+    return openSocket() ? 1 : 0;
+}
+
+int WiFiUDP::endPacket()
+{
+    sockaddr_in destination = {};
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(txPort);
+    destination.sin_addr.s_addr = (uint32_t)txIp;
+
+    ssize_t sent = sendto(socketFd, txBuffer, txLength, 0, (sockaddr *)&destination, sizeof destination);
+    txLength = 0;
+    return sent >= 0 ? 1 : 0;
+}
+
+size_t WiFiUDP::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+    if (size > sizeof txBuffer - txLength)
+        size = sizeof txBuffer - txLength;
+
+    memcpy(txBuffer + txLength, buffer, size);
+    txLength += size;
+    return size;
+}
+
+/**
+ * Fetch the next datagram, discarding whatever is left of the previous one
+ */
+int WiFiUDP::parsePacket()
+{
+    rxLength = 0;
+    rxPosition = 0;
+    if (socketFd < 0)
+        return 0;
+
+    sockaddr_in source = {};
+    socklen_t sourceLength = sizeof source;
+    ssize_t received = recvfrom(socketFd, rxBuffer, sizeof rxBuffer, 0, (sockaddr *)&source, &sourceLength);
+    if (received <= 0)
+        return 0;
+
+    rxLength = (int)received;
+    rxIp = IPAddress((uint32_t)source.sin_addr.s_addr);
+    rxPort = ntohs(source.sin_port);
+    return rxLength;
+}
+
+int WiFiUDP::available()
+{
+    return rxLength - rxPosition;
+}
+
+int WiFiUDP::read()
+{
+    if (rxPosition >= rxLength)
+        return -1;
+
+    return rxBuffer[rxPosition++];
+}
+
+int WiFiUDP::read(unsigned char *buffer, size_t len)
+{
+    int length = available();
+    if ((size_t)length > len)
+        length = (int)len;
+
+    memcpy(buffer, rxBuffer + rxPosition, length);
+    rxPosition += length;
+    return length;
+}
+
+void WiFiUDP::flush()
+{
+    rxPosition = rxLength;
+}
+
+IPAddress WiFiUDP::remoteIP()
+{
+    return rxIp;
+}
+
+uint16_t WiFiUDP::remotePort()
+{
+    return rxPort;
+}
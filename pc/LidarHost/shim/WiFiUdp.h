@@ -0,0 +1,52 @@
+#ifndef HOST_WIFIUDP_H
+#define HOST_WIFIUDP_H
+
+#include "Udp.h"
+
+#define HOST_UDP_BUFFER_SIZE      1472              // Largest datagram we will send or receive
+
+/**
+ * Host WiFiUDP, backed by a real UDP socket on the loopback interface.
+ * Broadcasts to 255.255.255.255 are delivered to 127.0.0.1, as the host has no AP to broadcast on.
+ * Only one endpoint can be bound to a port at a time; senders don't need to call begin().
+ */
+class WiFiUDP : public UDP {
+    private:
+        int socketFd;
+        IPAddress txIp;
+        uint16_t txPort;
+        uint8_t txBuffer[HOST_UDP_BUFFER_SIZE];
+        size_t txLength;
+        uint8_t rxBuffer[HOST_UDP_BUFFER_SIZE];
+        int rxLength;
+        int rxPosition;
+        IPAddress rxIp;
+        uint16_t rxPort;
+
+        bool openSocket();
+
+    public:
+        WiFiUDP();
+        ~WiFiUDP();
+
+        uint8_t begin(uint16_t port);
+        uint8_t begin(IPAddress address, uint16_t port);
+        void stop();
+
+        int beginPacket(IPAddress ip, uint16_t port);
+        int endPacket();
+        size_t write(uint8_t value);
+        size_t write(const uint8_t *buffer, size_t size);
+
+        int parsePacket();
+        int available();
+        int read();
+        int read(unsigned char *buffer, size_t len);
+        using UDP::read;
+        void flush();
+
+        IPAddress remoteIP();
+        uint16_t remotePort();
+};
+
+#endif
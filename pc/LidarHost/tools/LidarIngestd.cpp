@@ -0,0 +1,146 @@
+/**
+ * Lidar ingestion daemon
+ * ----------------------
+ * Reads bigbrain's output from its serial port, or a capture of it from a file, assembles each sensor head's
+ * samples into sweeps and writes every sweep out as a Cartesian point cloud, recording them and mapping them
+ * into an occupancy grid if asked. Runs until the input ends or it is interrupted, then reports what it took in
+ * on stderr.
+ *
+ * Usage: LidarIngestd [options] <serial device | file | ->
+ *    -b, --binary        Decode binary frames; on a serial port, ask bigbrain to send them ('B')
+ *    --baud <rate>       Serial baud rate (default 115200)
+ *    -q, --quiet         Don't report on stderr
+ * and the output options in IngestOutputs.h.
+ */
+
+#include <IngestOutputs.h>
+#include <ByteSource.h>
+#include <chrono>
+#include <memory>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define INGEST_BAUD               115200            // bigbrain's Serial.begin()
+#define INGEST_CHUNK              4096              // Bytes read at a time
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleSignal(int)
+{
+    stopRequested = 1;
+}
+
+static void usage()
+{
+    fprintf(stderr, "Usage: LidarIngestd [-b|--binary] [--baud rate]" INGEST_OUTPUT_USAGE
+        " [-q|--quiet] <serial device | file | ->\n");
+}
+
+static bool isCharacterDevice(const char *path)
+{
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISCHR(info.st_mode);
+}
+
+int main(int argc, char **argv)
+{
+    bool binary = false;
+    bool quiet = false;
+    int baud = INGEST_BAUD;
+    IngestOptions options;
+    const char *input = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        int used = options.parse(argc, argv, i);
+        if (used < 0) {
+            usage();
+            return 2;
+        } else if (used > 0) {
+            i += used - 1;
+        } else if (strcmp(arg, "-b") == 0 || strcmp(arg, "--binary") == 0) {
+            binary = true;
+        } else if (strcmp(arg, "-q") == 0 || strcmp(arg, "--quiet") == 0) {
+            quiet = true;
+        } else if (strcmp(arg, "--baud") == 0 && hasValue) {
+            baud = atoi(argv[++i]);
+        } else if (!input && (arg[0] != '-' || strcmp(arg, "-") == 0)) {
+            input = arg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!input) {
+        usage();
+        return 2;
+    }
+
+    // Source
+    std::unique_ptr<ByteSource> source;
+    bool serial = isCharacterDevice(input);
+    if (serial) {
+        SerialSource *port = new SerialSource();
+        source.reset(port);
+        if (!port->open(input, baud)) {
+            fprintf(stderr, "Can't open %s at %d baud\n", input, baud);
+            return 1;
+        }
+        const uint8_t mode = binary ? 'B' : 'T';
+        port->write(&mode, 1);
+    } else {
+        FileSource *file = new FileSource();
+        source.reset(file);
+        if (!file->open(input)) {
+            fprintf(stderr, "Can't open %s\n", input);
+            return 1;
+        }
+    }
+
+    // Everything is allocated here, before the first byte arrives
+    IngestOutputs outputs;
+    if (!outputs.open(options))
+        return 1;
+    std::unique_ptr<IngestPipeline> pipeline(new IngestPipeline(outputs.getSink(), binary));
+    outputs.attach(*pipeline);
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    static uint8_t chunk[INGEST_CHUNK];
+    auto start = std::chrono::steady_clock::now();
+
+    while (!stopRequested) {
+        int length = source->read(chunk, sizeof(chunk));
+        if (length < 0)
+            break;
+        if (length == 0)
+            continue;
+
+        auto now = std::chrono::steady_clock::now();
+        uint32_t timestamp = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+        pipeline->feed(chunk, length, timestamp);
+    }
+
+    pipeline->flush();
+    bool ok = outputs.close();
+
+    if (!quiet) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const AssemblerStats &sweeps = pipeline->getAssemblerStats();
+        fprintf(stderr, "%lu bytes, %lu samples, %lu sweeps (%lu partial), %lu dropped in %.1f s\n",
+            pipeline->getBytes(), sweeps.samples, sweeps.sweeps, sweeps.partial, sweeps.dropped, elapsed);
+        if (binary) {
+            const FrameStats &frames = pipeline->getFrameStats();
+            fprintf(stderr, "%lu frames, %lu CRC errors, %lu malformed, %lu lost\n", frames.frames,
+                frames.crcErrors, frames.malformed, frames.lostFrames);
+        } else {
+            fprintf(stderr, "%lu malformed samples\n", pipeline->getParserStats().malformed);
+        }
+        outputs.report(stderr);
+    }
+    return ok ? 0 : 1;
+}
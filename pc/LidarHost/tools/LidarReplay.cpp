@@ -0,0 +1,157 @@
+/**
+ * Capture replay
+ * --------------
+ * Plays a capture recorded by LidarIngestd back through LidarComms, as if its sensor heads were polling a
+ * brain again, and on through the same ingestion pipeline to point clouds. Runs at the speed it was recorded
+ * by default, faster with --speed, or flat out with --max for regression runs.
+ *
+ * Usage: LidarReplay [options] <capture>
+ *    --speed <factor>    Replay this many times faster than recorded (default 1)
+ *    --max               Replay as fast as it goes
+ *    --from <seconds>    Start this far into the capture
+ *    --to <seconds>      Stop this far into the capture
+ *    --info              Describe the capture and stop
+ *    -q, --quiet         Don't report on stderr
+ * and the output options in IngestOutputs.h; --record records the replayed sweeps to a new capture.
+ */
+
+#include <CaptureReplay.h>
+#include <IngestOutputs.h>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage()
+{
+    fprintf(stderr, "Usage: LidarReplay [--speed factor | --max] [--from seconds] [--to seconds]" INGEST_OUTPUT_USAGE
+        " [--info] [-q|--quiet] <capture>\n");
+}
+
+static void handleSample(void *context, int head, const PollSample &sample)
+{
+    ((IngestPipeline *)context)->addSample(head, sample);
+}
+
+/**
+ * Heads, sweeps and time covered by a capture
+ */
+static void describe(CaptureReader &reader, const char *path)
+{
+    uint32_t chunks = reader.getChunkCount();
+    unsigned long samples = 0;
+    unsigned long complete = 0;
+    bool heads[256] = { false };
+    for (uint32_t i = 0; i < chunks; i++) {
+        const CaptureEntry &entry = reader.getEntry(i);
+        samples += entry.count;
+        complete += (entry.flags & CAPTURE_COMPLETE) != 0;
+        heads[entry.head] = true;
+    }
+
+    printf("%s: %u sweeps (%lu complete), %lu samples", path, chunks, complete, samples);
+    if (chunks > 0) {
+        printf(", %.1f s", (reader.getEntry(chunks - 1).endTime - reader.getEntry(0).startTime) / 1e6);
+    }
+    printf("%s\nheads:", reader.wasRecovered() ? ", not closed (index rebuilt)" : "");
+    for (int i = 0; i < 256; i++) {
+        if (heads[i])
+            printf(" %d", i);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 1;
+    double fromSeconds = -1;
+    double toSeconds = -1;
+    bool info = false;
+    bool quiet = false;
+    IngestOptions options;
+    const char *input = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        int used = options.parse(argc, argv, i);
+        if (used < 0) {
+            usage();
+            return 2;
+        } else if (used > 0) {
+            i += used - 1;
+        } else if (strcmp(arg, "--speed") == 0 && hasValue) {
+            speed = atof(argv[++i]);
+            if (speed <= 0) {
+                usage();
+                return 2;
+            }
+        } else if (strcmp(arg, "--max") == 0) {
+            speed = 0;
+        } else if (strcmp(arg, "--from") == 0 && hasValue) {
+            fromSeconds = atof(argv[++i]);
+        } else if (strcmp(arg, "--to") == 0 && hasValue) {
+            toSeconds = atof(argv[++i]);
+        } else if (strcmp(arg, "--info") == 0) {
+            info = true;
+        } else if (strcmp(arg, "-q") == 0 || strcmp(arg, "--quiet") == 0) {
+            quiet = true;
+        } else if (!input && arg[0] != '-') {
+            input = arg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!input) {
+        usage();
+        return 2;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(input)) {
+        fprintf(stderr, "Can't read %s as a capture\n", input);
+        return 1;
+    }
+    if (info) {
+        describe(reader, input);
+        return 0;
+    }
+
+    // Chunks covering the time asked for
+    uint32_t first = 0;
+    uint32_t end = reader.getChunkCount();
+    if (end > 0) {
+        uint64_t startTime = reader.getEntry(0).startTime;
+        if (fromSeconds > 0)
+            first = reader.findTime(startTime + (uint64_t)(fromSeconds * 1e6));
+        if (toSeconds >= 0)
+            end = reader.findTime(startTime + (uint64_t)(toSeconds * 1e6));
+    }
+
+    IngestOutputs outputs;
+    if (!outputs.open(options))
+        return 1;
+    std::unique_ptr<IngestPipeline> pipeline(new IngestPipeline(outputs.getSink()));
+    outputs.attach(*pipeline);
+
+    Serial.setQuiet(true);
+    std::unique_ptr<CaptureReplay> replay(new CaptureReplay(reader, handleSample, pipeline.get()));
+    auto start = std::chrono::steady_clock::now();
+    unsigned long sent = replay->run(first, end, speed);
+    pipeline->flush();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    bool ok = outputs.close();
+
+    if (!quiet) {
+        const AssemblerStats &sweeps = pipeline->getAssemblerStats();
+        fprintf(stderr, "%u of %u sweeps replayed: %lu samples sent, %lu decoded into %lu sweeps (%lu partial) in %.2f s,"
+            " %.0f samples/s\n", end > first ? end - first : 0, reader.getChunkCount(), sent, sweeps.samples,
+            sweeps.sweeps, sweeps.partial, elapsed, sweeps.samples / elapsed);
+        if (replay->getDamaged() > 0)
+            fprintf(stderr, "%lu damaged sweeps skipped\n", replay->getDamaged());
+        outputs.report(stderr);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,305 @@
+#include "MemoryUdp.h"
+#include <algorithm>
+
+MemoryNetwork::MemoryNetwork()
+{
+    setImpairment(0, 0, 0);
+    resetCounters();
+}
+
+/**
+ * Drop, duplicate and reorder (swap with the next datagram) the given percentages of datagrams
+ */
+void MemoryNetwork::setImpairment(int dropPercent, int duplicatePercent, int reorderPercent, unsigned int seed)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->dropPercent = dropPercent;
+    this->duplicatePercent = duplicatePercent;
+    this->reorderPercent = reorderPercent;
+    this->seed = seed;
+    holding = false;
+}
+
+/**
+ * 0-99, from a generator of our own so impairments repeat run to run
+ */
+int MemoryNetwork::roll()
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % 100;
+}
+
+void MemoryNetwork::attach(MemoryUdp *endpoint)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    endpoints.push_back(endpoint);
+}
+
+void MemoryNetwork::detach(MemoryUdp *endpoint)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    endpoints.erase(std::remove(endpoints.begin(), endpoints.end(), endpoint), endpoints.end());
+}
+
+/**
+ * Hand a datagram to every bound endpoint it is addressed to
+ */
+void MemoryNetwork::deliver(MemoryUdp *sender, IPAddress to, uint16_t port, const uint8_t *data, size_t length)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (to == IPAddress(255, 255, 255, 255))
+        broadcasts++;
+    else
+        unicasts++;
+
+    if (roll() < dropPercent)
+        return;
+
+    if (!holding && roll() < reorderPercent) {
+        holding = true;
+        heldSender = sender;
+        heldTo = to;
+        heldPort = port;
+        heldData.assign(data, data + length);
+        return;
+    }
+
+    deliverNow(sender, to, port, data, length);
+    if (roll() < duplicatePercent)
+        deliverNow(sender, to, port, data, length);
+
+    if (holding) {
+        holding = false;
+        deliverNow(heldSender, heldTo, heldPort, heldData.data(), heldData.size());
+    }
+}
+
+/**
+ * Datagrams sent to 255.255.255.255, which Wi-Fi sends at its lowest rate and never retries
+ */
+unsigned long MemoryNetwork::getBroadcasts()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return broadcasts;
+}
+
+/**
+ * Datagrams sent to a single address
+ */
+unsigned long MemoryNetwork::getUnicasts()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return unicasts;
+}
+
+void MemoryNetwork::resetCounters()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    broadcasts = 0;
+    unicasts = 0;
+}
+
+/**
+ * Copy a datagram into every endpoint it reaches. Called with the lock held.
+ */
+void MemoryNetwork::deliverNow(MemoryUdp *sender, IPAddress to, uint16_t port, const uint8_t *data, size_t length)
+{
+    bool broadcast = to == IPAddress(255, 255, 255, 255);
+    for (MemoryUdp *endpoint : endpoints) {
+        if (endpoint == sender || !endpoint->isBound() || endpoint->getPort() != port)
+            continue;
+
+        if (broadcast || endpoint->getAddress() == to)
+            endpoint->receive(sender->getAddress(), sender->getPort(), data, length);
+    }
+}
+
+MemoryUdp::MemoryUdp(MemoryNetwork &network, IPAddress address, int queueSize)
+    : network(network), queue(queueSize)
+{
+    this->address = address;
+    port = 0;
+    bound = false;
+    queueHead = 0;
+    queueCount = 0;
+    dropped = 0;
+    receivedPackets = 0;
+    receivedBytes = 0;
+    current.length = 0;
+    currentPosition = 0;
+    txPort = 0;
+    txLength = 0;
+    network.attach(this);
+}
+
+MemoryUdp::~MemoryUdp()
+{
+    network.detach(this);
+}
+
+/**
+ * Queue an incoming datagram. Returns false (and counts a drop) if the queue is full.
+ */
+bool MemoryUdp::receive(IPAddress from, uint16_t port, const uint8_t *data, size_t length)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (queueCount >= (int)queue.size()) {
+        dropped++;
+        return false;
+    }
+
+    Datagram &slot = queue[(queueHead + queueCount) % queue.size()];
+    slot.from = from;
+    slot.port = port;
+    slot.length = (int)std::min(length, sizeof slot.data);
+    memcpy(slot.data, data, slot.length);
+    queueCount++;
+    receivedPackets++;
+    receivedBytes += slot.length;
+    return true;
+}
+
+IPAddress MemoryUdp::getAddress()
+{
+    return address;
+}
+
+uint16_t MemoryUdp::getPort()
+{
+    return port;
+}
+
+bool MemoryUdp::isBound()
+{
+    return bound;
+}
+
+unsigned long MemoryUdp::getDropped()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return dropped;
+}
+
+unsigned long MemoryUdp::getReceivedPackets()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return receivedPackets;
+}
+
+unsigned long MemoryUdp::getReceivedBytes()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return receivedBytes;
+}
+
+void MemoryUdp::resetCounters()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    dropped = 0;
+    receivedPackets = 0;
+    receivedBytes = 0;
+}
+
+uint8_t MemoryUdp::begin(uint16_t port)
+{
+    this->port = port;
+    bound = true;
+    return 1;
+}
+
+void MemoryUdp::stop()
+{
+    bound = false;
+    std::lock_guard<std::mutex> guard(lock);
+    queueCount = 0;
+}
+
+int MemoryUdp::beginPacket(IPAddress ip, uint16_t port)
+{
+    txIp = ip;
+    txPort = port;
+    txLength = 0;
+    return 1;
+}
+
+int MemoryUdp::endPacket()
+{
+    network.deliver(this, txIp, txPort, txBuffer, txLength);
+    txLength = 0;
+    return 1;
+}
+
+size_t MemoryUdp::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t MemoryUdp::write(const uint8_t *buffer, size_t size)
+{
+    if (size > sizeof txBuffer - txLength)
+        size = sizeof txBuffer - txLength;
+
+    memcpy(txBuffer + txLength, buffer, size);
+    txLength += size;
+    return size;
+}
+
+/**
+ * Move the next queued datagram into the read position
+ */
+int MemoryUdp::parsePacket()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    current.length = 0;
+    currentPosition = 0;
+    if (queueCount == 0)
+        return 0;
+
+    Datagram &slot = queue[queueHead];
+    current.from = slot.from;
+    current.port = slot.port;
+    current.length = slot.length;
+    memcpy(current.data, slot.data, slot.length);
+    queueHead = (queueHead + 1) % queue.size();
+    queueCount--;
+    return current.length;
+}
+
+int MemoryUdp::available()
+{
+    return current.length - currentPosition;
+}
+
+int MemoryUdp::read()
+{
+    if (currentPosition >= current.length)
+        return -1;
+
+    return current.data[currentPosition++];
+}
+
+int MemoryUdp::read(unsigned char *buffer, size_t len)
+{
+    int length = available();
+    if ((size_t)length > len)
+        length = (int)len;
+
+    memcpy(buffer, current.data + currentPosition, length);
+    currentPosition += length;
+    return length;
+}
+
+void MemoryUdp::flush()
+{
+    currentPosition = current.length;
+}
+
+IPAddress MemoryUdp::remoteIP()
+{
+    return current.from;
+}
+
+uint16_t MemoryUdp::remotePort()
+{
+    return current.port;
+}
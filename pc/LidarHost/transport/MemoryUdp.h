@@ -0,0 +1,116 @@
+#ifndef MEMORYUDP_H
+#define MEMORYUDP_H
+
+#include <Udp.h>
+#include <mutex>
+#include <vector>
+
+#define MEMORY_UDP_DATAGRAM_SIZE  1472              // Largest datagram carried
+#define MEMORY_UDP_QUEUE_SIZE     64                // Datagrams queued per endpoint before drops (lwIP default-ish)
+
+class MemoryUdp;
+
+/**
+ * An in-memory "network" joining MemoryUdp endpoints. Datagrams are copied straight into the
+ * receiving endpoint's queue; 255.255.255.255 reaches every bound endpoint except the sender.
+ * It can be made to drop, duplicate and reorder datagrams like a poor Wi-Fi link.
+ */
+class MemoryNetwork {
+    private:
+        std::mutex lock;
+        std::vector<MemoryUdp *> endpoints;
+
+        int dropPercent;
+        int duplicatePercent;
+        int reorderPercent;
+        unsigned int seed;
+        bool holding;                   // A datagram held back to be delivered after the next one
+        MemoryUdp *heldSender;
+        IPAddress heldTo;
+        uint16_t heldPort;
+        std::vector<uint8_t> heldData;
+        unsigned long broadcasts;
+        unsigned long unicasts;
+
+        int roll();
+        void deliverNow(MemoryUdp *sender, IPAddress to, uint16_t port, const uint8_t *data, size_t length);
+
+    public:
+        MemoryNetwork();
+
+        void setImpairment(int dropPercent, int duplicatePercent, int reorderPercent, unsigned int seed = 1);
+        void attach(MemoryUdp *endpoint);
+        void detach(MemoryUdp *endpoint);
+        void deliver(MemoryUdp *sender, IPAddress to, uint16_t port, const uint8_t *data, size_t length);
+        unsigned long getBroadcasts();
+        unsigned long getUnicasts();
+        void resetCounters();
+};
+
+/**
+ * UDP transport over a MemoryNetwork. Each endpoint has a fixed-size receive queue, so nothing is
+ * allocated per datagram and a full queue drops packets as the ESP32 stack would.
+ */
+class MemoryUdp : public UDP {
+    struct Datagram {
+        IPAddress from;
+        uint16_t port;
+        int length;
+        uint8_t data[MEMORY_UDP_DATAGRAM_SIZE];
+    };
+
+    private:
+        MemoryNetwork &network;
+        IPAddress address;
+        uint16_t port;
+        bool bound;
+
+        std::mutex lock;
+        std::vector<Datagram> queue;
+        int queueHead;
+        int queueCount;
+        unsigned long dropped;
+        unsigned long receivedPackets;
+        unsigned long receivedBytes;
+
+        Datagram current;
+        int currentPosition;
+
+        IPAddress txIp;
+        uint16_t txPort;
+        uint8_t txBuffer[MEMORY_UDP_DATAGRAM_SIZE];
+        size_t txLength;
+
+    public:
+        MemoryUdp(MemoryNetwork &network, IPAddress address, int queueSize = MEMORY_UDP_QUEUE_SIZE);
+        ~MemoryUdp();
+
+        bool receive(IPAddress from, uint16_t port, const uint8_t *data, size_t length);
+        IPAddress getAddress();
+        uint16_t getPort();
+        bool isBound();
+        unsigned long getDropped();
+        unsigned long getReceivedPackets();
+        unsigned long getReceivedBytes();
+        void resetCounters();
+
+        uint8_t begin(uint16_t port);
+        void stop();
+
+        int beginPacket(IPAddress ip, uint16_t port);
+        int endPacket();
+        size_t write(uint8_t value);
+        size_t write(const uint8_t *buffer, size_t size);
+
+        int parsePacket();
+        int available();
+        int read();
+        int read(unsigned char *buffer, size_t len);
+        using UDP::read;
+        void flush();
+
+        IPAddress remoteIP();
+        uint16_t remotePort();
+};
+
+#endif
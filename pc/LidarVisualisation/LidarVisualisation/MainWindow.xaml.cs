@@ -60,7 +60,7 @@ namespace PcInterpreter
         void SerialPortDataReceived(object sender, SerialDataReceivedEventArgs e)
         {
             var dataRecv = monitor.ReadLine();
-            Regex rx = new Regex(@"\[POLL:([0-9]+),([0-9\.]+)\]", RegexOptions.Compiled);
+            Regex rx = new Regex(@"\[POLL:([0-9]+),([0-9\.]+)(?:,([0-9]+))?\]", RegexOptions.Compiled);
             var matches = rx.Matches(dataRecv);
             var points = new Dictionary<int, double>();
             foreach (Match match in matches)